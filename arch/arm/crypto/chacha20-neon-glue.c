@@ -0,0 +1,220 @@
+/*
+ * ChaCha20 256-bit cipher algorithm, RFC7539, ARM NEON functions
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <crypto/algapi.h>
+#include <linux/bitops.h>
+#include <linux/crypto.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/unaligned.h>
+
+#include "chacha20poly1305_glue.h"
+
+asmlinkage void chacha20_block_xor_neon(u32 *state, u8 *dst, const u8 *src);
+asmlinkage void chacha20_4block_xor_neon(u32 *state, u8 *dst, const u8 *src);
+
+static void chacha20_block(u32 *state, u8 *stream)
+{
+	u32 x[16];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(x); i++)
+		x[i] = state[i];
+
+	for (i = 0; i < 20; i += 2) {
+		x[0]  += x[4];    x[12] = rol32(x[12] ^ x[0],  16);
+		x[1]  += x[5];    x[13] = rol32(x[13] ^ x[1],  16);
+		x[2]  += x[6];    x[14] = rol32(x[14] ^ x[2],  16);
+		x[3]  += x[7];    x[15] = rol32(x[15] ^ x[3],  16);
+
+		x[8]  += x[12];   x[4]  = rol32(x[4]  ^ x[8],  12);
+		x[9]  += x[13];   x[5]  = rol32(x[5]  ^ x[9],  12);
+		x[10] += x[14];   x[6]  = rol32(x[6]  ^ x[10], 12);
+		x[11] += x[15];   x[7]  = rol32(x[7]  ^ x[11], 12);
+
+		x[0]  += x[4];    x[12] = rol32(x[12] ^ x[0],   8);
+		x[1]  += x[5];    x[13] = rol32(x[13] ^ x[1],   8);
+		x[2]  += x[6];    x[14] = rol32(x[14] ^ x[2],   8);
+		x[3]  += x[7];    x[15] = rol32(x[15] ^ x[3],   8);
+
+		x[8]  += x[12];   x[4]  = rol32(x[4]  ^ x[8],   7);
+		x[9]  += x[13];   x[5]  = rol32(x[5]  ^ x[9],   7);
+		x[10] += x[14];   x[6]  = rol32(x[6]  ^ x[10],  7);
+		x[11] += x[15];   x[7]  = rol32(x[7]  ^ x[11],  7);
+
+		x[0]  += x[5];    x[15] = rol32(x[15] ^ x[0],  16);
+		x[1]  += x[6];    x[12] = rol32(x[12] ^ x[1],  16);
+		x[2]  += x[7];    x[13] = rol32(x[13] ^ x[2],  16);
+		x[3]  += x[4];    x[14] = rol32(x[14] ^ x[3],  16);
+
+		x[10] += x[15];   x[5]  = rol32(x[5]  ^ x[10], 12);
+		x[11] += x[12];   x[6]  = rol32(x[6]  ^ x[11], 12);
+		x[8]  += x[13];   x[7]  = rol32(x[7]  ^ x[8],  12);
+		x[9]  += x[14];   x[4]  = rol32(x[4]  ^ x[9],  12);
+
+		x[0]  += x[5];    x[15] = rol32(x[15] ^ x[0],   8);
+		x[1]  += x[6];    x[12] = rol32(x[12] ^ x[1],   8);
+		x[2]  += x[7];    x[13] = rol32(x[13] ^ x[2],   8);
+		x[3]  += x[4];    x[14] = rol32(x[14] ^ x[3],   8);
+
+		x[10] += x[15];   x[5]  = rol32(x[5]  ^ x[10],  7);
+		x[11] += x[12];   x[6]  = rol32(x[6]  ^ x[11],  7);
+		x[8]  += x[13];   x[7]  = rol32(x[7]  ^ x[8],   7);
+		x[9]  += x[14];   x[4]  = rol32(x[4]  ^ x[9],   7);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(x); i++)
+		put_unaligned_le32(x[i] + state[i], stream + i * sizeof(u32));
+
+	state[12]++;
+}
+
+void chacha20_arm_setkey(struct chacha20_ctx *ctx, const u8 *key)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ctx->key); i++)
+		ctx->key[i] = get_unaligned_le32(key + i * sizeof(u32));
+}
+
+void chacha20_arm_init(u32 *state, const struct chacha20_ctx *ctx,
+		       const u8 *iv)
+{
+	static const char constant[16] = "expand 32-byte k";
+	int i;
+
+	for (i = 0; i < 4; i++)
+		state[i] = get_unaligned_le32(constant + i * sizeof(u32));
+	for (i = 0; i < ARRAY_SIZE(ctx->key); i++)
+		state[4 + i] = ctx->key[i];
+	for (i = 0; i < 4; i++)
+		state[12 + i] = get_unaligned_le32(iv + i * sizeof(u32));
+}
+
+/*
+ * Xor the key stream into bytes of data, advancing the block counter.
+ * Only the last call for a message may pass a length that is not a multiple
+ * of the block size.
+ */
+void chacha20_arm_crypt(u32 *state, u8 *dst, const u8 *src,
+			unsigned int bytes, bool neon)
+{
+	u8 buf[CHACHA20_BLOCK_SIZE];
+
+	if (!neon) {
+		while (bytes) {
+			unsigned int n = min_t(unsigned int, bytes,
+					       CHACHA20_BLOCK_SIZE);
+
+			chacha20_block(state, buf);
+			if (dst != src)
+				memcpy(dst, src, n);
+			crypto_xor(dst, buf, n);
+			bytes -= n;
+			src += n;
+			dst += n;
+		}
+		return;
+	}
+
+	while (bytes >= CHACHA20_BLOCK_SIZE * 4) {
+		chacha20_4block_xor_neon(state, dst, src);
+		bytes -= CHACHA20_BLOCK_SIZE * 4;
+		src += CHACHA20_BLOCK_SIZE * 4;
+		dst += CHACHA20_BLOCK_SIZE * 4;
+		state[12] += 4;
+	}
+	while (bytes >= CHACHA20_BLOCK_SIZE) {
+		chacha20_block_xor_neon(state, dst, src);
+		bytes -= CHACHA20_BLOCK_SIZE;
+		src += CHACHA20_BLOCK_SIZE;
+		dst += CHACHA20_BLOCK_SIZE;
+		state[12]++;
+	}
+	if (bytes) {
+		memcpy(buf, src, bytes);
+		chacha20_block_xor_neon(state, buf, buf);
+		memcpy(dst, buf, bytes);
+		state[12]++;
+	}
+}
+
+static int chacha20_neon_setkey(struct crypto_tfm *tfm, const u8 *key,
+				unsigned int keysize)
+{
+	if (keysize != CHACHA20_KEY_SIZE)
+		return -EINVAL;
+
+	chacha20_arm_setkey(crypto_tfm_ctx(tfm), key);
+	return 0;
+}
+
+static int chacha20_neon_crypt(struct blkcipher_desc *desc,
+			       struct scatterlist *dst,
+			       struct scatterlist *src, unsigned int nbytes)
+{
+	struct blkcipher_walk walk;
+	bool neon = may_use_simd();
+	u32 state[16];
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt_block(desc, &walk, CHACHA20_BLOCK_SIZE);
+
+	chacha20_arm_init(state, crypto_blkcipher_ctx(desc->tfm), walk.iv);
+
+	/* NEON is claimed per step to keep non-preemptible sections short */
+	while (walk.nbytes >= CHACHA20_BLOCK_SIZE) {
+		if (neon)
+			kernel_neon_begin();
+		chacha20_arm_crypt(state, walk.dst.virt.addr, walk.src.virt.addr,
+				   round_down(walk.nbytes, CHACHA20_BLOCK_SIZE),
+				   neon);
+		if (neon)
+			kernel_neon_end();
+		err = blkcipher_walk_done(desc, &walk,
+					  walk.nbytes % CHACHA20_BLOCK_SIZE);
+	}
+
+	if (walk.nbytes) {
+		if (neon)
+			kernel_neon_begin();
+		chacha20_arm_crypt(state, walk.dst.virt.addr, walk.src.virt.addr,
+				   walk.nbytes, neon);
+		if (neon)
+			kernel_neon_end();
+		err = blkcipher_walk_done(desc, &walk, 0);
+	}
+
+	memzero_explicit(state, sizeof(state));
+	return err;
+}
+
+struct crypto_alg chacha20_neon_alg = {
+	.cra_name		= "chacha20",
+	.cra_driver_name	= "chacha20-neon",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= 1,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_ctxsize		= sizeof(struct chacha20_ctx),
+	.cra_module		= THIS_MODULE,
+	.cra_u			= {
+		.blkcipher = {
+			.min_keysize	= CHACHA20_KEY_SIZE,
+			.max_keysize	= CHACHA20_KEY_SIZE,
+			.ivsize		= CHACHA20_IV_SIZE,
+			.geniv		= "seqiv",
+			.setkey		= chacha20_neon_setkey,
+			.encrypt	= chacha20_neon_crypt,
+			.decrypt	= chacha20_neon_crypt,
+		},
+	},
+};
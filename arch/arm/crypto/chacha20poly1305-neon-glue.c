@@ -0,0 +1,506 @@
+/*
+ * ChaCha20-Poly1305 AEAD, RFC7539, ARM NEON functions
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * The cipher and the authenticator are called directly rather than through
+ * separate transforms, so that each chunk of data is encrypted and hashed
+ * within a single NEON section.
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/internal/hash.h>
+#include <crypto/scatterwalk.h>
+#include <linux/crypto.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/unaligned.h>
+
+#include "chacha20poly1305_glue.h"
+
+#define RFC7539_NONCE_SIZE	12
+
+/* Amount of data processed per NEON section */
+#define RFC7539_CHUNK_SIZE	PAGE_SIZE
+
+static int rfc7539_neon_setkey(struct crypto_aead *aead, const u8 *key,
+			       unsigned int keylen)
+{
+	if (keylen != CHACHA20_KEY_SIZE) {
+		crypto_aead_set_flags(aead, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+
+	chacha20_arm_setkey(crypto_aead_ctx(aead), key);
+	return 0;
+}
+
+static int rfc7539_neon_setauthsize(struct crypto_aead *aead,
+				    unsigned int authsize)
+{
+	if (authsize != POLY1305_DIGEST_SIZE)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void rfc7539_poly_pad(struct poly1305_arm_desc_ctx *poly,
+			     unsigned int len, bool neon)
+{
+	static const u8 pad[POLY1305_BLOCK_SIZE];
+
+	len %= POLY1305_BLOCK_SIZE;
+	if (len)
+		poly1305_arm_update(poly, pad, POLY1305_BLOCK_SIZE - len, neon);
+}
+
+/*
+ * Encrypt or decrypt len bytes from src to dst and compute the tag over
+ * assoc and the ciphertext, on linear buffers.
+ */
+static void rfc7539_neon_do(const struct chacha20_ctx *ctx, const u8 *nonce,
+			    const u8 *assoc, unsigned int assoclen,
+			    const u8 *src, u8 *dst, unsigned int len,
+			    bool enc, u8 *tag, bool neon)
+{
+	struct poly1305_arm_desc_ctx poly;
+	unsigned int cryptlen = len;
+	u8 block0[CHACHA20_BLOCK_SIZE];
+	u8 iv[CHACHA20_IV_SIZE];
+	__le64 lens[2];
+	u32 state[16];
+
+	memset(iv, 0, sizeof(u32));
+	memcpy(iv + sizeof(u32), nonce, RFC7539_NONCE_SIZE);
+	chacha20_arm_init(state, ctx, iv);
+
+	if (neon)
+		kernel_neon_begin();
+
+	/* the Poly1305 key is the first half of key stream block 0 */
+	memset(block0, 0, sizeof(block0));
+	chacha20_arm_crypt(state, block0, block0, sizeof(block0), neon);
+
+	poly1305_arm_init(&poly);
+	poly1305_arm_update(&poly, block0, POLY1305_KEY_SIZE, false);
+
+	poly1305_arm_update(&poly, assoc, assoclen, neon);
+	rfc7539_poly_pad(&poly, assoclen, neon);
+
+	lens[0] = cpu_to_le64(assoclen);
+	lens[1] = cpu_to_le64(cryptlen);
+
+	while (len) {
+		unsigned int n = min_t(unsigned int, len, RFC7539_CHUNK_SIZE);
+
+		if (!enc)
+			poly1305_arm_update(&poly, src, n, neon);
+		chacha20_arm_crypt(state, dst, src, n, neon);
+		if (enc)
+			poly1305_arm_update(&poly, dst, n, neon);
+
+		len -= n;
+		src += n;
+		dst += n;
+
+		if (neon && len) {
+			kernel_neon_end();
+			kernel_neon_begin();
+		}
+	}
+	rfc7539_poly_pad(&poly, cryptlen, neon);
+	poly1305_arm_update(&poly, (u8 *)lens, sizeof(lens), neon);
+
+	if (neon)
+		kernel_neon_end();
+
+	poly1305_arm_final(&poly, tag);
+
+	memzero_explicit(&poly, sizeof(poly));
+	memzero_explicit(block0, sizeof(block0));
+	memzero_explicit(state, sizeof(state));
+}
+
+/* Whether the first len bytes of sg can be mapped in one go */
+static bool rfc7539_sg_is_linear(struct scatterlist *sg, unsigned int len)
+{
+	return !len || (sg->length >= len &&
+			offset_in_page(sg->offset) + len <= PAGE_SIZE);
+}
+
+static u8 *rfc7539_sg_map(struct scatter_walk *walk, struct scatterlist *sg,
+			  unsigned int len)
+{
+	if (!len)
+		return NULL;
+
+	scatterwalk_start(walk, sg);
+	return scatterwalk_map(walk);
+}
+
+static void rfc7539_sg_unmap(u8 *vaddr)
+{
+	if (vaddr)
+		scatterwalk_unmap(vaddr);
+}
+
+static int rfc7539_neon_crypt(struct aead_request *req, bool enc)
+{
+	struct crypto_aead *aead = crypto_aead_reqtfm(req);
+	struct chacha20_ctx *ctx = crypto_aead_ctx(aead);
+	unsigned int assoclen = req->assoclen;
+	unsigned int len = req->cryptlen;
+	u8 tag[POLY1305_DIGEST_SIZE];
+	u8 otag[POLY1305_DIGEST_SIZE];
+	/* false in softirq, so the IPsec data path always takes the C code */
+	bool neon = may_use_simd();
+	int err = 0;
+
+	if (!enc) {
+		if (len < POLY1305_DIGEST_SIZE)
+			return -EINVAL;
+		len -= POLY1305_DIGEST_SIZE;
+	}
+
+	if (rfc7539_sg_is_linear(req->assoc, assoclen) &&
+	    rfc7539_sg_is_linear(req->src, len) &&
+	    rfc7539_sg_is_linear(req->dst, len)) {
+		struct scatter_walk assoc_walk, src_walk, dst_walk;
+		u8 *assoc, *src, *dst;
+
+		assoc = rfc7539_sg_map(&assoc_walk, req->assoc, assoclen);
+		src = rfc7539_sg_map(&src_walk, req->src, len);
+		if (req->dst == req->src)
+			dst = src;
+		else
+			dst = rfc7539_sg_map(&dst_walk, req->dst, len);
+
+		rfc7539_neon_do(ctx, req->iv, assoc, assoclen, src, dst, len,
+				enc, tag, neon);
+
+		if (dst != src)
+			rfc7539_sg_unmap(dst);
+		rfc7539_sg_unmap(src);
+		rfc7539_sg_unmap(assoc);
+	} else {
+		gfp_t gfp = req->base.flags & CRYPTO_TFM_REQ_MAY_SLEEP ?
+			    GFP_KERNEL : GFP_ATOMIC;
+		u8 *buf;
+
+		buf = kmalloc(assoclen + len, gfp);
+		if (!buf)
+			return -ENOMEM;
+
+		scatterwalk_map_and_copy(buf, req->assoc, 0, assoclen, 0);
+		scatterwalk_map_and_copy(buf + assoclen, req->src, 0, len, 0);
+
+		rfc7539_neon_do(ctx, req->iv, buf, assoclen, buf + assoclen,
+				buf + assoclen, len, enc, tag, neon);
+
+		scatterwalk_map_and_copy(buf + assoclen, req->dst, 0, len, 1);
+		kzfree(buf);
+	}
+
+	if (enc) {
+		scatterwalk_map_and_copy(tag, req->dst, len, sizeof(tag), 1);
+	} else {
+		scatterwalk_map_and_copy(otag, req->src, len, sizeof(otag), 0);
+		if (crypto_memneq(tag, otag, sizeof(tag)))
+			err = -EBADMSG;
+	}
+
+	memzero_explicit(tag, sizeof(tag));
+	return err;
+}
+
+static int rfc7539_neon_encrypt(struct aead_request *req)
+{
+	return rfc7539_neon_crypt(req, true);
+}
+
+static int rfc7539_neon_decrypt(struct aead_request *req)
+{
+	return rfc7539_neon_crypt(req, false);
+}
+
+static struct crypto_alg rfc7539_neon_alg = {
+	.cra_name		= "rfc7539(chacha20,poly1305)",
+	.cra_driver_name	= "rfc7539-chacha20-poly1305-neon",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_AEAD,
+	.cra_blocksize		= 1,
+	.cra_type		= &crypto_aead_type,
+	.cra_ctxsize		= sizeof(struct chacha20_ctx),
+	.cra_module		= THIS_MODULE,
+	.cra_u			= {
+		.aead = {
+			.setkey		= rfc7539_neon_setkey,
+			.setauthsize	= rfc7539_neon_setauthsize,
+			.encrypt	= rfc7539_neon_encrypt,
+			.decrypt	= rfc7539_neon_decrypt,
+			.ivsize		= RFC7539_NONCE_SIZE,
+			.maxauthsize	= POLY1305_DIGEST_SIZE,
+		},
+	},
+};
+
+/*
+ * Test vectors from RFC 7539: ChaCha20 encryption (2.4.2), Poly1305 (2.5.2)
+ * and the AEAD construction (2.8.2).
+ */
+static const u8 rfc7539_tv_text[] __initconst =
+	"Ladies and Gentlemen of the class of '99: If I could offer you only "
+	"one tip for the future, sunscreen would be it.";
+
+#define RFC7539_TV_TEXT_LEN	(sizeof(rfc7539_tv_text) - 1)
+
+static const u8 rfc7539_tv_chacha20_key[] __initconst = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+	0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+};
+
+static const u8 rfc7539_tv_chacha20_nonce[] __initconst = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4a,
+	0x00, 0x00, 0x00, 0x00,
+};
+
+static const u8 rfc7539_tv_chacha20_ct[] __initconst = {
+	0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80,
+	0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+	0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2,
+	0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+	0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab,
+	0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+	0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab,
+	0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+	0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61,
+	0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+	0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06,
+	0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+	0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6,
+	0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+	0x87, 0x4d,
+};
+
+static const u8 rfc7539_tv_poly1305_msg[] __initconst =
+	"Cryptographic Forum Research Group";
+
+#define RFC7539_TV_POLY1305_MSG_LEN	(sizeof(rfc7539_tv_poly1305_msg) - 1)
+
+static const u8 rfc7539_tv_poly1305_key[] __initconst = {
+	0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+	0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+	0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+	0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b,
+};
+
+static const u8 rfc7539_tv_poly1305_tag[] __initconst = {
+	0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+	0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9,
+};
+
+static const u8 rfc7539_tv_aead_key[] __initconst = {
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+	0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+};
+
+static const u8 rfc7539_tv_aead_nonce[] __initconst = {
+	0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43,
+	0x44, 0x45, 0x46, 0x47,
+};
+
+static const u8 rfc7539_tv_aead_assoc[] __initconst = {
+	0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7,
+};
+
+static const u8 rfc7539_tv_aead_ct[] __initconst = {
+	0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb,
+	0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2,
+	0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe,
+	0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6,
+	0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12,
+	0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+	0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29,
+	0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36,
+	0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c,
+	0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58,
+	0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94,
+	0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+	0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d,
+	0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b,
+	0x61, 0x16,
+};
+
+static const u8 rfc7539_tv_aead_tag[] __initconst = {
+	0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+	0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91,
+};
+
+/* Long enough to reach the four block ChaCha20 NEON code */
+#define RFC7539_TV_LONG_LEN	(4 * CHACHA20_BLOCK_SIZE + 37)
+
+static int __init rfc7539_neon_selftest_one(bool neon)
+{
+	struct poly1305_arm_desc_ctx poly;
+	struct chacha20_ctx ctx;
+	u8 buf[RFC7539_TV_TEXT_LEN];
+	u8 tag[POLY1305_DIGEST_SIZE];
+	u8 iv[CHACHA20_IV_SIZE];
+	u32 state[16];
+	int err = 0;
+
+	chacha20_arm_setkey(&ctx, rfc7539_tv_chacha20_key);
+	put_unaligned_le32(1, iv);
+	memcpy(iv + sizeof(u32), rfc7539_tv_chacha20_nonce, RFC7539_NONCE_SIZE);
+	chacha20_arm_init(state, &ctx, iv);
+
+	if (neon)
+		kernel_neon_begin();
+	chacha20_arm_crypt(state, buf, rfc7539_tv_text, sizeof(buf), neon);
+	if (neon)
+		kernel_neon_end();
+
+	if (memcmp(buf, rfc7539_tv_chacha20_ct, sizeof(buf)))
+		err = -EINVAL;
+
+	poly1305_arm_init(&poly);
+	poly1305_arm_update(&poly, rfc7539_tv_poly1305_key, POLY1305_KEY_SIZE,
+			    false);
+	if (neon)
+		kernel_neon_begin();
+	poly1305_arm_update(&poly, rfc7539_tv_poly1305_msg,
+			    RFC7539_TV_POLY1305_MSG_LEN, neon);
+	if (neon)
+		kernel_neon_end();
+	poly1305_arm_final(&poly, tag);
+
+	if (memcmp(tag, rfc7539_tv_poly1305_tag, sizeof(tag)))
+		err = -EINVAL;
+
+	chacha20_arm_setkey(&ctx, rfc7539_tv_aead_key);
+	rfc7539_neon_do(&ctx, rfc7539_tv_aead_nonce, rfc7539_tv_aead_assoc,
+			sizeof(rfc7539_tv_aead_assoc), rfc7539_tv_text, buf,
+			sizeof(buf), true, tag, neon);
+
+	if (memcmp(buf, rfc7539_tv_aead_ct, sizeof(buf)) ||
+	    memcmp(tag, rfc7539_tv_aead_tag, sizeof(tag)))
+		err = -EINVAL;
+
+	rfc7539_neon_do(&ctx, rfc7539_tv_aead_nonce, rfc7539_tv_aead_assoc,
+			sizeof(rfc7539_tv_aead_assoc), rfc7539_tv_aead_ct, buf,
+			sizeof(buf), false, tag, neon);
+
+	if (memcmp(buf, rfc7539_tv_text, sizeof(buf)) ||
+	    memcmp(tag, rfc7539_tv_aead_tag, sizeof(tag)))
+		err = -EINVAL;
+
+	return err;
+}
+
+/*
+ * Run the RFC 7539 vectors on the scalar and the NEON code, then check the
+ * two against each other on an input the vectors are too short to cover.
+ */
+static int __init rfc7539_neon_selftest(void)
+{
+	u8 tag[2][POLY1305_DIGEST_SIZE];
+	struct chacha20_ctx ctx;
+	unsigned int i;
+	int err;
+	u8 *buf;
+
+	err = rfc7539_neon_selftest_one(false);
+	if (!err)
+		err = rfc7539_neon_selftest_one(true);
+	if (err)
+		return err;
+
+	buf = kmalloc(3 * RFC7539_TV_LONG_LEN, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < RFC7539_TV_LONG_LEN; i++)
+		buf[i] = i * 0x9d + (i >> 8);
+
+	chacha20_arm_setkey(&ctx, rfc7539_tv_aead_key);
+	rfc7539_neon_do(&ctx, rfc7539_tv_aead_nonce, rfc7539_tv_aead_assoc,
+			sizeof(rfc7539_tv_aead_assoc), buf,
+			buf + RFC7539_TV_LONG_LEN, RFC7539_TV_LONG_LEN, true,
+			tag[0], false);
+	rfc7539_neon_do(&ctx, rfc7539_tv_aead_nonce, rfc7539_tv_aead_assoc,
+			sizeof(rfc7539_tv_aead_assoc), buf,
+			buf + 2 * RFC7539_TV_LONG_LEN, RFC7539_TV_LONG_LEN, true,
+			tag[1], true);
+
+	if (memcmp(buf + RFC7539_TV_LONG_LEN, buf + 2 * RFC7539_TV_LONG_LEN,
+		   RFC7539_TV_LONG_LEN) ||
+	    memcmp(tag[0], tag[1], sizeof(tag[0])))
+		err = -EINVAL;
+
+	kfree(buf);
+	return err;
+}
+
+static int __init chacha20poly1305_neon_mod_init(void)
+{
+	int err;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	err = rfc7539_neon_selftest();
+	if (err) {
+		pr_err("chacha20poly1305-neon: self test failed (%d)\n", err);
+		return err == -ENOMEM ? err : -ENODEV;
+	}
+
+	err = crypto_register_alg(&chacha20_neon_alg);
+	if (err)
+		return err;
+
+	err = crypto_register_shash(&poly1305_neon_alg);
+	if (err)
+		goto err_chacha20;
+
+	err = crypto_register_alg(&rfc7539_neon_alg);
+	if (err)
+		goto err_poly1305;
+
+	return 0;
+
+err_poly1305:
+	crypto_unregister_shash(&poly1305_neon_alg);
+err_chacha20:
+	crypto_unregister_alg(&chacha20_neon_alg);
+	return err;
+}
+
+static void __exit chacha20poly1305_neon_mod_exit(void)
+{
+	crypto_unregister_alg(&rfc7539_neon_alg);
+	crypto_unregister_shash(&poly1305_neon_alg);
+	crypto_unregister_alg(&chacha20_neon_alg);
+}
+
+module_init(chacha20poly1305_neon_mod_init);
+module_exit(chacha20poly1305_neon_mod_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("ChaCha20, Poly1305 and RFC7539 AEAD, NEON accelerated");
+
+MODULE_ALIAS_CRYPTO("chacha20");
+MODULE_ALIAS_CRYPTO("chacha20-neon");
+MODULE_ALIAS_CRYPTO("poly1305");
+MODULE_ALIAS_CRYPTO("poly1305-neon");
+MODULE_ALIAS_CRYPTO("rfc7539(chacha20,poly1305)");
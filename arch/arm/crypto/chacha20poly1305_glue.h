@@ -0,0 +1,35 @@
+#ifndef _CRYPTO_CHACHA20POLY1305_GLUE_H
+#define _CRYPTO_CHACHA20POLY1305_GLUE_H
+
+#include <linux/crypto.h>
+#include <crypto/chacha20.h>
+#include <crypto/hash.h>
+#include <crypto/poly1305.h>
+
+/*
+ * The helpers below take a neon argument telling whether the caller holds
+ * kernel_neon_begin(); the generic C code is used otherwise.
+ */
+
+struct poly1305_arm_desc_ctx {
+	struct poly1305_desc_ctx base;
+	/* r^2, for processing two blocks at a time */
+	u32 u[5];
+	bool uset;
+};
+
+extern struct crypto_alg chacha20_neon_alg;
+extern struct shash_alg poly1305_neon_alg;
+
+void chacha20_arm_setkey(struct chacha20_ctx *ctx, const u8 *key);
+void chacha20_arm_init(u32 *state, const struct chacha20_ctx *ctx,
+		       const u8 *iv);
+void chacha20_arm_crypt(u32 *state, u8 *dst, const u8 *src,
+			unsigned int bytes, bool neon);
+
+void poly1305_arm_init(struct poly1305_arm_desc_ctx *sctx);
+void poly1305_arm_update(struct poly1305_arm_desc_ctx *sctx, const u8 *src,
+			 unsigned int srclen, bool neon);
+int poly1305_arm_final(struct poly1305_arm_desc_ctx *sctx, u8 *dst);
+
+#endif /* _CRYPTO_CHACHA20POLY1305_GLUE_H */
@@ -0,0 +1,332 @@
+/*
+ * CRC32C and CRC-T10DIF using NEON vmull.p8 instructions
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <crypto/internal/hash.h>
+#include <linux/crc-t10dif.h>
+#include <linux/crc32.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/unaligned.h>
+
+#define CRC_FOLD_SIZE		16
+
+/*
+ * Shorter inputs are left to the table driven code, which is faster than
+ * the folding loop plus the cost of claiming the NEON unit.
+ */
+#define CRC_NEON_MIN_LEN	256
+
+/* Amount of data folded per NEON section */
+#define CRC_NEON_CHUNK_SIZE	PAGE_SIZE
+
+asmlinkage void crc32c_fold_p8(u8 acc[CRC_FOLD_SIZE], const u8 *src,
+			       int blocks);
+asmlinkage void crct10dif_fold_p8(u8 acc[CRC_FOLD_SIZE], const u8 *src,
+				  int blocks);
+
+static void crc_neon_fold(void (*fold)(u8 *, const u8 *, int),
+			  u8 acc[CRC_FOLD_SIZE], const u8 *src,
+			  unsigned int blocks)
+{
+	kernel_neon_begin();
+	while (blocks) {
+		unsigned int n = min_t(unsigned int, blocks,
+				       CRC_NEON_CHUNK_SIZE / CRC_FOLD_SIZE);
+
+		fold(acc, src, n);
+
+		blocks -= n;
+		src += n * CRC_FOLD_SIZE;
+
+		if (blocks) {
+			kernel_neon_end();
+			kernel_neon_begin();
+		}
+	}
+	kernel_neon_end();
+}
+
+static u32 crc32c_neon(u32 crc, const u8 *p, unsigned int len)
+{
+	u8 acc[CRC_FOLD_SIZE];
+	unsigned int blocks;
+
+	if (len >= CRC_NEON_MIN_LEN && may_use_simd()) {
+		blocks = len / CRC_FOLD_SIZE;
+
+		/* fold the initial value into the first block */
+		memcpy(acc, p, CRC_FOLD_SIZE);
+		put_unaligned_le32(get_unaligned_le32(acc) ^ crc, acc);
+
+		crc_neon_fold(crc32c_fold_p8, acc, p + CRC_FOLD_SIZE,
+			      blocks - 1);
+
+		crc = __crc32c_le(0, acc, CRC_FOLD_SIZE);
+		p += blocks * CRC_FOLD_SIZE;
+		len -= blocks * CRC_FOLD_SIZE;
+	}
+	return __crc32c_le(crc, p, len);
+}
+
+static u16 crct10dif_neon(u16 crc, const u8 *p, unsigned int len)
+{
+	u8 acc[CRC_FOLD_SIZE];
+	unsigned int blocks;
+
+	if (len >= CRC_NEON_MIN_LEN && may_use_simd()) {
+		blocks = len / CRC_FOLD_SIZE;
+
+		/* fold the initial value into the first block */
+		memcpy(acc, p, CRC_FOLD_SIZE);
+		acc[0] ^= crc >> 8;
+		acc[1] ^= crc & 0xff;
+
+		crc_neon_fold(crct10dif_fold_p8, acc, p + CRC_FOLD_SIZE,
+			      blocks - 1);
+
+		crc = crc_t10dif_generic(0, acc, CRC_FOLD_SIZE);
+		p += blocks * CRC_FOLD_SIZE;
+		len -= blocks * CRC_FOLD_SIZE;
+	}
+	return crc_t10dif_generic(crc, p, len);
+}
+
+struct crc32c_ctx {
+	u32 key;
+};
+
+struct crc32c_desc_ctx {
+	u32 crc;
+};
+
+struct crct10dif_desc_ctx {
+	u16 crc;
+};
+
+static int crc32c_neon_cra_init(struct crypto_tfm *tfm)
+{
+	struct crc32c_ctx *mctx = crypto_tfm_ctx(tfm);
+
+	mctx->key = ~0;
+	return 0;
+}
+
+/*
+ * Setting the seed allows arbitrary accumulators and flexible XOR policy
+ * If your algorithm starts with ~0, then XOR with ~0 before you set
+ * the seed.
+ */
+static int crc32c_neon_setkey(struct crypto_shash *tfm, const u8 *key,
+			      unsigned int keylen)
+{
+	struct crc32c_ctx *mctx = crypto_shash_ctx(tfm);
+
+	if (keylen != sizeof(mctx->key)) {
+		crypto_shash_set_flags(tfm, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	mctx->key = get_unaligned_le32(key);
+	return 0;
+}
+
+static int crc32c_neon_init(struct shash_desc *desc)
+{
+	struct crc32c_ctx *mctx = crypto_shash_ctx(desc->tfm);
+	struct crc32c_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	ctx->crc = mctx->key;
+	return 0;
+}
+
+static int crc32c_neon_update(struct shash_desc *desc, const u8 *data,
+			      unsigned int length)
+{
+	struct crc32c_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	ctx->crc = crc32c_neon(ctx->crc, data, length);
+	return 0;
+}
+
+static int crc32c_neon_final(struct shash_desc *desc, u8 *out)
+{
+	struct crc32c_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	put_unaligned_le32(~ctx->crc, out);
+	return 0;
+}
+
+static int crc32c_neon_finup(struct shash_desc *desc, const u8 *data,
+			     unsigned int len, u8 *out)
+{
+	struct crc32c_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	put_unaligned_le32(~crc32c_neon(ctx->crc, data, len), out);
+	return 0;
+}
+
+static int crc32c_neon_digest(struct shash_desc *desc, const u8 *data,
+			      unsigned int len, u8 *out)
+{
+	struct crc32c_ctx *mctx = crypto_shash_ctx(desc->tfm);
+
+	put_unaligned_le32(~crc32c_neon(mctx->key, data, len), out);
+	return 0;
+}
+
+static int crct10dif_neon_init(struct shash_desc *desc)
+{
+	struct crct10dif_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	ctx->crc = 0;
+	return 0;
+}
+
+static int crct10dif_neon_update(struct shash_desc *desc, const u8 *data,
+				 unsigned int length)
+{
+	struct crct10dif_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	ctx->crc = crct10dif_neon(ctx->crc, data, length);
+	return 0;
+}
+
+static int crct10dif_neon_final(struct shash_desc *desc, u8 *out)
+{
+	struct crct10dif_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	*(u16 *)out = ctx->crc;
+	return 0;
+}
+
+static int crct10dif_neon_finup(struct shash_desc *desc, const u8 *data,
+				unsigned int len, u8 *out)
+{
+	struct crct10dif_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	*(u16 *)out = crct10dif_neon(ctx->crc, data, len);
+	return 0;
+}
+
+static int crct10dif_neon_digest(struct shash_desc *desc, const u8 *data,
+				 unsigned int len, u8 *out)
+{
+	*(u16 *)out = crct10dif_neon(0, data, len);
+	return 0;
+}
+
+static struct shash_alg crc_neon_algs[] = { {
+	.digestsize		=	sizeof(u32),
+	.setkey			=	crc32c_neon_setkey,
+	.init			=	crc32c_neon_init,
+	.update			=	crc32c_neon_update,
+	.final			=	crc32c_neon_final,
+	.finup			=	crc32c_neon_finup,
+	.digest			=	crc32c_neon_digest,
+	.descsize		=	sizeof(struct crc32c_desc_ctx),
+	.base			=	{
+		.cra_name		=	"crc32c",
+		.cra_driver_name	=	"crc32c-neon",
+		.cra_priority		=	200,
+		.cra_blocksize		=	1,
+		.cra_ctxsize		=	sizeof(struct crc32c_ctx),
+		.cra_module		=	THIS_MODULE,
+		.cra_init		=	crc32c_neon_cra_init,
+	}
+}, {
+	.digestsize		=	CRC_T10DIF_DIGEST_SIZE,
+	.init			=	crct10dif_neon_init,
+	.update			=	crct10dif_neon_update,
+	.final			=	crct10dif_neon_final,
+	.finup			=	crct10dif_neon_finup,
+	.digest			=	crct10dif_neon_digest,
+	.descsize		=	sizeof(struct crct10dif_desc_ctx),
+	.base			=	{
+		.cra_name		=	"crct10dif",
+		.cra_driver_name	=	"crct10dif-neon",
+		.cra_priority		=	200,
+		.cra_blocksize		=	CRC_T10DIF_BLOCK_SIZE,
+		.cra_module		=	THIS_MODULE,
+	}
+} };
+
+/*
+ * Check the folding code against the table driven code before registering,
+ * over lengths and alignments that exercise the head, fold and tail paths,
+ * and the breaks between NEON sections.
+ */
+static int __init crc_neon_selftest(void)
+{
+	static const unsigned int lens[] = {
+		CRC_NEON_MIN_LEN, CRC_NEON_MIN_LEN + 1, CRC_NEON_MIN_LEN + 15,
+		1000, 4096, 3 * CRC_NEON_CHUNK_SIZE + 7,
+	};
+	unsigned int size = lens[ARRAY_SIZE(lens) - 1] + 4;
+	unsigned int i, off, len;
+	int err = 0;
+	u8 *buf;
+
+	buf = kmalloc(size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < size; i++)
+		buf[i] = i * 0x9d + (i >> 8);
+
+	for (i = 0; i < ARRAY_SIZE(lens) && !err; i++) {
+		for (off = 0; off < 4 && !err; off++) {
+			len = lens[i];
+
+			if (crc32c_neon(~0, buf + off, len) !=
+			    __crc32c_le(~0, buf + off, len) ||
+			    crct10dif_neon(0x1234, buf + off, len) !=
+			    crc_t10dif_generic(0x1234, buf + off, len))
+				err = -EINVAL;
+		}
+	}
+
+	kfree(buf);
+	return err;
+}
+
+static int __init crc_neon_mod_init(void)
+{
+	int err;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	err = crc_neon_selftest();
+	if (err) {
+		pr_err("crc-arm-neon: self test failed (%d)\n", err);
+		return err == -ENOMEM ? err : -ENODEV;
+	}
+
+	return crypto_register_shashes(crc_neon_algs,
+				       ARRAY_SIZE(crc_neon_algs));
+}
+
+static void __exit crc_neon_mod_exit(void)
+{
+	crypto_unregister_shashes(crc_neon_algs, ARRAY_SIZE(crc_neon_algs));
+}
+
+module_init(crc_neon_mod_init);
+module_exit(crc_neon_mod_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("CRC32C and CRC-T10DIF, NEON accelerated");
+
+MODULE_ALIAS_CRYPTO("crc32c");
+MODULE_ALIAS_CRYPTO("crc32c-neon");
+MODULE_ALIAS_CRYPTO("crct10dif");
+MODULE_ALIAS_CRYPTO("crct10dif-neon");
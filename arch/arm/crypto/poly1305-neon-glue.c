@@ -0,0 +1,301 @@
+/*
+ * Poly1305 authenticator algorithm, RFC7539, ARM NEON functions
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <crypto/internal/hash.h>
+#include <linux/crypto.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/unaligned.h>
+
+#include "chacha20poly1305_glue.h"
+
+asmlinkage void poly1305_2block_neon(u32 *h, const u8 *src, const u32 *r,
+				     unsigned int blocks, const u32 *u);
+
+static void poly1305_setrkey(struct poly1305_desc_ctx *dctx, const u8 *key)
+{
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	dctx->r[0] = (get_unaligned_le32(key +  0) >> 0) & 0x3ffffff;
+	dctx->r[1] = (get_unaligned_le32(key +  3) >> 2) & 0x3ffff03;
+	dctx->r[2] = (get_unaligned_le32(key +  6) >> 4) & 0x3ffc0ff;
+	dctx->r[3] = (get_unaligned_le32(key +  9) >> 6) & 0x3f03fff;
+	dctx->r[4] = (get_unaligned_le32(key + 12) >> 8) & 0x00fffff;
+}
+
+static void poly1305_setskey(struct poly1305_desc_ctx *dctx, const u8 *key)
+{
+	dctx->s[0] = get_unaligned_le32(key +  0);
+	dctx->s[1] = get_unaligned_le32(key +  4);
+	dctx->s[2] = get_unaligned_le32(key +  8);
+	dctx->s[3] = get_unaligned_le32(key + 12);
+}
+
+/* The key is passed as the first 32 bytes of data, r followed by s. */
+static unsigned int poly1305_setdesckey(struct poly1305_desc_ctx *dctx,
+					const u8 *src, unsigned int srclen)
+{
+	if (!dctx->sset) {
+		if (!dctx->rset && srclen >= POLY1305_BLOCK_SIZE) {
+			poly1305_setrkey(dctx, src);
+			src += POLY1305_BLOCK_SIZE;
+			srclen -= POLY1305_BLOCK_SIZE;
+			dctx->rset = true;
+		}
+		if (srclen >= POLY1305_BLOCK_SIZE) {
+			poly1305_setskey(dctx, src);
+			src += POLY1305_BLOCK_SIZE;
+			srclen -= POLY1305_BLOCK_SIZE;
+			dctx->sset = true;
+		}
+	}
+	return srclen;
+}
+
+/* h = (h + m[i]) * r for each block, partially reduced */
+static void poly1305_blocks_generic(u32 *h, const u32 *r, const u8 *src,
+				    unsigned int blocks, u32 hibit)
+{
+	u32 r0, r1, r2, r3, r4;
+	u32 s1, s2, s3, s4;
+	u32 h0, h1, h2, h3, h4;
+	u64 d0, d1, d2, d3, d4;
+
+	r0 = r[0];
+	r1 = r[1];
+	r2 = r[2];
+	r3 = r[3];
+	r4 = r[4];
+
+	s1 = r1 * 5;
+	s2 = r2 * 5;
+	s3 = r3 * 5;
+	s4 = r4 * 5;
+
+	h0 = h[0];
+	h1 = h[1];
+	h2 = h[2];
+	h3 = h[3];
+	h4 = h[4];
+
+	while (blocks--) {
+		/* h += m[i] */
+		h0 += (get_unaligned_le32(src +  0) >> 0) & 0x3ffffff;
+		h1 += (get_unaligned_le32(src +  3) >> 2) & 0x3ffffff;
+		h2 += (get_unaligned_le32(src +  6) >> 4) & 0x3ffffff;
+		h3 += (get_unaligned_le32(src +  9) >> 6) & 0x3ffffff;
+		h4 += (get_unaligned_le32(src + 12) >> 8) | hibit;
+
+		/* h *= r */
+		d0 = (u64)h0 * r0 + (u64)h1 * s4 + (u64)h2 * s3 +
+		     (u64)h3 * s2 + (u64)h4 * s1;
+		d1 = (u64)h0 * r1 + (u64)h1 * r0 + (u64)h2 * s4 +
+		     (u64)h3 * s3 + (u64)h4 * s2;
+		d2 = (u64)h0 * r2 + (u64)h1 * r1 + (u64)h2 * r0 +
+		     (u64)h3 * s4 + (u64)h4 * s3;
+		d3 = (u64)h0 * r3 + (u64)h1 * r2 + (u64)h2 * r1 +
+		     (u64)h3 * r0 + (u64)h4 * s4;
+		d4 = (u64)h0 * r4 + (u64)h1 * r3 + (u64)h2 * r2 +
+		     (u64)h3 * r1 + (u64)h4 * r0;
+
+		/* (partial) h %= p */
+		d1 += d0 >> 26;       h0 = d0 & 0x3ffffff;
+		d2 += d1 >> 26;       h1 = d1 & 0x3ffffff;
+		d3 += d2 >> 26;       h2 = d2 & 0x3ffffff;
+		d4 += d3 >> 26;       h3 = d3 & 0x3ffffff;
+		h0 += (d4 >> 26) * 5; h4 = d4 & 0x3ffffff;
+		h1 += h0 >> 26;       h0 = h0 & 0x3ffffff;
+
+		src += POLY1305_BLOCK_SIZE;
+	}
+
+	h[0] = h0;
+	h[1] = h1;
+	h[2] = h2;
+	h[3] = h3;
+	h[4] = h4;
+}
+
+static unsigned int poly1305_arm_blocks(struct poly1305_arm_desc_ctx *sctx,
+					const u8 *src, unsigned int srclen,
+					bool neon)
+{
+	static const u8 zero[POLY1305_BLOCK_SIZE];
+	struct poly1305_desc_ctx *dctx = &sctx->base;
+	unsigned int blocks;
+
+	if (unlikely(!dctx->sset)) {
+		unsigned int datalen = poly1305_setdesckey(dctx, src, srclen);
+
+		src += srclen - datalen;
+		srclen = datalen;
+	}
+
+	if (neon && srclen >= POLY1305_BLOCK_SIZE * 2) {
+		if (unlikely(!sctx->uset)) {
+			/* u = (r + 0) * r, without the hi-bit of a block */
+			memcpy(sctx->u, dctx->r, sizeof(sctx->u));
+			poly1305_blocks_generic(sctx->u, dctx->r, zero, 1, 0);
+			sctx->uset = true;
+		}
+		blocks = srclen / (POLY1305_BLOCK_SIZE * 2);
+		poly1305_2block_neon(dctx->h, src, dctx->r, blocks, sctx->u);
+		src += POLY1305_BLOCK_SIZE * 2 * blocks;
+		srclen -= POLY1305_BLOCK_SIZE * 2 * blocks;
+	}
+
+	blocks = srclen / POLY1305_BLOCK_SIZE;
+	poly1305_blocks_generic(dctx->h, dctx->r, src, blocks, 1 << 24);
+
+	return srclen % POLY1305_BLOCK_SIZE;
+}
+
+void poly1305_arm_init(struct poly1305_arm_desc_ctx *sctx)
+{
+	memset(sctx, 0, sizeof(*sctx));
+}
+
+void poly1305_arm_update(struct poly1305_arm_desc_ctx *sctx, const u8 *src,
+			 unsigned int srclen, bool neon)
+{
+	struct poly1305_desc_ctx *dctx = &sctx->base;
+	unsigned int bytes;
+
+	if (unlikely(dctx->buflen)) {
+		bytes = min(srclen, POLY1305_BLOCK_SIZE - dctx->buflen);
+		memcpy(dctx->buf + dctx->buflen, src, bytes);
+		src += bytes;
+		srclen -= bytes;
+		dctx->buflen += bytes;
+
+		if (dctx->buflen == POLY1305_BLOCK_SIZE) {
+			poly1305_arm_blocks(sctx, dctx->buf,
+					    POLY1305_BLOCK_SIZE, false);
+			dctx->buflen = 0;
+		}
+	}
+
+	if (likely(srclen >= POLY1305_BLOCK_SIZE)) {
+		bytes = poly1305_arm_blocks(sctx, src, srclen, neon);
+		src += srclen - bytes;
+		srclen = bytes;
+	}
+
+	if (unlikely(srclen)) {
+		dctx->buflen = srclen;
+		memcpy(dctx->buf, src, srclen);
+	}
+}
+
+int poly1305_arm_final(struct poly1305_arm_desc_ctx *sctx, u8 *dst)
+{
+	struct poly1305_desc_ctx *dctx = &sctx->base;
+	u32 h0, h1, h2, h3, h4;
+	u32 g0, g1, g2, g3, g4;
+	u32 mask;
+	u64 f = 0;
+
+	if (unlikely(!dctx->sset))
+		return -ENOKEY;
+
+	if (unlikely(dctx->buflen)) {
+		dctx->buf[dctx->buflen++] = 1;
+		memset(dctx->buf + dctx->buflen, 0,
+		       POLY1305_BLOCK_SIZE - dctx->buflen);
+		poly1305_blocks_generic(dctx->h, dctx->r, dctx->buf, 1, 0);
+	}
+
+	/* fully carry h */
+	h0 = dctx->h[0];
+	h1 = dctx->h[1];
+	h2 = dctx->h[2];
+	h3 = dctx->h[3];
+	h4 = dctx->h[4];
+
+	h2 += (h1 >> 26);     h1 = h1 & 0x3ffffff;
+	h3 += (h2 >> 26);     h2 = h2 & 0x3ffffff;
+	h4 += (h3 >> 26);     h3 = h3 & 0x3ffffff;
+	h0 += (h4 >> 26) * 5; h4 = h4 & 0x3ffffff;
+	h1 += (h0 >> 26);     h0 = h0 & 0x3ffffff;
+
+	/* compute h + -p */
+	g0 = h0 + 5;
+	g1 = h1 + (g0 >> 26);             g0 &= 0x3ffffff;
+	g2 = h2 + (g1 >> 26);             g1 &= 0x3ffffff;
+	g3 = h3 + (g2 >> 26);             g2 &= 0x3ffffff;
+	g4 = h4 + (g3 >> 26) - (1 << 26); g3 &= 0x3ffffff;
+
+	/* select h if h < p, or h + -p if h >= p */
+	mask = (g4 >> ((sizeof(u32) * 8) - 1)) - 1;
+	g0 &= mask;
+	g1 &= mask;
+	g2 &= mask;
+	g3 &= mask;
+	g4 &= mask;
+	mask = ~mask;
+	h0 = (h0 & mask) | g0;
+	h1 = (h1 & mask) | g1;
+	h2 = (h2 & mask) | g2;
+	h3 = (h3 & mask) | g3;
+	h4 = (h4 & mask) | g4;
+
+	/* h = h % (2^128) */
+	h0 = (h0 >>  0) | (h1 << 26);
+	h1 = (h1 >>  6) | (h2 << 20);
+	h2 = (h2 >> 12) | (h3 << 14);
+	h3 = (h3 >> 18) | (h4 <<  8);
+
+	/* mac = (h + s) % (2^128) */
+	f = (f >> 32) + h0 + dctx->s[0]; put_unaligned_le32(f, dst +  0);
+	f = (f >> 32) + h1 + dctx->s[1]; put_unaligned_le32(f, dst +  4);
+	f = (f >> 32) + h2 + dctx->s[2]; put_unaligned_le32(f, dst +  8);
+	f = (f >> 32) + h3 + dctx->s[3]; put_unaligned_le32(f, dst + 12);
+
+	return 0;
+}
+
+static int poly1305_neon_init(struct shash_desc *desc)
+{
+	poly1305_arm_init(shash_desc_ctx(desc));
+	return 0;
+}
+
+static int poly1305_neon_update(struct shash_desc *desc, const u8 *src,
+				unsigned int srclen)
+{
+	bool neon = srclen >= POLY1305_BLOCK_SIZE * 2 && may_use_simd();
+
+	if (neon)
+		kernel_neon_begin();
+	poly1305_arm_update(shash_desc_ctx(desc), src, srclen, neon);
+	if (neon)
+		kernel_neon_end();
+	return 0;
+}
+
+static int poly1305_neon_final(struct shash_desc *desc, u8 *dst)
+{
+	return poly1305_arm_final(shash_desc_ctx(desc), dst);
+}
+
+struct shash_alg poly1305_neon_alg = {
+	.digestsize	= POLY1305_DIGEST_SIZE,
+	.init		= poly1305_neon_init,
+	.update		= poly1305_neon_update,
+	.final		= poly1305_neon_final,
+	.descsize	= sizeof(struct poly1305_arm_desc_ctx),
+	.base		= {
+		.cra_name		= "poly1305",
+		.cra_driver_name	= "poly1305-neon",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize		= POLY1305_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	},
+};
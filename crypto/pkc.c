@@ -0,0 +1,127 @@
+/*
+ * PKC: public key primitives offloaded to a hardware engine
+ *
+ * A single engine can be registered. The operations hold the engine for
+ * their duration, so unregistering waits for the ones in flight.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <linux/errno.h>
+#include <linux/export.h>
+#include <linux/kernel.h>
+#include <linux/rwsem.h>
+#include <crypto/pkc.h>
+
+static struct pkc_engine *pkc_engine;
+static DECLARE_RWSEM(pkc_sem);
+
+int crypto_pkc_register(struct pkc_engine *engine)
+{
+	int err = 0;
+
+	down_write(&pkc_sem);
+	if (pkc_engine)
+		err = -EBUSY;
+	else
+		pkc_engine = engine;
+	up_write(&pkc_sem);
+
+	if (!err)
+		pr_info("pkc: %s registered\n", engine->name);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_pkc_register);
+
+void crypto_pkc_unregister(struct pkc_engine *engine)
+{
+	down_write(&pkc_sem);
+	if (pkc_engine == engine)
+		pkc_engine = NULL;
+	up_write(&pkc_sem);
+}
+EXPORT_SYMBOL_GPL(crypto_pkc_unregister);
+
+unsigned int crypto_pkc_features(void)
+{
+	unsigned int features = 0;
+
+	down_read(&pkc_sem);
+	if (pkc_engine)
+		features = pkc_engine->features;
+	up_read(&pkc_sem);
+
+	return features;
+}
+EXPORT_SYMBOL_GPL(crypto_pkc_features);
+
+/* returns the engine with pkc_sem read-held, or NULL */
+static struct pkc_engine *crypto_pkc_get(unsigned int feature,
+					 unsigned int len)
+{
+	down_read(&pkc_sem);
+	if (pkc_engine && (pkc_engine->features & feature) &&
+	    len * 8 <= pkc_engine->max_bits)
+		return pkc_engine;
+	up_read(&pkc_sem);
+
+	return NULL;
+}
+
+static void crypto_pkc_put(void)
+{
+	up_read(&pkc_sem);
+}
+
+int crypto_pkc_mod_exp(struct pkc_mod_exp_req *req)
+{
+	struct pkc_engine *engine;
+	int err;
+
+	engine = crypto_pkc_get(PKC_F_MOD_EXP, req->n_len);
+	if (!engine)
+		return -ENODEV;
+
+	err = engine->mod_exp(req);
+	crypto_pkc_put();
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_pkc_mod_exp);
+
+int crypto_pkc_mod_exp_crt(struct pkc_mod_exp_crt_req *req)
+{
+	struct pkc_engine *engine;
+	int err;
+
+	engine = crypto_pkc_get(PKC_F_MOD_EXP_CRT, req->out_len);
+	if (!engine)
+		return -ENODEV;
+
+	err = engine->mod_exp_crt(req);
+	crypto_pkc_put();
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_pkc_mod_exp_crt);
+
+int crypto_pkc_ecc_mul(struct pkc_ecc_mul_req *req)
+{
+	struct pkc_engine *engine;
+	int err;
+
+	engine = crypto_pkc_get(PKC_F_ECC_MUL, req->p_len);
+	if (!engine)
+		return -ENODEV;
+
+	err = engine->ecc_mul(req);
+	crypto_pkc_put();
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_pkc_ecc_mul);
@@ -87,6 +87,8 @@ enum {
 	HOST_IRQ_STAT		= 0x08, /* interrupt status */
 	HOST_PORTS_IMPL		= 0x0c, /* bitmap of implemented ports */
 	HOST_VERSION		= 0x10, /* AHCI spec. version compliancy */
+	HOST_CCC_CTL		= 0x14, /* Command Completion Coalescing ctl */
+	HOST_CCC_PORTS		= 0x18, /* ports that take part in CCC */
 	HOST_EM_LOC		= 0x1c, /* Enclosure Management location */
 	HOST_EM_CTL		= 0x20, /* Enclosure Management Control */
 	HOST_CAP2		= 0x24, /* host capabilities, extended */
@@ -97,6 +99,15 @@ enum {
 	HOST_MRSM		= (1 << 2),  /* MSI Revert to Single Message */
 	HOST_AHCI_EN		= (1 << 31), /* AHCI enabled */
 
+	/* HOST_CCC_CTL bits */
+	HOST_CCC_EN		= (1 << 0),  /* coalescing enabled */
+	HOST_CCC_INT_SHIFT	= 3,	     /* HOST_IRQ_STAT bit used by CCC */
+	HOST_CCC_INT_MASK	= (0x1f << 3),
+	HOST_CCC_CC_SHIFT	= 8,	     /* completions per interrupt */
+	HOST_CCC_CC_MASK	= (0xff << 8),
+	HOST_CCC_TV_SHIFT	= 16,	     /* timeout in ms */
+	HOST_CCC_TV_MASK	= (0xffff << 16),
+
 	/* HOST_CAP bits */
 	HOST_CAP_SXS		= (1 << 5),  /* Supports External SATA */
 	HOST_CAP_EMS		= (1 << 6),  /* Enclosure Management support */
@@ -347,6 +358,11 @@ struct ahci_host_priv {
 	 * be overridden anytime before the host is activated.
 	 */
 	void			(*start_engine)(struct ata_port *ap);
+	/*
+	 * Optional interrupt handler override for the single IRQ case, it
+	 * may use ahci_handle_port_intr() to service the ports.
+	 */
+	irqreturn_t		(*irq_handler)(int irq, void *dev_instance);
 };
 
 extern int ahci_ignore_sss;
@@ -395,6 +411,7 @@ int ahci_reset_em(struct ata_host *host);
 void ahci_print_info(struct ata_host *host, const char *scc_s);
 int ahci_host_activate(struct ata_host *host, int irq,
 		       struct scsi_host_template *sht);
+u32 ahci_handle_port_intr(struct ata_host *host, u32 irq_masked);
 void ahci_error_handler(struct ata_port *ap);
 
 static inline void __iomem *__ahci_port_base(struct ata_host *host,
@@ -12,6 +12,8 @@
 
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
 #include <linux/pm.h>
 #include <linux/ahci_platform.h>
 #include <linux/device.h>
@@ -48,6 +50,15 @@
 #define LS1043A_PORT_PHY2	0x28184d1f
 #define LS1043A_PORT_PHY3	0x0e081509
 
+/* command completion coalescing defaults: off, 1ms once enabled */
+#define AHCI_QORIQ_CCC_TIMEOUT	1
+
+/*
+ * longest stretch of reaping completions in one interrupt, in us: the
+ * handler runs in hardirq context with host->lock held, so keep it short
+ */
+#define AHCI_QORIQ_POLL_US	20
+
 enum ahci_qoriq_type {
 	AHCI_LS1021A,
 	AHCI_LS1043A,
@@ -58,6 +69,16 @@ struct ahci_qoriq_priv {
 	struct ccsr_ahci *reg_base;
 	enum ahci_qoriq_type type;
 	void __iomem *ecc_addr;
+
+	/* CCC setup, ccc_completions == 0 disables coalescing */
+	u32 ccc_completions;
+	u32 ccc_timeout;
+	u32 ccc_irq;		/* HOST_IRQ_STAT bit of CCC, 0 if disabled */
+
+	/* poll for completions while at least poll_depth commands are queued */
+	unsigned int poll_depth;
+
+	bool has_attrs;		/* the sysfs attribute group was created */
 };
 
 static const struct of_device_id ahci_qoriq_of_match[] = {
@@ -132,6 +153,179 @@ static int ahci_qoriq_hardreset(struct ata_link *link, unsigned int *class,
 	return rc;
 }
 
+/*
+ * With a deep NCQ queue the next completion is typically a few
+ * microseconds away. Keep reaping completions for up to AHCI_QORIQ_POLL_US
+ * while enough commands are outstanding, instead of taking an interrupt for
+ * each of them.
+ */
+static void ahci_qoriq_poll(struct ata_host *host,
+			    struct ahci_qoriq_priv *qoriq_priv)
+{
+	ktime_t end = ktime_add_us(ktime_get(), AHCI_QORIQ_POLL_US);
+	unsigned int i;
+	u32 busy;
+
+	for (;;) {
+		busy = 0;
+		for (i = 0; i < host->n_ports; i++) {
+			struct ata_port *ap = host->ports[i];
+
+			if (ap && hweight32(ap->qc_active) >=
+				  qoriq_priv->poll_depth)
+				busy |= 1 << i;
+		}
+		if (!busy)
+			break;
+
+		ahci_handle_port_intr(host, busy);
+		if (ktime_after(ktime_get(), end))
+			break;
+		udelay(1);
+	}
+}
+
+static irqreturn_t ahci_qoriq_irq_intr(int irq, void *dev_instance)
+{
+	struct ata_host *host = dev_instance;
+	struct ahci_host_priv *hpriv = host->private_data;
+	struct ahci_qoriq_priv *qoriq_priv = hpriv->plat_data;
+	void __iomem *mmio = hpriv->mmio;
+	u32 irq_stat, irq_masked;
+	unsigned int handled;
+
+	irq_stat = readl(mmio + HOST_IRQ_STAT);
+	if (!irq_stat)
+		return IRQ_NONE;
+
+	irq_masked = irq_stat & hpriv->port_map;
+
+	spin_lock(&host->lock);
+
+	/* a coalesced interrupt does not tell which ports completed commands */
+	if (irq_stat & qoriq_priv->ccc_irq)
+		irq_masked |= hpriv->port_map;
+
+	handled = ahci_handle_port_intr(host, irq_masked);
+
+	if (qoriq_priv->poll_depth)
+		ahci_qoriq_poll(host, qoriq_priv);
+
+	/* clear the latch after the port events, see ahci_single_irq_intr() */
+	writel(irq_stat, mmio + HOST_IRQ_STAT);
+
+	spin_unlock(&host->lock);
+
+	return IRQ_RETVAL(handled);
+}
+
+/* called with host->lock held, or before the host is activated */
+static void ahci_qoriq_ccc_config(struct ahci_host_priv *hpriv)
+{
+	struct ahci_qoriq_priv *qoriq_priv = hpriv->plat_data;
+	void __iomem *mmio = hpriv->mmio;
+	u32 ctl;
+
+	if (!(hpriv->cap & HOST_CAP_CCC))
+		return;
+
+	/* CC and TV may only be changed while coalescing is disabled */
+	ctl = readl(mmio + HOST_CCC_CTL);
+	writel(ctl & ~HOST_CCC_EN, mmio + HOST_CCC_CTL);
+	qoriq_priv->ccc_irq = 0;
+
+	if (!qoriq_priv->ccc_completions)
+		return;
+
+	writel(hpriv->port_map, mmio + HOST_CCC_PORTS);
+	ctl = (qoriq_priv->ccc_completions << HOST_CCC_CC_SHIFT) |
+	      (qoriq_priv->ccc_timeout << HOST_CCC_TV_SHIFT);
+	writel(ctl, mmio + HOST_CCC_CTL);
+	writel(ctl | HOST_CCC_EN, mmio + HOST_CCC_CTL);
+
+	ctl = readl(mmio + HOST_CCC_CTL);
+	qoriq_priv->ccc_irq = 1 << ((ctl & HOST_CCC_INT_MASK) >>
+				    HOST_CCC_INT_SHIFT);
+}
+
+static ssize_t ahci_qoriq_show(struct device *dev, char *buf, u32 val)
+{
+	return sprintf(buf, "%u\n", val);
+}
+
+static ssize_t ahci_qoriq_store(struct device *dev, const char *buf,
+				size_t count, u32 *val, u32 min, u32 max,
+				bool ccc)
+{
+	struct ata_host *host = dev_get_drvdata(dev);
+	struct ahci_host_priv *hpriv = host->private_data;
+	unsigned long flags;
+	u32 new;
+	int ret;
+
+	ret = kstrtou32(buf, 0, &new);
+	if (ret)
+		return ret;
+
+	if (new < min || new > max)
+		return -EINVAL;
+
+	if (ccc && !(hpriv->cap & HOST_CAP_CCC))
+		return -EOPNOTSUPP;
+
+	spin_lock_irqsave(&host->lock, flags);
+	*val = new;
+	if (ccc) {
+		ahci_qoriq_ccc_config(hpriv);
+		/* reap what was counted but not signalled yet */
+		ahci_handle_port_intr(host, hpriv->port_map);
+	}
+	spin_unlock_irqrestore(&host->lock, flags);
+
+	return count;
+}
+
+#define AHCI_QORIQ_ATTR(_name, _min, _max, _ccc)			\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{									\
+	struct ata_host *host = dev_get_drvdata(dev);			\
+	struct ahci_host_priv *hpriv = host->private_data;		\
+	struct ahci_qoriq_priv *qoriq_priv = hpriv->plat_data;		\
+									\
+	return ahci_qoriq_show(dev, buf, qoriq_priv->_name);		\
+}									\
+static ssize_t _name##_store(struct device *dev,			\
+			     struct device_attribute *attr,		\
+			     const char *buf, size_t count)		\
+{									\
+	struct ata_host *host = dev_get_drvdata(dev);			\
+	struct ahci_host_priv *hpriv = host->private_data;		\
+	struct ahci_qoriq_priv *qoriq_priv = hpriv->plat_data;		\
+									\
+	return ahci_qoriq_store(dev, buf, count, &qoriq_priv->_name,	\
+				_min, _max, _ccc);			\
+}									\
+static DEVICE_ATTR_RW(_name)
+
+/* completions per interrupt, 0 disables coalescing */
+AHCI_QORIQ_ATTR(ccc_completions, 0, 255, true);
+/* ms after the first completion before the interrupt fires anyway */
+AHCI_QORIQ_ATTR(ccc_timeout, 1, 65535, true);
+/* queue depth from which the interrupt handler polls, 0 disables it */
+AHCI_QORIQ_ATTR(poll_depth, 0, AHCI_MAX_CMDS, false);
+
+static struct attribute *ahci_qoriq_attrs[] = {
+	&dev_attr_ccc_completions.attr,
+	&dev_attr_ccc_timeout.attr,
+	&dev_attr_poll_depth.attr,
+	NULL
+};
+
+static const struct attribute_group ahci_qoriq_attr_group = {
+	.attrs = ahci_qoriq_attrs,
+};
+
 static struct ata_port_operations ahci_qoriq_ops = {
 	.inherits	= &ahci_ops,
 	.hardreset	= ahci_qoriq_hardreset,
@@ -203,6 +397,7 @@ static int ahci_qoriq_probe(struct platform_device *pdev)
 		return -ENOMEM;
 
 	qoriq_priv->type = (enum ahci_qoriq_type)of_id->data;
+	qoriq_priv->ccc_timeout = AHCI_QORIQ_CCC_TIMEOUT;
 
 	if (qoriq_priv->type == AHCI_LS1021A) {
 		res = platform_get_resource_byname(pdev, IORESOURCE_MEM,
@@ -217,6 +412,7 @@ static int ahci_qoriq_probe(struct platform_device *pdev)
 		return rc;
 
 	hpriv->plat_data = qoriq_priv;
+	hpriv->irq_handler = ahci_qoriq_irq_intr;
 	rc = ahci_qoriq_phy_init(hpriv);
 	if (rc)
 		goto disable_resources;
@@ -232,6 +428,13 @@ static int ahci_qoriq_probe(struct platform_device *pdev)
 	if (rc)
 		goto disable_resources;
 
+	/* the tuning attributes are optional, the disk works without them */
+	rc = sysfs_create_group(&dev->kobj, &ahci_qoriq_attr_group);
+	if (rc)
+		dev_warn(dev, "failed to create sysfs attributes\n");
+	else
+		qoriq_priv->has_attrs = true;
+
 	return 0;
 
 disable_resources:
@@ -240,6 +443,18 @@ disable_resources:
 	return rc;
 }
 
+static int ahci_qoriq_remove(struct platform_device *pdev)
+{
+	struct ata_host *host = platform_get_drvdata(pdev);
+	struct ahci_host_priv *hpriv = host->private_data;
+	struct ahci_qoriq_priv *qoriq_priv = hpriv->plat_data;
+
+	if (qoriq_priv->has_attrs)
+		sysfs_remove_group(&pdev->dev.kobj, &ahci_qoriq_attr_group);
+
+	return ata_platform_remove_one(pdev);
+}
+
 #ifdef CONFIG_PM_SLEEP
 static int ahci_qoriq_resume(struct device *dev)
 {
@@ -259,6 +474,11 @@ static int ahci_qoriq_resume(struct device *dev)
 	if (rc)
 		goto disable_resources;
 
+	/* the controller reset dropped the coalescing setup */
+	spin_lock_irq(&host->lock);
+	ahci_qoriq_ccc_config(hpriv);
+	spin_unlock_irq(&host->lock);
+
 	/* We resumed so update PM runtime state */
 	pm_runtime_disable(dev);
 	pm_runtime_set_active(dev);
@@ -278,7 +498,7 @@ static SIMPLE_DEV_PM_OPS(ahci_qoriq_pm_ops, ahci_platform_suspend,
 
 static struct platform_driver ahci_qoriq_driver = {
 	.probe = ahci_qoriq_probe,
-	.remove = ata_platform_remove_one,
+	.remove = ahci_qoriq_remove,
 	.driver = {
 		.name = DRV_NAME,
 		.of_match_table = ahci_qoriq_of_match,
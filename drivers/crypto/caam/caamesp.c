@@ -0,0 +1,1000 @@
+/*
+ * caam - Freescale FSL CAAM support for IPsec ESP protocol offload
+ *
+ * Registers the CAAM as ESP offload engine with esp4/esp6. Every offloaded
+ * SA gets two shared descriptors, one per direction, that run the IPsec
+ * ESP protocol of the SEC: the PDB in front of them holds SPI, sequence
+ * number and anti-replay window, and the SEC updates it (HDR_SAVECTX)
+ * while it builds or checks whole ESP payloads. A packet is then a single
+ * job with one input and one output pointer:
+ *
+ * encap: in  = payload
+ *        out = ESP header | IV | ciphertext | padding, trailer | ICV
+ *
+ * decap: in  = ESP header | IV | ciphertext | ICV
+ *        out = payload | padding, trailer
+ *
+ * Both are done in place in the linear skb. The next header of the trailer
+ * comes from the PDB (PDBOPTS_ESP_TUNNEL). The padding and trailer are
+ * left in the decap output, so esp4/esp6 strip them as for software ESP,
+ * and the anti-replay check is left to xfrm. The encap descriptor is
+ * built for the first packet, once xfrm has set up the sequence numbers;
+ * ESN SAs stay in software. Before registering, one packet is run each
+ * way against the software authenc transform to check these layouts.
+ *
+ * Jobs are collected per CPU and enqueued together by a flush scheduled
+ * for the end of the softirq run, or once CAAM_ESP_BATCH of them are
+ * waiting.
+ */
+
+#include "compat.h"
+
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/err.h>
+#include <linux/ip.h>
+#include <linux/locallock.h>
+#include <linux/percpu.h>
+#include <linux/skbuff.h>
+#include <asm/unaligned.h>
+#include <net/esp.h>
+
+#include "regs.h"
+#include "intern.h"
+#include "desc_constr.h"
+#include "jr.h"
+#include "error.h"
+#include "key_gen.h"
+#include "pdb.h"
+
+/* split HMAC key for SHA-512 padded to 16 bytes, plus an AES-256 key */
+#define CAAM_ESP_MAX_KEY_SIZE		(SHA512_DIGEST_SIZE * 2 + \
+					 AES_MAX_KEY_SIZE)
+
+#define DESC_ESP_JOB_LEN		(DESC_JOB_IO_LEN / CAAM_CMD_SZ + 1)
+
+/* jobs held back per CPU before the job ring is rung regardless */
+#define CAAM_ESP_BATCH			16
+
+struct caam_esp_cipher {
+	const char *name;
+	u16 pcl;
+};
+
+struct caam_esp_auth {
+	const char *name;
+	u16 pcl;
+	u32 alg_op;
+	unsigned int icv_bits;
+};
+
+static const struct caam_esp_cipher caam_esp_ciphers[] = {
+	{ "cbc(aes)",		OP_PCL_IPSEC_AES_CBC },
+	{ "cbc(des3_ede)",	OP_PCL_IPSEC_3DES },
+};
+
+/* only the RFC truncation lengths, the SEC implies them from the PCL */
+static const struct caam_esp_auth caam_esp_auths[] = {
+	{ "hmac(md5)",	  OP_PCL_IPSEC_HMAC_MD5_96,
+	  OP_ALG_ALGSEL_MD5 | OP_ALG_AAI_HMAC,		96 },
+	{ "hmac(sha1)",	  OP_PCL_IPSEC_HMAC_SHA1_96,
+	  OP_ALG_ALGSEL_SHA1 | OP_ALG_AAI_HMAC,		96 },
+	{ "hmac(sha256)", OP_PCL_IPSEC_HMAC_SHA2_256_128,
+	  OP_ALG_ALGSEL_SHA256 | OP_ALG_AAI_HMAC,	128 },
+	{ "hmac(sha384)", OP_PCL_IPSEC_HMAC_SHA2_384_192,
+	  OP_ALG_ALGSEL_SHA384 | OP_ALG_AAI_HMAC,	192 },
+	{ "hmac(sha512)", OP_PCL_IPSEC_HMAC_SHA2_512_256,
+	  OP_ALG_ALGSEL_SHA512 | OP_ALG_AAI_HMAC,	256 },
+};
+
+/* per-SA context */
+struct caam_esp_ctx {
+	u32 sh_desc_enc[MAX_CAAM_DESCSIZE] ____cacheline_aligned;
+	u32 sh_desc_dec[MAX_CAAM_DESCSIZE] ____cacheline_aligned;
+	u8 key[CAAM_ESP_MAX_KEY_SIZE] ____cacheline_aligned;
+	dma_addr_t sh_desc_enc_dma;
+	dma_addr_t sh_desc_dec_dma;
+	int sh_desc_enc_len;
+	int sh_desc_dec_len;
+	bool enc_ready;		/* sh_desc_enc built, see caam_esp_init_enc() */
+	struct xfrm_state *x;
+	u8 nexthdr;
+	struct device *jrdev;
+	u32 pcl;
+	u32 salt;
+	unsigned int split_key_len;
+	unsigned int split_key_pad_len;
+	unsigned int enckeylen;
+	unsigned int ivsize;
+	unsigned int icvsize;
+};
+
+/* per-packet job */
+struct caam_esp_edesc {
+	struct sk_buff *skb;
+	void (*done)(struct sk_buff *skb, int err);
+	dma_addr_t dma;
+	unsigned int dma_len;
+	u32 hw_desc[DESC_ESP_JOB_LEN];
+};
+
+/*
+ * Jobs held back on this CPU until the flush runs, so that the
+ * packets of one softirq run reach the job ring with a single lock round
+ * trip and doorbell write. All jobs of a batch go to the same job ring.
+ */
+struct caam_esp_batch {
+	struct device *jrdev;
+	int njobs;
+	struct caam_jr_job jobs[CAAM_ESP_BATCH];
+};
+
+static DEFINE_PER_CPU(struct caam_esp_batch, caam_esp_batch);
+static DEFINE_LOCAL_IRQ_LOCK(caam_esp_batch_lock);
+
+/* Jobs queued and not handed back yet, module exit waits for them */
+static atomic_t caam_esp_inflight = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(caam_esp_idle);
+
+static const struct esp_offload_ops caam_esp_offload_ops;
+
+static int caam_esp_set_auth(struct caam_esp_ctx *ctx, struct xfrm_state *x)
+{
+	/* Sizes for MDHA pads (*not* keys): MD5, SHA1, 224, 256, 384, 512 */
+	static const u8 mdpadlen[] = { 16, 20, 32, 32, 64, 64 };
+	const struct caam_esp_cipher *cipher = NULL;
+	const struct caam_esp_auth *auth = NULL;
+	unsigned int authkeylen;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(caam_esp_ciphers); i++)
+		if (!strcmp(x->ealg->alg_name, caam_esp_ciphers[i].name))
+			cipher = &caam_esp_ciphers[i];
+
+	for (i = 0; i < ARRAY_SIZE(caam_esp_auths); i++)
+		if (!strcmp(x->aalg->alg_name, caam_esp_auths[i].name) &&
+		    x->aalg->alg_trunc_len == caam_esp_auths[i].icv_bits)
+			auth = &caam_esp_auths[i];
+
+	if (!cipher || !auth)
+		return -EOPNOTSUPP;
+
+	ctx->pcl = cipher->pcl | auth->pcl;
+	ctx->enckeylen = (x->ealg->alg_key_len + 7) / 8;
+	authkeylen = (x->aalg->alg_key_len + 7) / 8;
+
+	ctx->split_key_len = mdpadlen[(auth->alg_op & OP_ALG_ALGSEL_SUBMASK) >>
+				      OP_ALG_ALGSEL_SHIFT] * 2;
+	ctx->split_key_pad_len = ALIGN(ctx->split_key_len, 16);
+
+	if (ctx->split_key_pad_len + ctx->enckeylen > CAAM_ESP_MAX_KEY_SIZE)
+		return -EINVAL;
+
+	if (gen_split_key(ctx->jrdev, ctx->key, ctx->split_key_len,
+			  ctx->split_key_pad_len, x->aalg->alg_key, authkeylen,
+			  OP_TYPE_CLASS2_ALG | auth->alg_op))
+		return -EINVAL;
+
+	/* postpend encryption key to auth split key */
+	memcpy(ctx->key + ctx->split_key_pad_len, x->ealg->alg_key,
+	       ctx->enckeylen);
+
+	return 0;
+}
+
+static int caam_esp_set_gcm(struct caam_esp_ctx *ctx, struct xfrm_state *x)
+{
+	unsigned int keylen = (x->aead->alg_key_len + 7) / 8;
+
+	if (strcmp(x->aead->alg_name, "rfc4106(gcm(aes))"))
+		return -EOPNOTSUPP;
+
+	switch (x->aead->alg_icv_len) {
+	case 64:
+		ctx->pcl = OP_PCL_IPSEC_AES_GCM8;
+		break;
+	case 96:
+		ctx->pcl = OP_PCL_IPSEC_AES_GCM12;
+		break;
+	case 128:
+		ctx->pcl = OP_PCL_IPSEC_AES_GCM16;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	/* the last four bytes of the key are the nonce salt */
+	if (keylen < 4 || keylen - 4 > AES_MAX_KEY_SIZE)
+		return -EINVAL;
+
+	ctx->enckeylen = keylen - 4;
+	ctx->salt = get_unaligned_be32(x->aead->alg_key + ctx->enckeylen);
+	memcpy(ctx->key, x->aead->alg_key, ctx->enckeylen);
+
+	return 0;
+}
+
+static void caam_esp_append_keys(u32 *desc, struct caam_esp_ctx *ctx)
+{
+	u32 *key_jump_cmd;
+
+	/* Skip key loading if they are loaded due to sharing */
+	key_jump_cmd = append_jump(desc, JUMP_JSL | JUMP_TEST_ALL |
+				   JUMP_COND_SHRD);
+	if (ctx->split_key_len)
+		append_key_as_imm(desc, ctx->key, ctx->split_key_pad_len,
+				  ctx->split_key_len, CLASS_2 |
+				  KEY_DEST_MDHA_SPLIT | KEY_ENC);
+	append_key_as_imm(desc, ctx->key + ctx->split_key_pad_len,
+			  ctx->enckeylen, ctx->enckeylen,
+			  CLASS_1 | KEY_DEST_CLASS_REG);
+	set_jump_tgt_here(desc, key_jump_cmd);
+}
+
+/* seq_num is the last sequence number sent, the SEC increments it first */
+static void caam_esp_init_sh_desc_enc(struct caam_esp_ctx *ctx,
+				      struct xfrm_state *x, u32 seq_num)
+{
+	u32 *desc = ctx->sh_desc_enc;
+	struct ipsec_encap_pdb pdb;
+
+	memset(&pdb, 0, sizeof(pdb));
+	pdb.ip_nh = ctx->nexthdr;
+	pdb.options = PDBOPTS_ESP_IVSRC;
+	/* without it the SEC does not take the next header from the PDB */
+	if (ctx->nexthdr)
+		pdb.options |= PDBOPTS_ESP_TUNNEL;
+	pdb.seq_num = seq_num;
+	if (x->aead)
+		pdb.gcm.salt = ctx->salt;
+	pdb.spi = be32_to_cpu(x->id.spi);
+
+	init_sh_desc_pdb(desc, HDR_SAVECTX | HDR_SHARE_SERIAL, sizeof(pdb));
+	append_data(desc, &pdb, sizeof(pdb));
+	caam_esp_append_keys(desc, ctx);
+	append_operation(desc, OP_TYPE_ENCAP_PROTOCOL | OP_PCLID_IPSEC |
+			 ctx->pcl);
+}
+
+static void caam_esp_init_sh_desc_dec(struct caam_esp_ctx *ctx,
+				      struct xfrm_state *x)
+{
+	u32 *desc = ctx->sh_desc_dec;
+	struct ipsec_decap_pdb pdb;
+
+	/*
+	 * xfrm checks the replay window itself, with windows wider than the
+	 * 64 entries the SEC can keep, so the SEC is not to drop anything.
+	 * Without its window the SEC does not use the sequence number.
+	 */
+	memset(&pdb, 0, sizeof(pdb));
+	pdb.options = PDBOPTS_ESP_ARSNONE;
+	if (x->aead)
+		pdb.gcm.salt = ctx->salt;
+
+	init_sh_desc_pdb(desc, HDR_SAVECTX | HDR_SHARE_SERIAL, sizeof(pdb));
+	append_data(desc, &pdb, sizeof(pdb));
+	caam_esp_append_keys(desc, ctx);
+	append_operation(desc, OP_TYPE_DECAP_PROTOCOL | OP_PCLID_IPSEC |
+			 ctx->pcl);
+}
+
+/*
+ * Build the encap shared descriptor for the first packet of the SA. Its
+ * PDB starts from the sequence number xfrm gave that packet: the replay
+ * state is not set up yet when the SA is added. x->lock held.
+ */
+static void caam_esp_init_enc(struct caam_esp_ctx *ctx, u32 seq)
+{
+	caam_esp_init_sh_desc_enc(ctx, ctx->x, seq - 1);
+	ctx->sh_desc_enc_len = desc_len(ctx->sh_desc_enc);
+	dma_sync_single_for_device(ctx->jrdev, ctx->sh_desc_enc_dma,
+				   sizeof(ctx->sh_desc_enc),
+				   DMA_BIDIRECTIONAL);
+
+	/* pairs with the acquire in caam_esp_encap() */
+	smp_store_release(&ctx->enc_ready, true);
+}
+
+/*
+ * ESN SAs are left to software: esp_init_state() runs before xfrm
+ * allocates x->replay_esn, and the SEC takes the high sequence number
+ * bits of an inbound packet from its own anti-replay window, which is
+ * off.
+ */
+static void *caam_esp_add_state(struct xfrm_state *x, u8 nexthdr)
+{
+	struct crypto_aead *aead = x->data;
+	struct caam_esp_ctx *ctx;
+	int err;
+
+	if (x->props.flags & XFRM_STATE_ESN)
+		return ERR_PTR(-EOPNOTSUPP);
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL | GFP_DMA);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	ctx->x = x;
+	ctx->nexthdr = nexthdr;
+
+	ctx->jrdev = caam_jr_alloc();
+	if (IS_ERR(ctx->jrdev)) {
+		err = PTR_ERR(ctx->jrdev);
+		goto out_free;
+	}
+
+	if (x->aead)
+		err = caam_esp_set_gcm(ctx, x);
+	else if (x->ealg && x->aalg)
+		err = caam_esp_set_auth(ctx, x);
+	else
+		err = -EOPNOTSUPP;
+	if (err)
+		goto out_jr;
+
+	ctx->ivsize = crypto_aead_ivsize(aead);
+	ctx->icvsize = crypto_aead_authsize(aead);
+
+	caam_esp_init_sh_desc_dec(ctx, x);
+	ctx->sh_desc_dec_len = desc_len(ctx->sh_desc_dec);
+
+	/*
+	 * The SEC writes the PDB back, so the CPU keeps its hands off. The
+	 * encap descriptor is mapped whole, it is only built later.
+	 */
+	ctx->sh_desc_enc_dma = dma_map_single(ctx->jrdev, ctx->sh_desc_enc,
+					      sizeof(ctx->sh_desc_enc),
+					      DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(ctx->jrdev, ctx->sh_desc_enc_dma)) {
+		err = -ENOMEM;
+		goto out_jr;
+	}
+
+	ctx->sh_desc_dec_dma = dma_map_single(ctx->jrdev, ctx->sh_desc_dec,
+					      desc_bytes(ctx->sh_desc_dec),
+					      DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(ctx->jrdev, ctx->sh_desc_dec_dma)) {
+		err = -ENOMEM;
+		goto out_unmap_enc;
+	}
+
+	return ctx;
+
+out_unmap_enc:
+	dma_unmap_single(ctx->jrdev, ctx->sh_desc_enc_dma,
+			 sizeof(ctx->sh_desc_enc), DMA_BIDIRECTIONAL);
+out_jr:
+	caam_jr_free(ctx->jrdev);
+out_free:
+	kzfree(ctx);
+	return ERR_PTR(err);
+}
+
+static void caam_esp_del_state(void *data)
+{
+	struct caam_esp_ctx *ctx = data;
+
+	dma_unmap_single(ctx->jrdev, ctx->sh_desc_dec_dma,
+			 desc_bytes(ctx->sh_desc_dec), DMA_BIDIRECTIONAL);
+	dma_unmap_single(ctx->jrdev, ctx->sh_desc_enc_dma,
+			 sizeof(ctx->sh_desc_enc), DMA_BIDIRECTIONAL);
+	caam_jr_free(ctx->jrdev);
+	kzfree(ctx);
+}
+
+static void caam_esp_complete(struct device *jrdev,
+			      struct caam_esp_edesc *edesc, int err)
+{
+	void (*done)(struct sk_buff *skb, int err) = edesc->done;
+	struct sk_buff *skb = edesc->skb;
+
+	dma_unmap_single(jrdev, edesc->dma, edesc->dma_len, DMA_BIDIRECTIONAL);
+	kfree(edesc);
+	done(skb, err);
+
+	if (atomic_dec_and_test(&caam_esp_inflight))
+		wake_up(&caam_esp_idle);
+}
+
+static void caam_esp_done(struct device *jrdev, u32 *desc, u32 status,
+			  void *context)
+{
+	int err = 0;
+
+	/* ICV mismatches and replays are the peer's problem, keep quiet */
+	if (status) {
+		if ((status & JRSTA_CCBERR_ERRID_MASK) ==
+		    JRSTA_CCBERR_ERRID_ICVCHK)
+			err = -EBADMSG;
+		else
+			err = -EIO;
+		if (net_ratelimit())
+			caam_jr_strstatus(jrdev, status);
+	}
+
+	caam_esp_complete(jrdev, context, err);
+}
+
+/*
+ * Submit the jobs held back on this CPU, with the batch lock held. Jobs
+ * the ring has no room for are dropped, as they would be when submitted
+ * one by one, only their failure is reported through done.
+ */
+static void __caam_esp_flush(struct caam_esp_batch *batch)
+{
+	int i, n;
+
+	n = caam_jr_enqueue_bulk(batch->jrdev, batch->jobs, batch->njobs);
+
+	for (i = max(n, 0); i < batch->njobs; i++)
+		caam_esp_complete(batch->jrdev, batch->jobs[i].areq,
+				  n < 0 ? n : -EBUSY);
+
+	batch->njobs = 0;
+}
+
+static void caam_esp_flush(void)
+{
+	struct caam_esp_batch *batch;
+
+	local_bh_disable();
+	local_lock(caam_esp_batch_lock);
+
+	batch = this_cpu_ptr(&caam_esp_batch);
+	if (batch->njobs)
+		__caam_esp_flush(batch);
+
+	local_unlock(caam_esp_batch_lock);
+	local_bh_enable();
+}
+
+/*
+ * A CPU going down between queueing and its flush tasklet would strand its
+ * batch: submit it from here. The CPU is dead, nothing else uses its batch.
+ */
+static int caam_esp_cpu_callback(struct notifier_block *nfb,
+				 unsigned long action, void *hcpu)
+{
+	struct caam_esp_batch *batch;
+	int cpu = (unsigned long)hcpu;
+
+	if (action != CPU_DEAD && action != CPU_DEAD_FROZEN)
+		return NOTIFY_OK;
+
+	local_bh_disable();
+	batch = per_cpu_ptr(&caam_esp_batch, cpu);
+	if (batch->njobs)
+		__caam_esp_flush(batch);
+	local_bh_enable();
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block caam_esp_cpu_notifier = {
+	.notifier_call	= caam_esp_cpu_callback,
+};
+
+static void caam_esp_queue(struct device *jrdev, u32 *desc,
+			   struct caam_esp_edesc *edesc)
+{
+	struct caam_esp_batch *batch;
+	struct caam_jr_job *job;
+
+	atomic_inc(&caam_esp_inflight);
+
+	local_bh_disable();
+	local_lock(caam_esp_batch_lock);
+
+	batch = this_cpu_ptr(&caam_esp_batch);
+	if (batch->njobs && batch->jrdev != jrdev)
+		__caam_esp_flush(batch);
+
+	batch->jrdev = jrdev;
+	job = &batch->jobs[batch->njobs++];
+	job->desc = desc;
+	job->cbk = caam_esp_done;
+	job->areq = edesc;
+
+	/* the flush has to run where the job waits, before we may migrate */
+	if (batch->njobs == CAAM_ESP_BATCH)
+		__caam_esp_flush(batch);
+	else
+		esp_offload_kick(&caam_esp_offload_ops);
+
+	local_unlock(caam_esp_batch_lock);
+	local_bh_enable();
+}
+
+static void caam_esp_init_job(u32 *desc, dma_addr_t sh_desc_dma,
+			      int sh_desc_len, dma_addr_t dma,
+			      unsigned int in_off, unsigned int in_len,
+			      unsigned int out_off, unsigned int out_len)
+{
+	init_job_desc_shared(desc, sh_desc_dma, sh_desc_len,
+			     HDR_SHARE_DEFER | HDR_REVERSE);
+	append_seq_out_ptr(desc, dma + out_off, out_len, 0);
+	append_seq_in_ptr(desc, dma + in_off, in_len, 0);
+}
+
+static int caam_esp_run(struct caam_esp_ctx *ctx, dma_addr_t sh_desc_dma,
+			int sh_desc_len, struct sk_buff *skb, u8 *buf,
+			unsigned int buf_len, unsigned int in_off,
+			unsigned int in_len, unsigned int out_off,
+			unsigned int out_len,
+			void (*done)(struct sk_buff *skb, int err))
+{
+	struct device *jrdev = ctx->jrdev;
+	struct caam_esp_edesc *edesc;
+	u32 *desc;
+
+	edesc = kmalloc(sizeof(*edesc), GFP_ATOMIC | GFP_DMA);
+	if (!edesc)
+		return -ENOMEM;
+
+	edesc->dma = dma_map_single(jrdev, buf, buf_len, DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(jrdev, edesc->dma)) {
+		kfree(edesc);
+		return -ENOMEM;
+	}
+	edesc->dma_len = buf_len;
+	edesc->skb = skb;
+	edesc->done = done;
+
+	desc = edesc->hw_desc;
+	caam_esp_init_job(desc, sh_desc_dma, sh_desc_len, edesc->dma, in_off,
+			  in_len, out_off, out_len);
+
+	caam_esp_queue(jrdev, desc, edesc);
+
+	return -EINPROGRESS;
+}
+
+static int caam_esp_encap(void *data, struct sk_buff *skb,
+			  struct ip_esp_hdr *esph, unsigned int len,
+			  void (*done)(struct sk_buff *skb, int err))
+{
+	struct caam_esp_ctx *ctx = data;
+	unsigned int hlen = sizeof(*esph) + ctx->ivsize;
+	unsigned int buf_len = skb_tail_pointer(skb) - (u8 *)esph;
+
+	if (unlikely(!smp_load_acquire(&ctx->enc_ready))) {
+		spin_lock_bh(&ctx->x->lock);
+		if (!ctx->enc_ready)
+			caam_esp_init_enc(ctx,
+					  XFRM_SKB_CB(skb)->seq.output.low);
+		spin_unlock_bh(&ctx->x->lock);
+	}
+
+	return caam_esp_run(ctx, ctx->sh_desc_enc_dma, ctx->sh_desc_enc_len,
+			    skb, (u8 *)esph, buf_len, hlen, len, 0, buf_len,
+			    done);
+}
+
+static int caam_esp_decap(void *data, struct sk_buff *skb,
+			  struct ip_esp_hdr *esph, unsigned int len,
+			  void (*done)(struct sk_buff *skb, int err))
+{
+	struct caam_esp_ctx *ctx = data;
+	unsigned int hlen = sizeof(*esph) + ctx->ivsize;
+
+	if (len <= hlen + ctx->icvsize)
+		return -EINVAL;
+
+	return caam_esp_run(ctx, ctx->sh_desc_dec_dma, ctx->sh_desc_dec_len,
+			    skb, (u8 *)esph, len, 0, len, hlen,
+			    len - hlen - ctx->icvsize, done);
+}
+
+static const struct esp_offload_ops caam_esp_offload_ops = {
+	.owner		= THIS_MODULE,
+	.add_state	= caam_esp_add_state,
+	.del_state	= caam_esp_del_state,
+	.encap		= caam_esp_encap,
+	.decap		= caam_esp_decap,
+	.flush		= caam_esp_flush,
+};
+
+/*
+ * Self test against the software ESP transform: an SA with known keys
+ * encapsulates a payload on the SEC, which the generic authenc(hmac(sha1),
+ * cbc(aes)) has to authenticate and decrypt to the payload with the RFC
+ * 4303 padding and trailer, and a packet built by the generic transform has
+ * to decapsulate on the SEC to payload, padding and trailer, as esp4/esp6
+ * expect. An ESN SA has to be declined.
+ */
+#define CAAM_ESP_TEST_SPI	0x00001000
+#define CAAM_ESP_TEST_SEQ	0x00000100	/* as left by an SA update */
+#define CAAM_ESP_TEST_LEN	37	/* padded with 9 bytes */
+
+static const u8 caam_esp_test_enckey[] __initconst = {
+	0x06, 0xa9, 0x21, 0x40, 0x36, 0xb8, 0xa1, 0x5b,
+	0x51, 0x2e, 0x03, 0xd5, 0x34, 0x12, 0x00, 0x06,
+};
+
+static const u8 caam_esp_test_authkey[] __initconst = {
+	0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
+	0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
+};
+
+struct caam_esp_test_result {
+	struct completion completion;
+	int err;
+};
+
+static void caam_esp_test_done(struct device *jrdev, u32 *desc, u32 status,
+			       void *context)
+{
+	struct caam_esp_test_result *res = context;
+
+	if (status) {
+		caam_jr_strstatus(jrdev, status);
+		res->err = -EIO;
+	}
+
+	complete(&res->completion);
+}
+
+static int __init caam_esp_test_run(struct caam_esp_ctx *ctx,
+				    dma_addr_t sh_desc_dma, int sh_desc_len,
+				    u8 *buf, unsigned int buf_len,
+				    unsigned int in_off, unsigned int in_len,
+				    unsigned int out_off, unsigned int out_len)
+{
+	struct caam_esp_test_result res;
+	dma_addr_t dma;
+	u32 *desc;
+	int err;
+
+	desc = kmalloc(DESC_ESP_JOB_LEN * CAAM_CMD_SZ, GFP_KERNEL | GFP_DMA);
+	if (!desc)
+		return -ENOMEM;
+
+	dma = dma_map_single(ctx->jrdev, buf, buf_len, DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(ctx->jrdev, dma)) {
+		kfree(desc);
+		return -ENOMEM;
+	}
+
+	caam_esp_init_job(desc, sh_desc_dma, sh_desc_len, dma, in_off, in_len,
+			  out_off, out_len);
+
+	init_completion(&res.completion);
+	res.err = 0;
+	err = caam_jr_enqueue(ctx->jrdev, desc, caam_esp_test_done, &res);
+	if (!err) {
+		wait_for_completion(&res.completion);
+		err = res.err;
+	}
+
+	dma_unmap_single(ctx->jrdev, dma, buf_len, DMA_BIDIRECTIONAL);
+	kfree(desc);
+
+	return err;
+}
+
+/* the software side, on the same esph | IV | data | ICV layout */
+static int __init caam_esp_test_sw(struct crypto_aead *aead, u8 *buf,
+				   unsigned int buf_len, bool encrypt)
+{
+	unsigned int hlen = sizeof(struct ip_esp_hdr) +
+			    crypto_aead_ivsize(aead);
+	unsigned int icvsize = crypto_aead_authsize(aead);
+	struct scatterlist asg, sg;
+	struct aead_request *req;
+	u8 iv[AES_BLOCK_SIZE];
+	int err;
+
+	req = aead_request_alloc(aead, GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+
+	/* the cipher hands back its output IV, keep the packet's intact */
+	memcpy(iv, buf + sizeof(struct ip_esp_hdr), sizeof(iv));
+	sg_init_one(&asg, buf, sizeof(struct ip_esp_hdr));
+	sg_init_one(&sg, buf + hlen, buf_len - hlen);
+
+	aead_request_set_callback(req, 0, NULL, NULL);
+	aead_request_set_assoc(req, &asg, sizeof(struct ip_esp_hdr));
+	if (encrypt) {
+		aead_request_set_crypt(req, &sg, &sg,
+				       buf_len - hlen - icvsize, iv);
+		err = crypto_aead_encrypt(req);
+	} else {
+		aead_request_set_crypt(req, &sg, &sg, buf_len - hlen, iv);
+		err = crypto_aead_decrypt(req);
+	}
+
+	aead_request_free(req);
+
+	return err;
+}
+
+static struct crypto_aead * __init caam_esp_test_sw_alloc(void)
+{
+	struct crypto_authenc_key_param *param;
+	struct crypto_aead *aead;
+	struct rtattr *rta;
+	unsigned int keylen;
+	u8 *key, *p;
+	int err;
+
+	aead = crypto_alloc_aead("authenc(hmac(sha1-generic),cbc(aes-generic))",
+				 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(aead))
+		return aead;
+
+	keylen = RTA_SPACE(sizeof(*param)) + sizeof(caam_esp_test_authkey) +
+		 sizeof(caam_esp_test_enckey);
+	key = kmalloc(keylen, GFP_KERNEL);
+	if (!key) {
+		err = -ENOMEM;
+		goto out_free_aead;
+	}
+
+	p = key;
+	rta = (void *)p;
+	rta->rta_type = CRYPTO_AUTHENC_KEYA_PARAM;
+	rta->rta_len = RTA_LENGTH(sizeof(*param));
+	param = RTA_DATA(rta);
+	param->enckeylen = cpu_to_be32(sizeof(caam_esp_test_enckey));
+	p += RTA_SPACE(sizeof(*param));
+	memcpy(p, caam_esp_test_authkey, sizeof(caam_esp_test_authkey));
+	p += sizeof(caam_esp_test_authkey);
+	memcpy(p, caam_esp_test_enckey, sizeof(caam_esp_test_enckey));
+
+	err = crypto_aead_setauthsize(aead, 96 / 8);
+	if (!err)
+		err = crypto_aead_setkey(aead, key, keylen);
+	kzfree(key);
+	if (err)
+		goto out_free_aead;
+
+	return aead;
+
+out_free_aead:
+	crypto_free_aead(aead);
+	return ERR_PTR(err);
+}
+
+/* an SA as esp4 would offload it, keys in the xfrm_algo layout */
+static struct xfrm_state * __init
+caam_esp_test_state(struct crypto_aead *aead)
+{
+	struct xfrm_state *x;
+
+	x = kzalloc(sizeof(*x), GFP_KERNEL);
+	if (!x)
+		return NULL;
+
+	x->ealg = kzalloc(sizeof(*x->ealg) + sizeof(caam_esp_test_enckey),
+			  GFP_KERNEL);
+	x->aalg = kzalloc(sizeof(*x->aalg) + sizeof(caam_esp_test_authkey),
+			  GFP_KERNEL);
+	if (!x->ealg || !x->aalg) {
+		kfree(x->ealg);
+		kfree(x->aalg);
+		kfree(x);
+		return NULL;
+	}
+
+	strcpy(x->ealg->alg_name, "cbc(aes)");
+	x->ealg->alg_key_len = sizeof(caam_esp_test_enckey) * 8;
+	memcpy(x->ealg->alg_key, caam_esp_test_enckey,
+	       sizeof(caam_esp_test_enckey));
+
+	strcpy(x->aalg->alg_name, "hmac(sha1)");
+	x->aalg->alg_key_len = sizeof(caam_esp_test_authkey) * 8;
+	x->aalg->alg_trunc_len = 96;
+	memcpy(x->aalg->alg_key, caam_esp_test_authkey,
+	       sizeof(caam_esp_test_authkey));
+
+	x->id.spi = htonl(CAAM_ESP_TEST_SPI);
+	x->data = aead;
+
+	return x;
+}
+
+static int __init caam_esp_selftest(void)
+{
+	struct caam_esp_ctx *ctx, *esn_ctx;
+	struct crypto_aead *aead;
+	struct ip_esp_hdr *esph;
+	struct xfrm_state *x;
+	unsigned int hlen, clen, buf_len, padlen, i;
+	u8 *buf, *plain;
+	int err;
+
+	aead = caam_esp_test_sw_alloc();
+	if (IS_ERR(aead))
+		return PTR_ERR(aead);
+
+	x = caam_esp_test_state(aead);
+	if (!x) {
+		err = -ENOMEM;
+		goto out_free_aead;
+	}
+
+	ctx = caam_esp_add_state(x, IPPROTO_IPIP);
+	if (IS_ERR(ctx)) {
+		err = PTR_ERR(ctx);
+		goto out_free_state;
+	}
+
+	hlen = sizeof(*esph) + ctx->ivsize;
+	clen = ALIGN(CAAM_ESP_TEST_LEN + 2, AES_BLOCK_SIZE);
+	padlen = clen - CAAM_ESP_TEST_LEN - 2;
+	buf_len = hlen + clen + ctx->icvsize;
+
+	buf = kzalloc(buf_len, GFP_KERNEL | GFP_DMA);
+	plain = kmalloc(clen, GFP_KERNEL);
+	if (!buf || !plain) {
+		err = -ENOMEM;
+		goto out_free_buf;
+	}
+
+	/* payload, monotonic padding as in RFC 4303, pad length, next header */
+	for (i = 0; i < CAAM_ESP_TEST_LEN; i++)
+		plain[i] = i * 0x9d + 3;
+	for (i = 0; i < padlen; i++)
+		plain[CAAM_ESP_TEST_LEN + i] = i + 1;
+	plain[clen - 2] = padlen;
+	plain[clen - 1] = IPPROTO_IPIP;
+
+	/* the first packet goes out with what xfrm numbered it, alone here */
+	caam_esp_init_enc(ctx, CAAM_ESP_TEST_SEQ);
+
+	/* encap on the SEC, decrypt in software */
+	esph = (struct ip_esp_hdr *)buf;
+	memcpy(buf + hlen, plain, CAAM_ESP_TEST_LEN);
+	err = caam_esp_test_run(ctx, ctx->sh_desc_enc_dma,
+				ctx->sh_desc_enc_len, buf, buf_len, hlen,
+				CAAM_ESP_TEST_LEN, 0, buf_len);
+	if (err)
+		goto out_free_buf;
+
+	err = -EINVAL;
+	if (esph->spi != htonl(CAAM_ESP_TEST_SPI) ||
+	    esph->seq_no != htonl(CAAM_ESP_TEST_SEQ))
+		goto out_free_buf;
+
+	err = caam_esp_test_sw(aead, buf, buf_len, false);
+	if (err)
+		goto out_free_buf;
+
+	err = -EINVAL;
+	if (memcmp(buf + hlen, plain, clen))
+		goto out_free_buf;
+
+	/* encrypt in software, decap on the SEC */
+	memset(buf, 0, buf_len);
+	esph->spi = htonl(CAAM_ESP_TEST_SPI);
+	esph->seq_no = htonl(1);
+	for (i = 0; i < ctx->ivsize; i++)
+		esph->enc_data[i] = i * 0x35 + 1;
+	memcpy(buf + hlen, plain, clen);
+
+	err = caam_esp_test_sw(aead, buf, buf_len, true);
+	if (err)
+		goto out_free_buf;
+
+	err = caam_esp_test_run(ctx, ctx->sh_desc_dec_dma,
+				ctx->sh_desc_dec_len, buf, buf_len, 0,
+				buf_len, hlen, clen);
+	if (err)
+		goto out_free_buf;
+
+	if (memcmp(buf + hlen, plain, clen)) {
+		err = -EINVAL;
+		goto out_free_buf;
+	}
+
+	/* an ESN SA as esp_init_state() sees it, before replay_esn exists */
+	x->props.flags |= XFRM_STATE_ESN;
+	esn_ctx = caam_esp_add_state(x, IPPROTO_IPIP);
+	x->props.flags &= ~XFRM_STATE_ESN;
+	if (!IS_ERR(esn_ctx)) {
+		caam_esp_del_state(esn_ctx);
+		err = -EINVAL;
+	} else if (PTR_ERR(esn_ctx) != -EOPNOTSUPP) {
+		err = PTR_ERR(esn_ctx);
+	}
+
+out_free_buf:
+	kfree(plain);
+	kfree(buf);
+	caam_esp_del_state(ctx);
+out_free_state:
+	kzfree(x->aalg);
+	kzfree(x->ealg);
+	kfree(x);
+out_free_aead:
+	crypto_free_aead(aead);
+	return err;
+}
+
+/*
+ * With the engine unregistered and no SA left, nothing queues jobs any
+ * more. Submit what is still held back on any CPU, then wait for the ring
+ * to hand every job back before its callback goes away with the module.
+ */
+static void __exit caam_esp_exit(void)
+{
+	struct caam_esp_batch *batch;
+	int cpu;
+
+	esp_offload_unregister(&caam_esp_offload_ops);
+
+	get_online_cpus();
+	local_bh_disable();
+	for_each_possible_cpu(cpu) {
+		batch = per_cpu_ptr(&caam_esp_batch, cpu);
+		if (batch->njobs)
+			__caam_esp_flush(batch);
+	}
+	local_bh_enable();
+	put_online_cpus();
+
+	unregister_cpu_notifier(&caam_esp_cpu_notifier);
+
+	wait_event(caam_esp_idle, !atomic_read(&caam_esp_inflight));
+}
+
+static int __init caam_esp_init(void)
+{
+	struct device_node *dev_node;
+	struct platform_device *pdev;
+	struct device *ctrldev;
+	void *priv;
+	int err;
+
+	dev_node = of_find_compatible_node(NULL, NULL, "fsl,sec-v4.0");
+	if (!dev_node) {
+		dev_node = of_find_compatible_node(NULL, NULL, "fsl,sec4.0");
+		if (!dev_node)
+			return -ENODEV;
+	}
+
+	pdev = of_find_device_by_node(dev_node);
+	if (!pdev) {
+		of_node_put(dev_node);
+		return -ENODEV;
+	}
+
+	ctrldev = &pdev->dev;
+	priv = dev_get_drvdata(ctrldev);
+	of_node_put(dev_node);
+
+	/*
+	 * If priv is NULL, it's probably because the caam driver wasn't
+	 * properly initialized (e.g. RNG4 init failed). Thus, bail out here.
+	 */
+	if (!priv)
+		return -ENODEV;
+
+	err = caam_esp_selftest();
+	if (err) {
+		pr_err("caam IPsec ESP offload self test failed (%d)\n", err);
+		return err == -ENOMEM ? err : -ENODEV;
+	}
+
+	err = register_cpu_notifier(&caam_esp_cpu_notifier);
+	if (err)
+		return err;
+
+	err = esp_offload_register(&caam_esp_offload_ops);
+	if (err) {
+		unregister_cpu_notifier(&caam_esp_cpu_notifier);
+		return err;
+	}
+
+	pr_info("caam IPsec ESP offload registered\n");
+
+	return 0;
+}
+
+module_init(caam_esp_init);
+module_exit(caam_esp_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("FSL CAAM support for IPsec ESP protocol offload");
@@ -51,6 +51,19 @@
  * | (input buffer)    |
  * | (input length)    |
  * ---------------------
+ *
+ * One-shot digests of small, contiguous buffers are batched: while such a
+ * job is in flight for a tfm, further ones are queued, and are then sent
+ * as one job descriptor that hashes each of them in turn, without shared
+ * descriptor. Digests below fallback_thld bytes are not sent to the SEC at
+ * all but computed by the best software implementation (the NEON ones on
+ * ARM), as the job ring round trip costs more than hashing them.
+ *
+ * HMAC split keys are generated asynchronously: setkey queues the job and
+ * returns, requests issued meanwhile are held until the key is ready.
+ * Split keys are shared, setting a key that another tfm has set needs no
+ * job at all. Unless key_cache_idle is set, an entry and the raw key in it
+ * are wiped once no tfm uses it any more.
  */
 
 #include "compat.h"
@@ -63,6 +76,10 @@
 #include "sg_sw_sec4.h"
 #include "key_gen.h"
 
+#include <linux/moduleparam.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
 #define CAAM_CRA_PRIORITY		3000
 
 /* max hash key is max split key size */
@@ -87,6 +104,30 @@
 #define HASH_MSG_LEN			8
 #define MAX_CTX_LEN			(HASH_MSG_LEN + SHA512_DIGEST_SIZE)
 
+/* digests hashed by one batch job, and largest one batched */
+#define CAAM_HASH_BATCH_MAX		4
+#define CAAM_HASH_BATCH_BYTES		1024
+/* digests queued behind a batch job, the next ones go on their own */
+#define CAAM_HASH_BATCH_QUEUE		64
+
+/*
+ * batch job: header, split key, and per digest: wait for class 2 done and
+ * clear, operation, fifo load of the data, store of the digest
+ */
+#define DESC_AHASH_BATCH_LEN		(2 * CAAM_CMD_SZ + CAAM_PTR_SZ + \
+					 CAAM_HASH_BATCH_MAX * \
+					 (6 * CAAM_CMD_SZ + 2 * CAAM_PTR_SZ))
+
+static unsigned int fallback_thld = 256;
+module_param(fallback_thld, uint, 0644);
+MODULE_PARM_DESC(fallback_thld,
+		 "Digests up to this many bytes are computed in software (0: none)");
+
+static unsigned int key_cache_idle;
+module_param(key_cache_idle, uint, 0644);
+MODULE_PARM_DESC(key_cache_idle,
+		 "Split keys kept for rekeying after their last tfm dropped them (default 0: none)");
+
 #ifdef DEBUG
 /* for print_hex_dumps with line references */
 #define debug(format, arg...) printk(format, arg)
@@ -117,6 +158,19 @@ struct caam_hash_ctx {
 	int ctx_len;
 	unsigned int split_key_len;
 	unsigned int split_key_pad_len;
+	struct crypto_shash *fallback;
+	spinlock_t lock;		/* ck, key_* and batch_* below */
+	struct caam_hash_key *ck;	/* shared split key of the key set */
+	bool key_pending;
+	int key_err;
+	unsigned int key_gen;
+	struct list_head key_wait;
+	struct work_struct key_work;	/* replays key_wait */
+	atomic_t key_jobs;
+	wait_queue_head_t key_jobs_wq;
+	bool batch_busy;
+	unsigned int batch_len;
+	struct list_head batch_queue;
 };
 
 /* ahash state */
@@ -132,6 +186,9 @@ struct caam_hash_state {
 	int (*final)(struct ahash_request *req);
 	int (*finup)(struct ahash_request *req);
 	int current_buf;
+	/* waiting for the split key or in the batch queue */
+	struct list_head entry;
+	int (*deferred)(struct ahash_request *req);
 };
 
 struct caam_export_state {
@@ -317,6 +374,28 @@ static inline void ahash_data_to_out(u32 *desc, u32 op, u32 state,
 	ahash_append_load_str(desc, digestsize);
 }
 
+/*
+ * Shared descriptors are mapped at their full size once, and synced after
+ * being rebuilt on rekeying.
+ */
+static int ahash_map_sh_desc(struct device *jrdev, u32 *desc, size_t size,
+			     dma_addr_t *dma)
+{
+	if (*dma) {
+		dma_sync_single_for_device(jrdev, *dma, size, DMA_TO_DEVICE);
+		return 0;
+	}
+
+	*dma = dma_map_single(jrdev, desc, size, DMA_TO_DEVICE);
+	if (dma_mapping_error(jrdev, *dma)) {
+		dev_err(jrdev, "unable to map shared descriptor\n");
+		*dma = 0;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
 static int ahash_set_sh_desc(struct crypto_ahash *ahash)
 {
 	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
@@ -324,6 +403,7 @@ static int ahash_set_sh_desc(struct crypto_ahash *ahash)
 	struct device *jrdev = ctx->jrdev;
 	u32 have_key = 0;
 	u32 *desc;
+	int ret;
 
 	if (ctx->split_key_len)
 		have_key = OP_ALG_AAI_HMAC_PRECOMP;
@@ -344,12 +424,10 @@ static int ahash_set_sh_desc(struct crypto_ahash *ahash)
 	/* Load data and write to result or context */
 	ahash_append_load_str(desc, ctx->ctx_len);
 
-	ctx->sh_desc_update_dma = dma_map_single(jrdev, desc, desc_bytes(desc),
-						 DMA_TO_DEVICE);
-	if (dma_mapping_error(jrdev, ctx->sh_desc_update_dma)) {
-		dev_err(jrdev, "unable to map shared descriptor\n");
-		return -ENOMEM;
-	}
+	ret = ahash_map_sh_desc(jrdev, desc, sizeof(ctx->sh_desc_update),
+				&ctx->sh_desc_update_dma);
+	if (ret)
+		return ret;
 #ifdef DEBUG
 	print_hex_dump(KERN_ERR,
 		       "ahash update shdesc@"__stringify(__LINE__)": ",
@@ -362,13 +440,10 @@ static int ahash_set_sh_desc(struct crypto_ahash *ahash)
 	ahash_data_to_out(desc, have_key | ctx->alg_type, OP_ALG_AS_INIT,
 			  ctx->ctx_len, ctx);
 
-	ctx->sh_desc_update_first_dma = dma_map_single(jrdev, desc,
-						       desc_bytes(desc),
-						       DMA_TO_DEVICE);
-	if (dma_mapping_error(jrdev, ctx->sh_desc_update_first_dma)) {
-		dev_err(jrdev, "unable to map shared descriptor\n");
-		return -ENOMEM;
-	}
+	ret = ahash_map_sh_desc(jrdev, desc, sizeof(ctx->sh_desc_update_first),
+				&ctx->sh_desc_update_first_dma);
+	if (ret)
+		return ret;
 #ifdef DEBUG
 	print_hex_dump(KERN_ERR,
 		       "ahash update first shdesc@"__stringify(__LINE__)": ",
@@ -381,12 +456,10 @@ static int ahash_set_sh_desc(struct crypto_ahash *ahash)
 	ahash_ctx_data_to_out(desc, have_key | ctx->alg_type,
 			      OP_ALG_AS_FINALIZE, digestsize, ctx);
 
-	ctx->sh_desc_fin_dma = dma_map_single(jrdev, desc, desc_bytes(desc),
-					      DMA_TO_DEVICE);
-	if (dma_mapping_error(jrdev, ctx->sh_desc_fin_dma)) {
-		dev_err(jrdev, "unable to map shared descriptor\n");
-		return -ENOMEM;
-	}
+	ret = ahash_map_sh_desc(jrdev, desc, sizeof(ctx->sh_desc_fin),
+				&ctx->sh_desc_fin_dma);
+	if (ret)
+		return ret;
 #ifdef DEBUG
 	print_hex_dump(KERN_ERR, "ahash final shdesc@"__stringify(__LINE__)": ",
 		       DUMP_PREFIX_ADDRESS, 16, 4, desc,
@@ -399,12 +472,10 @@ static int ahash_set_sh_desc(struct crypto_ahash *ahash)
 	ahash_ctx_data_to_out(desc, have_key | ctx->alg_type,
 			      OP_ALG_AS_FINALIZE, digestsize, ctx);
 
-	ctx->sh_desc_finup_dma = dma_map_single(jrdev, desc, desc_bytes(desc),
-						DMA_TO_DEVICE);
-	if (dma_mapping_error(jrdev, ctx->sh_desc_finup_dma)) {
-		dev_err(jrdev, "unable to map shared descriptor\n");
-		return -ENOMEM;
-	}
+	ret = ahash_map_sh_desc(jrdev, desc, sizeof(ctx->sh_desc_finup),
+				&ctx->sh_desc_finup_dma);
+	if (ret)
+		return ret;
 #ifdef DEBUG
 	print_hex_dump(KERN_ERR, "ahash finup shdesc@"__stringify(__LINE__)": ",
 		       DUMP_PREFIX_ADDRESS, 16, 4, desc,
@@ -417,13 +488,10 @@ static int ahash_set_sh_desc(struct crypto_ahash *ahash)
 	ahash_data_to_out(desc, have_key | ctx->alg_type, OP_ALG_AS_INITFINAL,
 			  digestsize, ctx);
 
-	ctx->sh_desc_digest_dma = dma_map_single(jrdev, desc,
-						 desc_bytes(desc),
-						 DMA_TO_DEVICE);
-	if (dma_mapping_error(jrdev, ctx->sh_desc_digest_dma)) {
-		dev_err(jrdev, "unable to map shared descriptor\n");
-		return -ENOMEM;
-	}
+	ret = ahash_map_sh_desc(jrdev, desc, sizeof(ctx->sh_desc_digest),
+				&ctx->sh_desc_digest_dma);
+	if (ret)
+		return ret;
 #ifdef DEBUG
 	print_hex_dump(KERN_ERR,
 		       "ahash digest shdesc@"__stringify(__LINE__)": ",
@@ -434,12 +502,138 @@ static int ahash_set_sh_desc(struct crypto_ahash *ahash)
 	return 0;
 }
 
-static int gen_split_hash_key(struct caam_hash_ctx *ctx, const u8 *key_in,
-			      u32 keylen)
+/*
+ * Split keys shared between the tfms that have the same key set. Entries
+ * are looked up by the key as passed to setkey, so keys longer than a block
+ * are not shared. Each tfm holds a reference on the entry of its key. Once
+ * the last of them is rekeyed or freed the entry goes to the idle LRU, so
+ * that rekeying back to it needs no job; only key_cache_idle entries are
+ * kept there, the least recently used one is wiped beyond that.
+ */
+struct caam_hash_key {
+	struct list_head entry;
+	struct list_head idle;		/* in key_cache_lru while unused */
+	unsigned int users;		/* protected by key_cache_lock */
+	u32 alg_op;
+	unsigned int keylen;
+	u8 key[CAAM_MAX_HASH_BLOCK_SIZE];
+	u8 split_key[CAAM_MAX_HASH_KEY_SIZE];
+};
+
+static LIST_HEAD(key_cache);
+static LIST_HEAD(key_cache_lru);
+static unsigned int key_cache_lru_len;
+static DEFINE_SPINLOCK(key_cache_lock);
+
+/* take a reference, with key_cache_lock held */
+static void ahash_key_cache_hold(struct caam_hash_key *ck)
+{
+	if (!ck->users++) {
+		list_del(&ck->idle);
+		key_cache_lru_len--;
+	}
+}
+
+/* drop idle entries beyond max to evict, with key_cache_lock held */
+static void ahash_key_cache_trim(unsigned int max, struct list_head *evict)
+{
+	struct caam_hash_key *ck;
+
+	while (key_cache_lru_len > max) {
+		ck = list_last_entry(&key_cache_lru, struct caam_hash_key,
+				     idle);
+		list_del(&ck->entry);
+		list_move(&ck->idle, evict);
+		key_cache_lru_len--;
+	}
+}
+
+static void ahash_key_cache_free(struct list_head *evict)
+{
+	struct caam_hash_key *ck, *n;
+
+	list_for_each_entry_safe(ck, n, evict, idle)
+		kzfree(ck);
+}
+
+/* returns a referenced entry for the key, or NULL */
+static struct caam_hash_key *ahash_key_cache_get(struct caam_hash_ctx *ctx,
+						 const u8 *key,
+						 unsigned int keylen,
+						 u8 *split_key)
+{
+	struct caam_hash_key *ck;
+
+	spin_lock_bh(&key_cache_lock);
+	list_for_each_entry(ck, &key_cache, entry) {
+		if (ck->alg_op != ctx->alg_op || ck->keylen != keylen ||
+		    crypto_memneq(ck->key, key, keylen))
+			continue;
+
+		memcpy(split_key, ck->split_key, ctx->split_key_pad_len);
+		ahash_key_cache_hold(ck);
+		spin_unlock_bh(&key_cache_lock);
+		return ck;
+	}
+	spin_unlock_bh(&key_cache_lock);
+
+	return NULL;
+}
+
+/* add a new entry, returns it or the same key added meanwhile, referenced */
+static struct caam_hash_key *ahash_key_cache_put(struct caam_hash_key *new)
+{
+	struct caam_hash_key *ck;
+
+	spin_lock_bh(&key_cache_lock);
+	list_for_each_entry(ck, &key_cache, entry) {
+		if (ck->alg_op == new->alg_op && ck->keylen == new->keylen &&
+		    !crypto_memneq(ck->key, new->key, new->keylen)) {
+			/* set concurrently on another tfm */
+			ahash_key_cache_hold(ck);
+			spin_unlock_bh(&key_cache_lock);
+			kzfree(new);
+			return ck;
+		}
+	}
+
+	new->users = 1;
+	list_add(&new->entry, &key_cache);
+	spin_unlock_bh(&key_cache_lock);
+
+	return new;
+}
+
+static void ahash_key_cache_release(struct caam_hash_key *ck)
+{
+	LIST_HEAD(evict);
+
+	if (!ck)
+		return;
+
+	spin_lock_bh(&key_cache_lock);
+	if (!--ck->users) {
+		list_add(&ck->idle, &key_cache_lru);
+		key_cache_lru_len++;
+		ahash_key_cache_trim(key_cache_idle, &evict);
+	}
+	spin_unlock_bh(&key_cache_lock);
+
+	ahash_key_cache_free(&evict);
+}
+
+/* make ck the entry of the tfm's key, dropping the one of the last key */
+static void ahash_key_cache_switch(struct caam_hash_ctx *ctx,
+				   struct caam_hash_key *ck)
 {
-	return gen_split_key(ctx->jrdev, ctx->key, ctx->split_key_len,
-			       ctx->split_key_pad_len, key_in, keylen,
-			       ctx->alg_op);
+	struct caam_hash_key *old;
+
+	spin_lock_bh(&ctx->lock);
+	old = ctx->ck;
+	ctx->ck = ck;
+	spin_unlock_bh(&ctx->lock);
+
+	ahash_key_cache_release(old);
 }
 
 /* Digest hash size if it is too large */
@@ -518,6 +712,180 @@ static int hash_digest_key(struct caam_hash_ctx *ctx, const u8 *key_in,
 	return ret;
 }
 
+/*
+ * Install a split key: copy it to ctx->key, sync it and rebuild the shared
+ * descriptors. Called with ctx->lock held, so that a key job completing
+ * meanwhile cannot install an older key.
+ */
+static int ahash_set_key(struct crypto_ahash *ahash, const u8 *split_key)
+{
+	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
+
+	memcpy(ctx->key, split_key, ctx->split_key_pad_len);
+
+#ifdef DEBUG
+	print_hex_dump(KERN_ERR, "ctx.key@"__stringify(__LINE__)": ",
+		       DUMP_PREFIX_ADDRESS, 16, 4, ctx->key,
+		       ctx->split_key_pad_len, 1);
+#endif
+	dma_sync_single_for_device(ctx->jrdev, ctx->key_dma, sizeof(ctx->key),
+				   DMA_TO_DEVICE);
+
+	return ahash_set_sh_desc(ahash);
+}
+
+static inline struct ahash_request *
+ahash_state_req(struct caam_hash_state *state)
+{
+	return container_of((void *)state, struct ahash_request, __ctx);
+}
+
+/*
+ * Run an operation now, or hold it until the split key being generated
+ * is ready. Held requests are run from ctx->key_work once it is.
+ */
+static int ahash_key_wait(struct ahash_request *req,
+			  int (*op)(struct ahash_request *req))
+{
+	struct crypto_ahash *ahash = crypto_ahash_reqtfm(req);
+	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
+	struct caam_hash_state *state = ahash_request_ctx(req);
+	int err;
+
+	spin_lock_bh(&ctx->lock);
+	if (ctx->key_pending) {
+		state->deferred = op;
+		list_add_tail(&state->entry, &ctx->key_wait);
+		spin_unlock_bh(&ctx->lock);
+		return -EINPROGRESS;
+	}
+	err = ctx->key_err;
+	spin_unlock_bh(&ctx->lock);
+
+	if (unlikely(err))
+		return err;
+
+	return op(req);
+}
+
+/*
+ * Replay the held requests in process context, with the flags their
+ * callers gave: the key job completion cannot sleep or backlog for them.
+ */
+static void ahash_key_replay(struct work_struct *work)
+{
+	struct caam_hash_ctx *ctx = container_of(work, struct caam_hash_ctx,
+						 key_work);
+	struct caam_hash_state *state, *n;
+	struct ahash_request *req;
+	LIST_HEAD(held);
+	int err, ret;
+
+	spin_lock_bh(&ctx->lock);
+	/* rekeyed meanwhile, the next key releases them */
+	if (ctx->key_pending) {
+		spin_unlock_bh(&ctx->lock);
+		return;
+	}
+	err = ctx->key_err;
+	list_splice_init(&ctx->key_wait, &held);
+	spin_unlock_bh(&ctx->lock);
+
+	list_for_each_entry_safe(state, n, &held, entry) {
+		list_del(&state->entry);
+		req = ahash_state_req(state);
+
+		ret = err ? err : state->deferred(req);
+		if (ret != -EINPROGRESS)
+			req->base.complete(&req->base, ret);
+	}
+}
+
+/* the key of setkey generation gen is ready, or failed: release requests */
+static void ahash_key_ready(struct caam_hash_ctx *ctx, unsigned int gen,
+			    int err)
+{
+	spin_lock_bh(&ctx->lock);
+	/* superseded by a later setkey, whose job releases the requests */
+	if (gen != ctx->key_gen) {
+		spin_unlock_bh(&ctx->lock);
+		return;
+	}
+	ctx->key_pending = false;
+	ctx->key_err = err;
+	if (!list_empty(&ctx->key_wait))
+		schedule_work(&ctx->key_work);
+	spin_unlock_bh(&ctx->lock);
+}
+
+/*
+ * ahash_key_job - asynchronous split key generation
+ * @ahash: tfm being keyed
+ * @gen: setkey generation, a later setkey supersedes this job
+ * @ck: cache entry to fill, if the key can be cached
+ * @key: key, or digest of the key if longer than a block
+ * @split_key: split key output
+ * @hw_desc: the h/w job descriptor
+ */
+struct ahash_key_job {
+	struct crypto_ahash *ahash;
+	unsigned int gen;
+	struct caam_hash_key *ck;
+	dma_addr_t key_dma;
+	dma_addr_t split_key_dma;
+	unsigned int keylen;
+	u8 key[CAAM_MAX_HASH_BLOCK_SIZE] ____cacheline_aligned;
+	u8 split_key[CAAM_MAX_HASH_KEY_SIZE] ____cacheline_aligned;
+	u32 hw_desc[DESC_SPLIT_KEY_LEN / CAAM_CMD_SZ];
+};
+
+static void ahash_setkey_done(struct device *jrdev, u32 *desc, u32 err,
+			      void *context)
+{
+	struct ahash_key_job *job = context;
+	struct crypto_ahash *ahash = job->ahash;
+	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
+	struct caam_hash_key *ck = NULL, *old = NULL;
+	int ret = 0;
+
+	dma_unmap_single(jrdev, job->key_dma, job->keylen, DMA_TO_DEVICE);
+	dma_unmap_single(jrdev, job->split_key_dma, ctx->split_key_pad_len,
+			 DMA_FROM_DEVICE);
+
+	if (err) {
+		caam_jr_strstatus(jrdev, err);
+		ret = -EINVAL;
+	} else if (job->ck) {
+		memcpy(job->ck->split_key, job->split_key,
+		       ctx->split_key_pad_len);
+		ck = ahash_key_cache_put(job->ck);
+		job->ck = NULL;
+	}
+
+	spin_lock_bh(&ctx->lock);
+	if (job->gen == ctx->key_gen && !ret) {
+		ret = ahash_set_key(ahash, job->split_key);
+		if (!ret) {
+			old = ctx->ck;
+			ctx->ck = ck;
+			ck = NULL;
+		}
+	}
+	spin_unlock_bh(&ctx->lock);
+
+	/* superseded or failed keys are not kept */
+	ahash_key_cache_release(old);
+	ahash_key_cache_release(ck);
+
+	ahash_key_ready(ctx, job->gen, ret);
+
+	kzfree(job->ck);
+	kzfree(job);
+
+	if (atomic_dec_and_test(&ctx->key_jobs))
+		wake_up(&ctx->key_jobs_wq);
+}
+
 static int ahash_setkey(struct crypto_ahash *ahash,
 			const u8 *key, unsigned int keylen)
 {
@@ -527,23 +895,21 @@ static int ahash_setkey(struct crypto_ahash *ahash,
 	struct device *jrdev = ctx->jrdev;
 	int blocksize = crypto_tfm_alg_blocksize(&ahash->base);
 	int digestsize = crypto_ahash_digestsize(ahash);
+	struct ahash_key_job *job;
+	struct caam_hash_key *ck = NULL;
+	u8 split_key[CAAM_MAX_HASH_KEY_SIZE];
+	u32 job_keylen = keylen;
+	unsigned int gen;
 	int ret = 0;
-	u8 *hashed_key = NULL;
 
 #ifdef DEBUG
 	printk(KERN_ERR "keylen %d\n", keylen);
 #endif
 
-	if (keylen > blocksize) {
-		hashed_key = kmalloc(sizeof(u8) * digestsize, GFP_KERNEL |
-				     GFP_DMA);
-		if (!hashed_key)
-			return -ENOMEM;
-		ret = hash_digest_key(ctx, key, &keylen, hashed_key,
-				      digestsize);
+	if (ctx->fallback) {
+		ret = crypto_shash_setkey(ctx->fallback, key, keylen);
 		if (ret)
-			goto badkey;
-		key = hashed_key;
+			return ret;
 	}
 
 	/* Pick class 2 key length from algorithm submask */
@@ -558,34 +924,97 @@ static int ahash_setkey(struct crypto_ahash *ahash,
 		       DUMP_PREFIX_ADDRESS, 16, 4, key, keylen, 1);
 #endif
 
-	ret = gen_split_hash_key(ctx, key, keylen);
-	if (ret)
-		goto badkey;
+	if (keylen <= blocksize)
+		ck = ahash_key_cache_get(ctx, key, keylen, split_key);
+	if (ck) {
+		/* supersede any key job still in flight */
+		spin_lock_bh(&ctx->lock);
+		gen = ++ctx->key_gen;
+		ret = ahash_set_key(ahash, split_key);
+		spin_unlock_bh(&ctx->lock);
+
+		memzero_explicit(split_key, sizeof(split_key));
+		if (ret) {
+			ahash_key_cache_release(ck);
+			ck = NULL;
+		}
+		ahash_key_cache_switch(ctx, ck);
+		ahash_key_ready(ctx, gen, ret);
+		return ret;
+	}
+
+	/* the last key is not used any more */
+	ahash_key_cache_switch(ctx, NULL);
+
+	job = kzalloc(sizeof(*job), GFP_KERNEL | GFP_DMA);
+	if (!job)
+		return -ENOMEM;
 
-	ctx->key_dma = dma_map_single(jrdev, ctx->key, ctx->split_key_pad_len,
+	if (keylen > blocksize) {
+		ret = hash_digest_key(ctx, key, &job_keylen, job->key,
+				      digestsize);
+		if (ret)
+			goto badkey;
+	} else {
+		memcpy(job->key, key, keylen);
+
+		/* caching is best effort */
+		job->ck = kzalloc(sizeof(*job->ck), GFP_KERNEL);
+		if (job->ck) {
+			job->ck->alg_op = ctx->alg_op;
+			job->ck->keylen = keylen;
+			memcpy(job->ck->key, key, keylen);
+		}
+	}
+
+	job->ahash = ahash;
+	job->keylen = job_keylen;
+
+	job->key_dma = dma_map_single(jrdev, job->key, job->keylen,
 				      DMA_TO_DEVICE);
-	if (dma_mapping_error(jrdev, ctx->key_dma)) {
-		dev_err(jrdev, "unable to map key i/o memory\n");
+	if (dma_mapping_error(jrdev, job->key_dma)) {
+		dev_err(jrdev, "unable to map key input memory\n");
 		ret = -ENOMEM;
-		goto map_err;
+		goto free_job;
 	}
-#ifdef DEBUG
-	print_hex_dump(KERN_ERR, "ctx.key@"__stringify(__LINE__)": ",
-		       DUMP_PREFIX_ADDRESS, 16, 4, ctx->key,
-		       ctx->split_key_pad_len, 1);
-#endif
 
-	ret = ahash_set_sh_desc(ahash);
-	if (ret) {
-		dma_unmap_single(jrdev, ctx->key_dma, ctx->split_key_pad_len,
-				 DMA_TO_DEVICE);
+	job->split_key_dma = dma_map_single(jrdev, job->split_key,
+					    ctx->split_key_pad_len,
+					    DMA_FROM_DEVICE);
+	if (dma_mapping_error(jrdev, job->split_key_dma)) {
+		dev_err(jrdev, "unable to map key output memory\n");
+		ret = -ENOMEM;
+		goto unmap_key;
 	}
 
-map_err:
-	kfree(hashed_key);
+	init_split_key_job_desc(job->hw_desc, job->split_key_dma,
+				ctx->split_key_len, job->key_dma, job->keylen,
+				ctx->alg_op);
+
+	/* requests from now on wait for the job */
+	spin_lock_bh(&ctx->lock);
+	job->gen = ++ctx->key_gen;
+	ctx->key_pending = true;
+	spin_unlock_bh(&ctx->lock);
+
+	atomic_inc(&ctx->key_jobs);
+	ret = caam_jr_enqueue(jrdev, job->hw_desc, ahash_setkey_done, job);
+	if (!ret)
+		return 0;
+
+	atomic_dec(&ctx->key_jobs);
+	ahash_key_ready(ctx, job->gen, ret);
+	dma_unmap_single(jrdev, job->split_key_dma, ctx->split_key_pad_len,
+			 DMA_FROM_DEVICE);
+unmap_key:
+	dma_unmap_single(jrdev, job->key_dma, job->keylen, DMA_TO_DEVICE);
+free_job:
+	kzfree(job->ck);
+	kzfree(job);
 	return ret;
 badkey:
-	kfree(hashed_key);
+	kzfree(job->ck);
+	kzfree(job);
 	crypto_ahash_set_flags(ahash, CRYPTO_TFM_RES_BAD_KEY_LEN);
 	return -EINVAL;
 }
@@ -1077,7 +1506,7 @@ static int ahash_finup_ctx(struct ahash_request *req)
 	return ret;
 }
 
-static int ahash_digest(struct ahash_request *req)
+static int ahash_digest_job(struct ahash_request *req)
 {
 	struct crypto_ahash *ahash = crypto_ahash_reqtfm(req);
 	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
@@ -1156,6 +1585,252 @@ static int ahash_digest(struct ahash_request *req)
 	return ret;
 }
 
+/* Digest in software, for inputs too small to be worth a job */
+static int ahash_digest_fallback(struct ahash_request *req)
+{
+	struct crypto_ahash *ahash = crypto_ahash_reqtfm(req);
+	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
+	SHASH_DESC_ON_STACK(desc, ctx->fallback);
+	int ret;
+
+	desc->tfm = ctx->fallback;
+	desc->flags = req->base.flags & CRYPTO_TFM_REQ_MAY_SLEEP;
+
+	ret = shash_ahash_digest(req, desc);
+	memzero_explicit(shash_desc_ctx(desc),
+			 crypto_shash_descsize(ctx->fallback));
+
+	return ret;
+}
+
+/*
+ * ahash_batch - digests hashed by a single job
+ * @ctx: tfm context
+ * @nreqs: number of requests in the batch
+ * @reqs: the requests
+ * @dst_dma: physical mapped addresses of the req->result
+ * @hw_desc: the h/w job descriptor
+ */
+struct ahash_batch {
+	struct caam_hash_ctx *ctx;
+	int nreqs;
+	struct ahash_request *reqs[CAAM_HASH_BATCH_MAX];
+	dma_addr_t dst_dma[CAAM_HASH_BATCH_MAX];
+	u32 hw_desc[DESC_AHASH_BATCH_LEN / CAAM_CMD_SZ];
+};
+
+static bool ahash_batchable(struct ahash_request *req)
+{
+	return req->nbytes && req->nbytes <= CAAM_HASH_BATCH_BYTES &&
+	       req->src->length >= req->nbytes;
+}
+
+static void ahash_batch_unmap(struct device *jrdev, struct ahash_batch *batch,
+			      int nreqs)
+{
+	int digestsize = crypto_ahash_digestsize(
+				crypto_ahash_reqtfm(batch->reqs[0]));
+	int i;
+
+	for (i = 0; i < nreqs; i++) {
+		dma_unmap_sg(jrdev, batch->reqs[i]->src, 1, DMA_TO_DEVICE);
+		dma_unmap_single(jrdev, batch->dst_dma[i], digestsize,
+				 DMA_FROM_DEVICE);
+	}
+}
+
+static void ahash_batch_done(struct device *jrdev, u32 *desc, u32 err,
+			     void *context);
+
+/*
+ * Hash each request of the batch in turn: the split key is loaded once,
+ * and the class 2 CHA cleared, but for the key, between the requests.
+ */
+static int ahash_batch_submit(struct caam_hash_ctx *ctx,
+			      struct ahash_request **reqs, int nreqs)
+{
+	struct crypto_ahash *ahash = crypto_ahash_reqtfm(reqs[0]);
+	int digestsize = crypto_ahash_digestsize(ahash);
+	struct device *jrdev = ctx->jrdev;
+	struct ahash_batch *batch;
+	struct ahash_request *req;
+	u32 *desc, *jump_cmd;
+	u32 have_key = 0;
+	int i, ret;
+
+	batch = kmalloc(sizeof(*batch), GFP_ATOMIC);
+	if (!batch)
+		return -ENOMEM;
+
+	batch->ctx = ctx;
+	batch->nreqs = nreqs;
+	memcpy(batch->reqs, reqs, nreqs * sizeof(*reqs));
+
+	desc = batch->hw_desc;
+	init_job_desc(desc, 0);
+
+	if (ctx->split_key_len) {
+		append_key(desc, ctx->key_dma, ctx->split_key_len, CLASS_2 |
+			   KEY_DEST_MDHA_SPLIT | KEY_ENC);
+		have_key = OP_ALG_AAI_HMAC_PRECOMP;
+	}
+
+	for (i = 0; i < nreqs; i++) {
+		req = reqs[i];
+
+		if (!dma_map_sg(jrdev, req->src, 1, DMA_TO_DEVICE)) {
+			ret = -ENOMEM;
+			goto unmap;
+		}
+		batch->dst_dma[i] = dma_map_single(jrdev, req->result,
+						   digestsize, DMA_FROM_DEVICE);
+		if (dma_mapping_error(jrdev, batch->dst_dma[i])) {
+			dma_unmap_sg(jrdev, req->src, 1, DMA_TO_DEVICE);
+			ret = -ENOMEM;
+			goto unmap;
+		}
+
+		if (i) {
+			/* wait for class 2 done, then clear all but the key */
+			jump_cmd = append_jump(desc, JUMP_CLASS_CLASS2);
+			set_jump_tgt_here(desc, jump_cmd);
+			append_load_imm_u32(desc, CLRW_CLR_C2MODE |
+					    CLRW_CLR_C2DATAS | CLRW_CLR_C2CTX |
+					    CLRW_RESET_CLS2_DONE,
+					    LDST_SRCDST_WORD_CLRW);
+		}
+
+		append_operation(desc, ctx->alg_type | have_key |
+				 OP_ALG_AS_INITFINAL | OP_ALG_ENCRYPT);
+		append_fifo_load(desc, sg_dma_address(req->src), req->nbytes,
+				 FIFOLD_CLASS_CLASS2 | FIFOLD_TYPE_MSG |
+				 FIFOLD_TYPE_LAST2);
+		append_store(desc, batch->dst_dma[i], digestsize,
+			     LDST_CLASS_2_CCB | LDST_SRCDST_BYTE_CONTEXT);
+	}
+
+#ifdef DEBUG
+	print_hex_dump(KERN_ERR, "batch jobdesc@"__stringify(__LINE__)": ",
+		       DUMP_PREFIX_ADDRESS, 16, 4, desc, desc_bytes(desc), 1);
+#endif
+
+	ret = caam_jr_enqueue(jrdev, desc, ahash_batch_done, batch);
+	if (!ret)
+		return 0;
+unmap:
+	ahash_batch_unmap(jrdev, batch, i);
+	kfree(batch);
+	return ret;
+}
+
+/* Send the queued digests as the next batch, or mark the tfm idle */
+static void ahash_batch_next(struct caam_hash_ctx *ctx)
+{
+	struct ahash_request *reqs[CAAM_HASH_BATCH_MAX];
+	struct caam_hash_state *state;
+	int i, nreqs, ret;
+
+	do {
+		nreqs = 0;
+		spin_lock_bh(&ctx->lock);
+		while (nreqs < CAAM_HASH_BATCH_MAX &&
+		       !list_empty(&ctx->batch_queue)) {
+			state = list_first_entry(&ctx->batch_queue,
+						 struct caam_hash_state, entry);
+			list_del(&state->entry);
+			reqs[nreqs++] = ahash_state_req(state);
+		}
+		ctx->batch_len -= nreqs;
+		if (!nreqs)
+			ctx->batch_busy = false;
+		spin_unlock_bh(&ctx->lock);
+
+		if (!nreqs)
+			return;
+
+		ret = ahash_batch_submit(ctx, reqs, nreqs);
+		if (ret)
+			for (i = 0; i < nreqs; i++)
+				reqs[i]->base.complete(&reqs[i]->base, ret);
+	} while (ret);
+}
+
+static void ahash_batch_done(struct device *jrdev, u32 *desc, u32 err,
+			     void *context)
+{
+	struct ahash_batch *batch = context;
+	struct caam_hash_ctx *ctx = batch->ctx;
+	int i;
+
+#ifdef DEBUG
+	dev_err(jrdev, "%s %d: err 0x%x\n", __func__, __LINE__, err);
+#endif
+	if (err)
+		caam_jr_strstatus(jrdev, err);
+
+	ahash_batch_unmap(jrdev, batch, batch->nreqs);
+
+	for (i = 0; i < batch->nreqs; i++)
+		batch->reqs[i]->base.complete(&batch->reqs[i]->base, err);
+
+	kfree(batch);
+
+	ahash_batch_next(ctx);
+}
+
+/*
+ * Submit a small digest at once if no batch is in flight for the tfm,
+ * queue it for the next batch otherwise.
+ */
+static int ahash_digest_batch(struct ahash_request *req)
+{
+	struct crypto_ahash *ahash = crypto_ahash_reqtfm(req);
+	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
+	struct caam_hash_state *state = ahash_request_ctx(req);
+	int ret;
+
+	spin_lock_bh(&ctx->lock);
+	if (ctx->batch_busy) {
+		if (ctx->batch_len >= CAAM_HASH_BATCH_QUEUE) {
+			spin_unlock_bh(&ctx->lock);
+			return ahash_digest_job(req);
+		}
+		list_add_tail(&state->entry, &ctx->batch_queue);
+		ctx->batch_len++;
+		spin_unlock_bh(&ctx->lock);
+		return -EINPROGRESS;
+	}
+	ctx->batch_busy = true;
+	spin_unlock_bh(&ctx->lock);
+
+	ret = ahash_batch_submit(ctx, &req, 1);
+	if (ret) {
+		ahash_batch_next(ctx);
+		return ret;
+	}
+
+	return -EINPROGRESS;
+}
+
+static int ahash_do_digest(struct ahash_request *req)
+{
+	struct crypto_ahash *ahash = crypto_ahash_reqtfm(req);
+	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
+
+	if (ctx->fallback && req->nbytes <= ACCESS_ONCE(fallback_thld))
+		return ahash_digest_fallback(req);
+
+	if (ahash_batchable(req))
+		return ahash_digest_batch(req);
+
+	return ahash_digest_job(req);
+}
+
+static int ahash_digest(struct ahash_request *req)
+{
+	return ahash_key_wait(req, ahash_do_digest);
+}
+
 /* submit ahash final if it the first job descriptor */
 static int ahash_final_no_ctx(struct ahash_request *req)
 {
@@ -1541,7 +2216,7 @@ static int ahash_update_first(struct ahash_request *req)
 
 static int ahash_finup_first(struct ahash_request *req)
 {
-	return ahash_digest(req);
+	return ahash_do_digest(req);
 }
 
 static int ahash_init(struct ahash_request *req)
@@ -1564,44 +2239,57 @@ static int ahash_update(struct ahash_request *req)
 {
 	struct caam_hash_state *state = ahash_request_ctx(req);
 
-	return state->update(req);
+	return ahash_key_wait(req, state->update);
 }
 
 static int ahash_finup(struct ahash_request *req)
 {
 	struct caam_hash_state *state = ahash_request_ctx(req);
 
-	return state->finup(req);
+	return ahash_key_wait(req, state->finup);
 }
 
 static int ahash_final(struct ahash_request *req)
 {
 	struct caam_hash_state *state = ahash_request_ctx(req);
 
-	return state->final(req);
+	return ahash_key_wait(req, state->final);
 }
 
+/*
+ * The tfm context holds the key, locks and queues: export the request
+ * state only, in struct caam_export_state as announced by statesize.
+ */
 static int ahash_export(struct ahash_request *req, void *out)
 {
-	struct crypto_ahash *ahash = crypto_ahash_reqtfm(req);
-	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
 	struct caam_hash_state *state = ahash_request_ctx(req);
+	struct caam_export_state *export = out;
+	u8 *buf = state->current_buf ? state->buf_1 : state->buf_0;
+	int buflen = state->current_buf ? state->buflen_1 : state->buflen_0;
+
+	memcpy(export->buf, buf, buflen);
+	memcpy(export->caam_ctx, state->caam_ctx, sizeof(export->caam_ctx));
+	export->buflen = buflen;
+	export->update = state->update;
+	export->final = state->final;
+	export->finup = state->finup;
 
-	memcpy(out, ctx, sizeof(struct caam_hash_ctx));
-	memcpy(out + sizeof(struct caam_hash_ctx), state,
-	       sizeof(struct caam_hash_state));
 	return 0;
 }
 
 static int ahash_import(struct ahash_request *req, const void *in)
 {
-	struct crypto_ahash *ahash = crypto_ahash_reqtfm(req);
-	struct caam_hash_ctx *ctx = crypto_ahash_ctx(ahash);
 	struct caam_hash_state *state = ahash_request_ctx(req);
+	const struct caam_export_state *export = in;
+
+	memset(state, 0, sizeof(*state));
+	memcpy(state->buf_0, export->buf, export->buflen);
+	memcpy(state->caam_ctx, export->caam_ctx, sizeof(state->caam_ctx));
+	state->buflen_0 = export->buflen;
+	state->update = export->update;
+	state->final = export->final;
+	state->finup = export->finup;
 
-	memcpy(ctx, in, sizeof(struct caam_hash_ctx));
-	memcpy(state, in + sizeof(struct caam_hash_ctx),
-	       sizeof(struct caam_hash_state));
 	return 0;
 }
 
@@ -1760,6 +2448,34 @@ struct caam_hash_alg {
 	struct ahash_alg ahash_alg;
 };
 
+/* undo the mappings of ahash_map_sh_desc() */
+static void ahash_unmap_sh_descs(struct caam_hash_ctx *ctx)
+{
+	if (ctx->sh_desc_update_dma &&
+	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_update_dma))
+		dma_unmap_single(ctx->jrdev, ctx->sh_desc_update_dma,
+				 sizeof(ctx->sh_desc_update),
+				 DMA_TO_DEVICE);
+	if (ctx->sh_desc_update_first_dma &&
+	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_update_first_dma))
+		dma_unmap_single(ctx->jrdev, ctx->sh_desc_update_first_dma,
+				 sizeof(ctx->sh_desc_update_first),
+				 DMA_TO_DEVICE);
+	if (ctx->sh_desc_fin_dma &&
+	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_fin_dma))
+		dma_unmap_single(ctx->jrdev, ctx->sh_desc_fin_dma,
+				 sizeof(ctx->sh_desc_fin), DMA_TO_DEVICE);
+	if (ctx->sh_desc_digest_dma &&
+	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_digest_dma))
+		dma_unmap_single(ctx->jrdev, ctx->sh_desc_digest_dma,
+				 sizeof(ctx->sh_desc_digest),
+				 DMA_TO_DEVICE);
+	if (ctx->sh_desc_finup_dma &&
+	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_finup_dma))
+		dma_unmap_single(ctx->jrdev, ctx->sh_desc_finup_dma,
+				 sizeof(ctx->sh_desc_finup), DMA_TO_DEVICE);
+}
+
 static int caam_hash_cra_init(struct crypto_tfm *tfm)
 {
 	struct crypto_ahash *ahash = __crypto_ahash_cast(tfm);
@@ -1799,8 +2515,47 @@ static int caam_hash_cra_init(struct crypto_tfm *tfm)
 	crypto_ahash_set_reqsize(__crypto_ahash_cast(tfm),
 				 sizeof(struct caam_hash_state));
 
+	spin_lock_init(&ctx->lock);
+	INIT_LIST_HEAD(&ctx->key_wait);
+	INIT_WORK(&ctx->key_work, ahash_key_replay);
+	atomic_set(&ctx->key_jobs, 0);
+	init_waitqueue_head(&ctx->key_jobs_wq);
+	INIT_LIST_HEAD(&ctx->batch_queue);
+
+	ctx->key_dma = dma_map_single(ctx->jrdev, ctx->key, sizeof(ctx->key),
+				      DMA_TO_DEVICE);
+	if (dma_mapping_error(ctx->jrdev, ctx->key_dma)) {
+		dev_err(ctx->jrdev, "unable to map key i/o memory\n");
+		ctx->key_dma = 0;
+		caam_jr_free(ctx->jrdev);
+		return -ENOMEM;
+	}
+
+	/*
+	 * Software implementation for small digests; being synchronous,
+	 * this cannot be an ahash driver, such as this one.
+	 */
+	ctx->fallback = crypto_alloc_shash(crypto_tfm_alg_name(tfm), 0, 0);
+	if (IS_ERR(ctx->fallback)) {
+		dev_dbg(ctx->jrdev, "no software fallback for %s\n",
+			crypto_tfm_alg_name(tfm));
+		ctx->fallback = NULL;
+	}
+
 	ret = ahash_set_sh_desc(ahash);
+	if (ret)
+		goto unwind;
+
+	return 0;
 
+unwind:
+	/* cra_exit is not called for a failed cra_init */
+	ahash_unmap_sh_descs(ctx);
+	if (ctx->fallback)
+		crypto_free_shash(ctx->fallback);
+	dma_unmap_single(ctx->jrdev, ctx->key_dma, sizeof(ctx->key),
+			 DMA_TO_DEVICE);
+	caam_jr_free(ctx->jrdev);
 	return ret;
 }
 
@@ -1808,29 +2563,18 @@ static void caam_hash_cra_exit(struct crypto_tfm *tfm)
 {
 	struct caam_hash_ctx *ctx = crypto_tfm_ctx(tfm);
 
-	if (ctx->sh_desc_update_dma &&
-	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_update_dma))
-		dma_unmap_single(ctx->jrdev, ctx->sh_desc_update_dma,
-				 desc_bytes(ctx->sh_desc_update),
-				 DMA_TO_DEVICE);
-	if (ctx->sh_desc_update_first_dma &&
-	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_update_first_dma))
-		dma_unmap_single(ctx->jrdev, ctx->sh_desc_update_first_dma,
-				 desc_bytes(ctx->sh_desc_update_first),
-				 DMA_TO_DEVICE);
-	if (ctx->sh_desc_fin_dma &&
-	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_fin_dma))
-		dma_unmap_single(ctx->jrdev, ctx->sh_desc_fin_dma,
-				 desc_bytes(ctx->sh_desc_fin), DMA_TO_DEVICE);
-	if (ctx->sh_desc_digest_dma &&
-	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_digest_dma))
-		dma_unmap_single(ctx->jrdev, ctx->sh_desc_digest_dma,
-				 desc_bytes(ctx->sh_desc_digest),
+	/* key jobs superseded by a later setkey may still be in flight */
+	wait_event(ctx->key_jobs_wq, !atomic_read(&ctx->key_jobs));
+	flush_work(&ctx->key_work);
+	ahash_key_cache_release(ctx->ck);
+
+	if (ctx->fallback)
+		crypto_free_shash(ctx->fallback);
+	if (ctx->key_dma)
+		dma_unmap_single(ctx->jrdev, ctx->key_dma, sizeof(ctx->key),
 				 DMA_TO_DEVICE);
-	if (ctx->sh_desc_finup_dma &&
-	    !dma_mapping_error(ctx->jrdev, ctx->sh_desc_finup_dma))
-		dma_unmap_single(ctx->jrdev, ctx->sh_desc_finup_dma,
-				 desc_bytes(ctx->sh_desc_finup), DMA_TO_DEVICE);
+
+	ahash_unmap_sh_descs(ctx);
 
 	caam_jr_free(ctx->jrdev);
 }
@@ -1838,6 +2582,7 @@ static void caam_hash_cra_exit(struct crypto_tfm *tfm)
 static void __exit caam_algapi_hash_exit(void)
 {
 	struct caam_hash_alg *t_alg, *n;
+	LIST_HEAD(evict);
 
 	if (!hash_list.next)
 		return;
@@ -1847,6 +2592,12 @@ static void __exit caam_algapi_hash_exit(void)
 		list_del(&t_alg->entry);
 		kfree(t_alg);
 	}
+
+	/* no tfm is left, every entry is idle */
+	spin_lock_bh(&key_cache_lock);
+	ahash_key_cache_trim(0, &evict);
+	spin_unlock_bh(&key_cache_lock);
+	ahash_key_cache_free(&evict);
 }
 
 static struct caam_hash_alg *
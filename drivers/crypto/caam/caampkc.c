@@ -0,0 +1,765 @@
+/*
+ * caam - Freescale FSL CAAM support for public key operations
+ *
+ * Registers the PKHA of the SEC as public key engine (crypto/pkc.h).
+ * Every operation is a short job descriptor that loads its operands into
+ * the PKHA registers, runs one or more PKHA functions and stores the
+ * result:
+ *
+ * mod_exp:	N = n, A = a; A = A mod N; E = e; B = A^E mod N
+ * ecc_mul:	N = p, A0/A1 = x/y, A3 = a, B0 = b, E = k; B1/B2 = k * (x, y)
+ *
+ * RSA private key operations use the CRT form: the two half-size
+ * exponentiations run as separate jobs, so they can be picked up by two
+ * DECOs at the same time, and a third job computes
+ * h = qinv * (m1 - m2) mod p. Only the final m2 + h * q, a plain
+ * multiply-add, is done by the CPU.
+ *
+ * Exponentiation and point multiplication run with timing equalization,
+ * as the exponent or scalar is usually secret. The engine is registered
+ * only once known answer tests of all three operations have passed.
+ */
+
+#include "compat.h"
+
+#include <linux/delay.h>
+#include <crypto/pkc.h>
+
+#include "regs.h"
+#include "intern.h"
+#include "desc_constr.h"
+#include "jr.h"
+#include "error.h"
+
+/* PKHA registers hold up to 4096 bits, ECC operands are quarter segments */
+#define CAAM_PKC_MAX_BITS		4096
+#define CAAM_PKC_ECC_MAX_BITS		(CAAM_PKC_MAX_BITS / 4)
+
+#define DESC_PKC_LEN			32
+
+/* retries while the job ring is full */
+#define CAAM_PKC_BUSY_RETRIES		100
+
+#define PKHA_OP(fn)			(OP_TYPE_PK | OP_ALG_PK | (fn))
+#define PKHA_LOAD(reg)			(FIFOLD_CLASS_CLASS1 | FIFOLD_TYPE_PK | \
+					 FIFOLD_TYPE_PK_##reg)
+
+struct caam_pkc_job {
+	struct completion completion;
+	int err;
+	u32 hw_desc[DESC_PKC_LEN];
+};
+
+/*
+ * All operands of an operation are copied into one DMA buffer, so a single
+ * mapping covers every job the operation runs.
+ */
+struct caam_pkc_buf {
+	u8 *virt;
+	dma_addr_t dma;
+	unsigned int len;
+	unsigned int used;
+};
+
+static void caam_pkc_done(struct device *jrdev, u32 *desc, u32 err,
+			  void *context)
+{
+	struct caam_pkc_job *job = context;
+
+	job->err = 0;
+	if (err) {
+		caam_jr_strstatus(jrdev, err);
+		job->err = -EINVAL;
+	}
+
+	complete(&job->completion);
+}
+
+static int caam_pkc_enqueue(struct device *jrdev, struct caam_pkc_job *job)
+{
+	int retries = CAAM_PKC_BUSY_RETRIES;
+	int ret;
+
+	init_completion(&job->completion);
+
+	do {
+		ret = caam_jr_enqueue(jrdev, job->hw_desc, caam_pkc_done, job);
+		if (ret != -EBUSY)
+			break;
+		usleep_range(50, 100);
+	} while (--retries);
+
+	return ret;
+}
+
+static int caam_pkc_wait(struct caam_pkc_job *job)
+{
+	wait_for_completion(&job->completion);
+
+	return job->err;
+}
+
+/* drop leading zeroes, the PKHA sizes its registers from the operands */
+static void caam_pkc_strip(const u8 **num, unsigned int *len)
+{
+	while (*len && !**num) {
+		(*num)++;
+		(*len)--;
+	}
+}
+
+static int caam_pkc_buf_alloc(struct caam_pkc_buf *buf, unsigned int len)
+{
+	buf->virt = kzalloc(len, GFP_KERNEL | GFP_DMA);
+	if (!buf->virt)
+		return -ENOMEM;
+
+	buf->len = len;
+	buf->used = 0;
+
+	return 0;
+}
+
+/* reserve len bytes, filled from num if given; returns the offset */
+static unsigned int caam_pkc_buf_add(struct caam_pkc_buf *buf, const u8 *num,
+				     unsigned int len)
+{
+	unsigned int off = buf->used;
+
+	if (num)
+		memcpy(buf->virt + off, num, len);
+	buf->used += ALIGN(len, 4);
+
+	return off;
+}
+
+static int caam_pkc_buf_map(struct device *jrdev, struct caam_pkc_buf *buf)
+{
+	buf->dma = dma_map_single(jrdev, buf->virt, buf->used,
+				  DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(jrdev, buf->dma)) {
+		dev_err(jrdev, "unable to map pkc operands\n");
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void caam_pkc_buf_unmap(struct device *jrdev, struct caam_pkc_buf *buf)
+{
+	dma_unmap_single(jrdev, buf->dma, buf->used, DMA_BIDIRECTIONAL);
+}
+
+static void caam_pkc_buf_free(struct caam_pkc_buf *buf)
+{
+	kzfree(buf->virt);
+}
+
+/* copy a result right-aligned into a zero-padded output */
+static void caam_pkc_copy_out(u8 *out, unsigned int out_len, const u8 *res,
+			      unsigned int res_len)
+{
+	memset(out, 0, out_len - res_len);
+	memcpy(out + out_len - res_len, res, res_len);
+}
+
+/* job: B = ((A mod N) ^ E) mod N, stored to out */
+static void caam_pkc_init_exp(u32 *desc, struct caam_pkc_buf *buf,
+			      unsigned int n, unsigned int n_len,
+			      unsigned int a, unsigned int a_len,
+			      unsigned int e, unsigned int e_len,
+			      unsigned int out)
+{
+	init_job_desc(desc, 0);
+	append_fifo_load(desc, buf->dma + n, n_len, PKHA_LOAD(N));
+	append_fifo_load(desc, buf->dma + a, a_len, PKHA_LOAD(A));
+	append_operation(desc, PKHA_OP(OP_ALG_PKMODE_MOD_REDUCT |
+				       OP_ALG_PKMODE_OUT_A));
+	append_key(desc, buf->dma + e, e_len, CLASS_1 | KEY_DEST_PKHA_E);
+	append_operation(desc, PKHA_OP(OP_ALG_PKMODE_MOD_EXPO |
+				       OP_ALG_PKMODE_TIME_EQ));
+	append_fifo_store(desc, buf->dma + out, n_len, FIFOST_TYPE_PKHA_B);
+}
+
+static int caam_pkc_mod_exp(struct pkc_mod_exp_req *req)
+{
+	const u8 *a = req->a, *e = req->e, *n = req->n;
+	unsigned int a_len = req->a_len, e_len = req->e_len;
+	unsigned int n_len = req->n_len;
+	unsigned int a_off, e_off, n_off, out_off;
+	struct caam_pkc_job *job;
+	struct caam_pkc_buf buf;
+	struct device *jrdev;
+	int ret;
+
+	caam_pkc_strip(&a, &a_len);
+	caam_pkc_strip(&e, &e_len);
+	caam_pkc_strip(&n, &n_len);
+	if (!n_len || !e_len || a_len > req->n_len)
+		return -EINVAL;
+
+	/* the PKHA refuses a zero base, the result is known anyway */
+	if (!a_len) {
+		memset(req->out, 0, req->n_len);
+		return 0;
+	}
+
+	job = kmalloc(sizeof(*job), GFP_KERNEL | GFP_DMA);
+	if (!job)
+		return -ENOMEM;
+
+	ret = caam_pkc_buf_alloc(&buf, ALIGN(n_len, 4) * 2 + ALIGN(a_len, 4) +
+				 ALIGN(e_len, 4));
+	if (ret)
+		goto out_job;
+
+	n_off = caam_pkc_buf_add(&buf, n, n_len);
+	a_off = caam_pkc_buf_add(&buf, a, a_len);
+	e_off = caam_pkc_buf_add(&buf, e, e_len);
+	out_off = caam_pkc_buf_add(&buf, NULL, n_len);
+
+	jrdev = caam_jr_alloc();
+	if (IS_ERR(jrdev)) {
+		ret = PTR_ERR(jrdev);
+		goto out_buf;
+	}
+
+	ret = caam_pkc_buf_map(jrdev, &buf);
+	if (ret)
+		goto out_jr;
+
+	caam_pkc_init_exp(job->hw_desc, &buf, n_off, n_len, a_off, a_len,
+			  e_off, e_len, out_off);
+
+	ret = caam_pkc_enqueue(jrdev, job);
+	if (!ret)
+		ret = caam_pkc_wait(job);
+
+	caam_pkc_buf_unmap(jrdev, &buf);
+
+	if (!ret)
+		caam_pkc_copy_out(req->out, req->n_len, buf.virt + out_off,
+				  n_len);
+out_jr:
+	caam_jr_free(jrdev);
+out_buf:
+	caam_pkc_buf_free(&buf);
+out_job:
+	kfree(job);
+	return ret;
+}
+
+/* out = m2 + h * q, all big-endian; the result fits n = p * q */
+static void caam_pkc_crt_combine(u8 *out, unsigned int out_len,
+				 const u8 *h, unsigned int h_len,
+				 const u8 *q, unsigned int q_len,
+				 const u8 *m2, unsigned int m2_len, u32 *acc)
+{
+	unsigned int i, j;
+	u32 carry = 0;
+
+	/* acc[k] collects the products of weight 256^k */
+	memset(acc, 0, out_len * sizeof(*acc));
+
+	/* no shortcut on zero bytes of h: the timing must not depend on it */
+	for (i = 0; i < h_len && i < out_len; i++) {
+		u32 hi = h[h_len - 1 - i];
+
+		for (j = 0; j < q_len && i + j < out_len; j++)
+			acc[i + j] += hi * q[q_len - 1 - j];
+	}
+
+	for (i = 0; i < m2_len && i < out_len; i++)
+		acc[i] += m2[m2_len - 1 - i];
+
+	for (i = 0; i < out_len; i++) {
+		carry += acc[i];
+		out[out_len - 1 - i] = carry & 0xff;
+		carry >>= 8;
+	}
+}
+
+static int caam_pkc_mod_exp_crt(struct pkc_mod_exp_crt_req *req)
+{
+	const u8 *a = req->a, *p = req->p, *q = req->q;
+	const u8 *dp = req->dp, *dq = req->dq, *qinv = req->qinv;
+	unsigned int a_len = req->a_len, p_len = req->p_len;
+	unsigned int q_len = req->q_len, dp_len = req->dp_len;
+	unsigned int dq_len = req->dq_len, qinv_len = req->qinv_len;
+	unsigned int a_off, p_off, q_off, dp_off, dq_off, qinv_off;
+	unsigned int m1_off, m2_off, h_off;
+	struct caam_pkc_job *jobs;
+	struct caam_pkc_buf buf;
+	struct device *jrdev;
+	u32 *desc;
+	u32 *acc;
+	int ret, ret2;
+
+	caam_pkc_strip(&a, &a_len);
+	caam_pkc_strip(&p, &p_len);
+	caam_pkc_strip(&q, &q_len);
+	caam_pkc_strip(&dp, &dp_len);
+	caam_pkc_strip(&dq, &dq_len);
+	caam_pkc_strip(&qinv, &qinv_len);
+	if (!p_len || !q_len || !dp_len || !dq_len || !qinv_len ||
+	    p_len + q_len > req->out_len || a_len > req->out_len)
+		return -EINVAL;
+
+	if (!a_len) {
+		memset(req->out, 0, req->out_len);
+		return 0;
+	}
+
+	jobs = kmalloc(sizeof(*jobs) * 3, GFP_KERNEL | GFP_DMA);
+	if (!jobs)
+		return -ENOMEM;
+
+	acc = kmalloc_array(req->out_len, sizeof(*acc), GFP_KERNEL);
+	if (!acc) {
+		ret = -ENOMEM;
+		goto out_jobs;
+	}
+
+	ret = caam_pkc_buf_alloc(&buf, ALIGN(a_len, 4) +
+				 ALIGN(p_len, 4) * 3 + ALIGN(q_len, 4) * 2 +
+				 ALIGN(dp_len, 4) + ALIGN(dq_len, 4) +
+				 ALIGN(qinv_len, 4));
+	if (ret)
+		goto out_acc;
+
+	a_off = caam_pkc_buf_add(&buf, a, a_len);
+	p_off = caam_pkc_buf_add(&buf, p, p_len);
+	q_off = caam_pkc_buf_add(&buf, q, q_len);
+	dp_off = caam_pkc_buf_add(&buf, dp, dp_len);
+	dq_off = caam_pkc_buf_add(&buf, dq, dq_len);
+	qinv_off = caam_pkc_buf_add(&buf, qinv, qinv_len);
+	m1_off = caam_pkc_buf_add(&buf, NULL, p_len);
+	m2_off = caam_pkc_buf_add(&buf, NULL, q_len);
+	h_off = caam_pkc_buf_add(&buf, NULL, p_len);
+
+	jrdev = caam_jr_alloc();
+	if (IS_ERR(jrdev)) {
+		ret = PTR_ERR(jrdev);
+		goto out_buf;
+	}
+
+	ret = caam_pkc_buf_map(jrdev, &buf);
+	if (ret)
+		goto out_jr;
+
+	/* m1 = a^dp mod p, m2 = a^dq mod q, both in flight at once */
+	caam_pkc_init_exp(jobs[0].hw_desc, &buf, p_off, p_len, a_off, a_len,
+			  dp_off, dp_len, m1_off);
+	caam_pkc_init_exp(jobs[1].hw_desc, &buf, q_off, q_len, a_off, a_len,
+			  dq_off, dq_len, m2_off);
+
+	ret = caam_pkc_enqueue(jrdev, &jobs[0]);
+	if (ret)
+		goto out_unmap;
+
+	ret = caam_pkc_enqueue(jrdev, &jobs[1]);
+	ret2 = caam_pkc_wait(&jobs[0]);
+	if (!ret)
+		ret = caam_pkc_wait(&jobs[1]);
+	if (!ret)
+		ret = ret2;
+	if (ret)
+		goto out_unmap;
+
+	/* h = qinv * (m1 - m2 mod p) mod p */
+	desc = jobs[2].hw_desc;
+	init_job_desc(desc, 0);
+	append_fifo_load(desc, buf.dma + p_off, p_len, PKHA_LOAD(N));
+	append_fifo_load(desc, buf.dma + m2_off, q_len, PKHA_LOAD(A));
+	append_operation(desc, PKHA_OP(OP_ALG_PKMODE_MOD_REDUCT));
+	append_fifo_load(desc, buf.dma + m1_off, p_len, PKHA_LOAD(A));
+	append_operation(desc, PKHA_OP(OP_ALG_PKMODE_MOD_SUB_AB));
+	append_fifo_load(desc, buf.dma + qinv_off, qinv_len, PKHA_LOAD(A));
+	append_operation(desc, PKHA_OP(OP_ALG_PKMODE_MOD_MULT));
+	append_fifo_store(desc, buf.dma + h_off, p_len, FIFOST_TYPE_PKHA_B);
+
+	ret = caam_pkc_enqueue(jrdev, &jobs[2]);
+	if (!ret)
+		ret = caam_pkc_wait(&jobs[2]);
+
+out_unmap:
+	caam_pkc_buf_unmap(jrdev, &buf);
+
+	if (!ret)
+		caam_pkc_crt_combine(req->out, req->out_len,
+				     buf.virt + h_off, p_len, q, q_len,
+				     buf.virt + m2_off, q_len, acc);
+out_jr:
+	caam_jr_free(jrdev);
+out_buf:
+	caam_pkc_buf_free(&buf);
+out_acc:
+	kzfree(acc);
+out_jobs:
+	kfree(jobs);
+	return ret;
+}
+
+static int caam_pkc_ecc_mul(struct pkc_ecc_mul_req *req)
+{
+	const u8 *k = req->k;
+	unsigned int k_len = req->k_len, p_len = req->p_len;
+	unsigned int p_off, x_off, y_off, a_off, b_off, k_off;
+	unsigned int rx_off, ry_off;
+	struct caam_pkc_job *job;
+	struct caam_pkc_buf buf;
+	struct device *jrdev;
+	u32 *desc;
+	int ret;
+
+	caam_pkc_strip(&k, &k_len);
+	if (!p_len || !req->p[0] || !k_len ||
+	    p_len * 8 > CAAM_PKC_ECC_MAX_BITS)
+		return -EINVAL;
+
+	job = kmalloc(sizeof(*job), GFP_KERNEL | GFP_DMA);
+	if (!job)
+		return -ENOMEM;
+
+	ret = caam_pkc_buf_alloc(&buf, ALIGN(p_len, 4) * 7 + ALIGN(k_len, 4));
+	if (ret)
+		goto out_job;
+
+	p_off = caam_pkc_buf_add(&buf, req->p, p_len);
+	x_off = caam_pkc_buf_add(&buf, req->x, p_len);
+	y_off = caam_pkc_buf_add(&buf, req->y, p_len);
+	a_off = caam_pkc_buf_add(&buf, req->a, p_len);
+	b_off = caam_pkc_buf_add(&buf, req->b, p_len);
+	k_off = caam_pkc_buf_add(&buf, k, k_len);
+	rx_off = caam_pkc_buf_add(&buf, NULL, p_len);
+	ry_off = caam_pkc_buf_add(&buf, NULL, p_len);
+
+	jrdev = caam_jr_alloc();
+	if (IS_ERR(jrdev)) {
+		ret = PTR_ERR(jrdev);
+		goto out_buf;
+	}
+
+	ret = caam_pkc_buf_map(jrdev, &buf);
+	if (ret)
+		goto out_jr;
+
+	/* the point at infinity as result is reported as an error */
+	desc = job->hw_desc;
+	init_job_desc(desc, 0);
+	append_fifo_load(desc, buf.dma + p_off, p_len, PKHA_LOAD(N));
+	append_fifo_load(desc, buf.dma + x_off, p_len, PKHA_LOAD(A0));
+	append_fifo_load(desc, buf.dma + y_off, p_len, PKHA_LOAD(A1));
+	append_fifo_load(desc, buf.dma + a_off, p_len, PKHA_LOAD(A3));
+	append_fifo_load(desc, buf.dma + b_off, p_len, PKHA_LOAD(B0));
+	append_key(desc, buf.dma + k_off, k_len, CLASS_1 | KEY_DEST_PKHA_E);
+	append_operation(desc, PKHA_OP(OP_ALG_PKMODE_MOD_ECC_MULT |
+				       OP_ALG_PKMODE_TIME_EQ));
+	append_fifo_store(desc, buf.dma + rx_off, p_len, FIFOST_TYPE_PKHA_B1);
+	append_fifo_store(desc, buf.dma + ry_off, p_len, FIFOST_TYPE_PKHA_B2);
+
+	ret = caam_pkc_enqueue(jrdev, job);
+	if (!ret)
+		ret = caam_pkc_wait(job);
+
+	caam_pkc_buf_unmap(jrdev, &buf);
+
+	if (!ret) {
+		memcpy(req->rx, buf.virt + rx_off, p_len);
+		memcpy(req->ry, buf.virt + ry_off, p_len);
+	}
+out_jr:
+	caam_jr_free(jrdev);
+out_buf:
+	caam_pkc_buf_free(&buf);
+out_job:
+	kfree(job);
+	return ret;
+}
+
+static struct pkc_engine caam_pkc_engine = {
+	.name		= "caam-pkha",
+	.features	= PKC_F_MOD_EXP | PKC_F_MOD_EXP_CRT | PKC_F_ECC_MUL,
+	.max_bits	= CAAM_PKC_MAX_BITS,
+	.mod_exp	= caam_pkc_mod_exp,
+	.mod_exp_crt	= caam_pkc_mod_exp_crt,
+	.ecc_mul	= caam_pkc_ecc_mul,
+};
+
+/*
+ * Known answer tests, run before the engine is registered: nothing else
+ * checks the PKHA descriptor sequences. A 512-bit RSA key encrypts m to c
+ * with mod_exp and decrypts c back to m with the CRT, which also covers
+ * the h = qinv * (m1 - m2) job and the combination on the CPU, and k * G
+ * on P-256 checks the operand layout of ECC_MULT.
+ */
+static const u8 caam_pkc_kat_e[] __initconst = { 0x01, 0x00, 0x01 };
+
+static const u8 caam_pkc_kat_n[] __initconst = {
+	0xb6, 0xf3, 0x5f, 0xba, 0x69, 0x0e, 0x97, 0x5d,
+	0x82, 0x96, 0x26, 0x3e, 0x63, 0xe0, 0x38, 0xb9,
+	0x36, 0xa7, 0xde, 0xc0, 0xae, 0xb2, 0xe2, 0x2a,
+	0x19, 0x55, 0xf8, 0xd5, 0x8e, 0x0a, 0x53, 0xee,
+	0x77, 0x7c, 0xe4, 0x28, 0x2b, 0xbb, 0x34, 0x7a,
+	0x01, 0x78, 0xd5, 0xb4, 0xac, 0x18, 0x3d, 0xe4,
+	0xa9, 0x2f, 0x8c, 0xa3, 0x7d, 0xf2, 0xb3, 0x8e,
+	0x7d, 0x89, 0xe1, 0x08, 0x35, 0xd4, 0xa0, 0xc7,
+};
+
+static const u8 caam_pkc_kat_p[] __initconst = {
+	0xde, 0xbf, 0x5a, 0x0a, 0x22, 0xfd, 0x7e, 0x35,
+	0x01, 0x48, 0x34, 0x42, 0x80, 0x44, 0x11, 0xba,
+	0x68, 0x53, 0x93, 0x82, 0x2d, 0xdc, 0x8b, 0x9f,
+	0x4c, 0x3f, 0xa6, 0x19, 0xbf, 0x8d, 0x33, 0x07,
+};
+
+static const u8 caam_pkc_kat_q[] __initconst = {
+	0xd2, 0x43, 0x1f, 0xef, 0x76, 0x8d, 0x5c, 0xf8,
+	0xf0, 0x85, 0x45, 0xe7, 0x7e, 0x31, 0x0e, 0x6b,
+	0x1c, 0x38, 0x94, 0x18, 0x3c, 0x28, 0x0b, 0x71,
+	0x96, 0xb9, 0x80, 0x2c, 0x40, 0xe8, 0xf4, 0x41,
+};
+
+static const u8 caam_pkc_kat_dp[] __initconst = {
+	0xd0, 0x8f, 0x94, 0x4b, 0xd7, 0x75, 0x48, 0x9d,
+	0x72, 0xa4, 0xdb, 0xa1, 0xc4, 0x9d, 0x77, 0x87,
+	0xf5, 0x35, 0x03, 0xf1, 0xa8, 0xe5, 0x4e, 0xaa,
+	0x09, 0xe7, 0xb2, 0xab, 0x7b, 0x2a, 0x47, 0x33,
+};
+
+static const u8 caam_pkc_kat_dq[] __initconst = {
+	0x2c, 0x81, 0x68, 0xd1, 0x17, 0x16, 0xf5, 0x06,
+	0xfc, 0x62, 0x39, 0x59, 0xb6, 0xac, 0x4b, 0x91,
+	0x00, 0x78, 0x39, 0x60, 0xa7, 0xdb, 0x12, 0x11,
+	0x09, 0x06, 0x5a, 0xcb, 0x03, 0x32, 0x4c, 0x01,
+};
+
+static const u8 caam_pkc_kat_qinv[] __initconst = {
+	0x83, 0xd5, 0x4d, 0xdc, 0x1b, 0xcf, 0x8b, 0x6c,
+	0x5c, 0xb9, 0x8e, 0x32, 0xea, 0xfa, 0x53, 0xb9,
+	0xce, 0x42, 0x01, 0x56, 0x0c, 0xbe, 0x76, 0x88,
+	0x40, 0x91, 0x73, 0xf4, 0x7d, 0x55, 0x20, 0xf4,
+};
+
+static const u8 caam_pkc_kat_m[] __initconst = {
+	0x4c, 0x29, 0xe7, 0x9e, 0x15, 0xc0, 0x45, 0xf0,
+	0x59, 0x17, 0x1e, 0xbe, 0x51, 0xfd, 0xf7, 0x04,
+	0x37, 0xd8, 0x2e, 0xbb, 0x30, 0xf3, 0x7c, 0x48,
+	0x9a, 0x33, 0x1b, 0x83, 0x16, 0x6f, 0x68, 0x40,
+	0x5f, 0xbc, 0x3d, 0x2e, 0x09, 0x97, 0x7a, 0x0f,
+	0xa0, 0x6a, 0x47, 0x56, 0xba, 0x5f, 0xfe, 0x99,
+	0x7c, 0x7e, 0x2c, 0x67, 0x3e, 0xea, 0x55, 0x9d,
+	0xe8, 0xba, 0x7e, 0x6f, 0x94, 0xcc, 0xb7, 0x88,
+};
+
+static const u8 caam_pkc_kat_c[] __initconst = {
+	0x42, 0x1a, 0x2c, 0x7c, 0x67, 0xd3, 0x2c, 0x53,
+	0x65, 0x2b, 0x0b, 0x57, 0x50, 0x22, 0x32, 0x52,
+	0x50, 0xa4, 0xd5, 0xc2, 0x39, 0xd8, 0x9c, 0x53,
+	0xc2, 0x28, 0x18, 0xad, 0x92, 0xcd, 0x04, 0xd9,
+	0x5e, 0x74, 0x19, 0x6c, 0xec, 0x35, 0x8b, 0x41,
+	0x75, 0x54, 0xb6, 0xcd, 0xdd, 0xd9, 0xba, 0xe6,
+	0x7b, 0x4b, 0x6a, 0x79, 0x02, 0xe2, 0xb8, 0xca,
+	0x31, 0xae, 0xee, 0x2c, 0x7b, 0xd0, 0x18, 0x1e,
+};
+
+static const u8 caam_pkc_kat_p256_p[] __initconst = {
+	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+static const u8 caam_pkc_kat_p256_a[] __initconst = {
+	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfc,
+};
+
+static const u8 caam_pkc_kat_p256_b[] __initconst = {
+	0x5a, 0xc6, 0x35, 0xd8, 0xaa, 0x3a, 0x93, 0xe7,
+	0xb3, 0xeb, 0xbd, 0x55, 0x76, 0x98, 0x86, 0xbc,
+	0x65, 0x1d, 0x06, 0xb0, 0xcc, 0x53, 0xb0, 0xf6,
+	0x3b, 0xce, 0x3c, 0x3e, 0x27, 0xd2, 0x60, 0x4b,
+};
+
+static const u8 caam_pkc_kat_p256_gx[] __initconst = {
+	0x6b, 0x17, 0xd1, 0xf2, 0xe1, 0x2c, 0x42, 0x47,
+	0xf8, 0xbc, 0xe6, 0xe5, 0x63, 0xa4, 0x40, 0xf2,
+	0x77, 0x03, 0x7d, 0x81, 0x2d, 0xeb, 0x33, 0xa0,
+	0xf4, 0xa1, 0x39, 0x45, 0xd8, 0x98, 0xc2, 0x96,
+};
+
+static const u8 caam_pkc_kat_p256_gy[] __initconst = {
+	0x4f, 0xe3, 0x42, 0xe2, 0xfe, 0x1a, 0x7f, 0x9b,
+	0x8e, 0xe7, 0xeb, 0x4a, 0x7c, 0x0f, 0x9e, 0x16,
+	0x2b, 0xce, 0x33, 0x57, 0x6b, 0x31, 0x5e, 0xce,
+	0xcb, 0xb6, 0x40, 0x68, 0x37, 0xbf, 0x51, 0xf5,
+};
+
+static const u8 caam_pkc_kat_ecc_k[] __initconst = {
+	0xdc, 0x84, 0xba, 0xd7, 0x34, 0xea, 0x03, 0x79,
+	0xbf, 0xbf, 0xd3, 0x0b, 0xfa, 0x74, 0xf6, 0xe6,
+	0xd8, 0x31, 0xe6, 0x4c, 0x38, 0xcc, 0xf5, 0x02,
+	0x26, 0xc9, 0x0e, 0x42, 0xc2, 0x98, 0x57, 0xaa,
+};
+
+static const u8 caam_pkc_kat_ecc_rx[] __initconst = {
+	0x3f, 0xa9, 0x35, 0x47, 0x5d, 0xe2, 0x20, 0xd1,
+	0xc5, 0x79, 0x25, 0x38, 0x36, 0x07, 0x47, 0xcd,
+	0xff, 0x4f, 0x80, 0x29, 0xec, 0x6a, 0xb1, 0xd0,
+	0x21, 0xc3, 0x00, 0x81, 0xb2, 0x8e, 0x0d, 0xd7,
+};
+
+static const u8 caam_pkc_kat_ecc_ry[] __initconst = {
+	0xf1, 0xa0, 0x9c, 0x28, 0x46, 0x43, 0xda, 0x6c,
+	0x1c, 0x27, 0xb7, 0x12, 0x3e, 0xf5, 0x36, 0xbe,
+	0xa6, 0xc7, 0x58, 0x9e, 0x72, 0x3e, 0x6d, 0x5b,
+	0x3c, 0xab, 0x6d, 0x15, 0xbb, 0x48, 0x8b, 0x6e,
+};
+
+static int __init caam_pkc_kat_rsa(void)
+{
+	struct pkc_mod_exp_crt_req crt_req;
+	struct pkc_mod_exp_req req;
+	u8 *out;
+	int ret;
+
+	out = kmalloc(sizeof(caam_pkc_kat_n), GFP_KERNEL);
+	if (!out)
+		return -ENOMEM;
+
+	req.a = caam_pkc_kat_m;
+	req.a_len = sizeof(caam_pkc_kat_m);
+	req.e = caam_pkc_kat_e;
+	req.e_len = sizeof(caam_pkc_kat_e);
+	req.n = caam_pkc_kat_n;
+	req.n_len = sizeof(caam_pkc_kat_n);
+	req.out = out;
+
+	ret = caam_pkc_mod_exp(&req);
+	if (ret)
+		goto out;
+	if (memcmp(out, caam_pkc_kat_c, sizeof(caam_pkc_kat_c))) {
+		pr_err("caam pkc: mod_exp known answer test failed\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	crt_req.a = caam_pkc_kat_c;
+	crt_req.a_len = sizeof(caam_pkc_kat_c);
+	crt_req.p = caam_pkc_kat_p;
+	crt_req.p_len = sizeof(caam_pkc_kat_p);
+	crt_req.q = caam_pkc_kat_q;
+	crt_req.q_len = sizeof(caam_pkc_kat_q);
+	crt_req.dp = caam_pkc_kat_dp;
+	crt_req.dp_len = sizeof(caam_pkc_kat_dp);
+	crt_req.dq = caam_pkc_kat_dq;
+	crt_req.dq_len = sizeof(caam_pkc_kat_dq);
+	crt_req.qinv = caam_pkc_kat_qinv;
+	crt_req.qinv_len = sizeof(caam_pkc_kat_qinv);
+	crt_req.out = out;
+	crt_req.out_len = sizeof(caam_pkc_kat_n);
+
+	ret = caam_pkc_mod_exp_crt(&crt_req);
+	if (ret)
+		goto out;
+	if (memcmp(out, caam_pkc_kat_m, sizeof(caam_pkc_kat_m))) {
+		pr_err("caam pkc: CRT known answer test failed\n");
+		ret = -EINVAL;
+	}
+out:
+	kzfree(out);
+	return ret;
+}
+
+static int __init caam_pkc_kat_ecc(void)
+{
+	struct pkc_ecc_mul_req req;
+	u8 *out;
+	int ret;
+
+	out = kmalloc(2 * sizeof(caam_pkc_kat_p256_p), GFP_KERNEL);
+	if (!out)
+		return -ENOMEM;
+
+	req.p = caam_pkc_kat_p256_p;
+	req.a = caam_pkc_kat_p256_a;
+	req.b = caam_pkc_kat_p256_b;
+	req.x = caam_pkc_kat_p256_gx;
+	req.y = caam_pkc_kat_p256_gy;
+	req.p_len = sizeof(caam_pkc_kat_p256_p);
+	req.k = caam_pkc_kat_ecc_k;
+	req.k_len = sizeof(caam_pkc_kat_ecc_k);
+	req.rx = out;
+	req.ry = out + req.p_len;
+
+	ret = caam_pkc_ecc_mul(&req);
+	if (ret)
+		goto out;
+	if (memcmp(req.rx, caam_pkc_kat_ecc_rx, req.p_len) ||
+	    memcmp(req.ry, caam_pkc_kat_ecc_ry, req.p_len)) {
+		pr_err("caam pkc: ECC_MULT known answer test failed\n");
+		ret = -EINVAL;
+	}
+out:
+	kzfree(out);
+	return ret;
+}
+
+static void __exit caam_pkc_exit(void)
+{
+	crypto_pkc_unregister(&caam_pkc_engine);
+}
+
+static int __init caam_pkc_init(void)
+{
+	struct device_node *dev_node;
+	struct platform_device *pdev;
+	struct device *ctrldev;
+	struct caam_drv_private *priv;
+	int ret;
+
+	dev_node = of_find_compatible_node(NULL, NULL, "fsl,sec-v4.0");
+	if (!dev_node) {
+		dev_node = of_find_compatible_node(NULL, NULL, "fsl,sec4.0");
+		if (!dev_node)
+			return -ENODEV;
+	}
+
+	pdev = of_find_device_by_node(dev_node);
+	if (!pdev) {
+		of_node_put(dev_node);
+		return -ENODEV;
+	}
+
+	ctrldev = &pdev->dev;
+	priv = dev_get_drvdata(ctrldev);
+	of_node_put(dev_node);
+
+	/*
+	 * If priv is NULL, it's probably because the caam driver wasn't
+	 * properly initialized (e.g. RNG4 init failed). Thus, bail out here.
+	 */
+	if (!priv)
+		return -ENODEV;
+
+	/* CHANUM has the CHAVID layout, a zero count means no PKHA */
+	if (!(rd_reg32(&priv->ctrl->perfmon.cha_num_ls) & CHA_ID_LS_PK_MASK))
+		return -ENODEV;
+
+	ret = caam_pkc_kat_rsa();
+	if (!ret)
+		ret = caam_pkc_kat_ecc();
+	if (ret)
+		return ret == -ENOMEM ? ret : -ENODEV;
+
+	return crypto_pkc_register(&caam_pkc_engine);
+}
+
+module_init(caam_pkc_init);
+module_exit(caam_pkc_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("FSL CAAM support for public key operations");
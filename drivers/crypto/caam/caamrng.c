@@ -13,8 +13,8 @@
  * ---------------      |              | (move)     |
  *                      |              | (store)    |
  * ---------------      |              --------------
- * | JobDesc #1  |------|
- * | *(buffer 1) |
+ * | JobDesc #n  |------|
+ * | *(buffer n) |
  * ---------------
  *
  * A job desc looks like this:
@@ -26,14 +26,20 @@
  * | (output buffer)   |
  * ---------------------
  *
- * The SharedDesc never changes, and each job descriptor points to one of two
- * buffers for each device, from which the data will be copied into the
- * requested destination
+ * The SharedDesc never changes, and each job descriptor points to one of
+ * the buffers of the device, from which the data will be copied into the
+ * requested destination.
+ *
+ * The buffers form a ring. The reader drains them in order, and each
+ * drained buffer is queued for refilling right away, as long as fewer
+ * than high_water buffers are filled or being filled. Several jobs are
+ * thus in flight while the reader consumes the buffers before them.
  */
 
 #include <linux/hw_random.h>
 #include <linux/completion.h>
 #include <linux/atomic.h>
+#include <linux/moduleparam.h>
 
 #include "compat.h"
 
@@ -50,13 +56,27 @@
 #define RN_BUF_SIZE			(0xffff / L1_CACHE_BYTES * \
 					 L1_CACHE_BYTES)
 
+#define RN_BUFS_MAX			32
+
 /* length of descriptors */
 #define DESC_JOB_O_LEN			(CAAM_CMD_SZ * 2 + CAAM_PTR_SZ * 2)
 #define DESC_RNG_LEN			(4 * CAAM_CMD_SZ)
 
-/* Buffer, its dma address and lock */
+static unsigned int buffers = CONFIG_CRYPTO_DEV_FSL_CAAM_RNG_BUFS;
+module_param(buffers, uint, 0444);
+MODULE_PARM_DESC(buffers, "Number of random number buffers (2-32)");
+
+static unsigned int high_water = RN_BUFS_MAX;
+module_param(high_water, uint, 0644);
+MODULE_PARM_DESC(high_water,
+		 "Number of buffers kept filled, at most the buffer count");
+
+/*
+ * Buffer, its dma address and lock. The buffer is allocated on its own, with
+ * it the bookkeeping would take the allocation past 64KiB.
+ */
 struct buf_data {
-	u8 buf[RN_BUF_SIZE] ____cacheline_aligned;
+	u8 *buf;
 	dma_addr_t addr;
 	struct completion filled;
 	u32 hw_desc[DESC_JOB_O_LEN];
@@ -72,8 +92,11 @@ struct caam_rng_ctx {
 	dma_addr_t sh_desc_dma;
 	u32 sh_desc[DESC_RNG_LEN];
 	unsigned int cur_buf_idx;
-	int current_buf;
-	struct buf_data bufs[2];
+	unsigned int current_buf;
+	unsigned int next_fill;	/* next buffer to submit a job for */
+	unsigned int queued;	/* filled or pending buffers, from current */
+	unsigned int nbufs;
+	struct buf_data *bufs[RN_BUFS_MAX];
 };
 
 static struct caam_rng_ctx *rng_ctx;
@@ -88,12 +111,14 @@ static inline void rng_unmap_buf(struct device *jrdev, struct buf_data *bd)
 static inline void rng_unmap_ctx(struct caam_rng_ctx *ctx)
 {
 	struct device *jrdev = ctx->jrdev;
+	int i;
 
 	if (ctx->sh_desc_dma)
 		dma_unmap_single(jrdev, ctx->sh_desc_dma,
 				 desc_bytes(ctx->sh_desc), DMA_TO_DEVICE);
-	rng_unmap_buf(jrdev, &ctx->bufs[0]);
-	rng_unmap_buf(jrdev, &ctx->bufs[1]);
+	for (i = 0; i < ctx->nbufs; i++)
+		if (ctx->bufs[i])
+			rng_unmap_buf(jrdev, ctx->bufs[i]);
 }
 
 static void rng_done(struct device *jrdev, u32 *desc, u32 err, void *context)
@@ -103,86 +128,124 @@ static void rng_done(struct device *jrdev, u32 *desc, u32 err, void *context)
 	bd = (struct buf_data *)((char *)desc -
 	      offsetof(struct buf_data, hw_desc));
 
-	if (err)
+	/* a failed job leaves the buffer empty, the reader skips it */
+	if (err) {
 		caam_jr_strstatus(jrdev, err);
-
-	atomic_set(&bd->empty, BUF_NOT_EMPTY);
+		atomic_set(&bd->empty, BUF_EMPTY);
+	} else {
+		atomic_set(&bd->empty, BUF_NOT_EMPTY);
+	}
 	complete(&bd->filled);
-#ifdef DEBUG
-	print_hex_dump(KERN_ERR, "rng refreshed buf@: ",
-		       DUMP_PREFIX_ADDRESS, 16, 4, bd->buf, RN_BUF_SIZE, 1);
-#endif
 }
 
-static inline int submit_job(struct caam_rng_ctx *ctx, int to_current)
+static inline int submit_job(struct caam_rng_ctx *ctx, struct buf_data *bd)
 {
-	struct buf_data *bd = &ctx->bufs[!(to_current ^ ctx->current_buf)];
 	struct device *jrdev = ctx->jrdev;
 	u32 *desc = bd->hw_desc;
 	int err;
 
-	dev_dbg(jrdev, "submitting job %d\n", !(to_current ^ ctx->current_buf));
-	init_completion(&bd->filled);
+	dev_dbg(jrdev, "submitting job %d\n", ctx->next_fill);
+	reinit_completion(&bd->filled);
+	dma_sync_single_for_device(jrdev, bd->addr, RN_BUF_SIZE,
+				   DMA_FROM_DEVICE);
+
+	/* mark pending first, the job may complete before enqueue returns */
+	atomic_set(&bd->empty, BUF_PENDING);
 	err = caam_jr_enqueue(jrdev, desc, rng_done, ctx);
-	if (err)
+	if (err) {
+		atomic_set(&bd->empty, BUF_EMPTY);
 		complete(&bd->filled); /* don't wait on failed job*/
-	else
-		atomic_inc(&bd->empty); /* note if pending */
+	}
 
 	return err;
 }
 
+/*
+ * Queue jobs for the empty buffers after the filled ones, up to the
+ * high-water mark. Only called by the reader (and at init): the hwrng
+ * core serializes reads, so next_fill and queued need no locking.
+ */
+static void rng_refill(struct caam_rng_ctx *ctx)
+{
+	unsigned int hw = clamp_t(unsigned int, ACCESS_ONCE(high_water), 1,
+				  ctx->nbufs);
+
+	while (ctx->queued < hw) {
+		if (submit_job(ctx, ctx->bufs[ctx->next_fill]))
+			break;
+		ctx->next_fill = (ctx->next_fill + 1) % ctx->nbufs;
+		ctx->queued++;
+	}
+}
+
+/* done with the current buffer, whether it was read or its job failed */
+static void rng_drain_buf(struct caam_rng_ctx *ctx)
+{
+	atomic_set(&ctx->bufs[ctx->current_buf]->empty, BUF_EMPTY);
+	ctx->cur_buf_idx = 0;
+	ctx->current_buf = (ctx->current_buf + 1) % ctx->nbufs;
+	ctx->queued--;
+	dev_dbg(ctx->jrdev, "switched to buffer %d\n", ctx->current_buf);
+}
+
 static int caam_read(struct hwrng *rng, void *data, size_t max, bool wait)
 {
 	struct caam_rng_ctx *ctx = rng_ctx;
-	struct buf_data *bd = &ctx->bufs[ctx->current_buf];
-	int next_buf_idx, copied_idx;
-	int err;
+	struct buf_data *bd;
+	size_t copied = 0, len;
 
-	if (atomic_read(&bd->empty)) {
-		/* try to submit job if there wasn't one */
-		if (atomic_read(&bd->empty) == BUF_EMPTY) {
-			err = submit_job(ctx, 1);
-			/* if can't submit job, can't even wait */
-			if (err)
-				return 0;
+	dev_dbg(ctx->jrdev, "%s: start reading at buffer %d, idx %d\n",
+		__func__, ctx->current_buf, ctx->cur_buf_idx);
+
+	while (copied < max) {
+		/* if can't submit job, can't even wait */
+		if (!ctx->queued) {
+			rng_refill(ctx);
+			if (!ctx->queued)
+				break;
 		}
-		/* no immediate data, so exit if not waiting */
-		if (!wait)
-			return 0;
 
-		/* waiting for pending job */
-		if (atomic_read(&bd->empty))
+		bd = ctx->bufs[ctx->current_buf];
+		if (atomic_read(&bd->empty) == BUF_PENDING) {
+			/*
+			 * No immediate data: don't wait if not asked to, or
+			 * if some data has already been read.
+			 */
+			if (!wait || copied)
+				break;
 			wait_for_completion(&bd->filled);
-	}
+		}
 
-	next_buf_idx = ctx->cur_buf_idx + max;
-	dev_dbg(ctx->jrdev, "%s: start reading at buffer %d, idx %d\n",
-		 __func__, ctx->current_buf, ctx->cur_buf_idx);
+		/* the job failed, the refill below resubmits it */
+		if (atomic_read(&bd->empty) == BUF_EMPTY) {
+			rng_drain_buf(ctx);
+			break;
+		}
 
-	/* if enough data in current buffer */
-	if (next_buf_idx < RN_BUF_SIZE) {
-		memcpy(data, bd->buf + ctx->cur_buf_idx, max);
-		ctx->cur_buf_idx = next_buf_idx;
-		return max;
-	}
+		if (!ctx->cur_buf_idx) {
+			dma_sync_single_for_cpu(ctx->jrdev, bd->addr,
+						RN_BUF_SIZE, DMA_FROM_DEVICE);
+#ifdef DEBUG
+			print_hex_dump(KERN_ERR, "rng refreshed buf@: ",
+				       DUMP_PREFIX_ADDRESS, 16, 4, bd->buf,
+				       RN_BUF_SIZE, 1);
+#endif
+		}
 
-	/* else, copy what's left... */
-	copied_idx = RN_BUF_SIZE - ctx->cur_buf_idx;
-	memcpy(data, bd->buf + ctx->cur_buf_idx, copied_idx);
-	ctx->cur_buf_idx = 0;
-	atomic_set(&bd->empty, BUF_EMPTY);
+		len = min_t(size_t, max - copied,
+			    RN_BUF_SIZE - ctx->cur_buf_idx);
+		memcpy(data + copied, bd->buf + ctx->cur_buf_idx, len);
+		ctx->cur_buf_idx += len;
+		copied += len;
 
-	/* ...refill... */
-	submit_job(ctx, 1);
+		/* refill drained buffers before the reader gets back to them */
+		if (ctx->cur_buf_idx == RN_BUF_SIZE)
+			rng_drain_buf(ctx);
+	}
 
-	/* and use next buffer */
-	ctx->current_buf = !ctx->current_buf;
-	dev_dbg(ctx->jrdev, "switched to buffer %d\n", ctx->current_buf);
+	rng_refill(ctx);
 
-	/* since there already is some data read, don't wait */
-	return copied_idx + caam_read(rng, data + copied_idx,
-				      max - copied_idx, false);
+	return copied;
 }
 
 static inline int rng_create_sh_desc(struct caam_rng_ctx *ctx)
@@ -205,6 +268,7 @@ static inline int rng_create_sh_desc(struct caam_rng_ctx *ctx)
 					  DMA_TO_DEVICE);
 	if (dma_mapping_error(jrdev, ctx->sh_desc_dma)) {
 		dev_err(jrdev, "unable to map shared descriptor\n");
+		ctx->sh_desc_dma = 0;
 		return -ENOMEM;
 	}
 #ifdef DEBUG
@@ -214,10 +278,10 @@ static inline int rng_create_sh_desc(struct caam_rng_ctx *ctx)
 	return 0;
 }
 
-static inline int rng_create_job_desc(struct caam_rng_ctx *ctx, int buf_id)
+static inline int rng_create_job_desc(struct caam_rng_ctx *ctx,
+				      struct buf_data *bd)
 {
 	struct device *jrdev = ctx->jrdev;
-	struct buf_data *bd = &ctx->bufs[buf_id];
 	u32 *desc = bd->hw_desc;
 	int sh_len = desc_len(ctx->sh_desc);
 
@@ -227,6 +291,7 @@ static inline int rng_create_job_desc(struct caam_rng_ctx *ctx, int buf_id)
 	bd->addr = dma_map_single(jrdev, bd->buf, RN_BUF_SIZE, DMA_FROM_DEVICE);
 	if (dma_mapping_error(jrdev, bd->addr)) {
 		dev_err(jrdev, "unable to map dst\n");
+		bd->addr = 0;
 		return -ENOMEM;
 	}
 
@@ -238,58 +303,96 @@ static inline int rng_create_job_desc(struct caam_rng_ctx *ctx, int buf_id)
 	return 0;
 }
 
-static void caam_cleanup(struct hwrng *rng)
+static void rng_wait_pending(struct caam_rng_ctx *ctx)
 {
-	int i;
 	struct buf_data *bd;
+	int i;
 
-	for (i = 0; i < 2; i++) {
-		bd = &rng_ctx->bufs[i];
-		if (atomic_read(&bd->empty) == BUF_PENDING)
+	for (i = 0; i < ctx->nbufs; i++) {
+		bd = ctx->bufs[i];
+		if (bd && atomic_read(&bd->empty) == BUF_PENDING)
 			wait_for_completion(&bd->filled);
 	}
+}
 
-	rng_unmap_ctx(rng_ctx);
+static void caam_free_rng(struct caam_rng_ctx *ctx)
+{
+	int i;
+
+	rng_wait_pending(ctx);
+	rng_unmap_ctx(ctx);
+
+	for (i = 0; i < ctx->nbufs; i++) {
+		if (!ctx->bufs[i])
+			continue;
+		kfree(ctx->bufs[i]->buf);
+		kfree(ctx->bufs[i]);
+	}
+}
+
+/*
+ * The hwrng core calls this when switching to another rng, which may be
+ * switched back to later: only quiesce here, the ring is freed on exit.
+ */
+static void caam_cleanup(struct hwrng *rng)
+{
+	rng_wait_pending(rng_ctx);
 }
 
 static int caam_init_buf(struct caam_rng_ctx *ctx, int buf_id)
 {
-	struct buf_data *bd = &ctx->bufs[buf_id];
-	int err;
+	struct buf_data *bd;
 
-	err = rng_create_job_desc(ctx, buf_id);
-	if (err)
-		return err;
+	bd = kzalloc(sizeof(*bd), GFP_KERNEL | GFP_DMA);
+	if (!bd)
+		return -ENOMEM;
 
+	bd->buf = kmalloc(RN_BUF_SIZE, GFP_KERNEL | GFP_DMA);
+	if (!bd->buf) {
+		kfree(bd);
+		return -ENOMEM;
+	}
+
+	init_completion(&bd->filled);
 	atomic_set(&bd->empty, BUF_EMPTY);
-	submit_job(ctx, buf_id == ctx->current_buf);
-	wait_for_completion(&bd->filled);
+	ctx->bufs[buf_id] = bd;
 
-	return 0;
+	return rng_create_job_desc(ctx, bd);
 }
 
 static int caam_init_rng(struct caam_rng_ctx *ctx, struct device *jrdev)
 {
-	int err;
+	int i, err;
 
 	ctx->jrdev = jrdev;
+	ctx->nbufs = clamp_t(unsigned int, buffers, 2, RN_BUFS_MAX);
 
 	err = rng_create_sh_desc(ctx);
 	if (err)
-		return err;
+		goto err;
 
 	ctx->current_buf = 0;
 	ctx->cur_buf_idx = 0;
+	ctx->next_fill = 0;
+	ctx->queued = 0;
 
-	err = caam_init_buf(ctx, 0);
-	if (err)
-		return err;
+	for (i = 0; i < ctx->nbufs; i++) {
+		err = caam_init_buf(ctx, i);
+		if (err)
+			goto err;
+	}
 
-	err = caam_init_buf(ctx, 1);
-	if (err)
-		return err;
+	/* start filling the ring, the first read waits for buffer 0 */
+	rng_refill(ctx);
+	if (!ctx->queued) {
+		err = -EIO;
+		goto err;
+	}
 
 	return 0;
+err:
+	caam_free_rng(ctx);
+	return err;
 }
 
 static struct hwrng caam_rng = {
@@ -300,8 +403,9 @@ static struct hwrng caam_rng = {
 
 static void __exit caam_rng_exit(void)
 {
-	caam_jr_free(rng_ctx->jrdev);
 	hwrng_unregister(&caam_rng);
+	caam_free_rng(rng_ctx);
+	caam_jr_free(rng_ctx->jrdev);
 	kfree(rng_ctx);
 }
 
@@ -343,15 +447,29 @@ static int __init caam_rng_init(void)
 		pr_err("Job Ring Device allocation for transform failed\n");
 		return PTR_ERR(dev);
 	}
-	rng_ctx = kmalloc(sizeof(struct caam_rng_ctx), GFP_DMA);
-	if (!rng_ctx)
-		return -ENOMEM;
+	rng_ctx = kzalloc(sizeof(struct caam_rng_ctx), GFP_DMA);
+	if (!rng_ctx) {
+		err = -ENOMEM;
+		goto free_jr;
+	}
 	err = caam_init_rng(rng_ctx, dev);
 	if (err)
-		return err;
+		goto free_ctx;
+
+	dev_info(dev, "registering rng-caam, %u buffers\n", rng_ctx->nbufs);
+	err = hwrng_register(&caam_rng);
+	if (err) {
+		caam_free_rng(rng_ctx);
+		goto free_ctx;
+	}
+
+	return 0;
 
-	dev_info(dev, "registering rng-caam\n");
-	return hwrng_register(&caam_rng);
+free_ctx:
+	kfree(rng_ctx);
+free_jr:
+	caam_jr_free(dev);
+	return err;
 }
 
 module_init(caam_rng_init);
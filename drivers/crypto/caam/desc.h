@@ -239,6 +239,14 @@ struct sec4_sg_entry {
 #define LDST_SRCDST_WORD_DESCBUF_SHARED_WE (0x46 << LDST_SRCDST_SHIFT)
 #define LDST_SRCDST_WORD_INFO_FIFO	(0x7a << LDST_SRCDST_SHIFT)
 
+/* CLRW - Clear Written register bits, class 2 */
+#define CLRW_CLR_C2MODE			0x00010000
+#define CLRW_CLR_C2DATAS		0x00040000
+#define CLRW_CLR_C2CTX			0x00200000
+#define CLRW_CLR_C2KEY			0x00400000
+#define CLRW_RESET_CLS2_DONE		0x04000000
+#define CLRW_RESET_CLS2_CHA		0x10000000
+
 /* Offset in source/destination */
 #define LDST_OFFSET_SHIFT	8
 #define LDST_OFFSET_MASK	(0xff << LDST_OFFSET_SHIFT)
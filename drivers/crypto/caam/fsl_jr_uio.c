@@ -1,6 +1,28 @@
 /*
  * Copyright 2013 Freescale Semiconductor, Inc.
  *
+ * Each job ring not used by the kernel is exposed as a UIO device
+ * (fsl-jrN, N being the index of the ring under the SEC node), so that a
+ * userspace driver can enqueue and dequeue jobs without kernel involvement:
+ *
+ *   map0: job ring registers
+ *   map1: DMA buffer pool, for the rings, descriptors and data. It is
+ *         allocated while the device is open; its bus address, which the
+ *         descriptors use, is in /sys/class/uio/uioX/maps/map1/addr.
+ *
+ * When there are several such rings, an fsl-jr-grp device maps up to four
+ * of them into one process: mapN are the registers of the Nth ring and the
+ * last map is the DMA buffer pool. It signals the interrupts of all its
+ * rings, and the commands written to it apply to all of them. Opening it
+ * fails if any of the rings is open on its own, and the other way around.
+ * The group is rebuilt whenever a ring is bound or unbound; an open group
+ * is kept until it is released, unless it loses one of its rings. It hangs
+ * off a platform device of its own, which goes away with the group, so
+ * that unbinding a ring does not free the UIO device under an open file.
+ *
+ * The rings have the same compatible as those of the caam_jr driver, a ring
+ * belongs to whichever driver binds it first. jr_mask selects the rings,
+ * by their index under the SEC node, that this driver may take.
  */
 
 #include <linux/kernel.h>
@@ -8,13 +30,24 @@
 #include <linux/of_address.h>
 #include <linux/of_irq.h>
 #include <linux/of_platform.h>
+#include <linux/platform_device.h>
 #include <linux/io.h>
 #include <linux/uio_driver.h>
 #include <linux/slab.h>
 #include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/dma-mapping.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/interrupt.h>
+#include <linux/workqueue.h>
+#include <linux/sizes.h>
 #include "regs.h"
 #include "fsl_jr_uio.h"
 
+#define setbits32(_addr, _v) writel((readl(_addr) | (_v)), (_addr))
+#define clrbits32(_addr, _v) writel((readl(_addr) & ~(_v)), (_addr))
+
 static const char jr_uio_version[] = "fsl JR UIO driver v1.0";
 
 #define NAME_LENGTH 30
@@ -23,12 +56,27 @@ static const char jr_uio_version[] = "fsl JR UIO driver v1.0";
 static const char uio_device_name[] = "fsl-jr";
 static LIST_HEAD(jr_list);
 
+static unsigned int pool_size = SZ_1M;
+module_param(pool_size, uint, 0444);
+MODULE_PARM_DESC(pool_size, "Size of the DMA buffer pool of a device (0: none)");
+
+static unsigned int jr_mask = ~0U;
+module_param(jr_mask, uint, 0444);
+MODULE_PARM_DESC(jr_mask, "Job rings to expose, bit N for ring N of the SEC (default: all)");
+
 struct jr_uio_info {
 	atomic_t ref; /* exclusive, only one open() at a time */
 	struct uio_info uio;
 	char name[NAME_LENGTH];
+	/* DMA buffer pool, allocated while the device is open */
+	struct device *pool_dev;
+	int pool_map;		/* index in uio.mem, -1 if no pool */
+	void *pool;
+	dma_addr_t pool_dma;
 };
 
+struct jr_uio_group;
+
 struct jr_dev {
 	u32 revision;
 	u32 index;
@@ -39,12 +87,108 @@ struct jr_dev {
 	struct jr_uio_info info;
 	struct list_head node;
 	struct list_head jr_list;
+	spinlock_t cfg_lock;		/* rconfig_lo */
+	struct jr_uio_group *group;	/* while open through the group */
 };
 
+struct jr_uio_group {
+	struct jr_uio_info info;
+	struct platform_device *pdev;	/* parent of the UIO device */
+	struct device *dev;	/* of the first ring, for the pool */
+	bool open;
+	bool removed;		/* freed on release, if still open */
+	int nrings;
+	struct jr_dev *rings[MAX_UIO_MAPS - 1];
+};
+
+static struct jr_uio_group *jr_group;
+static bool jr_group_stale;	/* rings changed while the group was open */
+static DEFINE_MUTEX(jr_group_lock);	/* jr_list and the group */
+
+static void jr_uio_group_work_fn(struct work_struct *work);
+static DECLARE_WORK(jr_group_work, jr_uio_group_work_fn);
+
+static void jr_uio_init_pool(struct jr_uio_info *info, struct device *dev,
+			     int map)
+{
+	struct uio_mem *mem;
+
+	info->pool_map = -1;
+	if (!pool_size || map >= MAX_UIO_MAPS)
+		return;
+
+	info->pool_dev = dev;
+	info->pool_map = map;
+
+	mem = &info->uio.mem[map];
+	mem->name = "DMA buffer pool";
+	mem->size = PAGE_ALIGN(pool_size);
+	mem->memtype = UIO_MEM_PHYS;
+}
+
+static int jr_uio_pool_alloc(struct jr_uio_info *info)
+{
+	struct uio_mem *mem;
+
+	if (info->pool_map < 0)
+		return 0;
+
+	mem = &info->uio.mem[info->pool_map];
+	info->pool = dma_alloc_coherent(info->pool_dev, mem->size,
+					&info->pool_dma, GFP_KERNEL);
+	if (!info->pool) {
+		pr_err("%s: unable to allocate DMA buffer pool\n", info->name);
+		return -ENOMEM;
+	}
+	mem->addr = info->pool_dma;
+
+	return 0;
+}
+
+static void jr_uio_pool_free(struct jr_uio_info *info)
+{
+	struct uio_mem *mem;
+
+	if (!info->pool)
+		return;
+
+	mem = &info->uio.mem[info->pool_map];
+	dma_free_coherent(info->pool_dev, mem->size, info->pool,
+			  info->pool_dma);
+	info->pool = NULL;
+	mem->addr = 0;
+}
+
+/* Job ring registers uncached, the pool as the DMA API maps it */
+static int jr_uio_mmap(struct uio_info *info, struct vm_area_struct *vma)
+{
+	struct jr_uio_info *uio_info = container_of(info,
+					struct jr_uio_info, uio);
+	int mi = vma->vm_pgoff;
+	struct uio_mem *mem = &info->mem[mi];
+
+	if (mi == uio_info->pool_map) {
+		if (!uio_info->pool)
+			return -ENODEV;
+
+		vma->vm_pgoff = 0;
+		return dma_mmap_coherent(uio_info->pool_dev, vma,
+					 uio_info->pool, uio_info->pool_dma,
+					 mem->size);
+	}
+
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	return remap_pfn_range(vma, vma->vm_start, mem->addr >> PAGE_SHIFT,
+			       vma->vm_end - vma->vm_start,
+			       vma->vm_page_prot);
+}
+
 static int jr_uio_open(struct uio_info *info, struct inode *inode)
 {
 	struct jr_uio_info *uio_info = container_of(info,
 					struct jr_uio_info, uio);
+	int ret;
 
 	if (!atomic_dec_and_test(&uio_info->ref)) {
 		pr_err("%s: failing non-exclusive open()\n", uio_info->name);
@@ -52,13 +196,19 @@ static int jr_uio_open(struct uio_info *info, struct inode *inode)
 		return -EBUSY;
 	}
 
-	return 0;
+	ret = jr_uio_pool_alloc(uio_info);
+	if (ret)
+		atomic_inc(&uio_info->ref);
+
+	return ret;
 }
 
 static int jr_uio_release(struct uio_info *info, struct inode *inode)
 {
 	struct jr_uio_info *uio_info = container_of(info,
 					struct jr_uio_info, uio);
+
+	jr_uio_pool_free(uio_info);
 	atomic_inc(&uio_info->ref);
 
 	return 0;
@@ -67,6 +217,7 @@ static int jr_uio_release(struct uio_info *info, struct inode *inode)
 static irqreturn_t jr_uio_irq_handler(int irq, struct uio_info *dev_info)
 {
 	struct jr_dev *jrdev = dev_info->priv;
+	struct jr_uio_group *group;
 	u32 irqstate;
 	irqstate = rd_reg32(&jrdev->global_regs->jrintstatus);
 	if (!irqstate) {
@@ -78,43 +229,80 @@ static irqreturn_t jr_uio_irq_handler(int irq, struct uio_info *dev_info)
 			 irqstate);
 
 	/*mask valid interrupts */
+	spin_lock(&jrdev->cfg_lock);
 	setbits32(&jrdev->global_regs->rconfig_lo, JRCFG_IMSK);
+	spin_unlock(&jrdev->cfg_lock);
 
 	/* Have valid interrupt at this point, just ACK and trigger */
 	wr_reg32(&jrdev->global_regs->jrintstatus, irqstate);
 
+	group = ACCESS_ONCE(jrdev->group);
+	if (group)
+		uio_event_notify(&group->info.uio);
+
 	return IRQ_HANDLED;
 }
 
-static int jr_uio_irqcontrol(struct uio_info *dev_info, int irqon)
+/* Program the hardware interrupt coalescing thresholds, 0 count is off */
+static void jr_uio_config_intc(struct jr_dev *jrdev, u32 count, u32 time)
 {
-	struct jr_dev *jrdev = dev_info->priv;
+	u32 cfg;
+
+	cfg = rd_reg32(&jrdev->global_regs->rconfig_lo);
+	cfg &= ~(JRCFG_ICEN | JRCFG_ICDCT_MASK | JRCFG_ICTT_MASK);
+	if (count)
+		cfg |= JRCFG_ICEN | (count << JRCFG_ICDCT_SHIFT) |
+		       (max_t(u32, time, 1) << JRCFG_ICTT_SHIFT);
+	wr_reg32(&jrdev->global_regs->rconfig_lo, cfg);
+}
 
-	switch (irqon) {
-	case SEC_UIO_SIMULATE_IRQ_CMD:
-		uio_event_notify(dev_info);
-		break;
-	case SEC_UIO_ENABLE_IRQ_CMD:
-		/* Enable Job Ring interrupt */
-		clrbits32(&jrdev->global_regs->rconfig_lo, JRCFG_IMSK);
+/* Commands acting on a job ring, for its device and for the group */
+static void jr_uio_ring_control(struct jr_dev *jrdev, s32 irqon)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&jrdev->cfg_lock, flags);
+
+	switch (SEC_UIO_CMD(irqon)) {
+	case SEC_UIO_COALESCE_CMD:
+		jr_uio_config_intc(jrdev, SEC_UIO_COALESCE_COUNT(irqon),
+				   SEC_UIO_COALESCE_TIME(irqon));
 		break;
-	case SEC_UIO_DISABLE_IRQ_CMD:
-		/* Disable Job Ring interrupt */
-		setbits32(&jrdev->global_regs->rconfig_lo, JRCFG_IMSK);
+	case 0:
+		if (irqon == SEC_UIO_ENABLE_IRQ_CMD)
+			/* Enable Job Ring interrupt */
+			clrbits32(&jrdev->global_regs->rconfig_lo, JRCFG_IMSK);
+		else if (irqon == SEC_UIO_DISABLE_IRQ_CMD)
+			/* Disable Job Ring interrupt */
+			setbits32(&jrdev->global_regs->rconfig_lo, JRCFG_IMSK);
 		break;
 	default:
 		break;
 	}
+
+	spin_unlock_irqrestore(&jrdev->cfg_lock, flags);
+}
+
+static int jr_uio_irqcontrol(struct uio_info *dev_info, int irqon)
+{
+	struct jr_dev *jrdev = dev_info->priv;
+
+	if (irqon == SEC_UIO_SIMULATE_IRQ_CMD)
+		uio_event_notify(dev_info);
+	else
+		jr_uio_ring_control(jrdev, irqon);
+
 	return 0;
 }
 
-static int __init jr_uio_init(struct jr_dev *uio_dev)
+static int jr_uio_init(struct jr_dev *uio_dev)
 {
 	int ret;
 	struct jr_uio_info *info;
 
 	info = &uio_dev->info;
 	atomic_set(&info->ref, 1);
+	spin_lock_init(&uio_dev->cfg_lock);
 	info->uio.version = jr_uio_version;
 	info->uio.name = uio_dev->info.name;
 	info->uio.mem[0].name = "JR config space";
@@ -128,7 +316,9 @@ static int __init jr_uio_init(struct jr_dev *uio_dev)
 	info->uio.irqcontrol = jr_uio_irqcontrol;
 	info->uio.open = jr_uio_open;
 	info->uio.release = jr_uio_release;
+	info->uio.mmap = jr_uio_mmap;
 	info->uio.priv = uio_dev;
+	jr_uio_init_pool(info, uio_dev->dev, 1);
 
 	ret = uio_register_device(uio_dev->dev, &info->uio);
 	if (ret) {
@@ -139,6 +329,248 @@ static int __init jr_uio_init(struct jr_dev *uio_dev)
 	return 0;
 }
 
+static int jr_uio_group_open(struct uio_info *info, struct inode *inode)
+{
+	struct jr_uio_group *group = info->priv;
+	int i, ret;
+
+	mutex_lock(&jr_group_lock);
+	if (group->removed || group->open) {
+		ret = group->removed ? -ENODEV : -EBUSY;
+		mutex_unlock(&jr_group_lock);
+		return ret;
+	}
+
+	/* take every ring, as their own devices do on open */
+	for (i = 0; i < group->nrings; i++) {
+		if (!atomic_dec_and_test(&group->rings[i]->info.ref)) {
+			atomic_inc(&group->rings[i]->info.ref);
+			pr_err("%s: %s is open\n", group->info.name,
+			       group->rings[i]->info.name);
+			ret = -EBUSY;
+			goto release;
+		}
+	}
+
+	ret = jr_uio_pool_alloc(&group->info);
+	if (ret)
+		goto release;
+
+	for (i = 0; i < group->nrings; i++)
+		group->rings[i]->group = group;
+	group->open = true;
+	mutex_unlock(&jr_group_lock);
+
+	return 0;
+
+release:
+	while (i--)
+		atomic_inc(&group->rings[i]->info.ref);
+	mutex_unlock(&jr_group_lock);
+	return ret;
+}
+
+/* Stop signalling the group and give the rings back, jr_group_lock held */
+static void jr_uio_group_detach(struct jr_uio_group *group)
+{
+	int i;
+
+	for (i = 0; i < group->nrings; i++) {
+		ACCESS_ONCE(group->rings[i]->group) = NULL;
+		synchronize_irq(group->rings[i]->irq);
+		atomic_inc(&group->rings[i]->info.ref);
+	}
+}
+
+/* The UIO device is devres of pdev, it goes with the last reference */
+static void jr_uio_group_free(struct jr_uio_group *group)
+{
+	platform_device_unregister(group->pdev);
+	put_device(group->dev);
+	kfree(group);
+}
+
+static int jr_uio_group_release(struct uio_info *info, struct inode *inode)
+{
+	struct jr_uio_group *group = info->priv;
+	bool removed;
+
+	mutex_lock(&jr_group_lock);
+	/* the rings were already given back on removal */
+	if (!group->removed)
+		jr_uio_group_detach(group);
+	jr_uio_pool_free(&group->info);
+	group->open = false;
+	removed = group->removed;
+	/* not from here, the UIO core still holds the device */
+	if (!removed && jr_group_stale)
+		schedule_work(&jr_group_work);
+	mutex_unlock(&jr_group_lock);
+
+	if (removed)
+		jr_uio_group_free(group);
+
+	return 0;
+}
+
+static int jr_uio_group_irqcontrol(struct uio_info *info, int irqon)
+{
+	struct jr_uio_group *group = info->priv;
+	int i;
+
+	if (irqon == SEC_UIO_SIMULATE_IRQ_CMD) {
+		uio_event_notify(info);
+		return 0;
+	}
+
+	/* the rings may be gone once the group is removed */
+	mutex_lock(&jr_group_lock);
+	if (group->removed) {
+		mutex_unlock(&jr_group_lock);
+		return -ENODEV;
+	}
+	for (i = 0; i < group->nrings; i++)
+		jr_uio_ring_control(group->rings[i], irqon);
+	mutex_unlock(&jr_group_lock);
+
+	return 0;
+}
+
+/*
+ * Group the rings probed so far into one device, if there are several,
+ * jr_group_lock held
+ */
+static int jr_uio_group_init(void)
+{
+	struct jr_uio_group *group;
+	struct jr_uio_info *info;
+	struct uio_mem *mem;
+	struct jr_dev *jr_dev;
+	int ret, n = 0;
+
+	list_for_each_entry(jr_dev, &jr_list, node)
+		n++;
+	if (n < 2)
+		return 0;
+
+	group = kzalloc(sizeof(*group), GFP_KERNEL);
+	if (!group)
+		return -ENOMEM;
+
+	info = &group->info;
+	atomic_set(&info->ref, 1);
+	snprintf(info->name, sizeof(info->name) - 1, "%s-grp",
+		 uio_device_name);
+
+	list_for_each_entry(jr_dev, &jr_list, node) {
+		if (group->nrings == ARRAY_SIZE(group->rings))
+			break;
+
+		mem = &info->uio.mem[group->nrings];
+		mem->name = "JR config space";
+		mem->addr = jr_dev->res->start;
+		mem->size = resource_size(jr_dev->res);
+		mem->internal_addr = jr_dev->global_regs;
+		mem->memtype = UIO_MEM_PHYS;
+		group->rings[group->nrings++] = jr_dev;
+	}
+
+	info->uio.version = jr_uio_version;
+	info->uio.name = info->name;
+	info->uio.irq = UIO_IRQ_CUSTOM;
+	info->uio.irqcontrol = jr_uio_group_irqcontrol;
+	info->uio.open = jr_uio_group_open;
+	info->uio.release = jr_uio_group_release;
+	info->uio.mmap = jr_uio_mmap;
+	info->uio.priv = group;
+	/* the pool may outlive the rings, until the group is closed */
+	group->dev = get_device(group->rings[0]->dev);
+	jr_uio_init_pool(info, group->dev, group->nrings);
+
+	group->pdev = platform_device_register_simple(info->name,
+						      PLATFORM_DEVID_AUTO,
+						      NULL, 0);
+	if (IS_ERR(group->pdev)) {
+		ret = PTR_ERR(group->pdev);
+		put_device(group->dev);
+		kfree(group);
+		return ret;
+	}
+
+	ret = uio_register_device(&group->pdev->dev, &info->uio);
+	if (ret) {
+		pr_err("jr_uio: UIO group registration failed\n");
+		jr_uio_group_free(group);
+		return ret;
+	}
+
+	jr_group = group;
+	dev_info(group->rings[0]->dev, "UIO device %s of %d job rings\n",
+		 info->name, group->nrings);
+
+	return 0;
+}
+
+/*
+ * Remove the group before any of its rings, jr_group_lock held. An open
+ * group keeps its memory and DMA buffer pool until it is released, as the
+ * UIO core still calls its release then, but the rings are detached from
+ * it right away.
+ */
+static void jr_uio_group_exit(void)
+{
+	struct jr_uio_group *group = jr_group;
+
+	if (!group)
+		return;
+
+	jr_group = NULL;
+	uio_unregister_device(&group->info.uio);
+
+	if (group->open)
+		jr_uio_group_detach(group);
+	group->removed = true;
+
+	if (!group->open)
+		jr_uio_group_free(group);
+}
+
+static bool jr_uio_group_has(struct jr_uio_group *group, struct jr_dev *ring)
+{
+	int i;
+
+	for (i = 0; i < group->nrings; i++)
+		if (group->rings[i] == ring)
+			return true;
+
+	return false;
+}
+
+/*
+ * Rebuild the group from the rings now in jr_list, jr_group_lock held.
+ * An open group is only replaced once released, unless it loses @gone.
+ */
+static void jr_uio_group_update(struct jr_dev *gone)
+{
+	if (jr_group && jr_group->open && !jr_uio_group_has(jr_group, gone)) {
+		jr_group_stale = true;
+		return;
+	}
+
+	jr_group_stale = false;
+	jr_uio_group_exit();
+	if (jr_uio_group_init())
+		pr_warn("jr_uio: no job ring group device\n");
+}
+
+static void jr_uio_group_work_fn(struct work_struct *work)
+{
+	mutex_lock(&jr_group_lock);
+	if (jr_group_stale)
+		jr_uio_group_update(NULL);
+	mutex_unlock(&jr_group_lock);
+}
+
 static const struct of_device_id jr_ids[] = {
 	{ .compatible = "fsl,sec-v4.0-job-ring", },
 	{ .compatible = "fsl,sec-v4.4-job-ring", },
@@ -147,13 +579,36 @@ static const struct of_device_id jr_ids[] = {
 	{},
 };
 
+/* Index of a job ring under the SEC node, as the controller numbers them */
+static int jr_uio_ring_index(struct device_node *jr_node)
+{
+	struct device_node *parent, *np;
+	int index = 0;
+
+	parent = of_get_parent(jr_node);
+	if (!parent)
+		return 0;
+
+	for_each_available_child_of_node(parent, np) {
+		if (np == jr_node) {
+			of_node_put(np);
+			break;
+		}
+		if (of_device_is_compatible(np, "fsl,sec-v4.0-job-ring") ||
+		    of_device_is_compatible(np, "fsl,sec4.0-job-ring"))
+			index++;
+	}
+	of_node_put(parent);
+
+	return index;
+}
+
 static int fsl_jr_probe(struct platform_device *dev)
 {
 	struct resource regs;
 	struct jr_dev *jr_dev;
 	struct device_node *jr_node;
-	int ret, count = 0;
-	struct list_head *p;
+	int index, ret;
 
 	jr_node = dev->dev.of_node;
 	if (!jr_node) {
@@ -161,17 +616,21 @@ static int fsl_jr_probe(struct platform_device *dev)
 		return -EFAULT;
 	}
 
+	/* leave the other rings to caam_jr */
+	index = jr_uio_ring_index(jr_node);
+	if (index >= 32 || !(jr_mask & BIT(index))) {
+		dev_dbg(&dev->dev, "job ring %d not selected\n", index);
+		return -ENODEV;
+	}
+
 	jr_dev = devm_kzalloc(&dev->dev, sizeof(struct jr_dev), GFP_KERNEL);
 	if (!jr_dev) {
 		dev_err(&dev->dev, "kzalloc failed\n");
 		return -ENOMEM;
 	}
 
-	/* Creat name and index */
-	list_for_each(p, &jr_list) {
-		count++;
-	}
-	jr_dev->index = count;
+	/* named after the ring, so that unbinding others does not rename it */
+	jr_dev->index = index;
 
 	snprintf(jr_dev->info.name, sizeof(jr_dev->info.name) - 1,
 		 "%s%d", uio_device_name, jr_dev->index);
@@ -213,7 +672,10 @@ static int fsl_jr_probe(struct platform_device *dev)
 		goto abort;
 	}
 
+	mutex_lock(&jr_group_lock);
 	list_add_tail(&jr_dev->node, &jr_list);
+	jr_uio_group_update(NULL);
+	mutex_unlock(&jr_group_lock);
 
 	dev_info(jr_dev->dev, "UIO device full name %s initialized\n",
 		 jr_dev->info.name);
@@ -231,7 +693,12 @@ static int fsl_jr_remove(struct platform_device *dev)
 	if (!jr_dev)
 		return 0;
 
+	/* the group may hold this ring */
+	mutex_lock(&jr_group_lock);
 	list_del(&jr_dev->node);
+	jr_uio_group_update(jr_dev);
+	mutex_unlock(&jr_group_lock);
+
 	uio_unregister_device(&jr_dev->info.uio);
 	platform_set_drvdata(dev, NULL);
 
@@ -253,16 +720,20 @@ static __init int fsl_jr_init(void)
 	int ret;
 
 	ret = platform_driver_register(&fsl_jr_driver);
-	if (unlikely(ret < 0))
+	if (unlikely(ret < 0)) {
 		pr_warn(": %s:%hu:%s(): platform_driver_register() = %d\n",
 			__FILE__, __LINE__, __func__, ret);
+		return ret;
+	}
 
-	return ret;
+	return 0;
 }
 
 static void __exit fsl_jr_exit(void)
 {
+	/* removing the rings takes the group down */
 	platform_driver_unregister(&fsl_jr_driver);
+	cancel_work_sync(&jr_group_work);
 }
 
 module_init(fsl_jr_init);
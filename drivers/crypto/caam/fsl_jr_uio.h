@@ -0,0 +1,39 @@
+/*
+ * CAAM Job Ring UIO support
+ *
+ * Copyright 2013 Freescale Semiconductor, Inc.
+ *
+ * Commands written (as a 32-bit value) to the UIO device file by the
+ * userspace driver, handled by the irqcontrol hook.
+ */
+
+#ifndef FSL_JR_UIO_H
+#define FSL_JR_UIO_H
+
+/* Disable the job ring interrupt */
+#define SEC_UIO_DISABLE_IRQ_CMD		0
+/* Enable the job ring interrupt */
+#define SEC_UIO_ENABLE_IRQ_CMD		1
+/* Have the kernel signal an interrupt event, as if one had occurred */
+#define SEC_UIO_SIMULATE_IRQ_CMD	2
+
+/*
+ * Commands with an argument carry the command in the top byte.
+ *
+ * SEC_UIO_COALESCE_CMD sets the job ring interrupt coalescing thresholds:
+ * an interrupt is raised once count descriptors completed, or time
+ * (in units of 64 bus clocks) after the first of fewer completed.
+ * A count of 0 turns coalescing off.
+ */
+#define SEC_UIO_CMD_SHIFT		24
+#define SEC_UIO_CMD(val)		((u32)(val) >> SEC_UIO_CMD_SHIFT)
+
+#define SEC_UIO_COALESCE_CMD		3
+#define SEC_UIO_COALESCE_COUNT(val)	((val) & 0xff)
+#define SEC_UIO_COALESCE_TIME(val)	(((val) >> 8) & 0xffff)
+#define SEC_UIO_COALESCE(count, time)	((SEC_UIO_COALESCE_CMD << \
+					  SEC_UIO_CMD_SHIFT) | \
+					 (((time) & 0xffff) << 8) | \
+					 ((count) & 0xff))
+
+#endif /* FSL_JR_UIO_H */
@@ -12,14 +12,15 @@
 /* Currently comes from Kconfig param as a ^2 (driver-required) */
 #define JOBR_DEPTH (1 << CONFIG_CRYPTO_DEV_FSL_CAAM_RINGSIZE)
 
-/* Kconfig params for interrupt coalescing if selected (else zero) */
+/*
+ * Kconfig params for interrupt coalescing if selected (else count is zero,
+ * i.e. off). Both can be changed per ring through sysfs.
+ */
 #ifdef CONFIG_CRYPTO_DEV_FSL_CAAM_INTC
-#define JOBR_INTC JRCFG_ICEN
 #define JOBR_INTC_TIME_THLD CONFIG_CRYPTO_DEV_FSL_CAAM_INTC_TIME_THLD
 #define JOBR_INTC_COUNT_THLD CONFIG_CRYPTO_DEV_FSL_CAAM_INTC_COUNT_THLD
 #else
-#define JOBR_INTC 0
-#define JOBR_INTC_TIME_THLD 0
+#define JOBR_INTC_TIME_THLD 2048
 #define JOBR_INTC_COUNT_THLD 0
 #endif
 
@@ -31,7 +32,7 @@ struct caam_jrentry_info {
 	void (*callbk)(struct device *dev, u32 *desc, u32 status, void *arg);
 	void *cbkarg;	/* Argument per ring entry */
 	u32 *desc_addr_virt;	/* Stored virt addr for postprocessing */
-	dma_addr_t desc_addr_dma;	/* Stored bus addr for done matching */
+	dma_addr_t desc_addr_dma;	/* Bus addr of pool slot, 0 when done */
 	u32 desc_size;	/* Stored size for postprocessing, header derived */
 };
 
@@ -41,8 +42,9 @@ struct caam_drv_private_jr {
 	struct device		*dev;
 	int ridx;
 	struct caam_job_ring __iomem *rregs;	/* JobR's register space */
-	struct tasklet_struct irqtask;
 	int irq;			/* One per queue */
+	unsigned int intc_count;	/* Coalescing count threshold, 0 = off */
+	unsigned int intc_time;		/* Coalescing timer threshold */
 
 	/* Number of scatterlist crypt transforms active on the JobR */
 	atomic_t tfm_count ____cacheline_aligned;
@@ -54,6 +56,8 @@ struct caam_drv_private_jr {
 	int inp_ring_write_index;	/* Input index "tail" */
 	int head;			/* entinfo (s/w ring) head index */
 	dma_addr_t *inpring;	/* Base of input ring, alloc DMA-safe */
+	u32 *descpool;		/* Job descriptor copies, one slot per entry */
+	dma_addr_t descpool_dma;
 	spinlock_t outlock ____cacheline_aligned; /* Output ring index lock */
 	int out_ring_read_index;	/* Output index "tail" */
 	int tail;			/* entinfo (s/w ring) tail index */
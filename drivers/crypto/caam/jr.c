@@ -17,6 +17,12 @@
 #define setbits32(_addr, _v) writel((readl(_addr) | (_v)), (_addr))
 #define clrbits32(_addr, _v) writel((readl(_addr) & ~(_v)), (_addr))
 
+/* Completions handled per polling pass before yielding the CPU */
+#define JOBR_POLL_BUDGET	64
+
+/* Each ring entry owns a slot of this size in the descriptor pool */
+#define JOBR_DESC_SLOT_SIZE	(MAX_CAAM_DESCSIZE * sizeof(u32))
+
 struct jr_driver_data {
 	/* List of Physical JobR's with the Driver */
 	struct list_head	jr_list;
@@ -76,8 +82,6 @@ int caam_jr_shutdown(struct device *dev)
 
 	ret = caam_reset_hw_jr(dev);
 
-	tasklet_kill(&jrp->irqtask);
-
 	/* Release interrupt */
 	free_irq(jrp->irq, dev);
 
@@ -88,42 +92,13 @@ int caam_jr_shutdown(struct device *dev)
 			  jrp->inpring, inpbusaddr);
 	dma_free_coherent(dev, sizeof(struct jr_outentry) * JOBR_DEPTH,
 			  jrp->outring, outbusaddr);
+	dma_free_coherent(dev, JOBR_DESC_SLOT_SIZE * JOBR_DEPTH,
+			  jrp->descpool, jrp->descpool_dma);
 	kfree(jrp->entinfo);
 
 	return ret;
 }
 
-static int caam_jr_remove(struct platform_device *pdev)
-{
-	int ret;
-	struct device *jrdev;
-	struct caam_drv_private_jr *jrpriv;
-
-	jrdev = &pdev->dev;
-	jrpriv = dev_get_drvdata(jrdev);
-
-	/*
-	 * Return EBUSY if job ring already allocated.
-	 */
-	if (atomic_read(&jrpriv->tfm_count)) {
-		dev_err(jrdev, "Device is busy\n");
-		return -EBUSY;
-	}
-
-	/* Remove the node from Physical JobR list maintained by driver */
-	spin_lock(&driver_data.jr_alloc_lock);
-	list_del(&jrpriv->list_node);
-	spin_unlock(&driver_data.jr_alloc_lock);
-
-	/* Release ring */
-	ret = caam_jr_shutdown(jrdev);
-	if (ret)
-		dev_err(jrdev, "Failed to shut down job ring\n");
-	irq_dispose_mapping(jrpriv->irq);
-
-	return ret;
-}
-
 /* Main per-ring interrupt handler */
 static irqreturn_t caam_jr_interrupt(int irq, void *st_dev)
 {
@@ -133,7 +108,7 @@ static irqreturn_t caam_jr_interrupt(int irq, void *st_dev)
 
 	/*
 	 * Check the output ring for ready responses, kick
-	 * tasklet if jobs done.
+	 * the polling thread if jobs done.
 	 */
 	irqstate = rd_reg32(&jrp->rregs->jrintstatus);
 	if (!irqstate)
@@ -155,84 +130,227 @@ static irqreturn_t caam_jr_interrupt(int irq, void *st_dev)
 	/* Have valid interrupt at this point, just ACK and trigger */
 	wr_reg32(&jrp->rregs->jrintstatus, irqstate);
 
-	preempt_disable();
-	tasklet_schedule(&jrp->irqtask);
-	preempt_enable();
-
-	return IRQ_HANDLED;
+	return IRQ_WAKE_THREAD;
 }
 
-/* Deferred service handler, run as interrupt-fired tasklet */
-static void caam_jr_dequeue(unsigned long devarg)
+/*
+ * Process up to @budget completed jobs. Returns the number of jobs done,
+ * the output ring may still hold more when this equals @budget.
+ */
+static int caam_jr_dequeue(struct device *dev, int budget)
 {
-	int hw_idx, sw_idx, i, head, tail;
-	struct device *dev = (struct device *)devarg;
+	int hw_idx, sw_idx, head, tail, avail, i;
 	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
 	void (*usercall)(struct device *dev, u32 *desc, u32 status, void *arg);
 	u32 *userdesc, userstatus;
 	void *userarg;
+	dma_addr_t outdesc;
+	int done = 0;
 
-	while (rd_reg32(&jrp->rregs->outring_used)) {
+	while (done < budget) {
+		avail = rd_reg32(&jrp->rregs->outring_used);
+		if (!avail)
+			break;
+		avail = min(avail, budget - done);
 
-		head = ACCESS_ONCE(jrp->head);
+		for (i = 0; i < avail; i++) {
+			head = ACCESS_ONCE(jrp->head);
 
-		spin_lock(&jrp->outlock);
+			spin_lock(&jrp->outlock);
 
-		sw_idx = tail = jrp->tail;
-		hw_idx = jrp->out_ring_read_index;
+			tail = jrp->tail;
+			hw_idx = jrp->out_ring_read_index;
+			outdesc = jrp->outring[hw_idx].desc;
 
-		for (i = 0; CIRC_CNT(head, tail + i, JOBR_DEPTH) >= 1; i++) {
-			sw_idx = (tail + i) & (JOBR_DEPTH - 1);
+			/* the descriptor's pool slot gives its ring entry */
+			sw_idx = (outdesc - jrp->descpool_dma) /
+				 JOBR_DESC_SLOT_SIZE;
 
-			if (jrp->outring[hw_idx].desc ==
-			    jrp->entinfo[sw_idx].desc_addr_dma)
-				break; /* found */
-		}
-		/* we should never fail to find a matching descriptor */
-		BUG_ON(CIRC_CNT(head, tail + i, JOBR_DEPTH) <= 0);
-
-		/* Unmap just-run descriptor so we can post-process */
-		dma_unmap_single(dev, jrp->outring[hw_idx].desc,
-				 jrp->entinfo[sw_idx].desc_size,
-				 DMA_TO_DEVICE);
-
-		/* mark completed, avoid matching on a recycled desc addr */
-		jrp->entinfo[sw_idx].desc_addr_dma = 0;
-
-		/* Stash callback params for use outside of lock */
-		usercall = jrp->entinfo[sw_idx].callbk;
-		userarg = jrp->entinfo[sw_idx].cbkarg;
-		userdesc = jrp->entinfo[sw_idx].desc_addr_virt;
-		userstatus = jrp->outring[hw_idx].jrstatus;
-
-		/* set done */
-		wr_reg32(&jrp->rregs->outring_rmvd, 1);
-
-		jrp->out_ring_read_index = (jrp->out_ring_read_index + 1) &
-					   (JOBR_DEPTH - 1);
-
-		/*
-		 * if this job completed out-of-order, do not increment
-		 * the tail.  Otherwise, increment tail by 1 plus the
-		 * number of subsequent jobs already completed out-of-order
-		 */
-		if (sw_idx == tail) {
-			do {
-				tail = (tail + 1) & (JOBR_DEPTH - 1);
-			} while (CIRC_CNT(head, tail, JOBR_DEPTH) >= 1 &&
-				 jrp->entinfo[tail].desc_addr_dma == 0);
-
-			jrp->tail = tail;
-		}
+			/* we should never fail to find a matching descriptor */
+			BUG_ON(outdesc < jrp->descpool_dma ||
+			       sw_idx >= JOBR_DEPTH ||
+			       jrp->entinfo[sw_idx].desc_addr_dma != outdesc);
+
+			/* mark completed, avoid matching on a recycled slot */
+			jrp->entinfo[sw_idx].desc_addr_dma = 0;
+
+			/* Stash callback params for use outside of lock */
+			usercall = jrp->entinfo[sw_idx].callbk;
+			userarg = jrp->entinfo[sw_idx].cbkarg;
+			userdesc = jrp->entinfo[sw_idx].desc_addr_virt;
+			userstatus = jrp->outring[hw_idx].jrstatus;
+
+			jrp->out_ring_read_index = (jrp->out_ring_read_index +
+						    1) & (JOBR_DEPTH - 1);
+
+			/*
+			 * if this job completed out-of-order, do not increment
+			 * the tail.  Otherwise, increment tail by 1 plus the
+			 * number of subsequent jobs already completed
+			 * out-of-order
+			 */
+			if (sw_idx == tail) {
+				do {
+					tail = (tail + 1) & (JOBR_DEPTH - 1);
+				} while (CIRC_CNT(head, tail, JOBR_DEPTH) >= 1 &&
+					 jrp->entinfo[tail].desc_addr_dma == 0);
 
-		spin_unlock(&jrp->outlock);
+				jrp->tail = tail;
+			}
 
-		/* Finally, execute user's callback */
-		usercall(dev, userdesc, userstatus, userarg);
+			spin_unlock(&jrp->outlock);
+
+			/* Finally, execute user's callback */
+			usercall(dev, userdesc, userstatus, userarg);
+		}
+
+		/* set done, the entries have all been read by now */
+		wr_reg32(&jrp->rregs->outring_rmvd, avail);
+		done += avail;
 	}
 
+	return done;
+}
+
+/*
+ * Threaded interrupt handler: poll the output ring in passes of
+ * JOBR_POLL_BUDGET jobs until it runs dry, with the interrupt left masked.
+ * Completion callbacks expect softirq context, like they had in the
+ * tasklet this replaces.
+ */
+static irqreturn_t caam_jr_threadirq(int irq, void *st_dev)
+{
+	struct device *dev = st_dev;
+	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
+	int done;
+
+	do {
+		local_bh_disable();
+		done = caam_jr_dequeue(dev, JOBR_POLL_BUDGET);
+		local_bh_enable();
+		cond_resched();
+	} while (done == JOBR_POLL_BUDGET);
+
 	/* reenable / unmask IRQs */
 	clrbits32(&jrp->rregs->rconfig_lo, JRCFG_IMSK);
+
+	return IRQ_HANDLED;
+}
+
+/* Program the hardware interrupt coalescing thresholds, 0 count is off */
+static void caam_jr_config_intc(struct caam_drv_private_jr *jrp)
+{
+	u32 cfg;
+
+	cfg = rd_reg32(&jrp->rregs->rconfig_lo);
+	cfg &= ~(JRCFG_ICEN | JRCFG_ICDCT_MASK | JRCFG_ICTT_MASK);
+	if (jrp->intc_count)
+		cfg |= JRCFG_ICEN |
+		       (jrp->intc_count << JRCFG_ICDCT_SHIFT) |
+		       (jrp->intc_time << JRCFG_ICTT_SHIFT);
+	wr_reg32(&jrp->rregs->rconfig_lo, cfg);
+}
+
+static ssize_t caam_jr_intc_store(struct device *dev, const char *buf,
+				  size_t count, unsigned int *thld,
+				  unsigned int min, unsigned int max)
+{
+	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (val < min || val > max)
+		return -EINVAL;
+
+	/* keep the handlers off the configuration register meanwhile */
+	disable_irq(jrp->irq);
+	*thld = val;
+	caam_jr_config_intc(jrp);
+	enable_irq(jrp->irq);
+
+	return count;
+}
+
+static ssize_t intc_count_thld_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", jrp->intc_count);
+}
+
+static ssize_t intc_count_thld_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
+
+	return caam_jr_intc_store(dev, buf, count, &jrp->intc_count, 0, 255);
+}
+static DEVICE_ATTR_RW(intc_count_thld);
+
+static ssize_t intc_time_thld_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", jrp->intc_time);
+}
+
+static ssize_t intc_time_thld_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
+
+	return caam_jr_intc_store(dev, buf, count, &jrp->intc_time, 1, 65535);
+}
+static DEVICE_ATTR_RW(intc_time_thld);
+
+static struct attribute *caam_jr_attrs[] = {
+	&dev_attr_intc_count_thld.attr,
+	&dev_attr_intc_time_thld.attr,
+	NULL,
+};
+
+static const struct attribute_group caam_jr_attr_group = {
+	.attrs = caam_jr_attrs,
+};
+
+static int caam_jr_remove(struct platform_device *pdev)
+{
+	int ret;
+	struct device *jrdev;
+	struct caam_drv_private_jr *jrpriv;
+
+	jrdev = &pdev->dev;
+	jrpriv = dev_get_drvdata(jrdev);
+
+	/*
+	 * Return EBUSY if job ring already allocated.
+	 */
+	if (atomic_read(&jrpriv->tfm_count)) {
+		dev_err(jrdev, "Device is busy\n");
+		return -EBUSY;
+	}
+
+	/* Remove the node from Physical JobR list maintained by driver */
+	spin_lock(&driver_data.jr_alloc_lock);
+	list_del(&jrpriv->list_node);
+	spin_unlock(&driver_data.jr_alloc_lock);
+
+	sysfs_remove_group(&jrdev->kobj, &caam_jr_attr_group);
+
+	/* Release ring */
+	ret = caam_jr_shutdown(jrdev);
+	if (ret)
+		dev_err(jrdev, "Failed to shut down job ring\n");
+	irq_dispose_mapping(jrpriv->irq);
+
+	return ret;
 }
 
 /**
@@ -288,15 +406,45 @@ void caam_jr_free(struct device *rdev)
 }
 EXPORT_SYMBOL(caam_jr_free);
 
+/*
+ * Copy a job into the next free ring entry, the caller holds inplock and
+ * has checked for room. The hardware reads the job from the entry's slot
+ * in the coherent descriptor pool. That saves mapping it for every job,
+ * and the slot address leads straight back to the entry on completion.
+ */
+static void caam_jr_add_job(struct caam_drv_private_jr *jrp, int head,
+			    int windex, u32 *desc, int desc_size,
+			    void (*cbk)(struct device *dev, u32 *desc,
+					u32 status, void *areq),
+			    void *areq)
+{
+	struct caam_jrentry_info *head_entry;
+	dma_addr_t desc_dma;
+
+	desc_dma = jrp->descpool_dma + head * JOBR_DESC_SLOT_SIZE;
+	memcpy((u8 *)jrp->descpool + head * JOBR_DESC_SLOT_SIZE, desc,
+	       desc_size);
+
+	head_entry = &jrp->entinfo[head];
+	head_entry->desc_addr_virt = desc;
+	head_entry->desc_size = desc_size;
+	head_entry->callbk = (void *)cbk;
+	head_entry->cbkarg = areq;
+	head_entry->desc_addr_dma = desc_dma;
+
+	jrp->inpring[windex] = desc_dma;
+}
+
 /**
  * caam_jr_enqueue() - Enqueue a job descriptor head. Returns 0 if OK,
- * -EBUSY if the queue is full, -EIO if it cannot map the caller's
- * descriptor.
+ * -EBUSY if the queue is full, -EIO if the caller's descriptor is
+ * too long.
  * @dev:  device of the job ring to be used. This device should have
  *        been assigned prior by caam_jr_register().
- * @desc: points to a job descriptor that execute our request. All
- *        descriptors (and all referenced data) must be in a DMAable
- *        region, and all data references must be physical addresses
+ * @desc: points to a job descriptor that execute our request. It is
+ *        copied to the job ring, so it needs not stay valid, but all
+ *        referenced data must be in a DMAable region, and all data
+ *        references must be physical addresses
  *        accessible to CAAM (i.e. within a PAMU window granted
  *        to it).
  * @cbk:  pointer to a callback function to be invoked upon completion
@@ -322,14 +470,11 @@ int caam_jr_enqueue(struct device *dev, u32 *desc,
 		    void *areq)
 {
 	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
-	struct caam_jrentry_info *head_entry;
 	int head, tail, desc_size;
-	dma_addr_t desc_dma;
 
 	desc_size = (*desc & HDR_JD_LENGTH_MASK) * sizeof(u32);
-	desc_dma = dma_map_single(dev, desc, desc_size, DMA_TO_DEVICE);
-	if (dma_mapping_error(dev, desc_dma)) {
-		dev_err(dev, "caam_jr_enqueue(): can't map jobdesc\n");
+	if (desc_size > JOBR_DESC_SLOT_SIZE) {
+		dev_err(dev, "caam_jr_enqueue(): jobdesc too long\n");
 		return -EIO;
 	}
 
@@ -341,18 +486,11 @@ int caam_jr_enqueue(struct device *dev, u32 *desc,
 	if (!rd_reg32(&jrp->rregs->inpring_avail) ||
 	    CIRC_SPACE(head, tail, JOBR_DEPTH) <= 0) {
 		spin_unlock_bh(&jrp->inplock);
-		dma_unmap_single(dev, desc_dma, desc_size, DMA_TO_DEVICE);
 		return -EBUSY;
 	}
 
-	head_entry = &jrp->entinfo[head];
-	head_entry->desc_addr_virt = desc;
-	head_entry->desc_size = desc_size;
-	head_entry->callbk = (void *)cbk;
-	head_entry->cbkarg = areq;
-	head_entry->desc_addr_dma = desc_dma;
-
-	jrp->inpring[jrp->inp_ring_write_index] = desc_dma;
+	caam_jr_add_job(jrp, head, jrp->inp_ring_write_index, desc, desc_size,
+			cbk, areq);
 
 	smp_wmb();
 
@@ -368,6 +506,63 @@ int caam_jr_enqueue(struct device *dev, u32 *desc,
 }
 EXPORT_SYMBOL(caam_jr_enqueue);
 
+/**
+ * caam_jr_enqueue_bulk() - Enqueue several job descriptors at once, with a
+ * single lock round trip and a single doorbell write. Returns the number
+ * of jobs enqueued, which is less than njobs if the ring fills up, or -EIO
+ * if one of the descriptors is too long, in which case none is enqueued.
+ * @dev:   device of the job ring to be used, as for caam_jr_enqueue().
+ * @jobs:  descriptors, callbacks and callback arguments, each as for
+ *         caam_jr_enqueue(). The jobs are run in array order.
+ * @njobs: number of entries in jobs.
+ **/
+int caam_jr_enqueue_bulk(struct device *dev, const struct caam_jr_job *jobs,
+			 int njobs)
+{
+	struct caam_drv_private_jr *jrp = dev_get_drvdata(dev);
+	int head, tail, windex, space, i;
+
+	for (i = 0; i < njobs; i++) {
+		if ((*jobs[i].desc & HDR_JD_LENGTH_MASK) * sizeof(u32) >
+		    JOBR_DESC_SLOT_SIZE) {
+			dev_err(dev, "caam_jr_enqueue_bulk(): jobdesc too long\n");
+			return -EIO;
+		}
+	}
+
+	spin_lock_bh(&jrp->inplock);
+
+	head = jrp->head;
+	tail = ACCESS_ONCE(jrp->tail);
+	windex = jrp->inp_ring_write_index;
+
+	space = min_t(int, CIRC_SPACE(head, tail, JOBR_DEPTH),
+		      rd_reg32(&jrp->rregs->inpring_avail));
+	njobs = min(njobs, space);
+
+	for (i = 0; i < njobs; i++) {
+		caam_jr_add_job(jrp, head, windex, jobs[i].desc,
+				(*jobs[i].desc & HDR_JD_LENGTH_MASK) *
+				sizeof(u32), jobs[i].cbk, jobs[i].areq);
+		head = (head + 1) & (JOBR_DEPTH - 1);
+		windex = (windex + 1) & (JOBR_DEPTH - 1);
+	}
+
+	if (njobs) {
+		smp_wmb();
+
+		jrp->inp_ring_write_index = windex;
+		jrp->head = head;
+
+		wr_reg32(&jrp->rregs->inpring_jobadd, njobs);
+	}
+
+	spin_unlock_bh(&jrp->inplock);
+
+	return njobs;
+}
+EXPORT_SYMBOL(caam_jr_enqueue_bulk);
+
 /*
  * Init JobR independent of platform property detection
  */
@@ -379,15 +574,14 @@ static int caam_jr_init(struct device *dev)
 
 	jrp = dev_get_drvdata(dev);
 
-	tasklet_init(&jrp->irqtask, caam_jr_dequeue, (unsigned long)dev);
-
 	/* Connect job ring interrupt handler. */
-	error = request_irq(jrp->irq, caam_jr_interrupt, IRQF_SHARED,
-			    dev_name(dev), dev);
+	error = request_threaded_irq(jrp->irq, caam_jr_interrupt,
+				     caam_jr_threadirq, IRQF_SHARED,
+				     dev_name(dev), dev);
 	if (error) {
 		dev_err(dev, "can't connect JobR %d interrupt (%d)\n",
 			jrp->ridx, jrp->irq);
-		goto out_kill_deq;
+		return error;
 	}
 
 	error = caam_reset_hw_jr(dev);
@@ -405,10 +599,16 @@ static int caam_jr_init(struct device *dev)
 	if (!jrp->outring)
 		goto out_free_inpring;
 
+	jrp->descpool = dma_alloc_coherent(dev, JOBR_DESC_SLOT_SIZE *
+					   JOBR_DEPTH, &jrp->descpool_dma,
+					   GFP_KERNEL);
+	if (!jrp->descpool)
+		goto out_free_outring;
+
 	jrp->entinfo = kzalloc(sizeof(struct caam_jrentry_info) * JOBR_DEPTH,
 			       GFP_KERNEL);
 	if (!jrp->entinfo)
-		goto out_free_outring;
+		goto out_free_descpool;
 
 	for (i = 0; i < JOBR_DEPTH; i++)
 		jrp->entinfo[i].desc_addr_dma = !0;
@@ -430,12 +630,15 @@ static int caam_jr_init(struct device *dev)
 	spin_lock_init(&jrp->outlock);
 
 	/* Select interrupt coalescing parameters */
-	setbits32(&jrp->rregs->rconfig_lo, JOBR_INTC |
-		  (JOBR_INTC_COUNT_THLD << JRCFG_ICDCT_SHIFT) |
-		  (JOBR_INTC_TIME_THLD << JRCFG_ICTT_SHIFT));
+	jrp->intc_count = JOBR_INTC_COUNT_THLD;
+	jrp->intc_time = JOBR_INTC_TIME_THLD;
+	caam_jr_config_intc(jrp);
 
 	return 0;
 
+out_free_descpool:
+	dma_free_coherent(dev, JOBR_DESC_SLOT_SIZE * JOBR_DEPTH,
+			  jrp->descpool, jrp->descpool_dma);
 out_free_outring:
 	dma_free_coherent(dev, sizeof(struct jr_outentry) * JOBR_DEPTH,
 			  jrp->outring, outbusaddr);
@@ -445,8 +648,6 @@ out_free_inpring:
 	dev_err(dev, "can't allocate job rings for %d\n", jrp->ridx);
 out_free_irq:
 	free_irq(jrp->irq, dev);
-out_kill_deq:
-	tasklet_kill(&jrp->irqtask);
 	return error;
 }
 
@@ -510,6 +711,9 @@ static int caam_jr_probe(struct platform_device *pdev)
 
 	atomic_set(&jrpriv->tfm_count, 0);
 
+	if (sysfs_create_group(&jrdev->kobj, &caam_jr_attr_group))
+		dev_warn(jrdev, "can't create sysfs attributes\n");
+
 	return 0;
 }
 
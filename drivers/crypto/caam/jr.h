@@ -7,6 +7,13 @@
 #ifndef JR_H
 #define JR_H
 
+/* A job for caam_jr_enqueue_bulk(), arguments as for caam_jr_enqueue() */
+struct caam_jr_job {
+	u32 *desc;
+	void (*cbk)(struct device *dev, u32 *desc, u32 status, void *areq);
+	void *areq;
+};
+
 /* Prototypes for backend-level services exposed to APIs */
 struct device *caam_jr_alloc(void);
 void caam_jr_free(struct device *rdev);
@@ -14,5 +21,7 @@ int caam_jr_enqueue(struct device *dev, u32 *desc,
 		    void (*cbk)(struct device *dev, u32 *desc, u32 status,
 				void *areq),
 		    void *areq);
+int caam_jr_enqueue_bulk(struct device *dev, const struct caam_jr_job *jobs,
+			 int njobs);
 
 #endif /* JR_H */
@@ -5,6 +5,9 @@
  *
  */
 
+/* length of the split key generation job descriptor */
+#define DESC_SPLIT_KEY_LEN	(CAAM_CMD_SZ * 6 + CAAM_PTR_SZ * 2)
+
 struct split_key_result {
 	struct completion completion;
 	int err;
@@ -12,6 +15,10 @@ struct split_key_result {
 
 void split_key_done(struct device *dev, u32 *desc, u32 err, void *context);
 
+void init_split_key_job_desc(u32 *desc, dma_addr_t key_out_dma,
+			     int split_key_len, dma_addr_t key_in_dma,
+			     u32 keylen, u32 alg_op);
+
 int gen_split_key(struct device *jrdev, u8 *key_out, int split_key_len,
 		    int split_key_pad_len, const u8 *key_in, u32 keylen,
 		    u32 alg_op);
@@ -115,6 +115,10 @@ int kcaop_to_user(struct kernel_crypt_auth_op *kcaop,
 int crypto_auth_run(struct fcrypt *fcr, struct kernel_crypt_auth_op *kcaop);
 int crypto_run(struct fcrypt *fcr, struct kernel_crypt_op *kcop);
 
+/* public key */
+uint32_t crypto_asym_features(void);
+int crypto_run_asym(struct crypt_kop *kop);
+
 #include <cryptlib.h>
 
 /* other internal structs */
@@ -808,6 +808,7 @@ cryptodev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg_)
 	struct crypt_priv *pcr = filp->private_data;
 	struct fcrypt *fcr;
 	struct session_info_op siop;
+	struct crypt_kop kop;
 	uint32_t ses;
 	int ret, fd;
 
@@ -818,7 +819,16 @@ cryptodev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg_)
 
 	switch (cmd) {
 	case CIOCASYMFEAT:
-		return put_user(0, p);
+		return put_user(crypto_asym_features(), p);
+	case CIOCKEY:
+		if (unlikely(copy_from_user(&kop, arg, sizeof(kop))))
+			return -EFAULT;
+
+		ret = crypto_run_asym(&kop);
+		kop.crk_status = ret;
+		if (unlikely(copy_to_user(arg, &kop, sizeof(kop))))
+			return -EFAULT;
+		return ret;
 	case CRIOGET:
 		fd = clonefd(filp);
 		ret = put_user(fd, p);
@@ -0,0 +1,260 @@
+/*
+ * Driver for /dev/crypto device (aka CryptoDev)
+ *
+ * This file is part of linux cryptodev.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * This file handles the public key part (CIOCKEY) of /dev/crypto.
+ *
+ * The operations run on the public key engine registered with
+ * crypto/pkc.h. As with OpenBSD's cryptodev, numbers are passed as
+ * little-endian byte strings of crp_nbits bits; the engine takes them
+ * big-endian.
+ */
+
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <crypto/pkc.h>
+#include "cryptodev_int.h"
+
+#define CRK_MAX_PARAM_BYTES	(4096 / 8)
+
+struct kernel_crparam {
+	u8 *num;
+	unsigned int len;
+};
+
+static void crparam_reverse(u8 *num, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len / 2; i++)
+		swap(num[i], num[len - 1 - i]);
+}
+
+static int crparam_alloc(struct kernel_crparam *kparam,
+			 const struct crparam *param)
+{
+	kparam->len = DIV_ROUND_UP(param->crp_nbits, 8);
+	if (!kparam->len || kparam->len > CRK_MAX_PARAM_BYTES)
+		return -EINVAL;
+
+	kparam->num = kzalloc(kparam->len, GFP_KERNEL);
+	if (!kparam->num)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int crparam_from_user(struct kernel_crparam *kparam,
+			     const struct crparam *param)
+{
+	int ret;
+
+	ret = crparam_alloc(kparam, param);
+	if (unlikely(ret))
+		return ret;
+
+	if (unlikely(copy_from_user(kparam->num, (void __user *)param->crp_p,
+				    kparam->len)))
+		return -EFAULT;
+
+	crparam_reverse(kparam->num, kparam->len);
+
+	return 0;
+}
+
+static int crparam_to_user(struct kernel_crparam *kparam,
+			   const struct crparam *param)
+{
+	crparam_reverse(kparam->num, kparam->len);
+
+	if (unlikely(copy_to_user((void __user *)param->crp_p, kparam->num,
+				  kparam->len)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/* in: a, e, n; out: a^e mod n */
+static int crypto_kop_mod_exp(struct kernel_crparam *kp)
+{
+	struct pkc_mod_exp_req req = {
+		.a = kp[0].num, .a_len = kp[0].len,
+		.e = kp[1].num, .e_len = kp[1].len,
+		.n = kp[2].num, .n_len = kp[2].len,
+	};
+
+	/* the result has the length of the modulus */
+	if (kp[3].len < req.n_len)
+		return -EINVAL;
+
+	req.out = kp[3].num + kp[3].len - req.n_len;
+
+	return crypto_pkc_mod_exp(&req);
+}
+
+/* in: private key, public key, prime; out: shared secret */
+static int crypto_kop_dh_compute_key(struct kernel_crparam *kp)
+{
+	struct kernel_crparam mod_exp[4] = {
+		kp[1], kp[0], kp[2], kp[3]
+	};
+
+	return crypto_kop_mod_exp(mod_exp);
+}
+
+/* in: p, q, a, dp, dq, qinv; out: a^d mod p*q */
+static int crypto_kop_mod_exp_crt(struct kernel_crparam *kp)
+{
+	struct pkc_mod_exp_crt_req req = {
+		.p = kp[0].num, .p_len = kp[0].len,
+		.q = kp[1].num, .q_len = kp[1].len,
+		.a = kp[2].num, .a_len = kp[2].len,
+		.dp = kp[3].num, .dp_len = kp[3].len,
+		.dq = kp[4].num, .dq_len = kp[4].len,
+		.qinv = kp[5].num, .qinv_len = kp[5].len,
+		.out = kp[6].num, .out_len = kp[6].len,
+	};
+
+	return crypto_pkc_mod_exp_crt(&req);
+}
+
+/* in: k, x, y, p, a, b; out: x and y of k * (x, y) */
+static int crypto_kop_ec_point_mul(struct kernel_crparam *kp)
+{
+	static const int elems[] = { 1, 2, 4, 5 };
+	struct pkc_ecc_mul_req req = {
+		.k = kp[0].num, .k_len = kp[0].len,
+		.p = kp[3].num, .p_len = kp[3].len,
+	};
+	u8 *nums[ARRAY_SIZE(elems)];
+	u8 *buf;
+	int i, ret;
+
+	if (kp[6].len < req.p_len || kp[7].len < req.p_len)
+		return -EINVAL;
+
+	/* the engine takes the field elements at the length of p */
+	buf = kcalloc(ARRAY_SIZE(elems), req.p_len, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(elems); i++) {
+		const struct kernel_crparam *elem = &kp[elems[i]];
+
+		if (elem->len > req.p_len) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		nums[i] = buf + i * req.p_len;
+		memcpy(nums[i] + req.p_len - elem->len, elem->num, elem->len);
+	}
+
+	req.x = nums[0];
+	req.y = nums[1];
+	req.a = nums[2];
+	req.b = nums[3];
+	req.rx = kp[6].num + kp[6].len - req.p_len;
+	req.ry = kp[7].num + kp[7].len - req.p_len;
+
+	ret = crypto_pkc_ecc_mul(&req);
+out:
+	kzfree(buf);
+	return ret;
+}
+
+static const struct {
+	unsigned int iparams;
+	unsigned int oparams;
+	unsigned int feature;
+	int (*run)(struct kernel_crparam *kp);
+} crypto_kops[] = {
+	[CRK_MOD_EXP]		= { 3, 1, PKC_F_MOD_EXP,
+				    crypto_kop_mod_exp },
+	[CRK_MOD_EXP_CRT]	= { 6, 1, PKC_F_MOD_EXP_CRT,
+				    crypto_kop_mod_exp_crt },
+	[CRK_DH_COMPUTE_KEY]	= { 3, 1, PKC_F_MOD_EXP,
+				    crypto_kop_dh_compute_key },
+	[CRK_EC_POINT_MUL]	= { 6, 2, PKC_F_ECC_MUL,
+				    crypto_kop_ec_point_mul },
+};
+
+uint32_t crypto_asym_features(void)
+{
+	unsigned int features = crypto_pkc_features();
+	uint32_t crf = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(crypto_kops); i++)
+		if (crypto_kops[i].run && (features & crypto_kops[i].feature))
+			crf |= 1 << i;
+
+	return crf;
+}
+
+int crypto_run_asym(struct crypt_kop *kop)
+{
+	struct kernel_crparam kp[CRK_MAXPARAM];
+	unsigned int nparams;
+	int i, ret;
+
+	if (unlikely(kop->crk_op >= ARRAY_SIZE(crypto_kops) ||
+		     !crypto_kops[kop->crk_op].run))
+		return -EOPNOTSUPP;
+
+	if (unlikely(kop->crk_iparams != crypto_kops[kop->crk_op].iparams ||
+		     kop->crk_oparams != crypto_kops[kop->crk_op].oparams))
+		return -EINVAL;
+
+	nparams = kop->crk_iparams + kop->crk_oparams;
+	memset(kp, 0, sizeof(kp));
+
+	for (i = 0; i < kop->crk_iparams; i++) {
+		ret = crparam_from_user(&kp[i], &kop->crk_param[i]);
+		if (unlikely(ret))
+			goto out;
+	}
+
+	for (; i < nparams; i++) {
+		ret = crparam_alloc(&kp[i], &kop->crk_param[i]);
+		if (unlikely(ret))
+			goto out;
+	}
+
+	ret = crypto_kops[kop->crk_op].run(kp);
+	if (unlikely(ret)) {
+		dwarning(2, "asymmetric operation %u failed: %d",
+			 kop->crk_op, ret);
+		goto out;
+	}
+
+	for (i = kop->crk_iparams; i < nparams; i++) {
+		ret = crparam_to_user(&kp[i], &kop->crk_param[i]);
+		if (unlikely(ret))
+			goto out;
+	}
+
+out:
+	for (i = 0; i < nparams; i++)
+		kzfree(kp[i].num);
+
+	return ret;
+}
@@ -8,6 +8,17 @@
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
+ *
+ * A write to MSIIR sets bit IBS of the MSIR register selected by SRS, and
+ * every MSIR has its own GIC interrupt. When the node lists one interrupt
+ * per CPU, MSIR n is bound to CPU n and an MSI is steered to a CPU by
+ * composing its message for that CPU's MSIR. With a single interrupt all
+ * MSIs are signalled through MSIR 0.
+ *
+ * The steering needs a node that lists at least one interrupt per CPU,
+ * with the "msir" region covering as many consecutive MSIR registers.
+ * The LS1021A MSI nodes list a single interrupt each, the steering stays
+ * off for them until a device tree describes more MSIRs per block.
  */
 
 #include <linux/bitmap.h>
@@ -16,12 +27,24 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/msi.h>
+#include <linux/of_irq.h>
 #include <linux/of_pci.h>
 #include <linux/of_platform.h>
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
 
 #define MAX_MSI_IRQS	32
+#define MAX_MSIR_NUM	8	/* SRS is 3 bits wide */
+#define MSIIR_IBS_SHIFT	3
+
+struct ls1_msi;
+
+struct ls1_msir {
+	struct ls1_msi		*msi_data;
+	void __iomem		*reg;
+	int			gic_irq;
+	char			name[32];
+};
 
 struct ls1_msi {
 	char			name[32];
@@ -31,11 +54,13 @@ struct ls1_msi {
 	struct msi_domain_info	info;
 	struct irq_chip		chip;
 	struct irq_domain	*parent;
-	void __iomem		*msir;
 	phys_addr_t		msiir_addr;
 	unsigned long		*bm;
 	u32			nr_irqs;
-	int			msi_irq;
+	struct ls1_msir		msir[MAX_MSIR_NUM];
+	u32			msir_num;
+	bool			affinity;	/* one MSIR per CPU */
+	u8			srs[MAX_MSI_IRQS]; /* MSIR of each hwirq */
 };
 
 static void ls1_msi_compose_msg(struct irq_data *data, struct msi_msg *msg)
@@ -45,13 +70,45 @@ static void ls1_msi_compose_msg(struct irq_data *data, struct msi_msg *msg)
 
 	msg->address_hi = (u32) (addr >> 32);
 	msg->address_lo = (u32) (addr);
-	msg->data = data->hwirq * 8;
+	msg->data = (data->hwirq << MSIIR_IBS_SHIFT) |
+		    msi_data->srs[data->hwirq];
 }
 
+/*
+ * The MSI domain core rewrites the message of the device after this, so
+ * only the MSIR has to be picked. An MSI still pending in the old MSIR is
+ * handled there, the handlers do not depend on the MSIR of a hwirq.
+ *
+ * request_irq() passes the default mask of all CPUs: keep the MSIR the
+ * vector was spread to at allocation while its CPU is allowed, and record
+ * the one CPU actually serving the vector.
+ */
 static int ls1_msi_set_affinity(struct irq_data *irq_data,
 				    const struct cpumask *mask, bool force)
 {
-	return 0;
+	struct ls1_msi *msi_data = irq_data_get_irq_chip_data(irq_data);
+	unsigned int cpu = msi_data->srs[irq_data->hwirq];
+
+	if (!msi_data->affinity)
+		return -EINVAL;
+
+	if (!cpumask_test_cpu(cpu, mask) ||
+	    (!force && !cpu_online(cpu))) {
+		if (force)
+			cpu = cpumask_first(mask);
+		else
+			cpu = cpumask_any_and(mask, cpu_online_mask);
+	}
+
+	if (cpu >= msi_data->msir_num)
+		return -EINVAL;
+
+	msi_data->srs[irq_data->hwirq] = cpu;
+	/* the mask lives in the top level irq_data, not in this parent */
+	cpumask_copy(irq_get_irq_data(irq_data->irq)->affinity,
+		     cpumask_of(cpu));
+
+	return IRQ_SET_MASK_OK_NOCOPY;
 }
 
 static struct irq_chip ls1_msi_parent_chip = {
@@ -75,6 +132,10 @@ static int ls1_msi_domain_irq_alloc(struct irq_domain *domain, unsigned int virq
 		return -ENOSPC;
 
 	for (i = 0; i < nr_irqs; i++) {
+		/* spread new vectors over the CPUs until they are steered */
+		msi_data->srs[pos + i] = msi_data->affinity ?
+					 (pos + i) % msi_data->msir_num : 0;
+
 		irq_domain_set_info(domain, virq + i, pos + i,
 				    &ls1_msi_parent_chip, msi_data,
 				    handle_simple_irq, NULL, NULL);
@@ -109,12 +170,13 @@ static const struct irq_domain_ops ls1_msi_domain_parent_ops = {
 
 static irqreturn_t ls1_msi_handler(int irq, void *arg)
 {
-	struct ls1_msi *msi_data = arg;
+	struct ls1_msir *msir = arg;
+	struct ls1_msi *msi_data = msir->msi_data;
 	unsigned long val;
 	int pos, virq;
 	irqreturn_t ret = IRQ_NONE;
 
-	val = ioread32be(msi_data->msir);
+	val = ioread32be(msir->reg);
 	pos = 0;
 
 	while ((pos = find_next_bit(&val, 32, pos)) != 32) {
@@ -206,12 +268,46 @@ _err:
 }
 
 
+static int __init ls1_msi_setup_msir(struct platform_device *pdev,
+				     struct ls1_msi *msi_data,
+				     void __iomem *base, u32 index)
+{
+	struct ls1_msir *msir = &msi_data->msir[index];
+	int ret;
+
+	msir->msi_data = msi_data;
+	msir->reg = base + index * 4;
+	snprintf(msir->name, sizeof(msir->name), "%s-%u", msi_data->name,
+		 index);
+
+	msir->gic_irq = platform_get_irq(pdev, index);
+	if (msir->gic_irq <= 0) {
+		dev_err(&pdev->dev, "failed to get MSI irq %u\n", index);
+		return -ENODEV;
+	}
+
+	ret = devm_request_irq(&pdev->dev, msir->gic_irq, ls1_msi_handler,
+			       IRQF_SHARED | IRQF_NOBALANCING,
+			       msir->name, msir);
+	if (ret) {
+		dev_err(&pdev->dev, "failed to request MSI irq %u\n", index);
+		return ret;
+	}
+
+	/* MSIR n serves the MSIs steered to CPU n */
+	if (msi_data->affinity)
+		irq_set_affinity(msir->gic_irq, cpumask_of(index));
+
+	return 0;
+}
+
 static int __init ls1_msi_probe(struct platform_device *pdev)
 {
 	struct ls1_msi *msi_data;
 	struct resource *res;
+	void __iomem *msir_base;
 	static int ls1_msi_idx;
-	int ret;
+	int ret, i;
 
 	msi_data = devm_kzalloc(&pdev->dev, sizeof(*msi_data), GFP_KERNEL);
 	if (!msi_data) {
@@ -241,15 +337,26 @@ static int __init ls1_msi_probe(struct platform_device *pdev)
 		return -ENODEV;
 	}
 
-	msi_data->msir = devm_ioremap_resource(&pdev->dev, res);
-	if (IS_ERR(msi_data->msir))
-		return PTR_ERR(msi_data->msir);
+	msir_base = devm_ioremap_resource(&pdev->dev, res);
+	if (IS_ERR(msir_base))
+		return PTR_ERR(msir_base);
 
-	msi_data->msi_irq = platform_get_irq(pdev, 0);
-	if (msi_data->msi_irq <= 0) {
+	/* one MSIR register and GIC interrupt per group */
+	msi_data->msir_num = min3((u32)of_irq_count(msi_data->of_node),
+				  (u32)(resource_size(res) / 4),
+				  (u32)MAX_MSIR_NUM);
+	if (!msi_data->msir_num) {
 		dev_err(&pdev->dev, "failed to get MSI irq\n");
 		return -ENODEV;
 	}
+	msi_data->affinity = num_possible_cpus() > 1 &&
+			     msi_data->msir_num >= num_possible_cpus();
+	if (msi_data->affinity)
+		msi_data->msir_num = num_possible_cpus();
+	else if (num_possible_cpus() > 1)
+		dev_info(&pdev->dev,
+			 "%u MSIR interrupt(s) for %u CPUs, no MSI steering\n",
+			 msi_data->msir_num, num_possible_cpus());
 
 	msi_data->nr_irqs = MAX_MSI_IRQS;
 
@@ -257,19 +364,17 @@ static int __init ls1_msi_probe(struct platform_device *pdev)
 				    BITS_TO_LONGS(msi_data->nr_irqs),
 				    GFP_KERNEL);
 	if (!msi_data->bm)
-		ret = -ENOMEM;
+		return -ENOMEM;
 
 	ls1_msi_idx++;
 	snprintf(msi_data->name, sizeof(msi_data->name), "MSI%d", ls1_msi_idx);
 
 	spin_lock_init(&msi_data->lock);
 
-	ret = devm_request_irq(&pdev->dev, msi_data->msi_irq,
-			       ls1_msi_handler, IRQF_SHARED,
-			       msi_data->name, msi_data);
-	if (ret) {
-		dev_err(&pdev->dev, "failed to request MSI irq\n");
-		return -ENODEV;
+	for (i = 0; i < msi_data->msir_num; i++) {
+		ret = ls1_msi_setup_msir(pdev, msi_data, msir_base, i);
+		if (ret)
+			return ret;
 	}
 
 	return ls1_msi_chip_init(msi_data);
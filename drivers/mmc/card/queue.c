@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/freezer.h>
 #include <linux/kthread.h>
 #include <linux/scatterlist.h>
@@ -23,72 +24,125 @@
 
 #define MMC_QUEUE_BOUNCESZ	65536
 
+#define MMC_QUEUE_DEPTH		64
+/* Requests a submitter issues on behalf of others before handing over */
+#define MMC_QUEUE_INLINE_BUDGET	16
+
 /*
- * Prepare a MMC request. This just filters out odd stuff.
+ * Check a MMC request. This just filters out odd stuff.
  */
-static int mmc_prep_request(struct request_queue *q, struct request *req)
+static bool mmc_queue_check_request(struct mmc_queue *mq, struct request *req)
 {
-	struct mmc_queue *mq = q->queuedata;
-
 	/*
 	 * We only like normal block requests and discards.
 	 */
 	if (req->cmd_type != REQ_TYPE_FS && !(req->cmd_flags & REQ_DISCARD)) {
 		blk_dump_rq_flags(req, "MMC bad request");
-		return BLKPREP_KILL;
+		return false;
 	}
 
-	if (mq && (mmc_card_removed(mq->card) || mmc_access_rpmb(mq)))
-		return BLKPREP_KILL;
+	if (mmc_card_removed(mq->card) || mmc_access_rpmb(mq))
+		return false;
 
-	req->cmd_flags |= REQ_DONTPREP;
+	return true;
+}
 
-	return BLKPREP_OK;
+/**
+ * mmc_queue_fetch_request - take the oldest request off the pending list
+ * @mq: MMC queue
+ */
+struct request *mmc_queue_fetch_request(struct mmc_queue *mq)
+{
+	struct request *req = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(mq->lock, flags);
+	if (!list_empty(&mq->pending)) {
+		req = list_first_entry(&mq->pending, struct request, queuelist);
+		list_del_init(&req->queuelist);
+	}
+	spin_unlock_irqrestore(mq->lock, flags);
+
+	return req;
 }
 
-static int mmc_queue_thread(void *d)
+/**
+ * mmc_queue_requeue_request - put a fetched request back to the list head
+ * @mq: MMC queue
+ * @req: request that was not issued
+ */
+void mmc_queue_requeue_request(struct mmc_queue *mq, struct request *req)
 {
-	struct mmc_queue *mq = d;
-	struct request_queue *q = mq->queue;
+	unsigned long flags;
 
-	current->flags |= PF_MEMALLOC;
+	spin_lock_irqsave(mq->lock, flags);
+	list_add(&req->queuelist, &mq->pending);
+	spin_unlock_irqrestore(mq->lock, flags);
+}
 
-	down(&mq->thread_sem);
+/*
+ * Issue pending requests until the list is empty or @budget requests have
+ * been fetched. While a request is being transferred the next one is
+ * prepared, so its mapping overlaps the card being busy. Must be called
+ * with thread_sem held; the host is released again on return.
+ */
+static void mmc_queue_issue(struct mmc_queue *mq, unsigned int budget)
+{
 	do {
 		struct request *req = NULL;
 		struct mmc_queue_req *tmp;
 		unsigned int cmd_flags = 0;
 
-		spin_lock_irq(q->queue_lock);
-		set_current_state(TASK_INTERRUPTIBLE);
-		req = blk_fetch_request(q);
+		spin_lock_irq(mq->lock);
+		if (budget && !list_empty(&mq->pending)) {
+			req = list_first_entry(&mq->pending, struct request,
+					       queuelist);
+			list_del_init(&req->queuelist);
+			budget--;
+		}
 		mq->mqrq_cur->req = req;
-		spin_unlock_irq(q->queue_lock);
+		spin_unlock_irq(mq->lock);
 
-		if (req || mq->mqrq_prev->req) {
-			set_current_state(TASK_RUNNING);
-			cmd_flags = req ? req->cmd_flags : 0;
-			mq->issue_fn(mq, req);
-			if (mq->flags & MMC_QUEUE_NEW_REQUEST) {
-				mq->flags &= ~MMC_QUEUE_NEW_REQUEST;
-				continue; /* fetch again */
-			}
+		if (!req && !mq->mqrq_prev->req)
+			break;
+
+		cmd_flags = req ? req->cmd_flags : 0;
+		mq->issue_fn(mq, req);
+		if (mq->flags & MMC_QUEUE_NEW_REQUEST) {
+			mq->flags &= ~MMC_QUEUE_NEW_REQUEST;
+			continue; /* fetch again */
+		}
+
+		/*
+		 * Current request becomes previous request
+		 * and vice versa.
+		 * In case of special requests, current request
+		 * has been finished. Do not assign it to previous
+		 * request.
+		 */
+		if (cmd_flags & MMC_REQ_SPECIAL_MASK)
+			mq->mqrq_cur->req = NULL;
+
+		mq->mqrq_prev->brq.mrq.data = NULL;
+		mq->mqrq_prev->req = NULL;
+		tmp = mq->mqrq_prev;
+		mq->mqrq_prev = mq->mqrq_cur;
+		mq->mqrq_cur = tmp;
+	} while (1);
+}
+
+static int mmc_queue_thread(void *d)
+{
+	struct mmc_queue *mq = d;
+
+	current->flags |= PF_MEMALLOC;
 
-			/*
-			 * Current request becomes previous request
-			 * and vice versa.
-			 * In case of special requests, current request
-			 * has been finished. Do not assign it to previous
-			 * request.
-			 */
-			if (cmd_flags & MMC_REQ_SPECIAL_MASK)
-				mq->mqrq_cur->req = NULL;
-
-			mq->mqrq_prev->brq.mrq.data = NULL;
-			mq->mqrq_prev->req = NULL;
-			tmp = mq->mqrq_prev;
-			mq->mqrq_prev = mq->mqrq_cur;
-			mq->mqrq_cur = tmp;
+	down(&mq->thread_sem);
+	do {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!list_empty_careful(&mq->pending)) {
+			set_current_state(TASK_RUNNING);
+			mmc_queue_issue(mq, UINT_MAX);
 		} else {
 			if (kthread_should_stop()) {
 				set_current_state(TASK_RUNNING);
@@ -105,28 +159,22 @@ static int mmc_queue_thread(void *d)
 }
 
 /*
- * Generic MMC request handler.  This is called for any queue on a
- * particular host.  When the host is not busy, we look for a request
- * on any queue on this host, and attempt to issue it.  This may
- * not be the queue we were asked to process.
+ * Let whoever currently owns the queue pick up a new request: either the
+ * issuer is waiting for the last transfer to complete and can start the
+ * new one right away, or the queue is idle and mmcqd is woken.
  */
-static void mmc_request_fn(struct request_queue *q)
+static void mmc_queue_kick(struct mmc_queue *mq)
 {
-	struct mmc_queue *mq = q->queuedata;
-	struct request *req;
+	struct mmc_context_info *cntx = &mq->card->host->context_info;
+	struct request *cur, *prev;
 	unsigned long flags;
-	struct mmc_context_info *cntx;
 
-	if (!mq) {
-		while ((req = blk_fetch_request(q)) != NULL) {
-			req->cmd_flags |= REQ_QUIET;
-			__blk_end_request_all(req, -EIO);
-		}
-		return;
-	}
+	spin_lock_irqsave(mq->lock, flags);
+	cur = mq->mqrq_cur->req;
+	prev = mq->mqrq_prev->req;
+	spin_unlock_irqrestore(mq->lock, flags);
 
-	cntx = &mq->card->host->context_info;
-	if (!mq->mqrq_cur->req && mq->mqrq_prev->req) {
+	if (!cur && prev) {
 		/*
 		 * New MMC request arrived when MMC thread may be
 		 * blocked on the previous request to be complete
@@ -138,10 +186,75 @@ static void mmc_request_fn(struct request_queue *q)
 			wake_up_interruptible(&cntx->wait);
 		}
 		spin_unlock_irqrestore(&cntx->lock, flags);
-	} else if (!mq->mqrq_cur->req && !mq->mqrq_prev->req)
+	} else if (!cur && !prev)
 		wake_up_process(mq->thread);
 }
 
+/*
+ * blk-mq only runs ->queue_rq() in a context that may sleep on a fully
+ * preemptible kernel, where the submitter just has migration disabled.
+ * Runs from kblockd are handed to mmcqd, so the shared worker is not kept
+ * busy for the whole transfer.
+ */
+static bool mmc_queue_can_issue_inline(void)
+{
+#ifdef CONFIG_PREEMPT_RT_FULL
+	return !in_atomic() && !irqs_disabled() &&
+	       !(current->flags & PF_WQ_WORKER);
+#else
+	return false;
+#endif
+}
+
+static int mmc_queue_rq(struct blk_mq_hw_ctx *hctx,
+			const struct blk_mq_queue_data *bd)
+{
+	struct mmc_queue *mq = hctx->queue->queuedata;
+	struct request *req = bd->rq;
+	int ret = BLK_MQ_RQ_QUEUE_OK;
+	unsigned long flags;
+
+	if (!mq) {
+		req->cmd_flags |= REQ_QUIET;
+		return BLK_MQ_RQ_QUEUE_ERROR;
+	}
+
+	if (mmc_queue_check_request(mq, req)) {
+		blk_mq_start_request(req);
+
+		spin_lock_irqsave(mq->lock, flags);
+		list_add_tail(&req->queuelist, &mq->pending);
+		spin_unlock_irqrestore(mq->lock, flags);
+	} else {
+		ret = BLK_MQ_RQ_QUEUE_ERROR;
+	}
+
+	/* more requests follow, issue them as one batch */
+	if (!bd->last)
+		return ret;
+
+	/*
+	 * Issue from the submitter when nobody else owns the queue. This
+	 * saves the switch to mmcqd and lets the request run at the
+	 * priority of its submitter.
+	 */
+	if (mmc_queue_can_issue_inline() && !down_trylock(&mq->thread_sem)) {
+		mmc_queue_issue(mq, MMC_QUEUE_INLINE_BUDGET);
+		up(&mq->thread_sem);
+		if (!list_empty_careful(&mq->pending))
+			wake_up_process(mq->thread);
+	} else {
+		mmc_queue_kick(mq);
+	}
+
+	return ret;
+}
+
+static struct blk_mq_ops mmc_mq_ops = {
+	.queue_rq	= mmc_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+};
+
 static struct scatterlist *mmc_alloc_sg(int sg_len, int *err)
 {
 	struct scatterlist *sg;
@@ -200,15 +313,31 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 		limit = (u64)dma_max_pfn(mmc_dev(host)) << PAGE_SHIFT;
 
 	mq->card = card;
-	mq->queue = blk_init_queue(mmc_request_fn, lock);
-	if (!mq->queue)
-		return -ENOMEM;
+	mq->lock = lock;
+	INIT_LIST_HEAD(&mq->pending);
+
+	memset(&mq->tag_set, 0, sizeof(mq->tag_set));
+	mq->tag_set.ops = &mmc_mq_ops;
+	mq->tag_set.nr_hw_queues = 1;
+	mq->tag_set.queue_depth = MMC_QUEUE_DEPTH;
+	mq->tag_set.numa_node = NUMA_NO_NODE;
+	mq->tag_set.flags = BLK_MQ_F_SHOULD_MERGE | BLK_MQ_F_SG_MERGE;
+	mq->tag_set.driver_data = mq;
+
+	ret = blk_mq_alloc_tag_set(&mq->tag_set);
+	if (ret)
+		return ret;
+
+	mq->queue = blk_mq_init_queue(&mq->tag_set);
+	if (IS_ERR(mq->queue)) {
+		ret = PTR_ERR(mq->queue);
+		goto free_tag_set;
+	}
 
 	mq->mqrq_cur = mqrq_cur;
 	mq->mqrq_prev = mqrq_prev;
 	mq->queue->queuedata = mq;
 
-	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
 	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, mq->queue);
 	if (mmc_can_erase(card))
@@ -317,6 +446,8 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 	mqrq_prev->bounce_buf = NULL;
 
 	blk_cleanup_queue(mq->queue);
+ free_tag_set:
+	blk_mq_free_tag_set(&mq->tag_set);
 	return ret;
 }
 
@@ -326,6 +457,8 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	unsigned long flags;
 	struct mmc_queue_req *mqrq_cur = mq->mqrq_cur;
 	struct mmc_queue_req *mqrq_prev = mq->mqrq_prev;
+	struct request *req, *tmp;
+	LIST_HEAD(pending);
 
 	/* Make sure the queue isn't suspended, as that will deadlock */
 	mmc_queue_resume(mq);
@@ -334,10 +467,17 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	kthread_stop(mq->thread);
 
 	/* Empty the queue */
-	spin_lock_irqsave(q->queue_lock, flags);
+	spin_lock_irqsave(mq->lock, flags);
 	q->queuedata = NULL;
-	blk_start_queue(q);
-	spin_unlock_irqrestore(q->queue_lock, flags);
+	list_splice_init(&mq->pending, &pending);
+	spin_unlock_irqrestore(mq->lock, flags);
+
+	list_for_each_entry_safe(req, tmp, &pending, queuelist) {
+		list_del_init(&req->queuelist);
+		req->cmd_flags |= REQ_QUIET;
+		blk_mq_end_request(req, -EIO);
+	}
+	blk_mq_start_stopped_hw_queues(q, true);
 
 	kfree(mqrq_cur->bounce_sg);
 	mqrq_cur->bounce_sg = NULL;
@@ -408,21 +548,16 @@ void mmc_packed_clean(struct mmc_queue *mq)
  * mmc_queue_suspend - suspend a MMC request queue
  * @mq: MMC queue to suspend
  *
- * Stop the block request queue, and wait for our thread to
+ * Stop the block request queue, and wait for the current issuer to
  * complete any outstanding requests.  This ensures that we
  * won't suspend while a request is being processed.
  */
 void mmc_queue_suspend(struct mmc_queue *mq)
 {
-	struct request_queue *q = mq->queue;
-	unsigned long flags;
-
 	if (!(mq->flags & MMC_QUEUE_SUSPENDED)) {
 		mq->flags |= MMC_QUEUE_SUSPENDED;
 
-		spin_lock_irqsave(q->queue_lock, flags);
-		blk_stop_queue(q);
-		spin_unlock_irqrestore(q->queue_lock, flags);
+		blk_mq_stop_hw_queues(mq->queue);
 
 		down(&mq->thread_sem);
 	}
@@ -434,17 +569,12 @@ void mmc_queue_suspend(struct mmc_queue *mq)
  */
 void mmc_queue_resume(struct mmc_queue *mq)
 {
-	struct request_queue *q = mq->queue;
-	unsigned long flags;
-
 	if (mq->flags & MMC_QUEUE_SUSPENDED) {
 		mq->flags &= ~MMC_QUEUE_SUSPENDED;
 
 		up(&mq->thread_sem);
 
-		spin_lock_irqsave(q->queue_lock, flags);
-		blk_start_queue(q);
-		spin_unlock_irqrestore(q->queue_lock, flags);
+		blk_mq_start_stopped_hw_queues(mq->queue, true);
 	}
 }
 
@@ -48,6 +48,13 @@
 #define ESDHC_DMA_SYSCTL	0x40c
 #define ESDHC_DMA_SNOOP		0x00000040
 
+/* Tuning Block Control Register */
+#define ESDHC_TBCTL		0x120
+#define ESDHC_TB_EN		0x00000004
+
+/* ADMA2 descriptor table entries, enough for 2MiB of scattered pages */
+#define ESDHC_ADMA_MAX_SEGS	512
+
 #define ESDHC_HOST_CONTROL_RES	0x01
 
 #endif /* _DRIVERS_MMC_SDHCI_ESDHC_H */
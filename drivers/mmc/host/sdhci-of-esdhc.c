@@ -66,6 +66,17 @@ static u32 esdhc_readl_fixup(struct sdhci_host *host,
 			return ret;
 		}
 	}
+
+	/*
+	 * The UHS speed modes depend on the SoC and the board, so they are
+	 * enabled from the device tree (e.g. "mmc-hs200-1_8v") only.
+	 */
+	if (spec_reg == SDHCI_CAPABILITIES_1) {
+		ret = value & ~(SDHCI_SUPPORT_SDR50 | SDHCI_SUPPORT_SDR104 |
+				SDHCI_SUPPORT_DDR50);
+		return ret;
+	}
+
 	ret = value;
 	return ret;
 }
@@ -473,6 +484,32 @@ static void esdhc_pltfm_set_bus_width(struct sdhci_host *host, int width)
 	sdhci_writel(host, ctrl, ESDHC_PROCTL);
 }
 
+/*
+ * HS200/SDR104 sample the data with the delay found by tuning, that
+ * needs the tuning block. It is enabled with the timing so that it is
+ * in place before the core runs the tuning procedure.
+ */
+static void esdhc_set_uhs_signaling(struct sdhci_host *host,
+				    unsigned timing)
+{
+	struct sdhci_pltfm_host *pltfm_host = sdhci_priv(host);
+	struct sdhci_esdhc *esdhc = sdhci_pltfm_priv(pltfm_host);
+	u32 val;
+
+	sdhci_set_uhs_signaling(host, timing);
+
+	if (esdhc->vendor_ver <= VENDOR_V_22)
+		return;
+
+	val = sdhci_readl(host, ESDHC_TBCTL);
+	if (timing == MMC_TIMING_MMC_HS200 ||
+	    timing == MMC_TIMING_UHS_SDR104)
+		val |= ESDHC_TB_EN;
+	else
+		val &= ~ESDHC_TB_EN;
+	sdhci_writel(host, val, ESDHC_TBCTL);
+}
+
 static void esdhc_reset(struct sdhci_host *host, u8 mask)
 {
 	sdhci_reset(host, mask);
@@ -528,7 +565,7 @@ static const struct sdhci_ops sdhci_esdhc_be_ops = {
 	.adma_workaround = esdhc_of_adma_workaround,
 	.set_bus_width = esdhc_pltfm_set_bus_width,
 	.reset = esdhc_reset,
-	.set_uhs_signaling = sdhci_set_uhs_signaling,
+	.set_uhs_signaling = esdhc_set_uhs_signaling,
 };
 
 static const struct sdhci_ops sdhci_esdhc_le_ops = {
@@ -545,7 +582,7 @@ static const struct sdhci_ops sdhci_esdhc_le_ops = {
 	.adma_workaround = esdhc_of_adma_workaround,
 	.set_bus_width = esdhc_pltfm_set_bus_width,
 	.reset = esdhc_reset,
-	.set_uhs_signaling = sdhci_set_uhs_signaling,
+	.set_uhs_signaling = esdhc_set_uhs_signaling,
 };
 
 static const struct sdhci_pltfm_data sdhci_esdhc_be_pdata = {
@@ -635,6 +672,12 @@ static int sdhci_esdhc_probe(struct platform_device *pdev)
 
 	mmc_of_parse_voltage(np, &host->ocr_mask);
 
+	/* only the eSDHC revisions with ADMA2 have the tuning block */
+	if (esdhc->vendor_ver > VENDOR_V_22)
+		host->max_segs = ESDHC_ADMA_MAX_SEGS;
+	else
+		host->mmc->caps2 &= ~MMC_CAP2_HS200;
+
 	ret = sdhci_add_host(host);
 	if (ret)
 		goto err;
@@ -467,6 +467,8 @@ struct sdhci_host {
 
 	int sg_count;		/* Mapped sg entries */
 
+	unsigned int max_segs;	/* ADMA table entries, 0: SDHCI_MAX_SEGS */
+
 	void *adma_table;	/* ADMA descriptor table */
 	void *align_buffer;	/* Bounce buffer */
 
@@ -193,6 +193,10 @@
 #define SEQID_RDCR		9
 #define SEQID_EN4B		10
 #define SEQID_BRWR		11
+#define SEQID_ERSP		12
+#define SEQID_ERRS		13
+#define SEQID_BE_4K		14
+#define SEQID_BE_32K		15
 
 /* Controller needs swap endian when access registers */
 #define QUADSPI_QUIRK_REGMAP_BE	(1 << 5)
@@ -248,6 +252,7 @@ struct fsl_qspi {
 	u32 clk_rate;
 	unsigned int chip_base_addr; /* We may support two chips. */
 	bool has_second_chip;
+	bool ahb_stale; /* the AHB buffer may hold outdated flash data */
 };
 
 static inline int is_vybrid_qspi(struct fsl_qspi *q)
@@ -393,10 +398,22 @@ static void fsl_qspi_init_lut(struct fsl_qspi *q)
 	qspi_writel(q, LUT0(CMD, PAD1, SPINOR_OP_RDSR) | LUT1(READ, PAD1, 0x1),
 			base + QUADSPI_LUT(lut_base));
 
-	/* Erase a sector */
+	/* Erase a sector, the largest erase type (SE or SE_4B) once scanned */
 	lut_base = SEQID_SE * 4;
+	op = SPINOR_OP_SE;
+	if (nor->num_erase_types)
+		op = nor->erase_type[nor->num_erase_types - 1].opcode;
+	qspi_writel(q, LUT0(CMD, PAD1, op) | LUT1(ADDR, PAD1, addrlen),
+			base + QUADSPI_LUT(lut_base));
+
+	/* Erase a 4KiB block */
+	lut_base = SEQID_BE_4K * 4;
+	qspi_writel(q, LUT0(CMD, PAD1, SPINOR_OP_BE_4K) | LUT1(ADDR, PAD1, addrlen),
+			base + QUADSPI_LUT(lut_base));
 
-	qspi_writel(q, LUT0(CMD, PAD1, nor->erase_opcode) | LUT1(ADDR, PAD1, addrlen),
+	/* Erase a 32KiB block */
+	lut_base = SEQID_BE_32K * 4;
+	qspi_writel(q, LUT0(CMD, PAD1, SPINOR_OP_BE_32K) | LUT1(ADDR, PAD1, addrlen),
 			base + QUADSPI_LUT(lut_base));
 
 	/* Erase the whole chip */
@@ -431,6 +448,14 @@ static void fsl_qspi_init_lut(struct fsl_qspi *q)
 	lut_base = SEQID_BRWR * 4;
 	qspi_writel(q, LUT0(CMD, PAD1, SPINOR_OP_BRWR), base + QUADSPI_LUT(lut_base));
 
+	/* Erase suspend */
+	lut_base = SEQID_ERSP * 4;
+	qspi_writel(q, LUT0(CMD, PAD1, SPINOR_OP_ERSP), base + QUADSPI_LUT(lut_base));
+
+	/* Erase resume */
+	lut_base = SEQID_ERRS * 4;
+	qspi_writel(q, LUT0(CMD, PAD1, SPINOR_OP_ERRS), base + QUADSPI_LUT(lut_base));
+
 	fsl_qspi_lock_lut(q);
 }
 
@@ -450,9 +475,13 @@ static int fsl_qspi_get_seqid(struct fsl_qspi *q, u8 cmd)
 		return SEQID_WRDI;
 	case SPINOR_OP_RDSR:
 		return SEQID_RDSR;
-	case SPINOR_OP_BE_4K:
 	case SPINOR_OP_SE:
+	case SPINOR_OP_SE_4B:
 		return SEQID_SE;
+	case SPINOR_OP_BE_4K:
+		return SEQID_BE_4K;
+	case SPINOR_OP_BE_32K:
+		return SEQID_BE_32K;
 	case SPINOR_OP_CHIP_ERASE:
 		return SEQID_CHIP_ERASE;
 	case SPINOR_OP_PP:
@@ -467,6 +496,10 @@ static int fsl_qspi_get_seqid(struct fsl_qspi *q, u8 cmd)
 		return SEQID_EN4B;
 	case SPINOR_OP_BRWR:
 		return SEQID_BRWR;
+	case SPINOR_OP_ERSP:
+		return SEQID_ERSP;
+	case SPINOR_OP_ERRS:
+		return SEQID_ERRS;
 	default:
 		dev_err(q->dev, "Unsupported cmd 0x%.2x\n", cmd);
 		break;
@@ -747,6 +780,10 @@ static const struct of_device_id fsl_qspi_dt_ids[] = {
 };
 MODULE_DEVICE_TABLE(of, fsl_qspi_dt_ids);
 
+/*
+ * Every command selects its chip: readers handed the flash in the middle of
+ * an erase or program may have selected another one meanwhile.
+ */
 static void fsl_qspi_set_base_addr(struct fsl_qspi *q, struct spi_nor *nor)
 {
 	q->chip_base_addr = q->nor_size * (nor - q->nor);
@@ -757,6 +794,7 @@ static int fsl_qspi_read_reg(struct spi_nor *nor, u8 opcode, u8 *buf, int len)
 	int ret;
 	struct fsl_qspi *q = nor->priv;
 
+	fsl_qspi_set_base_addr(q, nor);
 	ret = fsl_qspi_runcmd(q, opcode, 0, len);
 	if (ret)
 		return ret;
@@ -771,13 +809,15 @@ static int fsl_qspi_write_reg(struct spi_nor *nor, u8 opcode, u8 *buf, int len,
 	struct fsl_qspi *q = nor->priv;
 	int ret;
 
+	fsl_qspi_set_base_addr(q, nor);
 	if (!buf) {
 		ret = fsl_qspi_runcmd(q, opcode, 0, 1);
 		if (ret)
 			return ret;
 
-		if (opcode == SPINOR_OP_CHIP_ERASE)
-			fsl_qspi_invalid(q);
+		/* a chip erase or a resumed erase changes the flash content */
+		if (opcode == SPINOR_OP_CHIP_ERASE || opcode == SPINOR_OP_ERRS)
+			q->ahb_stale = true;
 
 	} else if (len > 0) {
 		ret = fsl_qspi_nor_write(q, nor, opcode, 0,
@@ -795,11 +835,12 @@ static void fsl_qspi_write(struct spi_nor *nor, loff_t to,
 {
 	struct fsl_qspi *q = nor->priv;
 
+	fsl_qspi_set_base_addr(q, nor);
 	fsl_qspi_nor_write(q, nor, nor->program_opcode, to,
 				(u32 *)buf, len, retlen);
 
-	/* invalid the data in the AHB buffer. */
-	fsl_qspi_invalid(q);
+	/* invalid the data in the AHB buffer before the next read */
+	q->ahb_stale = true;
 }
 
 static int fsl_qspi_read(struct spi_nor *nor, loff_t from,
@@ -823,6 +864,7 @@ static int fsl_qspi_erase(struct spi_nor *nor, loff_t offs)
 	struct fsl_qspi *q = nor->priv;
 	int ret;
 
+	fsl_qspi_set_base_addr(q, nor);
 	dev_dbg(nor->dev, "%dKiB at 0x%08x:0x%08x\n",
 		nor->mtd->erasesize / 1024, q->chip_base_addr, (u32)offs);
 
@@ -830,7 +872,7 @@ static int fsl_qspi_erase(struct spi_nor *nor, loff_t offs)
 	if (ret)
 		return ret;
 
-	fsl_qspi_invalid(q);
+	q->ahb_stale = true;
 	return 0;
 }
 
@@ -850,6 +892,17 @@ static int fsl_qspi_prep(struct spi_nor *nor, enum spi_nor_ops ops)
 	}
 
 	fsl_qspi_set_base_addr(q, nor);
+
+	/*
+	 * Invalidate the AHB buffer only when a read follows a change of the
+	 * flash content, so back to back programs do not each reset the
+	 * controller.
+	 */
+	if (ops == SPI_NOR_OPS_READ && q->ahb_stale) {
+		fsl_qspi_invalid(q);
+		q->ahb_stale = false;
+	}
+
 	return 0;
 }
 
@@ -989,6 +1042,9 @@ static int fsl_qspi_probe(struct platform_device *pdev)
 		/* set the chip address for READID */
 		fsl_qspi_set_base_addr(q, nor);
 
+		/* SEQID_ERSP/SEQID_ERRS, spi_nor_scan() clears it if needed */
+		nor->flags |= SNOR_F_ERASE_SUSPEND;
+
 		ret = spi_nor_scan(nor, modalias, SPI_NOR_QUAD);
 		if (ret)
 			goto irq_failed;
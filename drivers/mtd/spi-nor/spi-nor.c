@@ -26,6 +26,15 @@
 /* Define max times to check status register before we give up. */
 #define	MAX_READY_WAIT_JIFFIES	(40 * HZ) /* M25P16 specs 40s max chip erase */
 
+/*
+ * A suspended erase is resumed after this long even if readers keep coming,
+ * and it is not suspended again before it has run for this long: erases
+ * need some uninterrupted time to make progress at all. Multi-page programs
+ * are handed over between pages at the same pace.
+ */
+#define	ERASE_SUSPEND_MAX_JIFFIES	msecs_to_jiffies(20)
+#define	ERASE_RESUME_MIN_JIFFIES	msecs_to_jiffies(2)
+
 #define	SPI_NOR_MAX_ID_LEN	6
 
 struct flash_info {
@@ -277,6 +286,13 @@ static int spi_nor_lock_and_prep(struct spi_nor *nor, enum spi_nor_ops ops)
 
 	mutex_lock(&nor->lock);
 
+	/* only reads may run while an erase is suspended */
+	while (ops != SPI_NOR_OPS_READ && nor->erase_suspended) {
+		mutex_unlock(&nor->lock);
+		wait_event(nor->erase_wq, !ACCESS_ONCE(nor->erase_suspended));
+		mutex_lock(&nor->lock);
+	}
+
 	if (nor->prepare) {
 		ret = nor->prepare(nor, ops);
 		if (ret) {
@@ -295,6 +311,128 @@ static void spi_nor_unlock_and_unprep(struct spi_nor *nor, enum spi_nor_ops ops)
 	mutex_unlock(&nor->lock);
 }
 
+/*
+ * Hand the flash over to the waiting readers while the running erase is
+ * suspended, or a program is between two pages. Returns with the lock held
+ * again; the readers may have selected another chip on the controller.
+ */
+static void spi_nor_hand_over(struct spi_nor *nor)
+{
+	/*
+	 * The operation stays prepared, the readers prepare for themselves
+	 * on top of that.
+	 */
+	nor->erase_suspended = true;
+	mutex_unlock(&nor->lock);
+
+	wait_event_timeout(nor->erase_wq, !atomic_read(&nor->read_waiters),
+			   ERASE_SUSPEND_MAX_JIFFIES);
+
+	mutex_lock(&nor->lock);
+	nor->erase_suspended = false;
+	wake_up_all(&nor->erase_wq);
+	nor->erase_resumed = jiffies;
+}
+
+/*
+ * Suspend the running erase and hand the flash over to the waiting readers.
+ * Returns with the lock held again and the erase resumed.
+ */
+static int spi_nor_erase_suspend(struct spi_nor *nor)
+{
+	int ret;
+
+	ret = nor->write_reg(nor, SPINOR_OP_ERSP, NULL, 0, 0);
+	if (ret)
+		return ret;
+
+	/* WIP drops once the erase is suspended (or has completed) */
+	ret = spi_nor_wait_till_ready(nor);
+	if (ret)
+		return ret;
+
+	spi_nor_hand_over(nor);
+
+	return nor->write_reg(nor, SPINOR_OP_ERRS, NULL, 0, 0);
+}
+
+/*
+ * Between two pages of a program, let waiting readers through. A page
+ * program takes less than a millisecond, so it is not suspended itself.
+ */
+static void spi_nor_program_yield(struct spi_nor *nor)
+{
+	if (atomic_read(&nor->read_waiters) &&
+	    time_after_eq(jiffies, nor->erase_resumed +
+				   ERASE_RESUME_MIN_JIFFIES))
+		spi_nor_hand_over(nor);
+}
+
+/*
+ * Wait for an erase to complete. If the erase can be suspended, readers get
+ * the flash in between instead of waiting for the whole erase.
+ */
+static int spi_nor_wait_erase_done(struct spi_nor *nor)
+{
+	unsigned long deadline, suspended;
+	int ret;
+
+	if (!(nor->flags & SNOR_F_ERASE_SUSPEND))
+		return spi_nor_wait_till_ready(nor);
+
+	nor->erase_resumed = jiffies;
+	deadline = jiffies + MAX_READY_WAIT_JIFFIES;
+
+	for (;;) {
+		ret = spi_nor_ready(nor);
+		if (ret < 0)
+			return ret;
+		if (ret)
+			return 0;
+
+		if (time_after_eq(jiffies, deadline))
+			break;
+
+		if (atomic_read(&nor->read_waiters) &&
+		    time_after_eq(jiffies, nor->erase_resumed +
+					   ERASE_RESUME_MIN_JIFFIES)) {
+			suspended = jiffies;
+			ret = spi_nor_erase_suspend(nor);
+			if (ret)
+				return ret;
+			/* the time spent suspended does not count */
+			deadline += jiffies - suspended;
+			continue;
+		}
+
+		cond_resched();
+	}
+
+	dev_err(nor->dev, "flash operation timed out\n");
+
+	return -ETIMEDOUT;
+}
+
+/*
+ * Pick the largest erase type that starts at @addr and fits in @len. The
+ * smallest type always fits, the caller checked the alignment against
+ * mtd->erasesize.
+ */
+static const struct spi_nor_erase_type *
+spi_nor_select_erase(struct spi_nor *nor, u32 addr, u32 len)
+{
+	const struct spi_nor_erase_type *erase;
+	int i;
+
+	for (i = nor->num_erase_types - 1; i > 0; i--) {
+		erase = &nor->erase_type[i];
+		if (len >= erase->size && !(addr % erase->size))
+			return erase;
+	}
+
+	return &nor->erase_type[0];
+}
+
 /*
  * Erase an address range on the nor chip.  The address range may extend
  * one or more erase sectors.  Return an error is there is a problem erasing.
@@ -333,14 +471,18 @@ static int spi_nor_erase(struct mtd_info *mtd, struct erase_info *instr)
 		if (ret)
 			goto erase_err;
 
-	/* REVISIT in some cases we could speed up erasing large regions
-	 * by using SPINOR_OP_SE instead of SPINOR_OP_BE_4K.  We may have set up
-	 * to use "small sector erase", but that's not always optimal.
+	/*
+	 * "sector"-at-a-time erase, using the largest erase block that fits
+	 * at each address: a 64KiB sector erase takes about as long as a
+	 * single 4KiB one.
 	 */
-
-	/* "sector"-at-a-time erase */
 	} else {
 		while (len) {
+			const struct spi_nor_erase_type *erase;
+
+			erase = spi_nor_select_erase(nor, addr, len);
+			nor->erase_opcode = erase->opcode;
+
 			write_enable(nor);
 
 			if (nor->erase(nor, addr)) {
@@ -348,10 +490,10 @@ static int spi_nor_erase(struct mtd_info *mtd, struct erase_info *instr)
 				goto erase_err;
 			}
 
-			addr += mtd->erasesize;
-			len -= mtd->erasesize;
+			addr += erase->size;
+			len -= erase->size;
 
-			ret = spi_nor_wait_till_ready(nor);
+			ret = spi_nor_wait_erase_done(nor);
 			if (ret)
 				goto erase_err;
 		}
@@ -758,13 +900,19 @@ static int spi_nor_read(struct mtd_info *mtd, loff_t from, size_t len,
 
 	dev_dbg(nor->dev, "from 0x%08x, len %zd\n", (u32)from, len);
 
+	/* tell a running erase that it should suspend */
+	atomic_inc(&nor->read_waiters);
+
 	ret = spi_nor_lock_and_prep(nor, SPI_NOR_OPS_READ);
 	if (ret)
-		return ret;
+		goto out;
 
 	ret = nor->read(nor, from, len, retlen, buf);
 
 	spi_nor_unlock_and_unprep(nor, SPI_NOR_OPS_READ);
+out:
+	if (atomic_dec_and_test(&nor->read_waiters))
+		wake_up_all(&nor->erase_wq);
 	return ret;
 }
 
@@ -852,6 +1000,7 @@ static int spi_nor_write(struct mtd_info *mtd, loff_t to, size_t len,
 	if (ret)
 	        return ret;
 
+	nor->erase_resumed = jiffies;
 	write_enable(nor);
 
 	page_offset = to & (nor->page_size - 1);
@@ -874,6 +1023,8 @@ static int spi_nor_write(struct mtd_info *mtd, loff_t to, size_t len,
 			if (ret)
 				goto write_err;
 
+			spi_nor_program_yield(nor);
+
 			write_enable(nor);
 
 			nor->write(nor, to + i, page_size, retlen, buf + i);
@@ -1025,6 +1176,20 @@ static int spi_nor_check(struct spi_nor *nor)
 	return 0;
 }
 
+/* append an erase type, they have to be added smallest first */
+static void spi_nor_add_erase_type(struct spi_nor *nor, u8 opcode, u32 size)
+{
+	int n = nor->num_erase_types;
+
+	if (n >= SNOR_ERASE_TYPE_MAX ||
+	    (n && nor->erase_type[n - 1].size >= size))
+		return;
+
+	nor->erase_type[n].opcode = opcode;
+	nor->erase_type[n].size = size;
+	nor->num_erase_types++;
+}
+
 int spi_nor_scan(struct spi_nor *nor, const char *name, enum read_mode mode)
 {
 	const struct spi_device_id      *id = NULL;
@@ -1081,6 +1246,8 @@ int spi_nor_scan(struct spi_nor *nor, const char *name, enum read_mode mode)
 	}
 
 	mutex_init(&nor->lock);
+	atomic_set(&nor->read_waiters, 0);
+	init_waitqueue_head(&nor->erase_wq);
 
 	/*
 	 * Atmel, SST and Intel/Numonyx serial nor tend to power
@@ -1123,17 +1290,33 @@ int spi_nor_scan(struct spi_nor *nor, const char *name, enum read_mode mode)
 	if (info->flags & USE_FSR)
 		nor->flags |= SNOR_F_USE_FSR;
 
-	/* prefer "small sector" erase if possible */
-	if (info->flags & SECT_4K) {
-		nor->erase_opcode = SPINOR_OP_BE_4K;
-		mtd->erasesize = 4096;
-	} else if (info->flags & SECT_4K_PMC) {
-		nor->erase_opcode = SPINOR_OP_BE_4K_PMC;
-		mtd->erasesize = 4096;
-	} else {
-		nor->erase_opcode = SPINOR_OP_SE;
-		mtd->erasesize = info->sector_size;
-	}
+	/* only these use SPINOR_OP_ERSP/ERRS for erase suspend/resume */
+	if (JEDEC_MFR(info) != CFI_MFR_ST && JEDEC_MFR(info) != CFI_MFR_AMD &&
+	    JEDEC_MFR(info) != 0xef /* winbond */)
+		nor->flags &= ~SNOR_F_ERASE_SUSPEND;
+
+	/*
+	 * Collect the erase types, smallest first. The "small sector" erase is
+	 * the granularity exported to MTD, spi_nor_erase() uses the larger
+	 * ones wherever the range allows it.
+	 */
+	nor->num_erase_types = 0;
+	if (info->flags & SECT_4K)
+		spi_nor_add_erase_type(nor, SPINOR_OP_BE_4K, 4096);
+	else if (info->flags & SECT_4K_PMC)
+		spi_nor_add_erase_type(nor, SPINOR_OP_BE_4K_PMC, 4096);
+
+	/* these have a uniform 32KiB block erase next to the 4KiB one */
+	if (info->flags & SECT_4K &&
+	    (JEDEC_MFR(info) == 0xef /* winbond */ ||
+	     JEDEC_MFR(info) == CFI_MFR_MACRONIX ||
+	     JEDEC_MFR(info) == 0xc8 /* gigadevice */))
+		spi_nor_add_erase_type(nor, SPINOR_OP_BE_32K, 32 * 1024);
+
+	spi_nor_add_erase_type(nor, SPINOR_OP_SE, info->sector_size);
+
+	nor->erase_opcode = nor->erase_type[0].opcode;
+	mtd->erasesize = nor->erase_type[0].size;
 
 	if (info->flags & SPI_NOR_NO_ERASE)
 		mtd->flags |= MTD_NO_ERASE;
@@ -1216,6 +1399,9 @@ int spi_nor_scan(struct spi_nor *nor, const char *name, enum read_mode mode)
 			}
 			nor->program_opcode = SPINOR_OP_PP_4B;
 			/* No small sector erase for 4-byte command set */
+			nor->num_erase_types = 0;
+			spi_nor_add_erase_type(nor, SPINOR_OP_SE_4B,
+					       info->sector_size);
 			nor->erase_opcode = SPINOR_OP_SE_4B;
 			mtd->erasesize = info->sector_size;
 		} else
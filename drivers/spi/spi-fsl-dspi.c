@@ -14,7 +14,10 @@
  */
 
 #include <linux/clk.h>
+#include <linux/completion.h>
 #include <linux/delay.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/err.h>
 #include <linux/errno.h>
 #include <linux/interrupt.h>
@@ -40,6 +43,16 @@
 
 #define DSPI_FIFO_SIZE			4
 
+/*
+ * Transfers of at least this many bytes are run by the eDMA, smaller ones
+ * are cheaper to feed through the FIFO by the interrupt handler.
+ */
+#define DSPI_DMA_MIN_LEN		64
+/* PUSHR/POPR words per DMA round, the buffers hold one u32 per word */
+#define DSPI_DMA_BUFSIZE		(DSPI_FIFO_SIZE * 1024)
+#define DSPI_DMA_TIMEOUT		msecs_to_jiffies(3000)
+#define DSPI_POLL_TIMEOUT		msecs_to_jiffies(10)
+
 #define SPI_MCR		0x00
 #define SPI_MCR_MASTER		(1 << 31)
 #define SPI_MCR_PCSIS		(0x3F << 16)
@@ -70,6 +83,10 @@
 
 #define SPI_RSER		0x30
 #define SPI_RSER_EOQFE		0x10000000
+#define SPI_RSER_TFFFE		0x02000000
+#define SPI_RSER_TFFFD		0x01000000
+#define SPI_RSER_RFDFE		0x00020000
+#define SPI_RSER_RFDFD		0x00010000
 
 #define SPI_PUSHR		0x34
 #define SPI_PUSHR_CONT		(1 << 31)
@@ -102,17 +119,46 @@
 #define SPI_CS_ASSERT		0x02
 #define SPI_CS_DROP		0x04
 
+/*
+ * Short transfers are completed by busy polling the status register in the
+ * calling context instead of sleeping until the (possibly threaded) EOQ
+ * interrupt has run.
+ */
+static unsigned int poll_max_len = 8;
+module_param(poll_max_len, uint, 0644);
+MODULE_PARM_DESC(poll_max_len,
+		 "poll for transfers of up to this many bytes (0 = never)");
+
+static unsigned int poll_max_us;
+module_param(poll_max_us, uint, 0644);
+MODULE_PARM_DESC(poll_max_us,
+		 "poll for transfers taking up to this many microseconds on the wire (0 = never)");
+
 struct chip_data {
 	u32 mcr_val;
 	u32 ctar_val;
 	u16 void_write_data;
 };
 
+struct fsl_dspi_dma {
+	struct dma_chan		*chan_tx;
+	struct dma_chan		*chan_rx;
+	u32			*tx_dma_buf;
+	u32			*rx_dma_buf;
+	dma_addr_t		tx_dma_phys;
+	dma_addr_t		rx_dma_phys;
+	struct completion	cmd_rx_complete;
+	/* register byte order, the DMA bypasses regmap */
+	bool			big_endian;
+};
+
 struct fsl_dspi {
 	struct spi_master	*master;
 	struct platform_device	*pdev;
 
 	struct regmap		*regmap;
+	phys_addr_t		phys_addr;
+	struct fsl_dspi_dma	*dma;
 	int			irq;
 	struct clk		*clk;
 
@@ -327,6 +373,227 @@ static int dspi_transfer_read(struct fsl_dspi *dspi)
 	return rx_count;
 }
 
+static u32 dspi_dma_to_dev(struct fsl_dspi_dma *dma, u32 val)
+{
+	return dma->big_endian ? (__force u32)cpu_to_be32(val) :
+				 (__force u32)cpu_to_le32(val);
+}
+
+static u32 dspi_dma_from_dev(struct fsl_dspi_dma *dma, u32 val)
+{
+	return dma->big_endian ? be32_to_cpu((__force __be32)val) :
+				 le32_to_cpu((__force __le32)val);
+}
+
+static void dspi_rx_dma_callback(void *arg)
+{
+	struct fsl_dspi *dspi = arg;
+
+	complete(&dspi->dma->cmd_rx_complete);
+}
+
+/*
+ * Run up to DSPI_DMA_BUFSIZE words of the current transfer: the tx channel
+ * writes preformatted command+data words to PUSHR on every TFFF request and
+ * the rx channel drains POPR on every RFDF request. The rx channel finishes
+ * last, its completion is the only interrupt of the round. Returns -EAGAIN
+ * when the descriptors could not be prepared, before any word was used.
+ */
+static int dspi_dma_xfer_round(struct fsl_dspi *dspi, int word)
+{
+	struct fsl_dspi_dma *dma = dspi->dma;
+	struct dma_async_tx_descriptor *tx_desc, *rx_desc;
+	size_t count = min_t(size_t, dspi->len / word, DSPI_DMA_BUFSIZE);
+	u32 cmd = SPI_PUSHR_PCS(dspi->cs) | SPI_PUSHR_CTAS(dspi->cs);
+	u32 pushr;
+	size_t i;
+	u16 d;
+
+	rx_desc = dmaengine_prep_slave_single(dma->chan_rx, dma->rx_dma_phys,
+			count * sizeof(u32), DMA_DEV_TO_MEM,
+			DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!rx_desc) {
+		dev_err(&dspi->pdev->dev, "failed to prepare rx DMA\n");
+		return -EAGAIN;
+	}
+
+	tx_desc = dmaengine_prep_slave_single(dma->chan_tx, dma->tx_dma_phys,
+			count * sizeof(u32), DMA_MEM_TO_DEV, DMA_CTRL_ACK);
+	if (!tx_desc) {
+		dmaengine_terminate_all(dma->chan_rx);
+		dev_err(&dspi->pdev->dev, "failed to prepare tx DMA\n");
+		return -EAGAIN;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (dspi->dataflags & TRAN_STATE_TX_VOID) {
+			d = dspi->void_write_data;
+		} else if (word == 2) {
+			d = *(u16 *)dspi->tx;
+			dspi->tx += 2;
+		} else {
+			d = *(u8 *)dspi->tx;
+			dspi->tx++;
+		}
+
+		dspi->len -= word;
+
+		pushr = cmd | SPI_PUSHR_TXDATA(d);
+		/* keep the chip selected, except after the last word */
+		if (dspi->len || !dspi->cs_change)
+			pushr |= SPI_PUSHR_CONT;
+		dma->tx_dma_buf[i] = dspi_dma_to_dev(dma, pushr);
+	}
+
+	rx_desc->callback = dspi_rx_dma_callback;
+	rx_desc->callback_param = dspi;
+	reinit_completion(&dma->cmd_rx_complete);
+
+	/* rx first, so no received word can be missed */
+	dmaengine_submit(rx_desc);
+	dma_async_issue_pending(dma->chan_rx);
+	dmaengine_submit(tx_desc);
+	dma_async_issue_pending(dma->chan_tx);
+
+	if (!wait_for_completion_timeout(&dma->cmd_rx_complete,
+					 DSPI_DMA_TIMEOUT)) {
+		dmaengine_terminate_all(dma->chan_tx);
+		dmaengine_terminate_all(dma->chan_rx);
+		/*
+		 * Drop what the channels left behind: the words still in the
+		 * TX FIFO would be clocked out with the chip selected and the
+		 * RX FIFO would hand stale words to the next transfer.
+		 */
+		regmap_write(dspi->regmap, SPI_RSER, 0);
+		regmap_update_bits(dspi->regmap, SPI_MCR,
+				SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF,
+				SPI_MCR_CLR_TXF | SPI_MCR_CLR_RXF);
+		dev_err(&dspi->pdev->dev, "DMA transfer timed out\n");
+		return -ETIMEDOUT;
+	}
+
+	if (dspi->dataflags & TRAN_STATE_RX_VOID) {
+		dspi->rx += count * word;
+		return 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		d = SPI_POPR_RXDATA(dspi_dma_from_dev(dma, dma->rx_dma_buf[i]));
+		if (word == 2)
+			*(u16 *)dspi->rx = d;
+		else
+			*(u8 *)dspi->rx = d;
+		dspi->rx += word;
+	}
+
+	return 0;
+}
+
+static bool dspi_can_dma(struct fsl_dspi *dspi, struct spi_transfer *transfer)
+{
+	if (!dspi->dma || transfer->len < DSPI_DMA_MIN_LEN)
+		return false;
+
+	/* an odd byte in 16-bit mode needs the frame size switch of PIO */
+	if (is_double_byte_mode(dspi) && (transfer->len & 1))
+		return false;
+
+	return true;
+}
+
+static int dspi_dma_xfer(struct fsl_dspi *dspi)
+{
+	int word = is_double_byte_mode(dspi) + 1;
+	int ret = 0;
+
+	regmap_write(dspi->regmap, SPI_RSER, SPI_RSER_TFFFE | SPI_RSER_TFFFD |
+			SPI_RSER_RFDFE | SPI_RSER_RFDFD);
+
+	while (dspi->len) {
+		ret = dspi_dma_xfer_round(dspi, word);
+		if (ret)
+			break;
+	}
+
+	regmap_write(dspi->regmap, SPI_RSER, 0);
+
+	/* only a transfer that has not started can go another way */
+	if (ret == -EAGAIN && dspi->len != dspi->cur_transfer->len)
+		ret = -EIO;
+
+	return ret;
+}
+
+/*
+ * Collect the words of the finished queue and push the next ones, returns
+ * true when the current transfer is complete.
+ */
+static bool dspi_rxtx(struct fsl_dspi *dspi)
+{
+	struct spi_message *msg = dspi->cur_msg;
+
+	regmap_write(dspi->regmap, SPI_SR, SPI_SR_EOQF);
+	dspi_transfer_read(dspi);
+
+	if (!dspi->len) {
+		if (dspi->dataflags & TRAN_STATE_WORD_ODD_NUM)
+			regmap_update_bits(dspi->regmap, SPI_CTAR(dspi->cs),
+			SPI_FRAME_BITS_MASK, SPI_FRAME_BITS(16));
+
+		return true;
+	}
+
+	msg->actual_length += dspi_transfer_write(dspi);
+
+	return false;
+}
+
+static bool dspi_can_poll(struct fsl_dspi *dspi, struct spi_transfer *transfer)
+{
+	u32 hz = transfer->speed_hz ? : dspi->cur_msg->spi->max_speed_hz;
+
+	if (transfer->len <= poll_max_len)
+		return true;
+
+	/* 8 bits per byte, the chip select and inter frame delays are extra */
+	return poll_max_us && hz &&
+		div_u64((u64)transfer->len * 8 * USEC_PER_SEC, hz) <=
+		poll_max_us;
+}
+
+static int dspi_poll_xfer(struct fsl_dspi *dspi)
+{
+	unsigned long timeout;
+	unsigned int val;
+	bool expired;
+
+	regmap_write(dspi->regmap, SPI_RSER, 0);
+	dspi->cur_msg->actual_length += dspi_transfer_write(dspi);
+
+	do {
+		timeout = jiffies + DSPI_POLL_TIMEOUT;
+		do {
+			/*
+			 * Sample the deadline first, so that SR is read once
+			 * more after it passed: being preempted for longer
+			 * than the timeout is no failure.
+			 */
+			expired = time_after(jiffies, timeout);
+			regmap_read(dspi->regmap, SPI_SR, &val);
+			if (val & SPI_SR_EOQF)
+				break;
+			if (expired) {
+				dev_err(&dspi->pdev->dev,
+					"polled transfer timed out\n");
+				return -ETIMEDOUT;
+			}
+			cpu_relax();
+		} while (1);
+	} while (!dspi_rxtx(dspi));
+
+	return 0;
+}
+
 static int dspi_transfer_one_message(struct spi_master *master,
 		struct spi_message *message)
 {
@@ -370,12 +637,32 @@ static int dspi_transfer_one_message(struct spi_master *master,
 			regmap_write(dspi->regmap, SPI_CTAR(dspi->cs),
 					dspi->cur_chip->ctar_val);
 
-		regmap_write(dspi->regmap, SPI_RSER, SPI_RSER_EOQFE);
-		message->actual_length += dspi_transfer_write(dspi);
+		/* poll and PIO only if DMA is not possible or not ready */
+		status = -EAGAIN;
+		if (dspi_can_dma(dspi, transfer)) {
+			status = dspi_dma_xfer(dspi);
+			if (!status)
+				message->actual_length += transfer->len;
+		}
 
-		if (wait_event_interruptible(dspi->waitq, dspi->waitflags))
-			dev_err(&dspi->pdev->dev, "wait transfer complete fail!\n");
-		dspi->waitflags = 0;
+		if (status != -EAGAIN) {
+			if (status)
+				break;
+		} else if (dspi_can_poll(dspi, transfer)) {
+			status = dspi_poll_xfer(dspi);
+			if (status)
+				break;
+		} else {
+			status = 0;
+			regmap_write(dspi->regmap, SPI_RSER, SPI_RSER_EOQFE);
+			message->actual_length += dspi_transfer_write(dspi);
+
+			if (wait_event_interruptible(dspi->waitq,
+						     dspi->waitflags))
+				dev_err(&dspi->pdev->dev,
+					"wait transfer complete fail!\n");
+			dspi->waitflags = 0;
+		}
 
 		if (transfer->delay_usecs)
 			udelay(transfer->delay_usecs);
@@ -461,24 +748,108 @@ static irqreturn_t dspi_interrupt(int irq, void *dev_id)
 {
 	struct fsl_dspi *dspi = (struct fsl_dspi *)dev_id;
 
-	struct spi_message *msg = dspi->cur_msg;
-
-	regmap_write(dspi->regmap, SPI_SR, SPI_SR_EOQF);
-	dspi_transfer_read(dspi);
-
-	if (!dspi->len) {
-		if (dspi->dataflags & TRAN_STATE_WORD_ODD_NUM)
-			regmap_update_bits(dspi->regmap, SPI_CTAR(dspi->cs),
-			SPI_FRAME_BITS_MASK, SPI_FRAME_BITS(16));
-
+	if (dspi_rxtx(dspi)) {
 		dspi->waitflags = 1;
 		wake_up_interruptible(&dspi->waitq);
-	} else
-		msg->actual_length += dspi_transfer_write(dspi);
+	}
 
 	return IRQ_HANDLED;
 }
 
+static int dspi_request_dma(struct fsl_dspi *dspi)
+{
+	struct device *dev = &dspi->pdev->dev;
+	struct dma_slave_config cfg;
+	struct fsl_dspi_dma *dma;
+	int ret;
+
+	dma = devm_kzalloc(dev, sizeof(*dma), GFP_KERNEL);
+	if (!dma)
+		return -ENOMEM;
+
+	dma->chan_rx = dma_request_slave_channel(dev, "rx");
+	if (!dma->chan_rx)
+		return -ENODEV;
+
+	dma->chan_tx = dma_request_slave_channel(dev, "tx");
+	if (!dma->chan_tx) {
+		ret = -ENODEV;
+		goto err_tx_channel;
+	}
+
+	dma->tx_dma_buf = dma_alloc_coherent(dev, DSPI_DMA_BUFSIZE * sizeof(u32),
+					     &dma->tx_dma_phys, GFP_KERNEL);
+	if (!dma->tx_dma_buf) {
+		ret = -ENOMEM;
+		goto err_tx_dma_buf;
+	}
+
+	dma->rx_dma_buf = dma_alloc_coherent(dev, DSPI_DMA_BUFSIZE * sizeof(u32),
+					     &dma->rx_dma_phys, GFP_KERNEL);
+	if (!dma->rx_dma_buf) {
+		ret = -ENOMEM;
+		goto err_rx_dma_buf;
+	}
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.src_addr = dspi->phys_addr + SPI_POPR;
+	cfg.dst_addr = dspi->phys_addr + SPI_PUSHR;
+	cfg.src_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES;
+	cfg.dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES;
+	cfg.src_maxburst = 1;
+	cfg.dst_maxburst = 1;
+
+	cfg.direction = DMA_DEV_TO_MEM;
+	ret = dmaengine_slave_config(dma->chan_rx, &cfg);
+	if (ret) {
+		dev_err(dev, "can't configure rx dma channel\n");
+		goto err_slave_config;
+	}
+
+	cfg.direction = DMA_MEM_TO_DEV;
+	ret = dmaengine_slave_config(dma->chan_tx, &cfg);
+	if (ret) {
+		dev_err(dev, "can't configure tx dma channel\n");
+		goto err_slave_config;
+	}
+
+	dma->big_endian = of_property_read_bool(dev->of_node, "big-endian");
+	init_completion(&dma->cmd_rx_complete);
+	dspi->dma = dma;
+
+	return 0;
+
+err_slave_config:
+	dma_free_coherent(dev, DSPI_DMA_BUFSIZE * sizeof(u32),
+			  dma->rx_dma_buf, dma->rx_dma_phys);
+err_rx_dma_buf:
+	dma_free_coherent(dev, DSPI_DMA_BUFSIZE * sizeof(u32),
+			  dma->tx_dma_buf, dma->tx_dma_phys);
+err_tx_dma_buf:
+	dma_release_channel(dma->chan_tx);
+err_tx_channel:
+	dma_release_channel(dma->chan_rx);
+
+	return ret;
+}
+
+static void dspi_release_dma(struct fsl_dspi *dspi)
+{
+	struct fsl_dspi_dma *dma = dspi->dma;
+	struct device *dev = &dspi->pdev->dev;
+
+	if (!dma)
+		return;
+
+	dma_free_coherent(dev, DSPI_DMA_BUFSIZE * sizeof(u32),
+			  dma->rx_dma_buf, dma->rx_dma_phys);
+	dma_free_coherent(dev, DSPI_DMA_BUFSIZE * sizeof(u32),
+			  dma->tx_dma_buf, dma->tx_dma_phys);
+	dma_release_channel(dma->chan_tx);
+	dma_release_channel(dma->chan_rx);
+	dspi->dma = NULL;
+}
+
 static const struct of_device_id fsl_dspi_dt_ids[] = {
 	{ .compatible = "fsl,vf610-dspi", .data = NULL, },
 	{ /* sentinel */ }
@@ -565,6 +936,7 @@ static int dspi_probe(struct platform_device *pdev)
 		ret = PTR_ERR(base);
 		goto out_master_put;
 	}
+	dspi->phys_addr = res->start;
 
 	dspi->regmap = devm_regmap_init_mmio_clk(&pdev->dev, "dspi", base,
 						&dspi_regmap_config);
@@ -599,14 +971,22 @@ static int dspi_probe(struct platform_device *pdev)
 	init_waitqueue_head(&dspi->waitq);
 	platform_set_drvdata(pdev, master);
 
+	ret = dspi_request_dma(dspi);
+	if (ret == -ENOMEM)
+		goto out_clk_put;
+	if (ret)
+		dev_info(&pdev->dev, "no DMA channels, using PIO only\n");
+
 	ret = spi_register_master(master);
 	if (ret != 0) {
 		dev_err(&pdev->dev, "Problem registering DSPI master\n");
-		goto out_clk_put;
+		goto out_release_dma;
 	}
 
 	return ret;
 
+out_release_dma:
+	dspi_release_dma(dspi);
 out_clk_put:
 	clk_disable_unprepare(dspi->clk);
 out_master_put:
@@ -623,6 +1003,7 @@ static int dspi_remove(struct platform_device *pdev)
 	/* Disconnect from the SPI framework */
 	clk_disable_unprepare(dspi->clk);
 	spi_unregister_master(dspi->master);
+	dspi_release_dma(dspi);
 	spi_master_put(dspi->master);
 
 	return 0;
@@ -224,7 +224,13 @@
 #define UARTWATER_TXWATER_OFF	0
 #define UARTWATER_RXWATER_OFF	16
 
-#define FSL_UART_RX_DMA_BUFFER_SIZE	64
+/*
+ * The rx DMA runs cyclically over this ring and is never stopped. The
+ * period interrupts bound how much data can pile up between two idle line
+ * interrupts, so keep a few of them per ring.
+ */
+#define FSL_UART_RX_DMA_BUFFER_SIZE	4096
+#define FSL_UART_RX_DMA_PERIODS		4
 
 #define DRIVER_NAME	"fsl-lpuart"
 #define DEV_NAME	"ttyLP"
@@ -243,6 +249,7 @@ struct lpuart_port {
 	struct dma_chan		*dma_rx_chan;
 	struct dma_async_tx_descriptor  *dma_tx_desc;
 	struct dma_async_tx_descriptor  *dma_rx_desc;
+	struct scatterlist	dma_tx_sgl[2];
 	dma_addr_t		dma_tx_buf_bus;
 	dma_addr_t		dma_rx_buf_bus;
 	dma_cookie_t		dma_tx_cookie;
@@ -250,11 +257,8 @@ struct lpuart_port {
 	unsigned char		*dma_tx_buf_virt;
 	unsigned char		*dma_rx_buf_virt;
 	unsigned int		dma_tx_bytes;
-	unsigned int		dma_rx_bytes;
+	unsigned int		dma_rx_tail;
 	int			dma_tx_in_progress;
-	int			dma_rx_in_progress;
-	unsigned int		dma_rx_timeout;
-	struct timer_list	lpuart_timer;
 };
 
 static const struct of_device_id lpuart_dt_ids[] = {
@@ -316,68 +320,106 @@ static void lpuart32_stop_rx(struct uart_port *port)
 	lpuart32_write(temp & ~UARTCTRL_RE, port->membase + UARTCTRL);
 }
 
-static void lpuart_copy_rx_to_tty(struct lpuart_port *sport,
-		struct tty_port *tty, int count)
+static void lpuart_insert_rx_ring(struct lpuart_port *sport,
+		struct tty_port *tty, unsigned int start, unsigned int count)
 {
 	int copied;
 
 	sport->port.icount.rx += count;
 
-	if (!tty) {
-		dev_err(sport->port.dev, "No tty port\n");
-		return;
+	copied = tty_insert_flip_string(tty, sport->dma_rx_buf_virt + start,
+			count);
+	if (copied != count) {
+		sport->port.icount.buf_overrun++;
+		dev_err_ratelimited(sport->port.dev,
+				"RxData copy to tty layer failed\n");
 	}
+}
 
-	dma_sync_single_for_cpu(sport->port.dev, sport->dma_rx_buf_bus,
-			FSL_UART_RX_DMA_BUFFER_SIZE, DMA_FROM_DEVICE);
-	copied = tty_insert_flip_string(tty,
-			((unsigned char *)(sport->dma_rx_buf_virt)), count);
+/*
+ * Hand everything the rx DMA wrote since the last call to the tty layer.
+ * The write position is taken from the residue of the cyclic descriptor.
+ * Called with the port lock held, returns the number of bytes copied.
+ */
+static unsigned int lpuart_copy_rx_to_tty(struct lpuart_port *sport)
+{
+	struct tty_port *tty = &sport->port.state->port;
+	struct device *dev = sport->dma_rx_chan->device->dev;
+	unsigned int head, tail, count;
+	struct dma_tx_state state;
+	enum dma_status status;
 
-	if (copied != count) {
-		WARN_ON(1);
-		dev_err(sport->port.dev, "RxData copy to tty layer failed\n");
+	status = dmaengine_tx_status(sport->dma_rx_chan, sport->dma_rx_cookie,
+				     &state);
+	if (status == DMA_ERROR) {
+		dev_err_ratelimited(sport->port.dev, "Rx DMA error\n");
+		return 0;
 	}
 
-	dma_sync_single_for_device(sport->port.dev, sport->dma_rx_buf_bus,
-			FSL_UART_RX_DMA_BUFFER_SIZE, DMA_TO_DEVICE);
-}
+	head = FSL_UART_RX_DMA_BUFFER_SIZE - state.residue;
+	if (head == FSL_UART_RX_DMA_BUFFER_SIZE)
+		head = 0;
+	tail = sport->dma_rx_tail;
+	if (head == tail)
+		return 0;
 
-static void lpuart_pio_tx(struct lpuart_port *sport)
-{
-	struct circ_buf *xmit = &sport->port.state->xmit;
-	unsigned long flags;
+	dma_sync_single_for_cpu(dev, sport->dma_rx_buf_bus,
+			FSL_UART_RX_DMA_BUFFER_SIZE, DMA_FROM_DEVICE);
 
-	spin_lock_irqsave(&sport->port.lock, flags);
+	if (head < tail) {
+		/* the DMA wrapped around, first copy up to the ring end */
+		count = FSL_UART_RX_DMA_BUFFER_SIZE - tail;
+		lpuart_insert_rx_ring(sport, tty, tail, count);
+		tail = 0;
+	} else {
+		count = 0;
+	}
 
-	while (!uart_circ_empty(xmit) &&
-		readb(sport->port.membase + UARTTCFIFO) < sport->txfifo_size) {
-		writeb(xmit->buf[xmit->tail], sport->port.membase + UARTDR);
-		xmit->tail = (xmit->tail + 1) & (UART_XMIT_SIZE - 1);
-		sport->port.icount.tx++;
+	if (head > tail) {
+		lpuart_insert_rx_ring(sport, tty, tail, head - tail);
+		count += head - tail;
 	}
 
-	if (uart_circ_chars_pending(xmit) < WAKEUP_CHARS)
-		uart_write_wakeup(&sport->port);
+	sport->dma_rx_tail = head;
 
-	if (uart_circ_empty(xmit))
-		writeb(readb(sport->port.membase + UARTCR5) | UARTCR5_TDMAS,
-			sport->port.membase + UARTCR5);
+	dma_sync_single_for_device(dev, sport->dma_rx_buf_bus,
+			FSL_UART_RX_DMA_BUFFER_SIZE, DMA_FROM_DEVICE);
 
-	spin_unlock_irqrestore(&sport->port.lock, flags);
+	return count;
 }
 
-static int lpuart_dma_tx(struct lpuart_port *sport, unsigned long count)
+/*
+ * Send everything pending in the circular buffer with a single transfer.
+ * When the data wraps around the end of the buffer the transfer is made of
+ * two segments, both pointing into the permanent mapping of xmit->buf.
+ */
+static int lpuart_dma_tx(struct lpuart_port *sport)
 {
 	struct circ_buf *xmit = &sport->port.state->xmit;
-	dma_addr_t tx_bus_addr;
+	struct scatterlist *sgl = sport->dma_tx_sgl;
+	unsigned int nents = 1;
 
-	dma_sync_single_for_device(sport->port.dev, sport->dma_tx_buf_bus,
-				UART_XMIT_SIZE, DMA_TO_DEVICE);
-	sport->dma_tx_bytes = count & ~(sport->txfifo_size - 1);
-	tx_bus_addr = sport->dma_tx_buf_bus + xmit->tail;
-	sport->dma_tx_desc = dmaengine_prep_slave_single(sport->dma_tx_chan,
-					tx_bus_addr, sport->dma_tx_bytes,
-					DMA_MEM_TO_DEV, DMA_PREP_INTERRUPT);
+	sport->dma_tx_bytes = uart_circ_chars_pending(xmit);
+
+	sg_init_table(sgl, ARRAY_SIZE(sport->dma_tx_sgl));
+	sg_dma_address(&sgl[0]) = sport->dma_tx_buf_bus + xmit->tail;
+	if (xmit->tail < xmit->head) {
+		sg_dma_len(&sgl[0]) = sport->dma_tx_bytes;
+	} else {
+		sg_dma_len(&sgl[0]) = UART_XMIT_SIZE - xmit->tail;
+		if (xmit->head) {
+			sg_dma_address(&sgl[1]) = sport->dma_tx_buf_bus;
+			sg_dma_len(&sgl[1]) = xmit->head;
+			nents = 2;
+		}
+	}
+
+	dma_sync_single_for_device(sport->dma_tx_chan->device->dev,
+				sport->dma_tx_buf_bus, UART_XMIT_SIZE,
+				DMA_TO_DEVICE);
+	sport->dma_tx_desc = dmaengine_prep_slave_sg(sport->dma_tx_chan,
+					sgl, nents, DMA_MEM_TO_DEV,
+					DMA_PREP_INTERRUPT);
 
 	if (!sport->dma_tx_desc) {
 		dev_err(sport->port.dev, "Not able to get desc for tx\n");
@@ -396,20 +438,11 @@ static int lpuart_dma_tx(struct lpuart_port *sport, unsigned long count)
 static void lpuart_prepare_tx(struct lpuart_port *sport)
 {
 	struct circ_buf *xmit = &sport->port.state->xmit;
-	unsigned long count =  CIRC_CNT_TO_END(xmit->head,
-					xmit->tail, UART_XMIT_SIZE);
 
-	if (!count)
+	if (uart_circ_empty(xmit) || uart_tx_stopped(&sport->port))
 		return;
 
-	if (count < sport->txfifo_size)
-		writeb(readb(sport->port.membase + UARTCR5) & ~UARTCR5_TDMAS,
-				sport->port.membase + UARTCR5);
-	else {
-		writeb(readb(sport->port.membase + UARTCR5) | UARTCR5_TDMAS,
-				sport->port.membase + UARTCR5);
-		lpuart_dma_tx(sport, count);
-	}
+	lpuart_dma_tx(sport);
 }
 
 static void lpuart_dma_tx_complete(void *arg)
@@ -423,6 +456,7 @@ static void lpuart_dma_tx_complete(void *arg)
 	spin_lock_irqsave(&sport->port.lock, flags);
 
 	xmit->tail = (xmit->tail + sport->dma_tx_bytes) & (UART_XMIT_SIZE - 1);
+	sport->port.icount.tx += sport->dma_tx_bytes;
 	sport->dma_tx_in_progress = 0;
 
 	if (uart_circ_chars_pending(xmit) < WAKEUP_CHARS)
@@ -433,12 +467,16 @@ static void lpuart_dma_tx_complete(void *arg)
 	spin_unlock_irqrestore(&sport->port.lock, flags);
 }
 
+/*
+ * Start the cyclic rx DMA. It keeps running until shutdown, data is picked
+ * up from the ring on every period interrupt and on every idle line.
+ */
 static int lpuart_dma_rx(struct lpuart_port *sport)
 {
-	dma_sync_single_for_device(sport->port.dev, sport->dma_rx_buf_bus,
-			FSL_UART_RX_DMA_BUFFER_SIZE, DMA_TO_DEVICE);
-	sport->dma_rx_desc = dmaengine_prep_slave_single(sport->dma_rx_chan,
+	sport->dma_rx_tail = 0;
+	sport->dma_rx_desc = dmaengine_prep_dma_cyclic(sport->dma_rx_chan,
 			sport->dma_rx_buf_bus, FSL_UART_RX_DMA_BUFFER_SIZE,
+			FSL_UART_RX_DMA_BUFFER_SIZE / FSL_UART_RX_DMA_PERIODS,
 			DMA_DEV_TO_MEM, DMA_PREP_INTERRUPT);
 
 	if (!sport->dma_rx_desc) {
@@ -448,7 +486,6 @@ static int lpuart_dma_rx(struct lpuart_port *sport)
 
 	sport->dma_rx_desc->callback = lpuart_dma_rx_complete;
 	sport->dma_rx_desc->callback_param = sport;
-	sport->dma_rx_in_progress = 1;
 	sport->dma_rx_cookie = dmaengine_submit(sport->dma_rx_desc);
 	dma_async_issue_pending(sport->dma_rx_chan);
 
@@ -464,67 +501,49 @@ static void lpuart_flush_buffer(struct uart_port *port)
 	}
 }
 
+/* a period of the rx ring has been filled */
 static void lpuart_dma_rx_complete(void *arg)
 {
 	struct lpuart_port *sport = arg;
-	struct tty_port *port = &sport->port.state->port;
 	unsigned long flags;
-
-	async_tx_ack(sport->dma_rx_desc);
-	mod_timer(&sport->lpuart_timer, jiffies + sport->dma_rx_timeout);
+	unsigned int count;
 
 	spin_lock_irqsave(&sport->port.lock, flags);
-
-	sport->dma_rx_in_progress = 0;
-	lpuart_copy_rx_to_tty(sport, port, FSL_UART_RX_DMA_BUFFER_SIZE);
-	tty_flip_buffer_push(port);
-	lpuart_dma_rx(sport);
-
+	count = lpuart_copy_rx_to_tty(sport);
 	spin_unlock_irqrestore(&sport->port.lock, flags);
-}
-
-static void lpuart_timer_func(unsigned long data)
-{
-	struct lpuart_port *sport = (struct lpuart_port *)data;
-	struct tty_port *port = &sport->port.state->port;
-	struct dma_tx_state state;
-	unsigned long flags;
-	unsigned char temp;
-	int count;
-
-	del_timer(&sport->lpuart_timer);
-	dmaengine_pause(sport->dma_rx_chan);
-	dmaengine_tx_status(sport->dma_rx_chan, sport->dma_rx_cookie, &state);
-	dmaengine_terminate_all(sport->dma_rx_chan);
-	count = FSL_UART_RX_DMA_BUFFER_SIZE - state.residue;
-	async_tx_ack(sport->dma_rx_desc);
-
-	spin_lock_irqsave(&sport->port.lock, flags);
 
-	sport->dma_rx_in_progress = 0;
-	lpuart_copy_rx_to_tty(sport, port, count);
-	tty_flip_buffer_push(port);
-	temp = readb(sport->port.membase + UARTCR5);
-	writeb(temp & ~UARTCR5_RDMAS, sport->port.membase + UARTCR5);
-
-	spin_unlock_irqrestore(&sport->port.lock, flags);
+	if (count)
+		tty_flip_buffer_push(&sport->port.state->port);
 }
 
-static inline void lpuart_prepare_rx(struct lpuart_port *sport)
+/*
+ * The line went idle: push whatever the DMA has received so far, the
+ * remainder of a message must not wait for the ring period to fill up.
+ */
+static void lpuart_idle_rx(struct lpuart_port *sport)
 {
 	unsigned long flags;
-	unsigned char temp;
+	unsigned int count;
 
 	spin_lock_irqsave(&sport->port.lock, flags);
 
-	sport->lpuart_timer.expires = jiffies + sport->dma_rx_timeout;
-	add_timer(&sport->lpuart_timer);
+	/*
+	 * IDLE is cleared by reading SR1 (done by the caller) followed by DR.
+	 * With a rx watermark of 1 the DMA has already drained the FIFO when
+	 * the line goes idle, so the dummy read only underflows it. Never read
+	 * a character from under the DMA though.
+	 */
+	if (readb(sport->port.membase + UARTSFIFO) & UARTSFIFO_RXEMPT) {
+		readb(sport->port.membase + UARTDR);
+		writeb(UARTSFIFO_RXUF, sport->port.membase + UARTSFIFO);
+	}
 
-	lpuart_dma_rx(sport);
-	temp = readb(sport->port.membase + UARTCR5);
-	writeb(temp | UARTCR5_RDMAS, sport->port.membase + UARTCR5);
+	count = lpuart_copy_rx_to_tty(sport);
 
 	spin_unlock_irqrestore(&sport->port.lock, flags);
+
+	if (count)
+		tty_flip_buffer_push(&sport->port.state->port);
 }
 
 static inline void lpuart_transmit_buffer(struct lpuart_port *sport)
@@ -766,23 +785,18 @@ out:
 static irqreturn_t lpuart_int(int irq, void *dev_id)
 {
 	struct lpuart_port *sport = dev_id;
-	unsigned char sts, crdma;
+	unsigned char sts;
 
 	sts = readb(sport->port.membase + UARTSR1);
-	crdma = readb(sport->port.membase + UARTCR5);
 
-	if (sts & UARTSR1_RDRF && !(crdma & UARTCR5_RDMAS)) {
-		if (sport->lpuart_dma_rx_use)
-			lpuart_prepare_rx(sport);
-		else
-			lpuart_rxint(irq, dev_id);
-	}
-	if (sts & UARTSR1_TDRE && !(crdma & UARTCR5_TDMAS)) {
-		if (sport->lpuart_dma_tx_use)
-			lpuart_pio_tx(sport);
-		else
-			lpuart_txint(irq, dev_id);
+	if (sport->lpuart_dma_rx_use) {
+		if (sts & UARTSR1_IDLE)
+			lpuart_idle_rx(sport);
+	} else if (sts & UARTSR1_RDRF) {
+		lpuart_rxint(irq, dev_id);
 	}
+	if (sts & UARTSR1_TDRE && !sport->lpuart_dma_tx_use)
+		lpuart_txint(irq, dev_id);
 
 	return IRQ_HANDLED;
 }
@@ -857,7 +871,8 @@ static void lpuart_set_mctrl(struct uart_port *port, unsigned int mctrl)
 	temp = readb(port->membase + UARTMODEM) &
 			~(UARTMODEM_RXRTSE | UARTMODEM_TXCTSE);
 
-	if (mctrl & TIOCM_RTS)
+	/* in RS-485 mode RTS drives the transceiver */
+	if (mctrl & TIOCM_RTS && !(port->rs485.flags & SER_RS485_ENABLED))
 		temp |= UARTMODEM_RXRTSE;
 
 	if (mctrl & TIOCM_CTS)
@@ -873,7 +888,7 @@ static void lpuart32_set_mctrl(struct uart_port *port, unsigned int mctrl)
 	temp = lpuart32_read(port->membase + UARTMODIR) &
 			~(UARTMODIR_RXRTSE | UARTMODIR_TXCTSE);
 
-	if (mctrl & TIOCM_RTS)
+	if (mctrl & TIOCM_RTS && !(port->rs485.flags & SER_RS485_ENABLED))
 		temp |= UARTMODIR_RXRTSE;
 
 	if (mctrl & TIOCM_CTS)
@@ -882,6 +897,76 @@ static void lpuart32_set_mctrl(struct uart_port *port, unsigned int mctrl)
 	lpuart32_write(temp, port->membase + UARTMODIR);
 }
 
+/*
+ * Check a RS-485 configuration against what the transmitter RTS logic can
+ * do: RTS is asserted from one bit time before the start bit until the end
+ * of the last stop bit, only the polarity is configurable.
+ */
+static void lpuart_rs485_fixup(struct serial_rs485 *rs485)
+{
+	rs485->delay_rts_before_send = 0;
+	rs485->delay_rts_after_send = 0;
+	rs485->flags &= ~SER_RS485_RX_DURING_TX;
+
+	if (!(rs485->flags & SER_RS485_ENABLED))
+		return;
+
+	if (rs485->flags & SER_RS485_RTS_ON_SEND)
+		rs485->flags &= ~SER_RS485_RTS_AFTER_SEND;
+	else if (!(rs485->flags & SER_RS485_RTS_AFTER_SEND))
+		rs485->flags |= SER_RS485_RTS_ON_SEND;
+}
+
+/* called with the port lock held */
+static int lpuart_config_rs485(struct uart_port *port,
+			       struct serial_rs485 *rs485)
+{
+	unsigned char modem;
+
+	lpuart_rs485_fixup(rs485);
+
+	modem = readb(port->membase + UARTMODEM) &
+			~(UARTMODEM_TXRTSPOL | UARTMODEM_TXRTSE);
+
+	if (rs485->flags & SER_RS485_ENABLED) {
+		/* RTS is no longer available for receiver flow control */
+		modem &= ~UARTMODEM_RXRTSE;
+		modem |= UARTMODEM_TXRTSE;
+		if (rs485->flags & SER_RS485_RTS_AFTER_SEND)
+			modem |= UARTMODEM_TXRTSPOL;
+	}
+
+	writeb(modem, port->membase + UARTMODEM);
+
+	port->rs485 = *rs485;
+
+	return 0;
+}
+
+static int lpuart32_config_rs485(struct uart_port *port,
+				 struct serial_rs485 *rs485)
+{
+	unsigned long modir;
+
+	lpuart_rs485_fixup(rs485);
+
+	modir = lpuart32_read(port->membase + UARTMODIR) &
+			~(UARTMODIR_TXRTSPOL | UARTMODIR_TXRTSE);
+
+	if (rs485->flags & SER_RS485_ENABLED) {
+		modir &= ~UARTMODIR_RXRTSE;
+		modir |= UARTMODIR_TXRTSE;
+		if (rs485->flags & SER_RS485_RTS_AFTER_SEND)
+			modir |= UARTMODIR_TXRTSPOL;
+	}
+
+	lpuart32_write(modir, port->membase + UARTMODIR);
+
+	port->rs485 = *rs485;
+
+	return 0;
+}
+
 static void lpuart_break_ctl(struct uart_port *port, int break_state)
 {
 	unsigned char temp;
@@ -928,7 +1013,10 @@ static void lpuart_setup_watermark(struct lpuart_port *sport)
 	writeb(UARTCFIFO_TXFLUSH | UARTCFIFO_RXFLUSH,
 			sport->port.membase + UARTCFIFO);
 
-	writeb(0, sport->port.membase + UARTTWFIFO);
+	if (sport->lpuart_dma_tx_use)
+		writeb(sport->txfifo_size - 1, sport->port.membase + UARTTWFIFO);
+	else
+		writeb(0, sport->port.membase + UARTTWFIFO);
 	writeb(1, sport->port.membase + UARTRWFIFO);
 
 	/* Restore cr2 */
@@ -979,9 +1067,15 @@ static int lpuart_dma_tx_request(struct uart_port *port)
 	}
 
 	dma_buf = sport->port.state->xmit.buf;
+	memset(&dma_tx_sconfig, 0, sizeof(dma_tx_sconfig));
 	dma_tx_sconfig.dst_addr = sport->port.mapbase + UARTDR;
 	dma_tx_sconfig.dst_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE;
-	dma_tx_sconfig.dst_maxburst = sport->txfifo_size;
+	/*
+	 * Single byte requests: the segments start and end anywhere in the
+	 * circular buffer, so they cannot be split into FIFO sized bursts.
+	 * The tx watermark keeps the requests coming while the FIFO has room.
+	 */
+	dma_tx_sconfig.dst_maxburst = 1;
 	dma_tx_sconfig.direction = DMA_MEM_TO_DEV;
 	ret = dmaengine_slave_config(sport->dma_tx_chan, &dma_tx_sconfig);
 
@@ -1007,8 +1101,7 @@ static int lpuart_dma_rx_request(struct uart_port *port)
 	unsigned char *dma_buf;
 	int ret;
 
-	dma_buf = devm_kzalloc(sport->port.dev,
-				FSL_UART_RX_DMA_BUFFER_SIZE, GFP_KERNEL);
+	dma_buf = kzalloc(FSL_UART_RX_DMA_BUFFER_SIZE, GFP_KERNEL);
 
 	if (!dma_buf) {
 		dev_err(sport->port.dev, "Dma rx alloc failed\n");
@@ -1020,9 +1113,11 @@ static int lpuart_dma_rx_request(struct uart_port *port)
 
 	if (dma_mapping_error(sport->dma_rx_chan->device->dev, dma_bus)) {
 		dev_err(sport->port.dev, "dma_map_single rx failed\n");
+		kfree(dma_buf);
 		return -ENOMEM;
 	}
 
+	memset(&dma_rx_sconfig, 0, sizeof(dma_rx_sconfig));
 	dma_rx_sconfig.src_addr = sport->port.mapbase + UARTDR;
 	dma_rx_sconfig.src_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE;
 	dma_rx_sconfig.src_maxburst = 1;
@@ -1032,12 +1127,14 @@ static int lpuart_dma_rx_request(struct uart_port *port)
 	if (ret < 0) {
 		dev_err(sport->port.dev,
 				"Dma slave config failed, err = %d\n", ret);
+		dma_unmap_single(sport->dma_rx_chan->device->dev, dma_bus,
+				FSL_UART_RX_DMA_BUFFER_SIZE, DMA_FROM_DEVICE);
+		kfree(dma_buf);
 		return ret;
 	}
 
 	sport->dma_rx_buf_virt = dma_buf;
 	sport->dma_rx_buf_bus = dma_bus;
-	sport->dma_rx_in_progress = 0;
 
 	return 0;
 }
@@ -1047,8 +1144,11 @@ static void lpuart_dma_tx_free(struct uart_port *port)
 	struct lpuart_port *sport = container_of(port,
 					struct lpuart_port, port);
 
-	dma_unmap_single(sport->port.dev, sport->dma_tx_buf_bus,
-			UART_XMIT_SIZE, DMA_TO_DEVICE);
+	dmaengine_terminate_all(sport->dma_tx_chan);
+	sport->dma_tx_in_progress = 0;
+
+	dma_unmap_single(sport->dma_tx_chan->device->dev,
+			sport->dma_tx_buf_bus, UART_XMIT_SIZE, DMA_TO_DEVICE);
 
 	sport->dma_tx_buf_bus = 0;
 	sport->dma_tx_buf_virt = NULL;
@@ -1059,8 +1159,12 @@ static void lpuart_dma_rx_free(struct uart_port *port)
 	struct lpuart_port *sport = container_of(port,
 					struct lpuart_port, port);
 
-	dma_unmap_single(sport->port.dev, sport->dma_rx_buf_bus,
+	dmaengine_terminate_all(sport->dma_rx_chan);
+
+	dma_unmap_single(sport->dma_rx_chan->device->dev,
+			sport->dma_rx_buf_bus,
 			FSL_UART_RX_DMA_BUFFER_SIZE, DMA_FROM_DEVICE);
+	kfree(sport->dma_rx_buf_virt);
 
 	sport->dma_rx_buf_bus = 0;
 	sport->dma_rx_buf_virt = NULL;
@@ -1084,12 +1188,19 @@ static int lpuart_startup(struct uart_port *port)
 	sport->rxfifo_size = 0x1 << (((temp >> UARTPFIFO_RXSIZE_OFF) &
 		UARTPFIFO_FIFOSIZE_MASK) + 1);
 
+	/* before the cyclic RX DMA starts, there is nothing to undo yet */
+	ret = devm_request_irq(port->dev, port->irq, lpuart_int, 0,
+				DRIVER_NAME, sport);
+	if (ret)
+		return ret;
+
+	sport->lpuart_dma_rx_use = false;
 	if (sport->dma_rx_chan && !lpuart_dma_rx_request(port)) {
-		sport->lpuart_dma_rx_use = true;
-		setup_timer(&sport->lpuart_timer, lpuart_timer_func,
-			    (unsigned long)sport);
-	} else
-		sport->lpuart_dma_rx_use = false;
+		if (!lpuart_dma_rx(sport))
+			sport->lpuart_dma_rx_use = true;
+		else
+			lpuart_dma_rx_free(port);
+	}
 
 
 	if (sport->dma_tx_chan && !lpuart_dma_tx_request(port)) {
@@ -1100,17 +1211,23 @@ static int lpuart_startup(struct uart_port *port)
 	} else
 		sport->lpuart_dma_tx_use = false;
 
-	ret = devm_request_irq(port->dev, port->irq, lpuart_int, 0,
-				DRIVER_NAME, sport);
-	if (ret)
-		return ret;
-
 	spin_lock_irqsave(&sport->port.lock, flags);
 
 	lpuart_setup_watermark(sport);
 
+	if (sport->lpuart_dma_rx_use) {
+		/* count the idle time from the stop bit of the last character */
+		temp = readb(sport->port.membase + UARTCR1);
+		writeb(temp | UARTCR1_ILT, sport->port.membase + UARTCR1);
+
+		temp = readb(sport->port.membase + UARTCR5);
+		writeb(temp | UARTCR5_RDMAS, sport->port.membase + UARTCR5);
+	}
+
 	temp = readb(sport->port.membase + UARTCR2);
 	temp |= (UARTCR2_RIE | UARTCR2_TIE | UARTCR2_RE | UARTCR2_TE);
+	if (sport->lpuart_dma_rx_use)
+		temp |= UARTCR2_ILIE;
 	writeb(temp, sport->port.membase + UARTCR2);
 
 	spin_unlock_irqrestore(&sport->port.lock, flags);
@@ -1161,18 +1278,21 @@ static void lpuart_shutdown(struct uart_port *port)
 
 	/* disable Rx/Tx and interrupts */
 	temp = readb(port->membase + UARTCR2);
-	temp &= ~(UARTCR2_TE | UARTCR2_RE |
-			UARTCR2_TIE | UARTCR2_TCIE | UARTCR2_RIE);
+	temp &= ~(UARTCR2_TE | UARTCR2_RE | UARTCR2_TIE |
+			UARTCR2_TCIE | UARTCR2_RIE | UARTCR2_ILIE);
 	writeb(temp, port->membase + UARTCR2);
 
+	if (sport->lpuart_dma_rx_use) {
+		temp = readb(port->membase + UARTCR5);
+		writeb(temp & ~UARTCR5_RDMAS, port->membase + UARTCR5);
+	}
+
 	spin_unlock_irqrestore(&port->lock, flags);
 
 	devm_free_irq(port->dev, port->irq, sport);
 
-	if (sport->lpuart_dma_rx_use) {
+	if (sport->lpuart_dma_rx_use)
 		lpuart_dma_rx_free(&sport->port);
-		del_timer_sync(&sport->lpuart_timer);
-	}
 
 	if (sport->lpuart_dma_tx_use)
 		lpuart_dma_tx_free(&sport->port);
@@ -1240,6 +1360,10 @@ lpuart_set_termios(struct uart_port *port, struct ktermios *termios,
 		cr1 |= UARTCR1_M;
 	}
 
+	/* RTS is the transceiver enable in RS-485 mode, no flow control */
+	if (sport->port.rs485.flags & SER_RS485_ENABLED)
+		termios->c_cflag &= ~CRTSCTS;
+
 	if (termios->c_cflag & CRTSCTS) {
 		modem |= (UARTMODEM_RXRTSE | UARTMODEM_TXCTSE);
 	} else {
@@ -1297,17 +1421,6 @@ lpuart_set_termios(struct uart_port *port, struct ktermios *termios,
 	/* update the per-port timeout */
 	uart_update_timeout(port, termios->c_cflag, baud);
 
-	if (sport->lpuart_dma_rx_use) {
-		/* Calculate delay for 1.5 DMA buffers */
-		sport->dma_rx_timeout = (sport->port.timeout - HZ / 50) *
-					FSL_UART_RX_DMA_BUFFER_SIZE * 3 /
-					sport->rxfifo_size / 2;
-		dev_dbg(port->dev, "DMA Rx t-out %ums, tty t-out %u jiffies\n",
-			sport->dma_rx_timeout * 1000 / HZ, sport->port.timeout);
-		if (sport->dma_rx_timeout < msecs_to_jiffies(20))
-			sport->dma_rx_timeout = msecs_to_jiffies(20);
-	}
-
 	/* wait transmit engin complete */
 	while (!(readb(sport->port.membase + UARTSR1) & UARTSR1_TC))
 		barrier();
@@ -1375,6 +1488,10 @@ lpuart32_set_termios(struct uart_port *port, struct ktermios *termios,
 		ctrl |= UARTCTRL_M;
 	}
 
+	/* RTS is the transceiver enable in RS-485 mode, no flow control */
+	if (sport->port.rs485.flags & SER_RS485_ENABLED)
+		termios->c_cflag &= ~CRTSCTS;
+
 	if (termios->c_cflag & CRTSCTS) {
 		modem |= (UARTMODEM_RXRTSE | UARTMODEM_TXCTSE);
 	} else {
@@ -1792,10 +1909,13 @@ static int lpuart_probe(struct platform_device *pdev)
 	sport->port.type = PORT_LPUART;
 	sport->port.iotype = UPIO_MEM;
 	sport->port.irq = platform_get_irq(pdev, 0);
-	if (sport->lpuart32)
+	if (sport->lpuart32) {
 		sport->port.ops = &lpuart32_pops;
-	else
+		sport->port.rs485_config = lpuart32_config_rs485;
+	} else {
 		sport->port.ops = &lpuart_pops;
+		sport->port.rs485_config = lpuart_config_rs485;
+	}
 	sport->port.flags = UPF_BOOT_AUTOCONF;
 
 	sport->clk = devm_clk_get(&pdev->dev, "ipg");
@@ -1813,6 +1933,11 @@ static int lpuart_probe(struct platform_device *pdev)
 
 	sport->port.uartclk = clk_get_rate(sport->clk);
 
+	sport->port.rs485.flags = SER_RS485_RTS_ON_SEND;
+	if (of_property_read_bool(np, "linux,rs485-enabled-at-boot-time"))
+		sport->port.rs485.flags |= SER_RS485_ENABLED;
+	sport->port.rs485_config(&sport->port, &sport->port.rs485);
+
 	lpuart_ports[sport->port.line] = sport;
 
 	platform_set_drvdata(pdev, &sport->port);
@@ -479,11 +479,13 @@ static int uio_release(struct inode *inode, struct file *filep)
 	int ret = 0;
 	struct uio_listener *listener = filep->private_data;
 	struct uio_device *idev = listener->dev;
+	struct module *owner = idev->owner;
 
+	/* the driver may free an unregistered device from its release */
 	if (idev->info->release)
 		ret = idev->info->release(idev->info, inode);
 
-	module_put(idev->owner);
+	module_put(owner);
 	kfree(listener);
 	return ret;
 }
@@ -252,6 +252,7 @@ enum cryptodev_crk_op_t {
 	CRK_DSA_SIGN = 2,
 	CRK_DSA_VERIFY = 3,
 	CRK_DH_COMPUTE_KEY = 4,
+	CRK_EC_POINT_MUL = 5,
 	CRK_ALGORITHM_ALL
 };
 
@@ -264,6 +265,7 @@ enum cryptodev_crk_op_t {
 #define CRF_DSA_SIGN		(1 << CRK_DSA_SIGN)
 #define CRF_DSA_VERIFY		(1 << CRK_DSA_VERIFY)
 #define CRF_DH_COMPUTE_KEY	(1 << CRK_DH_COMPUTE_KEY)
+#define CRF_EC_POINT_MUL	(1 << CRK_EC_POINT_MUL)
 
 
 /* ioctl's. Compatible with old linux cryptodev.h
@@ -0,0 +1,94 @@
+/*
+ * PKC: public key primitives offloaded to a hardware engine
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#ifndef _CRYPTO_PKC_H
+#define _CRYPTO_PKC_H
+
+#include <linux/types.h>
+
+/*
+ * All numbers are unsigned big-endian byte strings. Results are written
+ * with leading zeroes to the full length of the modulus or field.
+ */
+
+/* out = a^e mod n; RSA public key operations and Diffie-Hellman */
+struct pkc_mod_exp_req {
+	const u8 *a;
+	const u8 *e;
+	const u8 *n;
+	u8 *out;
+	unsigned int a_len;
+	unsigned int e_len;
+	unsigned int n_len;
+};
+
+/* out = a^d mod p*q from the CRT form of d; RSA private key operations */
+struct pkc_mod_exp_crt_req {
+	const u8 *a;
+	const u8 *p;
+	const u8 *q;
+	const u8 *dp;
+	const u8 *dq;
+	const u8 *qinv;
+	u8 *out;
+	unsigned int a_len;
+	unsigned int p_len;
+	unsigned int q_len;
+	unsigned int dp_len;
+	unsigned int dq_len;
+	unsigned int qinv_len;
+	unsigned int out_len;
+};
+
+/* (rx, ry) = k * (x, y) on y^2 = x^3 + ax + b over GF(p); ECDH, ECDSA */
+struct pkc_ecc_mul_req {
+	const u8 *p;
+	const u8 *a;
+	const u8 *b;
+	const u8 *x;
+	const u8 *y;
+	const u8 *k;
+	u8 *rx;
+	u8 *ry;
+	unsigned int p_len;	/* length of p, a, b, x, y, rx and ry */
+	unsigned int k_len;
+};
+
+#define PKC_F_MOD_EXP		(1 << 0)
+#define PKC_F_MOD_EXP_CRT	(1 << 1)
+#define PKC_F_ECC_MUL		(1 << 2)
+
+/**
+ * struct pkc_engine - public key engine
+ * @name: name for log messages
+ * @features: PKC_F_* operations the engine implements
+ * @max_bits: largest modulus/field the engine takes
+ *
+ * The operations sleep until the result is available and may be called
+ * concurrently.
+ */
+struct pkc_engine {
+	const char *name;
+	unsigned int features;
+	unsigned int max_bits;
+	int (*mod_exp)(struct pkc_mod_exp_req *req);
+	int (*mod_exp_crt)(struct pkc_mod_exp_crt_req *req);
+	int (*ecc_mul)(struct pkc_ecc_mul_req *req);
+};
+
+int crypto_pkc_register(struct pkc_engine *engine);
+void crypto_pkc_unregister(struct pkc_engine *engine);
+
+unsigned int crypto_pkc_features(void);
+int crypto_pkc_mod_exp(struct pkc_mod_exp_req *req);
+int crypto_pkc_mod_exp_crt(struct pkc_mod_exp_crt_req *req);
+int crypto_pkc_ecc_mul(struct pkc_ecc_mul_req *req);
+
+#endif	/* _CRYPTO_PKC_H */
@@ -26,6 +26,15 @@
 
 #define DNAME(dev) ((dev) ? (dev)->name : "any")
 
+/*
+ * The size of struct sockaddr_can has grown with protocol specific address
+ * information. Check only for the part of the structure that is needed by
+ * the protocol to stay compatible with the original 16 byte sockaddr_can.
+ */
+#define CAN_REQUIRED_SIZE(struct_type, member) \
+	(offsetof(typeof(struct_type), member) + \
+	 sizeof(((typeof(struct_type) *)(NULL))->member))
+
 /**
  * struct can_proto - CAN protocol structure
  * @type:       type argument in socket() syscall, e.g. SOCK_DGRAM.
@@ -10,6 +10,9 @@
 #ifndef __LINUX_MTD_SPI_NOR_H
 #define __LINUX_MTD_SPI_NOR_H
 
+#include <linux/atomic.h>
+#include <linux/wait.h>
+
 /*
  * Note on opcode nomenclature: some opcodes have a format like
  * SPINOR_OP_FUNCTION{4,}_x_y_z. The numbers x, y, and z stand for the number
@@ -59,6 +62,10 @@
 /* Used for Spansion flashes only. */
 #define SPINOR_OP_BRWR		0x17	/* Bank register write */
 
+/* Used for Micron, Spansion and Winbond flashes. */
+#define SPINOR_OP_ERSP		0x75	/* Erase suspend */
+#define SPINOR_OP_ERRS		0x7a	/* Erase resume */
+
 /* Used for Micron flashes only. */
 #define SPINOR_OP_MIO_RDID	0xaf	/* Multiple I/O Read JEDEC ID */
 #define SPINOR_OP_RD_EVCR	0x65	/* Read EVCR register */
@@ -140,6 +147,20 @@ enum spi_nor_ops {
 
 enum spi_nor_option_flags {
 	SNOR_F_USE_FSR		= BIT(0),
+	/* set by the driver when it can issue SPINOR_OP_ERSP/ERRS */
+	SNOR_F_ERASE_SUSPEND	= BIT(1),
+};
+
+#define SNOR_ERASE_TYPE_MAX	3
+
+/**
+ * struct spi_nor_erase_type - an erase command supported by the flash
+ * @size:	number of bytes erased by @opcode
+ * @opcode:	the erase opcode
+ */
+struct spi_nor_erase_type {
+	u32	size;
+	u8	opcode;
 };
 
 /**
@@ -149,7 +170,10 @@ enum spi_nor_option_flags {
  * @dev:		point to a spi device, or a spi nor controller device.
  * @page_size:		the page size of the SPI NOR
  * @addr_width:		number of address bytes
- * @erase_opcode:	the opcode for erasing a sector
+ * @erase_opcode:	the opcode for erasing a sector, set from @erase_type
+ *			before each call of @erase
+ * @erase_type:		the erase commands of the flash, smallest first
+ * @num_erase_types:	number of valid entries in @erase_type
  * @read_opcode:	the read opcode
  * @read_dummy:		the dummy needed by the read operation
  * @program_opcode:	the program opcode
@@ -162,6 +186,12 @@ enum spi_nor_option_flags {
  * @write_proto:	the SPI protocol used by write operations
  * @reg_proto:		the SPI protocol used by read_reg/write_reg operations
  * @cmd_buf:		used by the write_reg
+ * @read_waiters:	number of readers waiting for or holding @lock
+ * @erase_suspended:	an erase, or a program between two pages, is
+ *			suspended to let readers through
+ * @erase_wq:		wait queue for the suspend handover
+ * @erase_resumed:	time the running erase or program last started or
+ *			resumed
  * @prepare:		[OPTIONAL] do some preparations for the
  *			read/write/erase/lock/unlock operations
  * @unprepare:		[OPTIONAL] do some post work after the
@@ -189,6 +219,8 @@ struct spi_nor {
 	u8			read_opcode;
 	u8			read_dummy;
 	u8			program_opcode;
+	struct spi_nor_erase_type erase_type[SNOR_ERASE_TYPE_MAX];
+	int			num_erase_types;
 	enum spi_protocol	erase_proto;
 	enum spi_protocol	read_proto;
 	enum spi_protocol	write_proto;
@@ -198,6 +230,10 @@ struct spi_nor {
 	u32			flags;
 	struct spi_nor_xfer_cfg cfg;
 	u8			cmd_buf[SPI_NOR_MAX_CMD_SIZE];
+	atomic_t		read_waiters;
+	bool			erase_suspended;
+	wait_queue_head_t	erase_wq;
+	unsigned long		erase_resumed;
 
 	int (*prepare)(struct spi_nor *nor, enum spi_nor_ops ops);
 	void (*unprepare)(struct spi_nor *nor, enum spi_nor_ops ops);
@@ -10,4 +10,47 @@ static inline struct ip_esp_hdr *ip_esp_hdr(const struct sk_buff *skb)
 	return (struct ip_esp_hdr *)skb_transport_header(skb);
 }
 
+struct xfrm_state;
+
+/*
+ * ESP protocol offload to a lookaside crypto engine.
+ *
+ * The engine keeps the SA (keys, SPI, sequence number and anti-replay
+ * window) in a context set up by add_state and builds or checks complete
+ * ESP payloads in place: encap writes the ESP header, IV, ciphertext,
+ * padding, trailer and ICV at esph for len bytes of payload, decap writes
+ * the plaintext including padding and trailer right after the IV. The
+ * ESP modules still do the skb layout, and the result is reported through
+ * done unless the call returns something other than -EINPROGRESS.
+ *
+ * An engine with a flush method may hold jobs back in encap and decap to
+ * submit them together: it calls esp_offload_kick() on the CPU holding
+ * them, before it can migrate, and flush then runs on that CPU once the
+ * current softirq run, such as a NAPI poll, is done with handing over
+ * packets.
+ */
+struct esp_offload_ops {
+	struct module	*owner;
+	void		*(*add_state)(struct xfrm_state *x, u8 nexthdr);
+	void		(*del_state)(void *ctx);
+	int		(*encap)(void *ctx, struct sk_buff *skb,
+				 struct ip_esp_hdr *esph, unsigned int len,
+				 void (*done)(struct sk_buff *skb, int err));
+	int		(*decap)(void *ctx, struct sk_buff *skb,
+				 struct ip_esp_hdr *esph, unsigned int len,
+				 void (*done)(struct sk_buff *skb, int err));
+	void		(*flush)(void);
+};
+
+struct esp_offload {
+	const struct esp_offload_ops	*ops;
+	void				*ctx;
+};
+
+int esp_offload_register(const struct esp_offload_ops *ops);
+void esp_offload_unregister(const struct esp_offload_ops *ops);
+void esp_offload_add_state(struct xfrm_state *x, u8 nexthdr);
+void esp_offload_del_state(struct xfrm_state *x);
+void esp_offload_kick(const struct esp_offload_ops *ops);
+
 #endif
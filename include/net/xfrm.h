@@ -229,6 +229,9 @@ struct xfrm_state {
 	/* Private data of this transformer, format is opaque,
 	 * interpreted by xfrm_type methods. */
 	void			*data;
+
+	/* ESP protocol offload of this SA, if any */
+	struct esp_offload	*esp_offload;
 };
 
 static inline struct net *xs_net(struct xfrm_state *x)
@@ -1616,6 +1619,7 @@ int km_report(struct net *net, u8 proto, struct xfrm_selector *sel,
 	      xfrm_address_t *addr);
 
 void xfrm_input_init(void);
+void xfrm_esp_offload_init(void);
 int xfrm_parse_spi(struct sk_buff *skb, u8 nexthdr, __be32 *spi, __be32 *seq);
 
 void xfrm_probe_algs(void);
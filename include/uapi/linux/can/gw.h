@@ -78,6 +78,7 @@ enum {
 	CGW_FILTER,	/* specify struct can_filter on source CAN device */
 	CGW_DELETED,	/* number of deleted CAN frames (see max_hops param) */
 	CGW_LIM_HOPS,	/* limit the number of hops of this specific rule */
+	CGW_LAT_HIST,	/* forwarding latency histogram (see below) */
 	__CGW_MAX
 };
 
@@ -86,6 +87,10 @@ enum {
 #define CGW_FLAGS_CAN_ECHO 0x01
 #define CGW_FLAGS_CAN_SRC_TSTAMP 0x02
 #define CGW_FLAGS_CAN_IIF_TX_OK 0x04
+#define CGW_FLAGS_CAN_LAT_HIST 0x08
+
+/* number of log2 scaled buckets in the CGW_LAT_HIST attribute */
+#define CGW_LAT_HIST_BUCKETS 16
 
 #define CGW_MOD_FUNCS 4 /* AND OR XOR SET */
 
@@ -162,6 +167,19 @@ enum {
  * load time of the can-gw module). This value is used to reduce the number of
  * possible hops for this gateway rule to a value smaller then max_hops.
  *
+ * CGW_LAT_HIST (length CGW_LAT_HIST_BUCKETS * 4 bytes):
+ * Forwarding latency histogram of a gateway job that has been created with
+ * the CGW_FLAGS_CAN_LAT_HIST flag. The latency is measured from the reception
+ * timestamp of the CAN frame (or the entry into the gateway when the frame
+ * has no timestamp) until the frame has been handed to the destination
+ * interface. Each element is a __u32 frame counter:
+ *
+ * bucket[0]     : latency < 1 us
+ * bucket[n]     : 2^(n-1) us <= latency < 2^n us
+ * bucket[last]  : latency >= 2^(CGW_LAT_HIST_BUCKETS - 2) us
+ *
+ * The attribute is only provided in dump replies and ignored on job creation.
+ *
  * CGW_CS_XOR (length 4 bytes):
  * Set a simple XOR checksum starting with an initial value into
  * data[result-idx] using data[start-idx] .. data[end-idx]
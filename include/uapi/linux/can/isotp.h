@@ -0,0 +1,107 @@
+/*
+ * linux/can/isotp.h
+ *
+ * Definitions for ISO 15765-2 CAN transport protocol sockets
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _UAPI_CAN_ISOTP_H
+#define _UAPI_CAN_ISOTP_H
+
+#include <linux/types.h>
+#include <linux/can.h>
+
+#define SOL_CAN_ISOTP (SOL_CAN_BASE + CAN_ISOTP)
+
+/* for socket options affecting the socket (not the global system) */
+
+enum {
+	CAN_ISOTP_OPTS = 1,	/* pass struct can_isotp_options    */
+	CAN_ISOTP_RECV_FC,	/* pass struct can_isotp_fc_options */
+	CAN_ISOTP_TX_STMIN,	/* pass __u32 value in nano secs    */
+	CAN_ISOTP_RX_STMIN,	/* pass __u32 value in nano secs    */
+};
+
+/* maximum PDU length (12 bit FF_DL) */
+#define CAN_ISOTP_MAX_MSG_LENGTH 4095
+
+/**
+ * struct can_isotp_options - general ISO-TP socket options
+ * @flags:          CAN_ISOTP_* option flags (see below)
+ * @frame_txtime:   frame transmission time (N_As/N_Ar) in nano secs,
+ *                  added to the separation time between consecutive frames
+ * @ext_address:    extended addressing byte for transmitted frames
+ *                  (and received frames without CAN_ISOTP_RX_EXT_ADDR)
+ * @txpad_content:  padding byte for transmitted frames
+ * @rxpad_content:  expected padding byte for received frames
+ * @rx_ext_address: extended addressing byte for received frames
+ */
+struct can_isotp_options {
+	__u32 flags;
+	__u32 frame_txtime;
+	__u8  ext_address;
+	__u8  txpad_content;
+	__u8  rxpad_content;
+	__u8  rx_ext_address;
+};
+
+/**
+ * struct can_isotp_fc_options - flow control parameters sent to the peer
+ * @bs:     block size: consecutive frames between flow control frames
+ *          (0 = no further flow control frames)
+ * @stmin:  separation time provided in the flow control frame
+ *          (0x00 - 0x7F : 0 - 127 ms, 0xF1 - 0xF9 : 100 - 900 us)
+ * @wftmax: max. number of wait frame transmissions (0 = omit FC.WT)
+ */
+struct can_isotp_fc_options {
+	__u8  bs;
+	__u8  stmin;
+	__u8  wftmax;
+};
+
+/* flags for isotp behaviour */
+
+#define CAN_ISOTP_LISTEN_MODE	0x001	/* listen only (do not send FC) */
+#define CAN_ISOTP_EXTEND_ADDR	0x002	/* enable extended addressing */
+#define CAN_ISOTP_TX_PADDING	0x004	/* enable CAN frame padding tx path */
+#define CAN_ISOTP_RX_PADDING	0x008	/* enable CAN frame padding rx path */
+#define CAN_ISOTP_CHK_PAD_LEN	0x010	/* check received CAN frame padding */
+#define CAN_ISOTP_CHK_PAD_DATA	0x020	/* check received CAN frame padding */
+#define CAN_ISOTP_HALF_DUPLEX	0x040	/* half duplex error state handling */
+#define CAN_ISOTP_FORCE_TXSTMIN	0x080	/* ignore stmin from received FC */
+#define CAN_ISOTP_FORCE_RXSTMIN	0x100	/* ignore CFs depending on rx stmin */
+#define CAN_ISOTP_RX_EXT_ADDR	0x200	/* different rx extended addressing */
+
+/* default values */
+
+#define CAN_ISOTP_DEFAULT_FLAGS		0
+#define CAN_ISOTP_DEFAULT_EXT_ADDRESS	0x00
+#define CAN_ISOTP_DEFAULT_PAD_CONTENT	0xCC /* prevent bit-stuffing */
+#define CAN_ISOTP_DEFAULT_FRAME_TXTIME	50000 /* 50 us */
+#define CAN_ISOTP_DEFAULT_RECV_BS	0
+#define CAN_ISOTP_DEFAULT_RECV_STMIN	0x00
+#define CAN_ISOTP_DEFAULT_RECV_WFTMAX	0
+
+/*
+ * Remark on CAN_ISOTP_DEFAULT_RECV_* values:
+ *
+ * We can strongly assume, that the Linux Kernel implementation of
+ * CAN_ISOTP is capable to run with BS=0, STmin=0 and WFTmax=0.
+ * But as we like to be able to behave as a commonly available ECU,
+ * these default settings can be changed via sockopts.
+ * For that reason the STmin value is intentionally _not_ checked for
+ * consistency and copied directly into the flow control (FC) frame.
+ *
+ * The CAN_ISOTP_TX_STMIN / CAN_ISOTP_RX_STMIN socket options are only
+ * evaluated when CAN_ISOTP_FORCE_TXSTMIN / CAN_ISOTP_FORCE_RXSTMIN are set.
+ */
+
+#endif /* !_UAPI_CAN_ISOTP_H */
@@ -58,6 +58,57 @@ enum {
 	CAN_RAW_RECV_OWN_MSGS,	/* receive my own msgs (default:off) */
 	CAN_RAW_FD_FRAMES,	/* allow CAN FD frames (default:off) */
 	CAN_RAW_JOIN_FILTERS,	/* all filters must match to trigger */
+	CAN_RAW_RX_RING,	/* set up a mmap'able receive ring   */
+};
+
+/*
+ * CAN_RAW_RX_RING - memory mapped receive ring
+ *
+ * Instead of queueing received CAN frames as skbs for recvmsg() the frames
+ * are copied into a ring of fixed size slots that is shared with userspace
+ * by mmap()'ing the socket. The ring is set up once per socket with
+ * setsockopt(CAN_RAW_RX_RING) and cannot be changed or removed afterwards.
+ * frame_nr has to be a power of two (max. CAN_RAW_RX_RING_MAX_FRAMES).
+ *
+ * Each slot is owned by the kernel while its status is CAN_RAW_RING_KERNEL.
+ * After filling the slot the kernel sets the status to CAN_RAW_RING_USER and
+ * wakes up poll()/select() waiters. The reader hands the slot back to the
+ * kernel by writing CAN_RAW_RING_KERNEL into the status after processing.
+ * When the next slot is still owned by userspace the CAN frame is dropped
+ * and accounted in the socket drop counter.
+ */
+struct can_raw_ring_req {
+	__u32 frame_nr;		/* number of slots in the ring */
+	__u32 frame_size;	/* size of one slot (set by the kernel) */
+};
+
+#define CAN_RAW_RX_RING_MAX_FRAMES (1 << 16)
+
+/* can_raw_ring_slot.status */
+#define CAN_RAW_RING_KERNEL	0
+#define CAN_RAW_RING_USER	1
+
+/* can_raw_ring_slot.flags */
+#define CAN_RAW_RING_F_HWTSTAMP	0x01 /* tstamp is a hardware timestamp */
+#define CAN_RAW_RING_F_LOCAL	0x02 /* frame originated on this host */
+#define CAN_RAW_RING_F_OWN	0x04 /* frame was sent by this socket */
+
+/**
+ * struct can_raw_ring_slot - receive ring slot
+ * @status:  slot ownership (CAN_RAW_RING_KERNEL / CAN_RAW_RING_USER)
+ * @mtu:     size of the received frame (CAN_MTU or CANFD_MTU)
+ * @ifindex: interface index of the receiving CAN interface
+ * @flags:   CAN_RAW_RING_F_* flags
+ * @tstamp:  reception timestamp in nanoseconds (CLOCK_REALTIME)
+ * @frame:   received CAN frame (struct can_frame layout for CAN_MTU)
+ */
+struct can_raw_ring_slot {
+	__u32 status;
+	__u32 mtu;
+	__s32 ifindex;
+	__u32 flags;
+	__u64 tstamp;
+	struct canfd_frame frame;
 };
 
 #endif /* !_UAPI_CAN_RAW_H */
@@ -0,0 +1,798 @@
+/*
+ * bench.c - CAN stack latency and throughput benchmark
+ *
+ * Sends timestamped CAN frames on one CAN interface and receives them on
+ * the same or another interface through the regular socket API, either
+ * with CAN_RAW or with CAN_BCM sockets. The send-to-receive latency of
+ * every frame goes into a histogram, the results and the parameters are
+ * available in debugfs (/sys/kernel/debug/can_bench/).
+ *
+ * Typical setups:
+ * - vcan: the frames travel through the af_can loopback (stack only)
+ * - flexcan in loopback mode ("ip link set canX type can loopback on"):
+ *   the frames are received by the controller itself, set hw_rx_only to
+ *   ignore the local echo and to measure the driver receive path
+ * - two interfaces with a can-gw job between them: set rx_ifindex to the
+ *   destination interface to measure the gateway path
+ *
+ * Every frame is counted once. With CAN_RAW on a single interface only
+ * the local echo is counted, or only the received copy with hw_rx_only.
+ * CAN_BCM cannot tell the two apart, there a copy that is not newer than
+ * the last counted frame is a duplicate and skipped.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/net.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/socket.h>
+#include <linux/uaccess.h>
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+#include <linux/can/raw.h>
+#include <net/sock.h>
+
+MODULE_DESCRIPTION("PF_CAN latency and throughput benchmark");
+MODULE_LICENSE("GPL v2");
+
+#define CAN_BENCH_MAX_FILTERS 512
+
+/* stop receiving when nothing arrived for this long after the last frame */
+#define CAN_BENCH_RX_IDLE_MS 500
+
+/*
+ * Latency histogram: 8 buckets per power of two of nanoseconds, which is
+ * a resolution of 12.5% over the whole 64 bit range.
+ */
+#define CAN_BENCH_HIST_SUB_BITS 3
+#define CAN_BENCH_HIST_SUB (1 << CAN_BENCH_HIST_SUB_BITS)
+#define CAN_BENCH_HIST_SIZE (64 * CAN_BENCH_HIST_SUB)
+
+enum can_bench_mode {
+	CAN_BENCH_RAW,
+	CAN_BENCH_BCM,
+};
+
+static const char * const can_bench_mode_names[] = {
+	[CAN_BENCH_RAW] = "raw",
+	[CAN_BENCH_BCM] = "bcm",
+};
+
+struct can_bench_frame {
+	struct bcm_msg_head head;
+	struct can_frame frame;
+};
+
+static struct can_bench {
+	/* serializes the start of a run and parameter changes */
+	struct mutex lock;
+	struct dentry *dir;
+
+	/* parameters */
+	u32 tx_ifindex;
+	u32 rx_ifindex;		/* 0: same as tx_ifindex */
+	u32 can_id;
+	u32 frames;
+	u32 gap_us;		/* 0: send as fast as possible */
+	u32 filters;		/* additional non-matching rx filters */
+	u32 priority;		/* SO_PRIORITY of the sending socket */
+	u32 hw_rx_only;		/* ignore the local echo of sent frames */
+	enum can_bench_mode mode;
+
+	/* run state */
+	bool running;
+	bool stop;
+	bool tx_done;
+	u64 tx_last;		/* send timestamp of the last frame sent */
+	u64 rx_last;		/* send timestamp of the last frame counted */
+	struct socket *tx_sock;
+	struct socket *rx_sock;
+	struct completion tx_exit;
+	struct completion run_exit;
+
+	/* results */
+	int err;
+	u64 sent;
+	u64 received;
+	u64 duplicates;
+	u64 tx_retries;
+	ktime_t start;
+	ktime_t end;
+	u64 lat_min;
+	u64 lat_max;
+	u64 lat_sum;
+	u32 hist[CAN_BENCH_HIST_SIZE];
+} bench;
+
+static unsigned int can_bench_hist_idx(u64 ns)
+{
+	unsigned int msb;
+
+	if (ns < CAN_BENCH_HIST_SUB)
+		return ns;
+
+	msb = fls64(ns) - 1;
+
+	return ((msb - CAN_BENCH_HIST_SUB_BITS + 1) << CAN_BENCH_HIST_SUB_BITS) |
+	       ((ns >> (msb - CAN_BENCH_HIST_SUB_BITS)) &
+		(CAN_BENCH_HIST_SUB - 1));
+}
+
+/* lowest latency in ns that falls into the histogram bucket */
+static u64 can_bench_hist_val(unsigned int idx)
+{
+	unsigned int exp = idx >> CAN_BENCH_HIST_SUB_BITS;
+
+	if (!exp)
+		return idx;
+
+	return (u64)(CAN_BENCH_HIST_SUB | (idx & (CAN_BENCH_HIST_SUB - 1)))
+		<< (exp - 1);
+}
+
+static void can_bench_account(u64 lat)
+{
+	bench.received++;
+	bench.lat_sum += lat;
+	if (lat < bench.lat_min)
+		bench.lat_min = lat;
+	if (lat > bench.lat_max)
+		bench.lat_max = lat;
+	bench.hist[can_bench_hist_idx(lat)]++;
+}
+
+/* latency below which permille of the received frames are */
+static u64 can_bench_percentile(unsigned int permille)
+{
+	u64 limit = div_u64(bench.received * permille + 999, 1000);
+	u64 sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < CAN_BENCH_HIST_SIZE; i++) {
+		sum += bench.hist[i];
+		if (sum >= limit)
+			return can_bench_hist_val(i + 1);
+	}
+
+	return bench.lat_max;
+}
+
+static canid_t can_bench_id_mask(canid_t can_id)
+{
+	return (can_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK;
+}
+
+/* the n-th rx filter, filter 0 is the one for the benchmark frames */
+static canid_t can_bench_filter_id(unsigned int n)
+{
+	canid_t mask = can_bench_id_mask(bench.can_id);
+
+	return (bench.can_id & CAN_EFF_FLAG) |
+	       ((bench.can_id + n) & mask);
+}
+
+static int can_bench_rx_ifindex(void)
+{
+	return bench.rx_ifindex ? bench.rx_ifindex : bench.tx_ifindex;
+}
+
+static int can_bench_bind(struct socket *sock, int ifindex, bool connect)
+{
+	struct sockaddr_can addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifindex;
+
+	if (connect)
+		return kernel_connect(sock, (struct sockaddr *)&addr,
+				      sizeof(addr), 0);
+
+	return kernel_bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+static int can_bench_setup_raw(void)
+{
+	struct can_filter *filters;
+	unsigned int i, n = bench.filters + 1;
+	int err;
+
+	/* the sending socket does not receive anything */
+	err = kernel_setsockopt(bench.tx_sock, SOL_CAN_RAW, CAN_RAW_FILTER,
+				NULL, 0);
+	if (err)
+		return err;
+
+	err = can_bench_bind(bench.tx_sock, bench.tx_ifindex, false);
+	if (err)
+		return err;
+
+	filters = kcalloc(n, sizeof(*filters), GFP_KERNEL);
+	if (!filters)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		filters[i].can_id = can_bench_filter_id(i);
+		filters[i].can_mask = can_bench_id_mask(bench.can_id) |
+				      CAN_EFF_FLAG | CAN_RTR_FLAG;
+	}
+
+	err = kernel_setsockopt(bench.rx_sock, SOL_CAN_RAW, CAN_RAW_FILTER,
+				(char *)filters, n * sizeof(*filters));
+	kfree(filters);
+	if (err)
+		return err;
+
+	return can_bench_bind(bench.rx_sock, can_bench_rx_ifindex(), false);
+}
+
+static int can_bench_setup_bcm(void)
+{
+	struct can_bench_frame msg;
+	struct msghdr msghdr;
+	struct kvec vec;
+	unsigned int i;
+	int err;
+
+	err = can_bench_bind(bench.tx_sock, bench.tx_ifindex, true);
+	if (err)
+		return err;
+
+	err = can_bench_bind(bench.rx_sock, can_bench_rx_ifindex(), true);
+	if (err)
+		return err;
+
+	/* one content-independent rx op per filter */
+	for (i = 0; i <= bench.filters; i++) {
+		memset(&msg, 0, sizeof(msg));
+		msg.head.opcode = RX_SETUP;
+		msg.head.flags = RX_FILTER_ID;
+		msg.head.can_id = can_bench_filter_id(i);
+
+		memset(&msghdr, 0, sizeof(msghdr));
+		vec.iov_base = &msg.head;
+		vec.iov_len = sizeof(msg.head);
+
+		err = kernel_sendmsg(bench.rx_sock, &msghdr, &vec, 1,
+				     vec.iov_len);
+		if (err < 0)
+			return err;
+	}
+
+	return 0;
+}
+
+static int can_bench_setup(void)
+{
+	int type = bench.mode == CAN_BENCH_BCM ? SOCK_DGRAM : SOCK_RAW;
+	int proto = bench.mode == CAN_BENCH_BCM ? CAN_BCM : CAN_RAW;
+	int err;
+
+	err = sock_create_kern(PF_CAN, type, proto, &bench.tx_sock);
+	if (err)
+		return err;
+
+	err = sock_create_kern(PF_CAN, type, proto, &bench.rx_sock);
+	if (err)
+		return err;
+
+	err = kernel_setsockopt(bench.tx_sock, SOL_SOCKET, SO_PRIORITY,
+				(char *)&bench.priority,
+				sizeof(bench.priority));
+	if (err)
+		return err;
+
+	/* periodically check for the end of the run */
+	bench.rx_sock->sk->sk_rcvtimeo = msecs_to_jiffies(100);
+
+	if (bench.mode == CAN_BENCH_BCM)
+		return can_bench_setup_bcm();
+
+	return can_bench_setup_raw();
+}
+
+static void can_bench_release(void)
+{
+	if (bench.tx_sock)
+		sock_release(bench.tx_sock);
+	if (bench.rx_sock)
+		sock_release(bench.rx_sock);
+
+	bench.tx_sock = NULL;
+	bench.rx_sock = NULL;
+}
+
+static int can_bench_send(void)
+{
+	struct can_bench_frame msg;
+	struct msghdr msghdr;
+	struct kvec vec;
+	u64 now;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.frame.can_id = bench.can_id;
+	msg.frame.can_dlc = CAN_MAX_DLEN;
+
+	memset(&msghdr, 0, sizeof(msghdr));
+
+	if (bench.mode == CAN_BENCH_BCM) {
+		msg.head.opcode = TX_SEND;
+		msg.head.can_id = bench.can_id;
+		msg.head.nframes = 1;
+		vec.iov_base = &msg;
+		vec.iov_len = sizeof(msg);
+	} else {
+		vec.iov_base = &msg.frame;
+		vec.iov_len = sizeof(msg.frame);
+	}
+
+	/* the send timestamp travels in the frame, unique per frame */
+	now = max(ktime_get_ns(), bench.tx_last + 1);
+	bench.tx_last = now;
+	memcpy(msg.frame.data, &now, sizeof(now));
+
+	return kernel_sendmsg(bench.tx_sock, &msghdr, &vec, 1, vec.iov_len);
+}
+
+static int can_bench_tx_thread(void *data)
+{
+	int err;
+
+	while (bench.sent < bench.frames && !READ_ONCE(bench.stop)) {
+		err = can_bench_send();
+		if (err == -ENOBUFS) {
+			/* interface queue full - retry */
+			bench.tx_retries++;
+			usleep_range(20, 50);
+			continue;
+		}
+		if (err < 0) {
+			bench.err = err;
+			break;
+		}
+
+		bench.sent++;
+
+		if (bench.gap_us)
+			usleep_range(bench.gap_us, bench.gap_us + 1);
+		else
+			cond_resched();
+	}
+
+	WRITE_ONCE(bench.tx_done, true);
+	complete_and_exit(&bench.tx_exit, 0);
+}
+
+/* receive one frame, returns 1 for a benchmark frame */
+static int can_bench_recv(u64 *lat)
+{
+	struct can_bench_frame msg;
+	struct can_frame *cf;
+	struct msghdr msghdr;
+	struct kvec vec;
+	u64 now, then;
+	int ret;
+
+	memset(&msghdr, 0, sizeof(msghdr));
+
+	if (bench.mode == CAN_BENCH_BCM) {
+		vec.iov_base = &msg;
+		vec.iov_len = sizeof(msg);
+	} else {
+		vec.iov_base = &msg.frame;
+		vec.iov_len = sizeof(msg.frame);
+	}
+
+	ret = kernel_recvmsg(bench.rx_sock, &msghdr, &vec, 1, vec.iov_len, 0);
+	now = ktime_get_ns();
+	if (ret < 0)
+		return ret;
+
+	if (ret != vec.iov_len)
+		return 0;
+
+	cf = &msg.frame;
+	if (bench.mode == CAN_BENCH_BCM &&
+	    (msg.head.opcode != RX_CHANGED || msg.head.nframes != 1))
+		return 0;
+
+	if (cf->can_id != bench.can_id || cf->can_dlc != CAN_MAX_DLEN)
+		return 0;
+
+	/*
+	 * CAN_RAW flags the frames sent from this host. On one interface
+	 * the controller may deliver a second copy of them, count one path.
+	 */
+	if (bench.mode == CAN_BENCH_RAW) {
+		if (bench.hw_rx_only && (msghdr.msg_flags & MSG_DONTROUTE))
+			return 0;
+		if (!bench.hw_rx_only &&
+		    can_bench_rx_ifindex() == bench.tx_ifindex &&
+		    !(msghdr.msg_flags & MSG_DONTROUTE))
+			return 0;
+	}
+
+	memcpy(&then, cf->data, sizeof(then));
+
+	/* frames arrive in order on each path, older ones were counted */
+	if (then <= bench.rx_last) {
+		bench.duplicates++;
+		return 0;
+	}
+	bench.rx_last = then;
+
+	*lat = now - then;
+
+	return 1;
+}
+
+static int can_bench_run_thread(void *data)
+{
+	unsigned long idle_end = 0;
+	struct task_struct *tx;
+	u64 lat;
+	int ret;
+
+	ret = can_bench_setup();
+	if (ret) {
+		bench.err = ret;
+		goto out;
+	}
+
+	tx = kthread_run(can_bench_tx_thread, NULL, "can_bench_tx");
+	if (IS_ERR(tx)) {
+		bench.err = PTR_ERR(tx);
+		goto out;
+	}
+
+	bench.start = ktime_get();
+
+	while (bench.received < bench.frames && !READ_ONCE(bench.stop)) {
+		ret = can_bench_recv(&lat);
+		if (ret > 0) {
+			can_bench_account(lat);
+			idle_end = 0;
+			continue;
+		}
+
+		if (ret < 0 && ret != -EAGAIN && ret != -EINTR) {
+			bench.err = ret;
+			break;
+		}
+
+		/* lost frames: give up after some idle time */
+		if (READ_ONCE(bench.tx_done)) {
+			if (!idle_end)
+				idle_end = jiffies +
+					   msecs_to_jiffies(CAN_BENCH_RX_IDLE_MS);
+			else if (time_after(jiffies, idle_end))
+				break;
+		}
+	}
+
+	bench.end = ktime_get();
+
+	WRITE_ONCE(bench.stop, true);
+	wait_for_completion(&bench.tx_exit);
+
+ out:
+	can_bench_release();
+
+	mutex_lock(&bench.lock);
+	bench.running = false;
+	mutex_unlock(&bench.lock);
+
+	complete_and_exit(&bench.run_exit, 0);
+}
+
+static int can_bench_start(void)
+{
+	struct task_struct *run;
+	int err = 0;
+
+	mutex_lock(&bench.lock);
+
+	if (bench.running) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	if (!bench.tx_ifindex || !bench.frames ||
+	    bench.filters > CAN_BENCH_MAX_FILTERS) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	bench.err = 0;
+	bench.sent = 0;
+	bench.received = 0;
+	bench.duplicates = 0;
+	bench.tx_retries = 0;
+	bench.tx_last = 0;
+	bench.rx_last = 0;
+	bench.start = ktime_set(0, 0);
+	bench.end = ktime_set(0, 0);
+	bench.lat_min = U64_MAX;
+	bench.lat_max = 0;
+	bench.lat_sum = 0;
+	memset(bench.hist, 0, sizeof(bench.hist));
+
+	bench.stop = false;
+	bench.tx_done = false;
+	reinit_completion(&bench.tx_exit);
+	reinit_completion(&bench.run_exit);
+
+	run = kthread_run(can_bench_run_thread, NULL, "can_bench");
+	if (IS_ERR(run)) {
+		err = PTR_ERR(run);
+		goto out;
+	}
+
+	bench.running = true;
+
+ out:
+	mutex_unlock(&bench.lock);
+
+	return err;
+}
+
+/* ask a running benchmark to finish, the results stay valid */
+static void can_bench_stop(void)
+{
+	mutex_lock(&bench.lock);
+	WRITE_ONCE(bench.stop, true);
+	mutex_unlock(&bench.lock);
+}
+
+static ssize_t can_bench_run_write(struct file *file,
+				   const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	unsigned int run;
+	int err;
+
+	err = kstrtouint_from_user(ubuf, count, 0, &run);
+	if (err)
+		return err;
+
+	if (run)
+		err = can_bench_start();
+	else
+		can_bench_stop();
+
+	return err ? err : count;
+}
+
+static int can_bench_run_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "%d\n", READ_ONCE(bench.running));
+
+	return 0;
+}
+
+static int can_bench_run_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, can_bench_run_show, NULL);
+}
+
+static const struct file_operations can_bench_run_fops = {
+	.owner   = THIS_MODULE,
+	.open    = can_bench_run_open,
+	.read    = seq_read,
+	.write   = can_bench_run_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+static ssize_t can_bench_mode_write(struct file *file,
+				    const char __user *ubuf,
+				    size_t count, loff_t *ppos)
+{
+	char buf[8];
+	int i, err = -EINVAL;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = 0;
+
+	mutex_lock(&bench.lock);
+	for (i = 0; i < ARRAY_SIZE(can_bench_mode_names); i++) {
+		if (sysfs_streq(buf, can_bench_mode_names[i])) {
+			if (bench.running) {
+				err = -EBUSY;
+			} else {
+				bench.mode = i;
+				err = 0;
+			}
+			break;
+		}
+	}
+	mutex_unlock(&bench.lock);
+
+	return err ? err : count;
+}
+
+static int can_bench_mode_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "%s\n", can_bench_mode_names[bench.mode]);
+
+	return 0;
+}
+
+static int can_bench_mode_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, can_bench_mode_show, NULL);
+}
+
+static const struct file_operations can_bench_mode_fops = {
+	.owner   = THIS_MODULE,
+	.open    = can_bench_mode_open,
+	.read    = seq_read,
+	.write   = can_bench_mode_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+static int can_bench_results_show(struct seq_file *m, void *v)
+{
+	u64 duration_ns, fps = 0;
+
+	mutex_lock(&bench.lock);
+
+	if (bench.running) {
+		seq_puts(m, "running\n");
+		goto out;
+	}
+
+	duration_ns = ktime_to_ns(ktime_sub(bench.end, bench.start));
+	if (duration_ns)
+		fps = div64_u64(bench.received * NSEC_PER_SEC, duration_ns);
+
+	seq_printf(m, "mode: %s\n", can_bench_mode_names[bench.mode]);
+	seq_printf(m, "error: %d\n", bench.err);
+	seq_printf(m, "sent: %llu\n", bench.sent);
+	seq_printf(m, "received: %llu\n", bench.received);
+	seq_printf(m, "lost: %llu\n", bench.sent > bench.received ?
+		   bench.sent - bench.received : 0);
+	seq_printf(m, "duplicates: %llu\n", bench.duplicates);
+	seq_printf(m, "tx_retries: %llu\n", bench.tx_retries);
+	seq_printf(m, "duration_us: %llu\n", div_u64(duration_ns,
+						     NSEC_PER_USEC));
+	seq_printf(m, "frames_per_sec: %llu\n", fps);
+
+	if (!bench.received)
+		goto out;
+
+	/* percentiles are upper bounds of the histogram buckets */
+	seq_printf(m, "latency_min_ns: %llu\n", bench.lat_min);
+	seq_printf(m, "latency_avg_ns: %llu\n",
+		   div64_u64(bench.lat_sum, bench.received));
+	seq_printf(m, "latency_p50_ns: %llu\n", can_bench_percentile(500));
+	seq_printf(m, "latency_p90_ns: %llu\n", can_bench_percentile(900));
+	seq_printf(m, "latency_p99_ns: %llu\n", can_bench_percentile(990));
+	seq_printf(m, "latency_p999_ns: %llu\n", can_bench_percentile(999));
+	seq_printf(m, "latency_max_ns: %llu\n", bench.lat_max);
+
+ out:
+	mutex_unlock(&bench.lock);
+
+	return 0;
+}
+
+static int can_bench_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, can_bench_results_show, NULL);
+}
+
+static const struct file_operations can_bench_results_fops = {
+	.owner   = THIS_MODULE,
+	.open    = can_bench_results_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/* non-empty buckets as "<lowest latency in ns> <frames>" */
+static int can_bench_hist_show(struct seq_file *m, void *v)
+{
+	unsigned int i;
+
+	mutex_lock(&bench.lock);
+	if (!bench.running) {
+		for (i = 0; i < CAN_BENCH_HIST_SIZE; i++) {
+			if (bench.hist[i])
+				seq_printf(m, "%llu %u\n",
+					   can_bench_hist_val(i),
+					   bench.hist[i]);
+		}
+	}
+	mutex_unlock(&bench.lock);
+
+	return 0;
+}
+
+static int can_bench_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, can_bench_hist_show, NULL);
+}
+
+static const struct file_operations can_bench_hist_fops = {
+	.owner   = THIS_MODULE,
+	.open    = can_bench_hist_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+static __init int can_bench_init(void)
+{
+	struct dentry *dir;
+
+	mutex_init(&bench.lock);
+	init_completion(&bench.tx_exit);
+	init_completion(&bench.run_exit);
+
+	bench.can_id = 0x123;
+	bench.frames = 10000;
+	bench.mode = CAN_BENCH_RAW;
+
+	dir = debugfs_create_dir("can_bench", NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return dir ? PTR_ERR(dir) : -ENOMEM;
+
+	debugfs_create_u32("tx_ifindex", 0600, dir, &bench.tx_ifindex);
+	debugfs_create_u32("rx_ifindex", 0600, dir, &bench.rx_ifindex);
+	debugfs_create_x32("can_id", 0600, dir, &bench.can_id);
+	debugfs_create_u32("frames", 0600, dir, &bench.frames);
+	debugfs_create_u32("gap_us", 0600, dir, &bench.gap_us);
+	debugfs_create_u32("filters", 0600, dir, &bench.filters);
+	debugfs_create_u32("priority", 0600, dir, &bench.priority);
+	debugfs_create_u32("hw_rx_only", 0600, dir, &bench.hw_rx_only);
+	debugfs_create_file("mode", 0600, dir, NULL, &can_bench_mode_fops);
+	debugfs_create_file("run", 0600, dir, NULL, &can_bench_run_fops);
+	debugfs_create_file("results", 0400, dir, NULL,
+			    &can_bench_results_fops);
+	debugfs_create_file("histogram", 0400, dir, NULL,
+			    &can_bench_hist_fops);
+
+	bench.dir = dir;
+
+	return 0;
+}
+
+static __exit void can_bench_exit(void)
+{
+	bool running;
+
+	debugfs_remove_recursive(bench.dir);
+
+	mutex_lock(&bench.lock);
+	running = bench.running;
+	WRITE_ONCE(bench.stop, true);
+	mutex_unlock(&bench.lock);
+
+	if (running)
+		wait_for_completion(&bench.run_exit);
+}
+
+module_init(can_bench_init);
+module_exit(can_bench_exit);
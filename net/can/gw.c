@@ -47,6 +47,9 @@
 #include <linux/spinlock.h>
 #include <linux/rcupdate.h>
 #include <linux/rculist.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/net.h>
 #include <linux/netdevice.h>
 #include <linux/if_arp.h>
@@ -125,13 +128,23 @@ struct can_can_gw {
 	int dst_idx;
 };
 
+/*
+ * Per-CPU statistics of a CAN gateway job. The counters are only updated
+ * with this_cpu operations from the receive path and summed up on demand,
+ * so the forwarding of CAN frames does not bounce a shared cache line.
+ */
+struct cgw_job_stats {
+	unsigned long handled_frames;
+	unsigned long dropped_frames;
+	unsigned long deleted_frames;
+	unsigned long lat_hist[CGW_LAT_HIST_BUCKETS];
+};
+
 /* list entry for CAN gateways jobs */
 struct cgw_job {
 	struct hlist_node list;
 	struct rcu_head rcu;
-	u32 handled_frames;
-	u32 dropped_frames;
-	u32 deleted_frames;
+	struct cgw_job_stats __percpu *stats;
 	struct cf_mod mod;
 	union {
 		/* CAN frame data source */
@@ -345,12 +358,25 @@ static void cgw_csum_crc8_neg(struct can_frame *cf, struct cgw_csum_crc8 *crc8)
 	cf->data[crc8->result_idx] = crc^crc8->final_xor_val;
 }
 
+/* account the forwarding latency of a CAN frame in the job histogram */
+static inline void cgw_lat_account(struct cgw_job *gwj, ktime_t rxtime)
+{
+	s64 us = ktime_us_delta(ktime_get_real(), rxtime);
+	int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(int, fls64(us), CGW_LAT_HIST_BUCKETS - 1);
+
+	this_cpu_inc(gwj->stats->lat_hist[bucket]);
+}
+
 /* the receive & process & send function */
 static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 {
 	struct cgw_job *gwj = (struct cgw_job *)data;
 	struct can_frame *cf;
 	struct sk_buff *nskb;
+	ktime_t rxtime = ktime_set(0, 0);
 	int modidx = 0;
 
 	/*
@@ -371,12 +397,12 @@ static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 
 	if (cgw_hops(skb) >= max_hops) {
 		/* indicate deleted frames due to misconfiguration */
-		gwj->deleted_frames++;
+		this_cpu_inc(gwj->stats->deleted_frames);
 		return;
 	}
 
 	if (!(gwj->dst.dev->flags & IFF_UP)) {
-		gwj->dropped_frames++;
+		this_cpu_inc(gwj->stats->dropped_frames);
 		return;
 	}
 
@@ -385,11 +411,17 @@ static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 	    can_skb_prv(skb)->ifindex == gwj->dst.dev->ifindex)
 		return;
 
+	/* take the reception time before the skb timestamp gets cleared */
+	if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST)
+		rxtime = skb->tstamp.tv64 ? skb->tstamp : ktime_get_real();
+
 	/*
 	 * clone the given skb, which has not been done in can_rcv()
 	 *
 	 * When there is at least one modification function activated,
 	 * we need to copy the skb as we want to modify skb->data.
+	 * Without modifications the data is shared and only the skb head
+	 * is duplicated, which keeps the pure routing path copy-free.
 	 */
 	if (gwj->mod.modfunc[0])
 		nskb = skb_copy(skb, GFP_ATOMIC);
@@ -397,7 +429,7 @@ static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 		nskb = skb_clone(skb, GFP_ATOMIC);
 
 	if (!nskb) {
-		gwj->dropped_frames++;
+		this_cpu_inc(gwj->stats->dropped_frames);
 		return;
 	}
 
@@ -431,10 +463,15 @@ static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 		nskb->tstamp.tv64 = 0;
 
 	/* send to netdevice */
-	if (can_send(nskb, gwj->flags & CGW_FLAGS_CAN_ECHO))
-		gwj->dropped_frames++;
-	else
-		gwj->handled_frames++;
+	if (can_send(nskb, gwj->flags & CGW_FLAGS_CAN_ECHO)) {
+		this_cpu_inc(gwj->stats->dropped_frames);
+		return;
+	}
+
+	this_cpu_inc(gwj->stats->handled_frames);
+
+	if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST)
+		cgw_lat_account(gwj, rxtime);
 }
 
 static inline int cgw_register_filter(struct cgw_job *gwj)
@@ -450,6 +487,41 @@ static inline void cgw_unregister_filter(struct cgw_job *gwj)
 			  gwj->ccgw.filter.can_mask, can_can_gw_rcv, gwj);
 }
 
+static void cgw_job_free_rcu(struct rcu_head *rcu_head)
+{
+	struct cgw_job *gwj = container_of(rcu_head, struct cgw_job, rcu);
+
+	free_percpu(gwj->stats);
+	kmem_cache_free(cgw_cache, gwj);
+}
+
+/* remove a job from the list - receive path and dumps may still access it */
+static void cgw_job_remove(struct cgw_job *gwj)
+{
+	hlist_del_rcu(&gwj->list);
+	cgw_unregister_filter(gwj);
+	call_rcu(&gwj->rcu, cgw_job_free_rcu);
+}
+
+/* sum up the per-CPU statistics of a gateway job */
+static void cgw_job_stats_sum(struct cgw_job *gwj, struct cgw_job_stats *sum)
+{
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		struct cgw_job_stats *st = per_cpu_ptr(gwj->stats, cpu);
+
+		sum->handled_frames += st->handled_frames;
+		sum->dropped_frames += st->dropped_frames;
+		sum->deleted_frames += st->deleted_frames;
+
+		for (i = 0; i < CGW_LAT_HIST_BUCKETS; i++)
+			sum->lat_hist[i] += st->lat_hist[i];
+	}
+}
+
 static int cgw_notifier(struct notifier_block *nb,
 			unsigned long msg, void *ptr)
 {
@@ -469,11 +541,8 @@ static int cgw_notifier(struct notifier_block *nb,
 
 		hlist_for_each_entry_safe(gwj, nx, &cgw_list, list) {
 
-			if (gwj->src.dev == dev || gwj->dst.dev == dev) {
-				hlist_del(&gwj->list);
-				cgw_unregister_filter(gwj);
-				kmem_cache_free(cgw_cache, gwj);
-			}
+			if (gwj->src.dev == dev || gwj->dst.dev == dev)
+				cgw_job_remove(gwj);
 		}
 	}
 
@@ -483,6 +552,7 @@ static int cgw_notifier(struct notifier_block *nb,
 static int cgw_put_job(struct sk_buff *skb, struct cgw_job *gwj, int type,
 		       u32 pid, u32 seq, int flags)
 {
+	struct cgw_job_stats stats;
 	struct cgw_frame_mod mb;
 	struct rtcanmsg *rtcan;
 	struct nlmsghdr *nlh;
@@ -498,18 +568,31 @@ static int cgw_put_job(struct sk_buff *skb, struct cgw_job *gwj, int type,
 
 	/* add statistics if available */
 
-	if (gwj->handled_frames) {
-		if (nla_put_u32(skb, CGW_HANDLED, gwj->handled_frames) < 0)
+	cgw_job_stats_sum(gwj, &stats);
+
+	if (stats.handled_frames) {
+		if (nla_put_u32(skb, CGW_HANDLED, stats.handled_frames) < 0)
+			goto cancel;
+	}
+
+	if (stats.dropped_frames) {
+		if (nla_put_u32(skb, CGW_DROPPED, stats.dropped_frames) < 0)
 			goto cancel;
 	}
 
-	if (gwj->dropped_frames) {
-		if (nla_put_u32(skb, CGW_DROPPED, gwj->dropped_frames) < 0)
+	if (stats.deleted_frames) {
+		if (nla_put_u32(skb, CGW_DELETED, stats.deleted_frames) < 0)
 			goto cancel;
 	}
 
-	if (gwj->deleted_frames) {
-		if (nla_put_u32(skb, CGW_DELETED, gwj->deleted_frames) < 0)
+	if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST) {
+		u32 hist[CGW_LAT_HIST_BUCKETS];
+		int i;
+
+		for (i = 0; i < CGW_LAT_HIST_BUCKETS; i++)
+			hist[i] = stats.lat_hist[i];
+
+		if (nla_put(skb, CGW_LAT_HIST, sizeof(hist), hist) < 0)
 			goto cancel;
 	}
 
@@ -823,9 +906,12 @@ static int cgw_create_job(struct sk_buff *skb,  struct nlmsghdr *nlh)
 	if (!gwj)
 		return -ENOMEM;
 
-	gwj->handled_frames = 0;
-	gwj->dropped_frames = 0;
-	gwj->deleted_frames = 0;
+	gwj->stats = alloc_percpu(struct cgw_job_stats);
+	if (!gwj->stats) {
+		kmem_cache_free(cgw_cache, gwj);
+		return -ENOMEM;
+	}
+
 	gwj->flags = r->flags;
 	gwj->gwtype = r->gwtype;
 
@@ -864,8 +950,10 @@ static int cgw_create_job(struct sk_buff *skb,  struct nlmsghdr *nlh)
 	if (!err)
 		hlist_add_head_rcu(&gwj->list, &cgw_list);
 out:
-	if (err)
+	if (err) {
+		free_percpu(gwj->stats);
 		kmem_cache_free(cgw_cache, gwj);
+	}
 
 	return err;
 }
@@ -877,11 +965,8 @@ static void cgw_remove_all_jobs(void)
 
 	ASSERT_RTNL();
 
-	hlist_for_each_entry_safe(gwj, nx, &cgw_list, list) {
-		hlist_del(&gwj->list);
-		cgw_unregister_filter(gwj);
-		kmem_cache_free(cgw_cache, gwj);
-	}
+	hlist_for_each_entry_safe(gwj, nx, &cgw_list, list)
+		cgw_job_remove(gwj);
 }
 
 static int cgw_remove_job(struct sk_buff *skb, struct nlmsghdr *nlh)
@@ -938,9 +1023,7 @@ static int cgw_remove_job(struct sk_buff *skb, struct nlmsghdr *nlh)
 		if (memcmp(&gwj->ccgw, &ccgw, sizeof(ccgw)))
 			continue;
 
-		hlist_del(&gwj->list);
-		cgw_unregister_filter(gwj);
-		kmem_cache_free(cgw_cache, gwj);
+		cgw_job_remove(gwj);
 		err = 0;
 		break;
 	}
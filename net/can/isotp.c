@@ -0,0 +1,1321 @@
+/*
+ * isotp.c - ISO 15765-2 CAN transport protocol for protocol family CAN
+ *
+ * This implementation segments and reassembles PDUs of up to 4095 bytes
+ * in the kernel, including the flow control handling and the separation
+ * time between consecutive frames, so applications just send and receive
+ * complete PDUs on a SOCK_DGRAM socket.
+ *
+ * An ISO-TP socket is bound to a CAN interface and a pair of CAN identifiers
+ * (sockaddr_can.can_addr.tp.rx_id / tx_id). Frames with the rx_id carry
+ * the incoming data and the flow control frames for our transmissions,
+ * frames with the tx_id are sent out.
+ *
+ * The protocol timing is driven by hrtimers. As the CAN frames may not be
+ * sent from hard interrupt context the timer handlers hand over to tasklets
+ * like it is done in the broadcast manager (bcm.c).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
+#include <linux/wait.h>
+#include <linux/uio.h>
+#include <linux/net.h>
+#include <linux/netdevice.h>
+#include <linux/socket.h>
+#include <linux/if_arp.h>
+#include <linux/skbuff.h>
+#include <linux/spinlock.h>
+#include <linux/can.h>
+#include <linux/can/core.h>
+#include <linux/can/skb.h>
+#include <linux/can/isotp.h>
+#include <linux/slab.h>
+#include <net/sock.h>
+#include <net/net_namespace.h>
+
+#define CAN_ISOTP_VERSION CAN_VERSION
+
+MODULE_DESCRIPTION("PF_CAN isotp 15765-2 protocol");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS("can-proto-6");
+
+#define SINGLE_MASK(id) ((id & CAN_EFF_FLAG) ? \
+			 (CAN_EFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG) : \
+			 (CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG))
+
+/* N_PCI type values in bits 7-4 of N_PCI bytes */
+#define N_PCI_SF 0x00	/* single frame */
+#define N_PCI_FF 0x10	/* first frame */
+#define N_PCI_CF 0x20	/* consecutive frame */
+#define N_PCI_FC 0x30	/* flow control */
+
+#define N_PCI_SZ 1	/* size of the PCI byte #1 */
+#define SF_PCI_SZ 1	/* size of SingleFrame PCI including 4 bit SF_DL */
+#define FF_PCI_SZ 2	/* size of FirstFrame PCI including 12 bit FF_DL */
+#define FC_CONTENT_SZ 3	/* flow control content size in byte (FS/BS/STmin) */
+
+#define ISOTP_CHECK_PADDING (CAN_ISOTP_CHK_PAD_LEN | CAN_ISOTP_CHK_PAD_DATA)
+
+/* flow status given in FC frame */
+#define ISOTP_FC_CTS 0		/* clear to send */
+#define ISOTP_FC_WT 1		/* wait */
+#define ISOTP_FC_OVFLW 2	/* overflow */
+
+/* N_Bs / N_Cr timeout for the reception of FC and CF frames */
+#define ISOTP_FC_TIMEOUT_NS	(1000 * NSEC_PER_MSEC)
+
+/* N_As timeout: how long the netdev queue may refuse a CF */
+#define ISOTP_AS_TIMEOUT_NS	(1000 * NSEC_PER_MSEC)
+
+/* retry interval for a CF refused by a full netdev queue */
+#define ISOTP_TX_RETRY_NS	(100 * NSEC_PER_USEC)
+
+enum {
+	ISOTP_IDLE = 0,
+	ISOTP_WAIT_FIRST_FC,
+	ISOTP_WAIT_FC,
+	ISOTP_WAIT_DATA,
+	ISOTP_SENDING,
+	ISOTP_SHUTDOWN,
+};
+
+struct tpcon {
+	int idx;
+	int len;
+	u8 state;
+	u8 bs;
+	u8 sn;
+	u8 buf[CAN_ISOTP_MAX_MSG_LENGTH + 1];
+};
+
+struct isotp_sock {
+	struct sock sk;
+	int bound;
+	int ifindex;
+	canid_t txid;
+	canid_t rxid;
+	ktime_t tx_gap;
+	ktime_t tx_stall;	/* first refusal of the pending CF, or 0 */
+	ktime_t lastrxcf_tstamp;
+	struct hrtimer rxtimer, txtimer;
+	struct tasklet_struct rxtsklet, txtsklet;
+	struct can_isotp_options opt;
+	struct can_isotp_fc_options rxfc, txfc;
+	u32 force_tx_stmin;
+	u32 force_rx_stmin;
+	spinlock_t lock;	/* protects the rx/tx state machines */
+	struct tpcon rx, tx;
+	struct notifier_block notifier;
+	wait_queue_head_t wait;
+};
+
+static inline struct isotp_sock *isotp_sk(const struct sock *sk)
+{
+	return (struct isotp_sock *)sk;
+}
+
+static inline int isotp_ae(struct isotp_sock *so)
+{
+	return (so->opt.flags & CAN_ISOTP_EXTEND_ADDR) ? 1 : 0;
+}
+
+/* report a protocol error to the socket user */
+static void isotp_report_error(struct sock *sk, int err)
+{
+	sk->sk_err = err;
+	if (!sock_flag(sk, SOCK_DEAD))
+		sk->sk_error_report(sk);
+}
+
+static enum hrtimer_restart isotp_rx_timer_handler(struct hrtimer *hrtimer)
+{
+	struct isotp_sock *so = container_of(hrtimer, struct isotp_sock,
+					     rxtimer);
+
+	tasklet_schedule(&so->rxtsklet);
+
+	return HRTIMER_NORESTART;
+}
+
+static enum hrtimer_restart isotp_tx_timer_handler(struct hrtimer *hrtimer)
+{
+	struct isotp_sock *so = container_of(hrtimer, struct isotp_sock,
+					     txtimer);
+
+	tasklet_schedule(&so->txtsklet);
+
+	return HRTIMER_NORESTART;
+}
+
+/* allocate and set up a CAN frame skb for the tx_id of the socket */
+static struct sk_buff *isotp_alloc_frame(struct sock *sk,
+					 struct net_device *dev)
+{
+	struct sk_buff *skb;
+
+	skb = alloc_skb(CAN_MTU + sizeof(struct can_skb_priv), GFP_ATOMIC);
+	if (!skb)
+		return NULL;
+
+	can_skb_reserve(skb);
+	can_skb_prv(skb)->ifindex = dev->ifindex;
+	can_skb_prv(skb)->skbcnt = 0;
+
+	memset(skb_put(skb, CAN_MTU), 0, CAN_MTU);
+
+	skb->dev = dev;
+	can_skb_set_owner(skb, sk);
+
+	return skb;
+}
+
+/* set the CAN frame length and the padding when enabled */
+static void isotp_pad_frame(struct isotp_sock *so, struct can_frame *cf,
+			    int len)
+{
+	if (so->opt.flags & CAN_ISOTP_TX_PADDING) {
+		memset(cf->data + len, so->opt.txpad_content,
+		       CAN_MAX_DLEN - len);
+		len = CAN_MAX_DLEN;
+	}
+
+	cf->can_dlc = len;
+}
+
+/* copy the next tx data into the CAN frame starting at data[offset] */
+static void isotp_fill_dataframe(struct isotp_sock *so, struct can_frame *cf,
+				 int ae, int offset)
+{
+	int space = CAN_MAX_DLEN - offset;
+	int num = min_t(int, so->tx.len - so->tx.idx, space);
+
+	cf->can_id = so->txid;
+
+	memcpy(cf->data + offset, so->tx.buf + so->tx.idx, num);
+	so->tx.idx += num;
+
+	if (ae)
+		cf->data[0] = so->opt.ext_address;
+
+	isotp_pad_frame(so, cf, offset + num);
+}
+
+/* called with so->lock held */
+static int isotp_send_fc(struct sock *sk, int ae, u8 flowstatus)
+{
+	struct isotp_sock *so = isotp_sk(sk);
+	struct net_device *dev;
+	struct sk_buff *nskb;
+	struct can_frame *ncf;
+	int err;
+
+	dev = dev_get_by_index(&init_net, so->ifindex);
+	if (!dev)
+		return -ENODEV;
+
+	nskb = isotp_alloc_frame(sk, dev);
+	if (!nskb) {
+		dev_put(dev);
+		return -ENOMEM;
+	}
+
+	ncf = (struct can_frame *)nskb->data;
+	ncf->can_id = so->txid;
+
+	if (ae)
+		ncf->data[0] = so->opt.ext_address;
+
+	ncf->data[ae] = N_PCI_FC | flowstatus;
+	ncf->data[ae + 1] = so->rxfc.bs;
+	ncf->data[ae + 2] = so->rxfc.stmin;
+
+	isotp_pad_frame(so, ncf, ae + FC_CONTENT_SZ);
+
+	err = can_send(nskb, 1);
+	dev_put(dev);
+
+	/* reset blocksize counter */
+	so->rx.bs = 0;
+
+	/* reset last CF frame rx timestamp for rx stmin enforcement */
+	so->lastrxcf_tstamp = ktime_set(0, 0);
+
+	/* start rx timeout watchdog (N_Cr) */
+	hrtimer_start(&so->rxtimer, ktime_set(0, ISOTP_FC_TIMEOUT_NS),
+		      HRTIMER_MODE_REL);
+
+	return err;
+}
+
+/* hand a completely received PDU to the socket receive queue */
+static void isotp_rcv_skb(struct sock *sk, struct sk_buff *skb, u8 *data,
+			  int len)
+{
+	struct isotp_sock *so = isotp_sk(sk);
+	struct sockaddr_can *addr;
+	struct sk_buff *nskb;
+
+	nskb = alloc_skb(len, GFP_ATOMIC);
+	if (!nskb)
+		return;
+
+	memcpy(skb_put(nskb, len), data, len);
+
+	nskb->tstamp = skb->tstamp;
+	nskb->dev = skb->dev;
+
+	sock_skb_cb_check_size(sizeof(struct sockaddr_can));
+	addr = (struct sockaddr_can *)nskb->cb;
+	memset(addr, 0, sizeof(*addr));
+	addr->can_family = AF_CAN;
+	addr->can_ifindex = skb->dev->ifindex;
+	addr->can_addr.tp.rx_id = so->rxid;
+	addr->can_addr.tp.tx_id = so->txid;
+
+	if (sock_queue_rcv_skb(sk, nskb) < 0)
+		kfree_skb(nskb);
+}
+
+/* check the padding of a received CAN frame - returns 0 on success */
+static int check_pad(struct isotp_sock *so, struct can_frame *cf,
+		     int start_idx)
+{
+	int i;
+
+	/* no RX_PADDING value => check length of optimized frame length */
+	if (!(so->opt.flags & CAN_ISOTP_RX_PADDING)) {
+		if (so->opt.flags & CAN_ISOTP_CHK_PAD_LEN)
+			return cf->can_dlc != start_idx;
+
+		return 0;
+	}
+
+	/* check datalength of correctly padded CAN frame */
+	if ((so->opt.flags & CAN_ISOTP_CHK_PAD_LEN) &&
+	    cf->can_dlc != CAN_MAX_DLEN)
+		return 1;
+
+	/* check padding content */
+	if (so->opt.flags & CAN_ISOTP_CHK_PAD_DATA) {
+		for (i = start_idx; i < cf->can_dlc; i++)
+			if (cf->data[i] != so->opt.rxpad_content)
+				return 1;
+	}
+
+	return 0;
+}
+
+static void isotp_rcv_fc(struct isotp_sock *so, struct can_frame *cf, int ae)
+{
+	struct sock *sk = &so->sk;
+
+	if (so->tx.state != ISOTP_WAIT_FC &&
+	    so->tx.state != ISOTP_WAIT_FIRST_FC)
+		return;
+
+	hrtimer_try_to_cancel(&so->txtimer);
+
+	if (cf->can_dlc < ae + FC_CONTENT_SZ ||
+	    ((so->opt.flags & ISOTP_CHECK_PADDING) &&
+	     check_pad(so, cf, ae + FC_CONTENT_SZ))) {
+		/* malformed PDU - report 'not a data message' */
+		isotp_report_error(sk, EBADMSG);
+		so->tx.state = ISOTP_IDLE;
+		wake_up_interruptible(&so->wait);
+		return;
+	}
+
+	/* get communication parameters only from the first FC frame */
+	if (so->tx.state == ISOTP_WAIT_FIRST_FC) {
+		so->txfc.bs = cf->data[ae + 1];
+		so->txfc.stmin = cf->data[ae + 2];
+
+		/* fix wrong STmin values according spec */
+		if (so->txfc.stmin > 0x7F &&
+		    (so->txfc.stmin < 0xF1 || so->txfc.stmin > 0xF9))
+			so->txfc.stmin = 0x7F;
+
+		so->tx_gap = ktime_set(0, 0);
+		/* add transmission time for CAN frame N_As */
+		so->tx_gap = ktime_add_ns(so->tx_gap, so->opt.frame_txtime);
+		/* add waiting time for consecutive frames N_Cs */
+		if (so->opt.flags & CAN_ISOTP_FORCE_TXSTMIN)
+			so->tx_gap = ktime_add_ns(so->tx_gap,
+						  so->force_tx_stmin);
+		else if (so->txfc.stmin < 0x80)
+			so->tx_gap = ktime_add_ns(so->tx_gap,
+						  so->txfc.stmin *
+						  NSEC_PER_MSEC);
+		else
+			so->tx_gap = ktime_add_ns(so->tx_gap,
+						  (so->txfc.stmin - 0xF0) *
+						  100 * NSEC_PER_USEC);
+
+		so->tx.state = ISOTP_WAIT_FC;
+	}
+
+	switch (cf->data[ae] & 0x0F) {
+
+	case ISOTP_FC_CTS:
+		so->tx.bs = 0;
+		so->tx.state = ISOTP_SENDING;
+		/* send the consecutive frames from the tx tasklet */
+		tasklet_schedule(&so->txtsklet);
+		break;
+
+	case ISOTP_FC_WT:
+		/* start timer to wait for next FC frame */
+		hrtimer_start(&so->txtimer, ktime_set(0, ISOTP_FC_TIMEOUT_NS),
+			      HRTIMER_MODE_REL);
+		break;
+
+	case ISOTP_FC_OVFLW:
+		/* overflow on receiver side - report 'message too long' */
+		isotp_report_error(sk, EMSGSIZE);
+		so->tx.state = ISOTP_IDLE;
+		wake_up_interruptible(&so->wait);
+		break;
+
+	default:
+		/* stop this tx job */
+		isotp_report_error(sk, EBADMSG);
+		so->tx.state = ISOTP_IDLE;
+		wake_up_interruptible(&so->wait);
+		break;
+	}
+}
+
+static void isotp_rcv_sf(struct sock *sk, struct can_frame *cf, int ae,
+			 struct sk_buff *skb)
+{
+	struct isotp_sock *so = isotp_sk(sk);
+	int pcilen = ae + SF_PCI_SZ;
+	int len = cf->data[ae] & 0x0F;
+
+	hrtimer_try_to_cancel(&so->rxtimer);
+	so->rx.state = ISOTP_IDLE;
+
+	if (!len || len > cf->can_dlc - pcilen)
+		return;
+
+	if ((so->opt.flags & ISOTP_CHECK_PADDING) &&
+	    check_pad(so, cf, pcilen + len)) {
+		/* malformed PDU - report 'not a data message' */
+		isotp_report_error(sk, EBADMSG);
+		return;
+	}
+
+	isotp_rcv_skb(sk, skb, &cf->data[pcilen], len);
+}
+
+static void isotp_rcv_ff(struct sock *sk, struct can_frame *cf, int ae)
+{
+	struct isotp_sock *so = isotp_sk(sk);
+	int i;
+
+	hrtimer_try_to_cancel(&so->rxtimer);
+	so->rx.state = ISOTP_IDLE;
+
+	/* a first frame always has the full length of a CAN frame */
+	if (cf->can_dlc != CAN_MAX_DLEN)
+		return;
+
+	so->rx.len = (cf->data[ae] & 0x0F) << 8;
+	so->rx.len += cf->data[ae + 1];
+
+	/* this PDU would have fitted into a single frame */
+	if (so->rx.len + ae + SF_PCI_SZ <= CAN_MAX_DLEN)
+		return;
+
+	if (so->rx.len > CAN_ISOTP_MAX_MSG_LENGTH) {
+		/* send FC frame with overflow status */
+		if (!(so->opt.flags & CAN_ISOTP_LISTEN_MODE)) {
+			isotp_send_fc(sk, ae, ISOTP_FC_OVFLW);
+			hrtimer_try_to_cancel(&so->rxtimer);
+		}
+		return;
+	}
+
+	/* copy the first received data bytes */
+	so->rx.idx = 0;
+	for (i = ae + FF_PCI_SZ; i < CAN_MAX_DLEN; i++)
+		so->rx.buf[so->rx.idx++] = cf->data[i];
+
+	/* initial setup for this pdu reception */
+	so->rx.sn = 1;
+	so->rx.state = ISOTP_WAIT_DATA;
+
+	/* no creation of flow control frames */
+	if (so->opt.flags & CAN_ISOTP_LISTEN_MODE) {
+		hrtimer_start(&so->rxtimer, ktime_set(0, ISOTP_FC_TIMEOUT_NS),
+			      HRTIMER_MODE_REL);
+		return;
+	}
+
+	/* send our first FC frame */
+	isotp_send_fc(sk, ae, ISOTP_FC_CTS);
+}
+
+static void isotp_rcv_cf(struct sock *sk, struct can_frame *cf, int ae,
+			 struct sk_buff *skb)
+{
+	struct isotp_sock *so = isotp_sk(sk);
+	int i;
+
+	if (so->rx.state != ISOTP_WAIT_DATA)
+		return;
+
+	/* ignore consecutive frames that arrive before the forced STmin */
+	if (so->opt.flags & CAN_ISOTP_FORCE_RXSTMIN) {
+		ktime_t now = ktime_get();
+
+		if (so->lastrxcf_tstamp.tv64 &&
+		    ktime_to_ns(ktime_sub(now, so->lastrxcf_tstamp)) <
+		    so->force_rx_stmin)
+			return;
+
+		so->lastrxcf_tstamp = now;
+	}
+
+	hrtimer_try_to_cancel(&so->rxtimer);
+
+	if (cf->can_dlc <= ae + N_PCI_SZ)
+		return;
+
+	if ((cf->data[ae] & 0x0F) != so->rx.sn) {
+		/* wrong sn detected - report 'illegal byte sequence' */
+		isotp_report_error(sk, EILSEQ);
+
+		/* reset rx state */
+		so->rx.state = ISOTP_IDLE;
+		return;
+	}
+	so->rx.sn++;
+	so->rx.sn %= 16;
+
+	for (i = ae + N_PCI_SZ; i < cf->can_dlc; i++) {
+		so->rx.buf[so->rx.idx++] = cf->data[i];
+		if (so->rx.idx >= so->rx.len)
+			break;
+	}
+
+	if (so->rx.idx >= so->rx.len) {
+		/* we are done */
+		so->rx.state = ISOTP_IDLE;
+
+		if ((so->opt.flags & ISOTP_CHECK_PADDING) &&
+		    check_pad(so, cf, i + 1)) {
+			/* malformed PDU - report 'not a data message' */
+			isotp_report_error(sk, EBADMSG);
+			return;
+		}
+
+		isotp_rcv_skb(sk, skb, so->rx.buf, so->rx.len);
+		return;
+	}
+
+	/* perform blocksize handling, if enabled */
+	if (!so->rxfc.bs || ++so->rx.bs < so->rxfc.bs) {
+		/* start rx timeout watchdog */
+		hrtimer_start(&so->rxtimer, ktime_set(0, ISOTP_FC_TIMEOUT_NS),
+			      HRTIMER_MODE_REL);
+		return;
+	}
+
+	/* no creation of flow control frames */
+	if (so->opt.flags & CAN_ISOTP_LISTEN_MODE)
+		return;
+
+	/* we reached the specified blocksize so->rxfc.bs */
+	isotp_send_fc(sk, ae, ISOTP_FC_CTS);
+}
+
+static void isotp_rcv(struct sk_buff *skb, void *data)
+{
+	struct sock *sk = (struct sock *)data;
+	struct isotp_sock *so = isotp_sk(sk);
+	struct can_frame *cf;
+	int ae = isotp_ae(so);
+	u8 n_pci_type;
+
+	/* only CAN 2.0 frames are handled by this implementation */
+	if (skb->len != CAN_MTU)
+		return;
+
+	cf = (struct can_frame *)skb->data;
+
+	/* if enabled: check reception of my configured extended address */
+	if (ae && cf->data[0] != ((so->opt.flags & CAN_ISOTP_RX_EXT_ADDR) ?
+				  so->opt.rx_ext_address :
+				  so->opt.ext_address))
+		return;
+
+	n_pci_type = cf->data[ae] & 0xF0;
+
+	spin_lock(&so->lock);
+
+	if (so->opt.flags & CAN_ISOTP_HALF_DUPLEX) {
+		/* check rx/tx path half duplex expectations */
+		if ((so->tx.state != ISOTP_IDLE && n_pci_type != N_PCI_FC) ||
+		    (so->rx.state != ISOTP_IDLE && n_pci_type == N_PCI_FC))
+			goto out;
+	}
+
+	switch (n_pci_type) {
+	case N_PCI_FC:
+		/* tx path: flow control frame containing the FC parameters */
+		isotp_rcv_fc(so, cf, ae);
+		break;
+
+	case N_PCI_SF:
+		/* rx path: single frame */
+		isotp_rcv_sf(sk, cf, ae, skb);
+		break;
+
+	case N_PCI_FF:
+		/* rx path: first frame */
+		isotp_rcv_ff(sk, cf, ae);
+		break;
+
+	case N_PCI_CF:
+		/* rx path: consecutive frame */
+		isotp_rcv_cf(sk, cf, ae, skb);
+		break;
+	}
+
+ out:
+	spin_unlock(&so->lock);
+}
+
+static void isotp_rx_timer_tsklet(unsigned long data)
+{
+	struct isotp_sock *so = (struct isotp_sock *)data;
+	struct sock *sk = &so->sk;
+
+	spin_lock(&so->lock);
+
+	if (so->rx.state == ISOTP_WAIT_DATA) {
+		/* N_Cr timeout - report 'timer expired' */
+		isotp_report_error(sk, ETIMEDOUT);
+
+		/* reset rx state */
+		so->rx.state = ISOTP_IDLE;
+	}
+
+	spin_unlock(&so->lock);
+}
+
+/*
+ * The netdev queue holds only a few frames, a burst of CFs without STmin
+ * easily outruns it. Retry the refused CF shortly, unless the queue stays
+ * full for longer than N_As. Called with so->lock held.
+ */
+static bool isotp_tx_retry(struct isotp_sock *so)
+{
+	ktime_t now = ktime_get();
+
+	if (!so->tx_stall.tv64)
+		so->tx_stall = now;
+
+	if (ktime_to_ns(ktime_sub(now, so->tx_stall)) >= ISOTP_AS_TIMEOUT_NS)
+		return false;
+
+	hrtimer_start(&so->txtimer, ktime_set(0, ISOTP_TX_RETRY_NS),
+		      HRTIMER_MODE_REL);
+	return true;
+}
+
+static void isotp_tx_timer_tsklet(unsigned long data)
+{
+	struct isotp_sock *so = (struct isotp_sock *)data;
+	struct sock *sk = &so->sk;
+	struct net_device *dev;
+	struct sk_buff *skb;
+	struct can_frame *cf;
+	int ae = isotp_ae(so);
+	int err;
+
+	spin_lock(&so->lock);
+
+	switch (so->tx.state) {
+
+	case ISOTP_WAIT_FC:
+	case ISOTP_WAIT_FIRST_FC:
+		/* N_Bs timeout - report 'communication error on send' */
+		isotp_report_error(sk, ECOMM);
+
+		/* reset tx state */
+		so->tx.state = ISOTP_IDLE;
+		wake_up_interruptible(&so->wait);
+		break;
+
+	case ISOTP_SENDING:
+		/* push out the next segmented pdu */
+		dev = dev_get_by_index(&init_net, so->ifindex);
+		if (!dev) {
+			isotp_report_error(sk, ENODEV);
+			so->tx.state = ISOTP_IDLE;
+			wake_up_interruptible(&so->wait);
+			break;
+		}
+
+		for (;;) {
+			int idx = so->tx.idx;
+
+			skb = isotp_alloc_frame(sk, dev);
+			if (!skb) {
+				/* retry after the separation time */
+				hrtimer_start(&so->txtimer,
+					      ktime_add_ns(so->tx_gap,
+							   NSEC_PER_MSEC),
+					      HRTIMER_MODE_REL);
+				break;
+			}
+
+			cf = (struct can_frame *)skb->data;
+
+			/* create consecutive frame */
+			isotp_fill_dataframe(so, cf, ae, ae + N_PCI_SZ);
+			cf->data[ae] = N_PCI_CF | so->tx.sn;
+
+			err = can_send(skb, 1);
+			if (err == -ENOBUFS) {
+				/* full netdev queue: send this CF again */
+				if (isotp_tx_retry(so)) {
+					so->tx.idx = idx;
+					break;
+				}
+				err = -ECOMM;
+			}
+
+			/* a lost CF breaks the sequence, the receiver aborts */
+			if (err) {
+				isotp_report_error(sk, -err);
+				so->tx.state = ISOTP_IDLE;
+				wake_up_interruptible(&so->wait);
+				break;
+			}
+
+			so->tx_stall.tv64 = 0;
+			so->tx.sn = (so->tx.sn + 1) % 16;
+			so->tx.bs++;
+
+			if (so->tx.idx >= so->tx.len) {
+				/* we are done */
+				so->tx.state = ISOTP_IDLE;
+				wake_up_interruptible(&so->wait);
+				break;
+			}
+
+			if (so->txfc.bs && so->tx.bs >= so->txfc.bs) {
+				/* stop and wait for FC */
+				so->tx.state = ISOTP_WAIT_FC;
+				hrtimer_start(&so->txtimer,
+					      ktime_set(0, ISOTP_FC_TIMEOUT_NS),
+					      HRTIMER_MODE_REL);
+				break;
+			}
+
+			/* no gap between data frames needed => burst mode */
+			if (!so->tx_gap.tv64)
+				continue;
+
+			/* start timer to send next data frame with the gap */
+			hrtimer_start(&so->txtimer, so->tx_gap,
+				      HRTIMER_MODE_REL);
+			break;
+		}
+
+		dev_put(dev);
+		break;
+
+	default:
+		/* idle or shut down - nothing to do */
+		break;
+	}
+
+	spin_unlock(&so->lock);
+}
+
+static int isotp_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
+{
+	struct sock *sk = sock->sk;
+	struct isotp_sock *so = isotp_sk(sk);
+	struct sk_buff *skb;
+	struct net_device *dev;
+	struct can_frame *cf;
+	int ae = isotp_ae(so);
+	int wait_tx_done = !(msg->msg_flags & MSG_DONTWAIT);
+	int err;
+
+	if (!so->bound)
+		return -EADDRNOTAVAIL;
+
+	/* we do not support multiple buffers - for now */
+	for (;;) {
+		spin_lock_bh(&so->lock);
+		if (so->tx.state == ISOTP_IDLE) {
+			/* reserve the tx path for this PDU */
+			so->tx.state = ISOTP_SENDING;
+			spin_unlock_bh(&so->lock);
+			break;
+		}
+		spin_unlock_bh(&so->lock);
+
+		if (msg->msg_flags & MSG_DONTWAIT)
+			return -EAGAIN;
+
+		/* wait for complete transmission of current pdu */
+		err = wait_event_interruptible(so->wait,
+					       so->tx.state == ISOTP_IDLE);
+		if (err)
+			return err;
+	}
+
+	if (!size || size > CAN_ISOTP_MAX_MSG_LENGTH) {
+		err = -EINVAL;
+		goto err_out;
+	}
+
+	err = memcpy_from_msg(so->tx.buf, msg, size);
+	if (err < 0)
+		goto err_out;
+
+	dev = dev_get_by_index(&init_net, so->ifindex);
+	if (!dev) {
+		err = -ENXIO;
+		goto err_out;
+	}
+
+	skb = sock_alloc_send_skb(sk, CAN_MTU + sizeof(struct can_skb_priv),
+				  msg->msg_flags & MSG_DONTWAIT, &err);
+	if (!skb) {
+		dev_put(dev);
+		goto err_out;
+	}
+
+	can_skb_reserve(skb);
+	can_skb_prv(skb)->ifindex = dev->ifindex;
+	can_skb_prv(skb)->skbcnt = 0;
+
+	cf = (struct can_frame *)skb_put(skb, CAN_MTU);
+	memset(cf, 0, CAN_MTU);
+
+	skb->dev = dev;
+	skb->sk = sk;
+	skb->priority = sk->sk_priority;
+
+	so->tx.len = size;
+	so->tx.idx = 0;
+
+	spin_lock_bh(&so->lock);
+
+	if (size + ae + SF_PCI_SZ <= CAN_MAX_DLEN) {
+		/* the PDU fits into a single frame */
+		isotp_fill_dataframe(so, cf, ae, ae + SF_PCI_SZ);
+		cf->data[ae] = N_PCI_SF | size;
+		wait_tx_done = 0;
+	} else {
+		/* send the first frame and wait for FC */
+		isotp_fill_dataframe(so, cf, ae, ae + FF_PCI_SZ);
+		cf->data[ae] = N_PCI_FF | ((size >> 8) & 0x0F);
+		cf->data[ae + 1] = size & 0xFF;
+
+		so->tx.sn = 1;
+		so->tx.state = ISOTP_WAIT_FIRST_FC;
+		so->tx_stall.tv64 = 0;
+
+		/* start timeout for FC (N_Bs) */
+		hrtimer_start(&so->txtimer, ktime_set(0, ISOTP_FC_TIMEOUT_NS),
+			      HRTIMER_MODE_REL);
+	}
+
+	err = can_send(skb, 1);
+	dev_put(dev);
+
+	if (err) {
+		hrtimer_try_to_cancel(&so->txtimer);
+		spin_unlock_bh(&so->lock);
+		goto err_out;
+	}
+
+	if (so->tx.state == ISOTP_SENDING) {
+		/* single frame has been sent */
+		so->tx.state = ISOTP_IDLE;
+		wake_up_interruptible(&so->wait);
+	}
+
+	spin_unlock_bh(&so->lock);
+
+	if (wait_tx_done) {
+		/* wait for complete transmission of current pdu */
+		err = wait_event_interruptible(so->wait,
+					       so->tx.state == ISOTP_IDLE);
+		if (err)
+			return err;
+	}
+
+	return size;
+
+ err_out:
+	spin_lock_bh(&so->lock);
+	so->tx.state = ISOTP_IDLE;
+	spin_unlock_bh(&so->lock);
+	wake_up_interruptible(&so->wait);
+
+	return err;
+}
+
+static int isotp_recvmsg(struct socket *sock, struct msghdr *msg, size_t size,
+			 int flags)
+{
+	struct sock *sk = sock->sk;
+	struct sk_buff *skb;
+	int err = 0;
+	int noblock;
+
+	noblock = flags & MSG_DONTWAIT;
+	flags &= ~MSG_DONTWAIT;
+
+	skb = skb_recv_datagram(sk, flags, noblock, &err);
+	if (!skb)
+		return err;
+
+	if (size < skb->len)
+		msg->msg_flags |= MSG_TRUNC;
+	else
+		size = skb->len;
+
+	err = memcpy_to_msg(msg, skb->data, size);
+	if (err < 0) {
+		skb_free_datagram(sk, skb);
+		return err;
+	}
+
+	sock_recv_timestamp(msg, sk, skb);
+
+	if (msg->msg_name) {
+		__sockaddr_check_size(sizeof(struct sockaddr_can));
+		msg->msg_namelen = sizeof(struct sockaddr_can);
+		memcpy(msg->msg_name, skb->cb, msg->msg_namelen);
+	}
+
+	skb_free_datagram(sk, skb);
+
+	return size;
+}
+
+static int isotp_release(struct socket *sock)
+{
+	struct sock *sk = sock->sk;
+	struct isotp_sock *so;
+
+	if (!sk)
+		return 0;
+
+	so = isotp_sk(sk);
+
+	unregister_netdevice_notifier(&so->notifier);
+
+	lock_sock(sk);
+
+	/* remove current filters & unregister */
+	if (so->bound) {
+		struct net_device *dev;
+
+		dev = dev_get_by_index(&init_net, so->ifindex);
+		if (dev) {
+			can_rx_unregister(dev, so->rxid, SINGLE_MASK(so->rxid),
+					  isotp_rcv, sk);
+			dev_put(dev);
+		}
+
+		/* wait for isotp_rcv() instances still processing frames */
+		synchronize_rcu();
+	}
+
+	/* stop the state machines - timers and tasklets do nothing now */
+	spin_lock_bh(&so->lock);
+	so->tx.state = ISOTP_SHUTDOWN;
+	so->rx.state = ISOTP_SHUTDOWN;
+	spin_unlock_bh(&so->lock);
+
+	hrtimer_cancel(&so->txtimer);
+	hrtimer_cancel(&so->rxtimer);
+	tasklet_kill(&so->txtsklet);
+	tasklet_kill(&so->rxtsklet);
+
+	so->ifindex = 0;
+	so->bound = 0;
+
+	sock_orphan(sk);
+	sock->sk = NULL;
+
+	release_sock(sk);
+	sock_put(sk);
+
+	return 0;
+}
+
+static int isotp_bind(struct socket *sock, struct sockaddr *uaddr, int len)
+{
+	struct sockaddr_can *addr = (struct sockaddr_can *)uaddr;
+	struct sock *sk = sock->sk;
+	struct isotp_sock *so = isotp_sk(sk);
+	struct net_device *dev;
+	int err = 0;
+	int notify_enetdown = 0;
+
+	if (len < CAN_REQUIRED_SIZE(*addr, can_addr.tp))
+		return -EINVAL;
+
+	if (addr->can_addr.tp.rx_id == addr->can_addr.tp.tx_id)
+		return -EADDRNOTAVAIL;
+
+	if ((addr->can_addr.tp.rx_id | addr->can_addr.tp.tx_id) &
+	    (CAN_ERR_FLAG | CAN_RTR_FLAG))
+		return -EADDRNOTAVAIL;
+
+	if (!addr->can_ifindex)
+		return -ENODEV;
+
+	lock_sock(sk);
+
+	/* rebinding is not supported */
+	if (so->bound) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	dev = dev_get_by_index(&init_net, addr->can_ifindex);
+	if (!dev) {
+		err = -ENODEV;
+		goto out;
+	}
+	if (dev->type != ARPHRD_CAN) {
+		dev_put(dev);
+		err = -ENODEV;
+		goto out;
+	}
+	if (!(dev->flags & IFF_UP))
+		notify_enetdown = 1;
+
+	err = can_rx_register(dev, addr->can_addr.tp.rx_id,
+			      SINGLE_MASK(addr->can_addr.tp.rx_id),
+			      isotp_rcv, sk, "isotp");
+	dev_put(dev);
+
+	if (!err) {
+		/* switch to new settings */
+		so->ifindex = addr->can_ifindex;
+		so->rxid = addr->can_addr.tp.rx_id;
+		so->txid = addr->can_addr.tp.tx_id;
+		so->bound = 1;
+	}
+
+ out:
+	release_sock(sk);
+
+	if (notify_enetdown) {
+		sk->sk_err = ENETDOWN;
+		if (!sock_flag(sk, SOCK_DEAD))
+			sk->sk_error_report(sk);
+	}
+
+	return err;
+}
+
+static int isotp_getname(struct socket *sock, struct sockaddr *uaddr,
+			 int *len, int peer)
+{
+	struct sockaddr_can *addr = (struct sockaddr_can *)uaddr;
+	struct sock *sk = sock->sk;
+	struct isotp_sock *so = isotp_sk(sk);
+
+	if (peer)
+		return -EOPNOTSUPP;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->can_family = AF_CAN;
+	addr->can_ifindex = so->ifindex;
+	addr->can_addr.tp.rx_id = so->rxid;
+	addr->can_addr.tp.tx_id = so->txid;
+
+	*len = sizeof(*addr);
+
+	return 0;
+}
+
+static int isotp_setsockopt(struct socket *sock, int level, int optname,
+			    char __user *optval, unsigned int optlen)
+{
+	struct sock *sk = sock->sk;
+	struct isotp_sock *so = isotp_sk(sk);
+	int ret = 0;
+
+	if (level != SOL_CAN_ISOTP)
+		return -EINVAL;
+
+	if (so->bound)
+		return -EISCONN;
+
+	switch (optname) {
+
+	case CAN_ISOTP_OPTS:
+		if (optlen != sizeof(struct can_isotp_options))
+			return -EINVAL;
+
+		if (copy_from_user(&so->opt, optval, optlen))
+			return -EFAULT;
+
+		/* no separate rx_ext_address is given => use ext_address */
+		if (!(so->opt.flags & CAN_ISOTP_RX_EXT_ADDR))
+			so->opt.rx_ext_address = so->opt.ext_address;
+		break;
+
+	case CAN_ISOTP_RECV_FC:
+		if (optlen != sizeof(struct can_isotp_fc_options))
+			return -EINVAL;
+
+		if (copy_from_user(&so->rxfc, optval, optlen))
+			return -EFAULT;
+		break;
+
+	case CAN_ISOTP_TX_STMIN:
+		if (optlen != sizeof(u32))
+			return -EINVAL;
+
+		if (copy_from_user(&so->force_tx_stmin, optval, optlen))
+			return -EFAULT;
+		break;
+
+	case CAN_ISOTP_RX_STMIN:
+		if (optlen != sizeof(u32))
+			return -EINVAL;
+
+		if (copy_from_user(&so->force_rx_stmin, optval, optlen))
+			return -EFAULT;
+		break;
+
+	default:
+		ret = -ENOPROTOOPT;
+	}
+
+	return ret;
+}
+
+static int isotp_getsockopt(struct socket *sock, int level, int optname,
+			    char __user *optval, int __user *optlen)
+{
+	struct sock *sk = sock->sk;
+	struct isotp_sock *so = isotp_sk(sk);
+	int len;
+	void *val;
+
+	if (level != SOL_CAN_ISOTP)
+		return -EINVAL;
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+
+	switch (optname) {
+
+	case CAN_ISOTP_OPTS:
+		len = min_t(int, len, sizeof(struct can_isotp_options));
+		val = &so->opt;
+		break;
+
+	case CAN_ISOTP_RECV_FC:
+		len = min_t(int, len, sizeof(struct can_isotp_fc_options));
+		val = &so->rxfc;
+		break;
+
+	case CAN_ISOTP_TX_STMIN:
+		len = min_t(int, len, sizeof(u32));
+		val = &so->force_tx_stmin;
+		break;
+
+	case CAN_ISOTP_RX_STMIN:
+		len = min_t(int, len, sizeof(u32));
+		val = &so->force_rx_stmin;
+		break;
+
+	default:
+		return -ENOPROTOOPT;
+	}
+
+	if (put_user(len, optlen))
+		return -EFAULT;
+	if (copy_to_user(optval, val, len))
+		return -EFAULT;
+	return 0;
+}
+
+static int isotp_notifier(struct notifier_block *nb,
+			  unsigned long msg, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	struct isotp_sock *so = container_of(nb, struct isotp_sock, notifier);
+	struct sock *sk = &so->sk;
+
+	if (!net_eq(dev_net(dev), &init_net))
+		return NOTIFY_DONE;
+
+	if (dev->type != ARPHRD_CAN)
+		return NOTIFY_DONE;
+
+	if (so->ifindex != dev->ifindex)
+		return NOTIFY_DONE;
+
+	switch (msg) {
+
+	case NETDEV_UNREGISTER:
+		lock_sock(sk);
+		/* remove current filters & unregister */
+		if (so->bound)
+			can_rx_unregister(dev, so->rxid, SINGLE_MASK(so->rxid),
+					  isotp_rcv, sk);
+
+		so->ifindex = 0;
+		so->bound = 0;
+		release_sock(sk);
+
+		sk->sk_err = ENODEV;
+		if (!sock_flag(sk, SOCK_DEAD))
+			sk->sk_error_report(sk);
+		break;
+
+	case NETDEV_DOWN:
+		sk->sk_err = ENETDOWN;
+		if (!sock_flag(sk, SOCK_DEAD))
+			sk->sk_error_report(sk);
+		break;
+	}
+
+	return NOTIFY_DONE;
+}
+
+static int isotp_init(struct sock *sk)
+{
+	struct isotp_sock *so = isotp_sk(sk);
+
+	so->ifindex = 0;
+	so->bound = 0;
+
+	so->opt.flags = CAN_ISOTP_DEFAULT_FLAGS;
+	so->opt.ext_address = CAN_ISOTP_DEFAULT_EXT_ADDRESS;
+	so->opt.rx_ext_address = CAN_ISOTP_DEFAULT_EXT_ADDRESS;
+	so->opt.rxpad_content = CAN_ISOTP_DEFAULT_PAD_CONTENT;
+	so->opt.txpad_content = CAN_ISOTP_DEFAULT_PAD_CONTENT;
+	so->opt.frame_txtime = CAN_ISOTP_DEFAULT_FRAME_TXTIME;
+	so->rxfc.bs = CAN_ISOTP_DEFAULT_RECV_BS;
+	so->rxfc.stmin = CAN_ISOTP_DEFAULT_RECV_STMIN;
+	so->rxfc.wftmax = CAN_ISOTP_DEFAULT_RECV_WFTMAX;
+	so->force_tx_stmin = 0;
+	so->force_rx_stmin = 0;
+
+	so->rx.state = ISOTP_IDLE;
+	so->tx.state = ISOTP_IDLE;
+
+	spin_lock_init(&so->lock);
+	init_waitqueue_head(&so->wait);
+
+	hrtimer_init(&so->rxtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	so->rxtimer.function = isotp_rx_timer_handler;
+	hrtimer_init(&so->txtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	so->txtimer.function = isotp_tx_timer_handler;
+
+	tasklet_init(&so->rxtsklet, isotp_rx_timer_tsklet, (unsigned long)so);
+	tasklet_init(&so->txtsklet, isotp_tx_timer_tsklet, (unsigned long)so);
+
+	/* set notifier */
+	so->notifier.notifier_call = isotp_notifier;
+
+	register_netdevice_notifier(&so->notifier);
+
+	return 0;
+}
+
+static unsigned int isotp_poll(struct file *file, struct socket *sock,
+			       poll_table *wait)
+{
+	struct sock *sk = sock->sk;
+	struct isotp_sock *so = isotp_sk(sk);
+	unsigned int mask = datagram_poll(file, sock, wait);
+
+	poll_wait(file, &so->wait, wait);
+
+	/* check for false positives due to TX state */
+	if ((mask & POLLWRNORM) && so->tx.state != ISOTP_IDLE)
+		mask &= ~(POLLOUT | POLLWRNORM);
+
+	return mask;
+}
+
+static const struct proto_ops isotp_ops = {
+	.family        = PF_CAN,
+	.release       = isotp_release,
+	.bind          = isotp_bind,
+	.connect       = sock_no_connect,
+	.socketpair    = sock_no_socketpair,
+	.accept        = sock_no_accept,
+	.getname       = isotp_getname,
+	.poll          = isotp_poll,
+	.ioctl         = can_ioctl,	/* use can_ioctl() from af_can.c */
+	.listen        = sock_no_listen,
+	.shutdown      = sock_no_shutdown,
+	.setsockopt    = isotp_setsockopt,
+	.getsockopt    = isotp_getsockopt,
+	.sendmsg       = isotp_sendmsg,
+	.recvmsg       = isotp_recvmsg,
+	.mmap          = sock_no_mmap,
+	.sendpage      = sock_no_sendpage,
+};
+
+static struct proto isotp_proto __read_mostly = {
+	.name       = "CAN_ISOTP",
+	.owner      = THIS_MODULE,
+	.obj_size   = sizeof(struct isotp_sock),
+	.init       = isotp_init,
+};
+
+static const struct can_proto isotp_can_proto = {
+	.type       = SOCK_DGRAM,
+	.protocol   = CAN_ISOTP,
+	.ops        = &isotp_ops,
+	.prot       = &isotp_proto,
+};
+
+static __init int isotp_module_init(void)
+{
+	int err;
+
+	pr_info("can: isotp protocol (rev " CAN_ISOTP_VERSION ")\n");
+
+	err = can_proto_register(&isotp_can_proto);
+	if (err < 0)
+		printk(KERN_ERR "can: registration of isotp protocol failed\n");
+
+	return err;
+}
+
+static __exit void isotp_module_exit(void)
+{
+	can_proto_unregister(&isotp_can_proto);
+}
+
+module_init(isotp_module_init);
+module_exit(isotp_module_exit);
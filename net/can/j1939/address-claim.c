@@ -0,0 +1,192 @@
+/*
+ * address-claim.c - SAE J1939 address claim tracking
+ *
+ * The address claim procedure itself (J1939-81) is run by the applications.
+ * The kernel snoops all address claimed messages on the bus, including the
+ * local ones, and keeps the NAME <-> address table up to date. Sockets that
+ * are bound to a NAME use this table to resolve their source and destination
+ * addresses.
+ *
+ * Contention is resolved like on the bus: when two ECUs claim the same
+ * address, the one with the lower NAME keeps it.
+ *
+ * Only ECUs that hold an address are tracked. An ECU that loses or gives up
+ * its address is forgotten, it resolves to J1939_IDLE_ADDR either way, so
+ * the table never holds more than the 254 unicast addresses worth of ECUs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/slab.h>
+#include <asm/unaligned.h>
+
+#include "j1939-priv.h"
+
+/* called with priv->lock held */
+static struct j1939_ecu *j1939_ecu_find_by_name_locked(struct j1939_priv *priv,
+						       name_t name)
+{
+	struct j1939_ecu *ecu;
+
+	list_for_each_entry(ecu, &priv->ecus, list) {
+		if (ecu->name == name)
+			return ecu;
+	}
+
+	return NULL;
+}
+
+/* called with priv->lock write locked */
+static void j1939_ecu_unmap_locked(struct j1939_priv *priv,
+				   struct j1939_ecu *ecu)
+{
+	if (j1939_address_is_unicast(ecu->addr) &&
+	    priv->ents[ecu->addr].ecu == ecu)
+		priv->ents[ecu->addr].ecu = NULL;
+
+	ecu->addr = J1939_IDLE_ADDR;
+}
+
+/* called with priv->lock write locked */
+static void j1939_ecu_remove_locked(struct j1939_priv *priv,
+				    struct j1939_ecu *ecu)
+{
+	j1939_ecu_unmap_locked(priv, ecu);
+	list_del(&ecu->list);
+	kfree(ecu);
+}
+
+/* update the address table with an address claim of (name, addr) */
+static void j1939_ac_process(struct j1939_priv *priv, name_t name, u8 addr)
+{
+	struct j1939_ecu *ecu, *other;
+
+	if (name == J1939_NO_NAME)
+		return;
+
+	write_lock_bh(&priv->lock);
+
+	ecu = j1939_ecu_find_by_name_locked(priv, name);
+
+	if (!j1939_address_is_unicast(addr)) {
+		/* cannot claim address - the ECU has no address anymore */
+		if (ecu)
+			j1939_ecu_remove_locked(priv, ecu);
+		goto out;
+	}
+
+	other = priv->ents[addr].ecu;
+	if (other && other != ecu && other->name < name) {
+		/* the ECU with the lower NAME keeps the address */
+		if (ecu)
+			j1939_ecu_remove_locked(priv, ecu);
+		goto out;
+	}
+
+	if (!ecu) {
+		ecu = kzalloc(sizeof(*ecu), GFP_ATOMIC);
+		if (!ecu)
+			goto out;
+
+		ecu->name = name;
+		ecu->addr = J1939_IDLE_ADDR;
+		list_add_tail(&ecu->list, &priv->ecus);
+	}
+
+	if (other && other != ecu)
+		j1939_ecu_remove_locked(priv, other);
+
+	j1939_ecu_unmap_locked(priv, ecu);
+	ecu->addr = addr;
+	priv->ents[addr].ecu = ecu;
+
+ out:
+	write_unlock_bh(&priv->lock);
+}
+
+void j1939_ac_recv(struct j1939_priv *priv, struct sk_buff *skb)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+
+	if (skb->len != 8)
+		return;
+
+	skcb->addr.src_name = get_unaligned_le64(skb->data);
+
+	j1939_ac_process(priv, skcb->addr.src_name, skcb->addr.sa);
+}
+
+/*
+ * Check an address claimed message sent by a local socket and update the
+ * address table right away, so the claimed address is usable before the
+ * message comes back from the CAN interface.
+ */
+int j1939_ac_verify_outgoing(struct j1939_priv *priv,
+			     const struct j1939_sk_buff_cb *skcb,
+			     const u8 *data, unsigned int len)
+{
+	if (len != 8)
+		return -EPROTO;
+
+	if (skcb->addr.src_name == J1939_NO_NAME ||
+	    skcb->addr.src_name != get_unaligned_le64(data))
+		return -EPROTO;
+
+	if (!j1939_address_is_unicast(skcb->addr.sa) &&
+	    skcb->addr.sa != J1939_IDLE_ADDR)
+		return -EPROTO;
+
+	j1939_ac_process(priv, skcb->addr.src_name, skcb->addr.sa);
+
+	return 0;
+}
+
+/* returns J1939_IDLE_ADDR when the NAME has no address */
+u8 j1939_name_to_addr(struct j1939_priv *priv, name_t name)
+{
+	struct j1939_ecu *ecu;
+	u8 addr = J1939_IDLE_ADDR;
+
+	if (name == J1939_NO_NAME)
+		return addr;
+
+	read_lock_bh(&priv->lock);
+	ecu = j1939_ecu_find_by_name_locked(priv, name);
+	if (ecu)
+		addr = ecu->addr;
+	read_unlock_bh(&priv->lock);
+
+	return addr;
+}
+
+name_t j1939_addr_to_name(struct j1939_priv *priv, u8 addr)
+{
+	name_t name = J1939_NO_NAME;
+
+	if (!j1939_address_is_unicast(addr))
+		return name;
+
+	read_lock_bh(&priv->lock);
+	if (priv->ents[addr].ecu)
+		name = priv->ents[addr].ecu->name;
+	read_unlock_bh(&priv->lock);
+
+	return name;
+}
+
+void j1939_ecu_remove_all(struct j1939_priv *priv)
+{
+	struct j1939_ecu *ecu, *tmp;
+
+	write_lock_bh(&priv->lock);
+	list_for_each_entry_safe(ecu, tmp, &priv->ecus, list)
+		j1939_ecu_remove_locked(priv, ecu);
+	write_unlock_bh(&priv->lock);
+}
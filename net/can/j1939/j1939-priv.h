@@ -0,0 +1,171 @@
+/*
+ * j1939-priv.h - SAE J1939 protocol family CAN private definitions
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _J1939_PRIV_H_
+#define _J1939_PRIV_H_
+
+#include <linux/can/j1939.h>
+#include <linux/interrupt.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <net/sock.h>
+
+/* all J1939 frames are extended (29 bit) data frames */
+#define J1939_CAN_ID CAN_EFF_FLAG
+#define J1939_CAN_MASK (CAN_EFF_FLAG | CAN_RTR_FLAG)
+
+/* maximum message sizes for the (extended) transport protocol */
+#define J1939_MAX_TP_PACKET_SIZE (7 * 0xff)
+/* ETP allows 7 * 0xffffff bytes, but a message must fit in the page frags
+ * of a single skb
+ */
+#define J1939_MAX_ETP_PACKET_SIZE (MAX_SKB_FRAGS * PAGE_SIZE)
+
+/* j1939_sk_buff_cb.flags */
+#define J1939_ECU_LOCAL_SRC BIT(0)	/* message was sent from this host */
+
+struct j1939_priv;
+
+/* electronic control unit holding an address, from the address claims */
+struct j1939_ecu {
+	struct list_head list;
+	name_t name;
+	u8 addr;
+};
+
+struct j1939_addr_ent {
+	struct j1939_ecu *ecu;
+};
+
+/* per CAN interface J1939 instance, shared by all sockets bound to it */
+struct j1939_priv {
+	struct list_head list;
+	struct kref kref;
+	int users;		/* bound sockets, protected by j1939_netdev_lock */
+	struct net_device *ndev;
+	int ifindex;
+
+	/* ecus and the address table */
+	rwlock_t lock;
+	struct list_head ecus;
+	struct j1939_addr_ent ents[256];
+
+	/* bound sockets */
+	spinlock_t j1939_socks_lock;
+	struct list_head j1939_socks;
+
+	/* transport protocol sessions and their state machines */
+	spinlock_t active_session_list_lock;
+	struct list_head active_session_list;
+};
+
+/* addressing information of a J1939 message */
+struct j1939_addr {
+	name_t src_name;
+	name_t dst_name;
+	pgn_t pgn;
+	u8 sa;
+	u8 da;
+};
+
+/* control buffer of J1939 message skbs */
+struct j1939_sk_buff_cb {
+	struct j1939_addr addr;
+	priority_t priority;
+	u32 flags;
+	/* sending socket - only used for comparison, never dereferenced */
+	const struct sock *tx_sk;
+};
+
+static inline struct j1939_sk_buff_cb *j1939_skb_to_cb(const struct sk_buff *skb)
+{
+	BUILD_BUG_ON(sizeof(struct j1939_sk_buff_cb) > sizeof(skb->cb));
+
+	return (struct j1939_sk_buff_cb *)skb->cb;
+}
+
+static inline bool j1939_address_is_unicast(u8 addr)
+{
+	return addr <= J1939_MAX_UNICAST_ADDR;
+}
+
+static inline bool j1939_address_is_valid(u8 addr)
+{
+	return addr != J1939_NO_ADDR;
+}
+
+static inline bool j1939_pgn_is_pdu1(pgn_t pgn)
+{
+	/* ignore dp & res bits for this */
+	return (pgn & 0xff00) < 0xf000;
+}
+
+static inline bool j1939_pgn_is_valid(pgn_t pgn)
+{
+	return pgn <= J1939_PGN_MAX;
+}
+
+/* J1939 priority 0 is the highest, socket priority 0 the lowest */
+static inline priority_t j1939_prio(u32 sk_priority)
+{
+	sk_priority = min_t(u32, sk_priority, 7);
+
+	return 7 - sk_priority;
+}
+
+static inline u32 j1939_to_sk_priority(priority_t prio)
+{
+	return 7 - prio;
+}
+
+/* main.c */
+void j1939_priv_get(struct j1939_priv *priv);
+void j1939_priv_put(struct j1939_priv *priv);
+struct j1939_priv *j1939_netdev_start(struct net_device *ndev);
+void j1939_netdev_stop(struct j1939_priv *priv);
+int j1939_send_frame(struct j1939_priv *priv,
+		     const struct j1939_sk_buff_cb *skcb,
+		     const u8 *data, unsigned int len);
+
+/* address-claim.c */
+void j1939_ac_recv(struct j1939_priv *priv, struct sk_buff *skb);
+int j1939_ac_verify_outgoing(struct j1939_priv *priv,
+			     const struct j1939_sk_buff_cb *skcb,
+			     const u8 *data, unsigned int len);
+u8 j1939_name_to_addr(struct j1939_priv *priv, name_t name);
+name_t j1939_addr_to_name(struct j1939_priv *priv, u8 addr);
+void j1939_ecu_remove_all(struct j1939_priv *priv);
+
+/* transport.c */
+bool j1939_tp_recv(struct j1939_priv *priv, struct sk_buff *skb);
+struct j1939_session *j1939_tp_send(struct j1939_priv *priv,
+				    struct sk_buff *skb, struct sock *sk,
+				    bool wait);
+int j1939_tp_wait(struct j1939_session *session, struct sock *sk);
+void j1939_tp_cancel_sk(struct j1939_priv *priv, struct sock *sk);
+void j1939_tp_cancel_all(struct j1939_priv *priv);
+int j1939_tp_init(void);
+void j1939_tp_exit(void);
+
+/* socket.c */
+void j1939_sk_recv(struct j1939_priv *priv, struct sk_buff *skb);
+bool j1939_sk_addr_is_local(struct j1939_priv *priv, u8 addr);
+void j1939_sk_netdev_event_unregister(struct j1939_priv *priv);
+int j1939_sk_module_init(void);
+void j1939_sk_module_exit(void);
+
+#endif /* _J1939_PRIV_H_ */
@@ -0,0 +1,350 @@
+/*
+ * main.c - SAE J1939 protocol family CAN - core and CAN interface handling
+ *
+ * A J1939 instance (struct j1939_priv) is created for a CAN interface when
+ * the first J1939 socket is bound to it. It receives all extended data
+ * frames of the interface, decodes the J1939 addressing from the CAN
+ * identifier and hands the messages to the address claim tracking, the
+ * transport protocol and the sockets.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/if_arp.h>
+#include <linux/can.h>
+#include <linux/can/core.h>
+#include <linux/can/skb.h>
+#include <net/net_namespace.h>
+
+#include "j1939-priv.h"
+
+MODULE_DESCRIPTION("PF_CAN SAE J1939");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS("can-proto-7");
+
+/* list of active J1939 instances, protected by j1939_netdev_lock */
+static LIST_HEAD(j1939_priv_list);
+static DEFINE_MUTEX(j1939_netdev_lock);
+
+static struct notifier_block j1939_notifier;
+
+/* LOWLEVEL CAN interface */
+
+static void j1939_can_recv(struct sk_buff *iskb, void *data)
+{
+	struct j1939_priv *priv = data;
+	struct j1939_sk_buff_cb *skcb;
+	struct can_frame *cf;
+	struct sk_buff *skb;
+
+	/* J1939 is specified for CAN 2.0 frames only */
+	if (iskb->len != CAN_MTU)
+		return;
+
+	cf = (struct can_frame *)iskb->data;
+
+	skb = alloc_skb(cf->can_dlc, GFP_ATOMIC);
+	if (!skb)
+		return;
+
+	memcpy(skb_put(skb, cf->can_dlc), cf->data, cf->can_dlc);
+	skb->tstamp = iskb->tstamp;
+	skb->dev = iskb->dev;
+
+	skcb = j1939_skb_to_cb(skb);
+	memset(skcb, 0, sizeof(*skcb));
+
+	/*
+	 * Echoes of frames sent by J1939 sockets and sessions are local, the
+	 * ones of other (e.g. CAN_RAW) sockets are handled like bus traffic.
+	 */
+	if (iskb->sk && iskb->sk->sk_family == PF_CAN &&
+	    iskb->sk->sk_protocol == CAN_J1939) {
+		skcb->flags |= J1939_ECU_LOCAL_SRC;
+		skcb->tx_sk = iskb->sk;
+	}
+
+	skcb->priority = (cf->can_id >> 26) & 0x7;
+	skcb->addr.sa = cf->can_id;
+	skcb->addr.pgn = (cf->can_id >> 8) & J1939_PGN_MAX;
+
+	if (j1939_pgn_is_pdu1(skcb->addr.pgn)) {
+		/* Type 1: with destination address */
+		skcb->addr.da = skcb->addr.pgn;
+		/* normalize pgn: strip dst address */
+		skcb->addr.pgn &= J1939_PGN_PDU1_MAX;
+	} else {
+		/* set broadcast address */
+		skcb->addr.da = J1939_NO_ADDR;
+	}
+
+	/* address claims carry the NAME of the sender in their data */
+	if (skcb->addr.pgn == J1939_PGN_ADDRESS_CLAIMED)
+		j1939_ac_recv(priv, skb);
+	else
+		skcb->addr.src_name = j1939_addr_to_name(priv,
+							 skcb->addr.sa);
+
+	if (j1939_address_is_unicast(skcb->addr.da))
+		skcb->addr.dst_name = j1939_addr_to_name(priv,
+							 skcb->addr.da);
+
+	/* transport protocol frames are consumed by the session handling */
+	if (!j1939_tp_recv(priv, skb))
+		j1939_sk_recv(priv, skb);
+
+	consume_skb(skb);
+}
+
+/* send a single CAN frame with the addressing information of skcb */
+int j1939_send_frame(struct j1939_priv *priv,
+		     const struct j1939_sk_buff_cb *skcb,
+		     const u8 *data, unsigned int len)
+{
+	struct net_device *ndev = priv->ndev;
+	struct can_frame *cf;
+	struct sk_buff *skb;
+	canid_t can_id;
+
+	if (WARN_ON_ONCE(len > CAN_MAX_DLEN))
+		return -EMSGSIZE;
+
+	skb = alloc_skb(CAN_MTU + sizeof(struct can_skb_priv), GFP_ATOMIC);
+	if (!skb)
+		return -ENOMEM;
+
+	can_skb_reserve(skb);
+	can_skb_prv(skb)->ifindex = ndev->ifindex;
+	can_skb_prv(skb)->skbcnt = 0;
+
+	cf = (struct can_frame *)skb_put(skb, CAN_MTU);
+	memset(cf, 0, CAN_MTU);
+
+	can_id = CAN_EFF_FLAG |
+		 ((skcb->priority & 0x7) << 26) |
+		 ((skcb->addr.pgn & J1939_PGN_MAX) << 8) |
+		 skcb->addr.sa;
+	if (j1939_pgn_is_pdu1(skcb->addr.pgn))
+		can_id |= skcb->addr.da << 8;
+
+	cf->can_id = can_id;
+	cf->can_dlc = len;
+	memcpy(cf->data, data, len);
+
+	skb->dev = ndev;
+
+	/*
+	 * Only frames sent on behalf of a socket are looped back: the echo
+	 * has to be recognizable as local (J1939_ECU_LOCAL_SRC), which needs
+	 * the owning socket. Flow control frames of receive sessions have no
+	 * owner.
+	 */
+	if (!skcb->tx_sk)
+		return can_send(skb, 0);
+
+	can_skb_set_owner(skb, (struct sock *)skcb->tx_sk);
+
+	return can_send(skb, 1);
+}
+
+static void __j1939_priv_release(struct kref *kref)
+{
+	struct j1939_priv *priv = container_of(kref, struct j1939_priv, kref);
+
+	j1939_ecu_remove_all(priv);
+
+	dev_put(priv->ndev);
+	kfree(priv);
+}
+
+void j1939_priv_get(struct j1939_priv *priv)
+{
+	kref_get(&priv->kref);
+}
+
+void j1939_priv_put(struct j1939_priv *priv)
+{
+	kref_put(&priv->kref, __j1939_priv_release);
+}
+
+static struct j1939_priv *j1939_priv_get_by_ndev_locked(struct net_device *ndev)
+{
+	struct j1939_priv *priv;
+
+	lockdep_assert_held(&j1939_netdev_lock);
+
+	list_for_each_entry(priv, &j1939_priv_list, list) {
+		if (priv->ndev == ndev) {
+			j1939_priv_get(priv);
+			return priv;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Get (or create) the J1939 instance of a CAN interface for a socket.
+ *
+ * The instance receives from the interface as long as sockets are bound to
+ * it. The memory is reference counted separately, transport sessions that
+ * are still being torn down may keep it a little longer.
+ */
+struct j1939_priv *j1939_netdev_start(struct net_device *ndev)
+{
+	struct j1939_priv *priv;
+	int ret;
+
+	mutex_lock(&j1939_netdev_lock);
+
+	priv = j1939_priv_get_by_ndev_locked(ndev);
+	if (priv) {
+		priv->users++;
+		goto out;
+	}
+
+	priv = kzalloc(sizeof(*priv), GFP_KERNEL);
+	if (!priv) {
+		priv = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+
+	kref_init(&priv->kref);
+	priv->users = 1;
+	priv->ndev = ndev;
+	priv->ifindex = ndev->ifindex;
+	rwlock_init(&priv->lock);
+	INIT_LIST_HEAD(&priv->ecus);
+	spin_lock_init(&priv->j1939_socks_lock);
+	INIT_LIST_HEAD(&priv->j1939_socks);
+	spin_lock_init(&priv->active_session_list_lock);
+	INIT_LIST_HEAD(&priv->active_session_list);
+
+	dev_hold(ndev);
+
+	ret = can_rx_register(ndev, J1939_CAN_ID, J1939_CAN_MASK,
+			      j1939_can_recv, priv, "j1939");
+	if (ret < 0) {
+		dev_put(ndev);
+		kfree(priv);
+		priv = ERR_PTR(ret);
+		goto out;
+	}
+
+	list_add_tail(&priv->list, &j1939_priv_list);
+
+ out:
+	mutex_unlock(&j1939_netdev_lock);
+
+	return priv;
+}
+
+void j1939_netdev_stop(struct j1939_priv *priv)
+{
+	bool last;
+
+	mutex_lock(&j1939_netdev_lock);
+	last = !--priv->users;
+	if (last)
+		list_del(&priv->list);
+	mutex_unlock(&j1939_netdev_lock);
+
+	if (last) {
+		can_rx_unregister(priv->ndev, J1939_CAN_ID, J1939_CAN_MASK,
+				  j1939_can_recv, priv);
+
+		/* wait for j1939_can_recv() instances still creating sessions */
+		synchronize_rcu();
+
+		j1939_tp_cancel_all(priv);
+	}
+
+	j1939_priv_put(priv);
+}
+
+static int j1939_netdev_notify(struct notifier_block *nb,
+			       unsigned long msg, void *data)
+{
+	struct net_device *ndev = netdev_notifier_info_to_dev(data);
+	struct j1939_priv *priv;
+
+	if (!net_eq(dev_net(ndev), &init_net))
+		return NOTIFY_DONE;
+
+	if (ndev->type != ARPHRD_CAN)
+		return NOTIFY_DONE;
+
+	if (msg != NETDEV_UNREGISTER && msg != NETDEV_DOWN)
+		return NOTIFY_DONE;
+
+	mutex_lock(&j1939_netdev_lock);
+	priv = j1939_priv_get_by_ndev_locked(ndev);
+	mutex_unlock(&j1939_netdev_lock);
+	if (!priv)
+		return NOTIFY_DONE;
+
+	switch (msg) {
+	case NETDEV_UNREGISTER:
+		/* unbind all sockets - this drops their priv references */
+		j1939_sk_netdev_event_unregister(priv);
+		break;
+
+	case NETDEV_DOWN:
+		/* running transfers cannot complete anymore */
+		j1939_tp_cancel_all(priv);
+		break;
+	}
+
+	j1939_priv_put(priv);
+
+	return NOTIFY_DONE;
+}
+
+static __init int j1939_module_init(void)
+{
+	int ret;
+
+	pr_info("can: SAE J1939\n");
+
+	ret = j1939_tp_init();
+	if (ret < 0)
+		return ret;
+
+	j1939_notifier.notifier_call = j1939_netdev_notify;
+	ret = register_netdevice_notifier(&j1939_notifier);
+	if (ret)
+		goto fail_notifier;
+
+	ret = j1939_sk_module_init();
+	if (ret)
+		goto fail_sk;
+
+	return 0;
+
+ fail_sk:
+	unregister_netdevice_notifier(&j1939_notifier);
+ fail_notifier:
+	j1939_tp_exit();
+	return ret;
+}
+
+static __exit void j1939_module_exit(void)
+{
+	j1939_sk_module_exit();
+	unregister_netdevice_notifier(&j1939_notifier);
+	j1939_tp_exit();
+}
+
+module_init(j1939_module_init);
+module_exit(j1939_module_exit);
@@ -0,0 +1,854 @@
+/*
+ * socket.c - SAE J1939 socket interface
+ *
+ * A J1939 socket is bound to a CAN interface and to a source address or
+ * NAME. Messages are sent and received as whole datagrams; messages with
+ * more than 8 bytes are carried by the transport protocol (transport.c).
+ * The PGN, the source and the destination of a message are passed in
+ * struct sockaddr_can, NAME based addresses are resolved with the address
+ * claim table (address-claim.c).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/capability.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/if_arp.h>
+#include <linux/can/core.h>
+#include <net/net_namespace.h>
+
+#include "j1939-priv.h"
+
+/* j1939_sock.state */
+#define J1939_SOCK_BOUND BIT(0)
+#define J1939_SOCK_CONNECTED BIT(1)
+#define J1939_SOCK_PROMISC BIT(2)
+
+struct j1939_sock {
+	struct sock sk; /* must be first to skip with memset */
+	struct list_head list;		/* on priv->j1939_socks */
+
+	struct j1939_priv *priv;
+	int ifindex;
+	u32 state;
+
+	/*
+	 * src_name/sa: local NAME or address, sa is the address to claim
+	 * for NAME bound sockets
+	 * dst_name/da: peer of a connected socket
+	 * pgn: only PGN received, default PGN to send
+	 * all protected by priv->j1939_socks_lock while bound
+	 */
+	struct j1939_addr addr;
+
+	struct j1939_filter *filters;
+	int nfilters;
+};
+
+static inline struct j1939_sock *j1939_sk(const struct sock *sk)
+{
+	return (struct j1939_sock *)sk;
+}
+
+static bool j1939_sk_filter_match(const struct j1939_sock *jsk,
+				  const struct j1939_sk_buff_cb *skcb)
+{
+	const struct j1939_filter *f = jsk->filters;
+	int i;
+
+	if (!jsk->nfilters)
+		return true;
+
+	for (i = 0; i < jsk->nfilters; i++, f++) {
+		if (((skcb->addr.src_name ^ f->name) & f->name_mask) == 0 &&
+		    ((skcb->addr.pgn ^ f->pgn) & f->pgn_mask) == 0 &&
+		    ((skcb->addr.sa ^ f->addr) & f->addr_mask) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/* called with priv->j1939_socks_lock held */
+static bool j1939_sk_match(const struct j1939_sock *jsk,
+			   const struct j1939_sk_buff_cb *skcb)
+{
+	/* never loop back to the sender */
+	if (skcb->tx_sk == &jsk->sk)
+		return false;
+
+	if (j1939_pgn_is_valid(jsk->addr.pgn) &&
+	    jsk->addr.pgn != skcb->addr.pgn)
+		return false;
+
+	if (!(jsk->state & J1939_SOCK_PROMISC) &&
+	    j1939_address_is_unicast(skcb->addr.da)) {
+		/* destination specific messages for this socket only */
+		if (jsk->addr.src_name) {
+			if (jsk->addr.src_name != skcb->addr.dst_name)
+				return false;
+		} else if (jsk->addr.sa != skcb->addr.da) {
+			return false;
+		}
+	}
+
+	return j1939_sk_filter_match(jsk, skcb);
+}
+
+/* deliver a (complete) message to the matching sockets */
+void j1939_sk_recv(struct j1939_priv *priv, struct sk_buff *skb)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	struct j1939_sock *jsk;
+	struct sk_buff *clone;
+
+	spin_lock_bh(&priv->j1939_socks_lock);
+	list_for_each_entry(jsk, &priv->j1939_socks, list) {
+		if (!j1939_sk_match(jsk, skcb))
+			continue;
+
+		clone = skb_clone(skb, GFP_ATOMIC);
+		if (!clone)
+			break;
+
+		if (sock_queue_rcv_skb(&jsk->sk, clone) < 0)
+			kfree_skb(clone);
+	}
+	spin_unlock_bh(&priv->j1939_socks_lock);
+}
+
+/* does a bound socket use the address as source? */
+bool j1939_sk_addr_is_local(struct j1939_priv *priv, u8 addr)
+{
+	struct j1939_sock *jsk;
+	bool local = false;
+
+	if (!j1939_address_is_unicast(addr))
+		return false;
+
+	spin_lock_bh(&priv->j1939_socks_lock);
+	list_for_each_entry(jsk, &priv->j1939_socks, list) {
+		if (jsk->addr.src_name)
+			local = j1939_name_to_addr(priv,
+						   jsk->addr.src_name) == addr;
+		else
+			local = jsk->addr.sa == addr;
+
+		if (local)
+			break;
+	}
+	spin_unlock_bh(&priv->j1939_socks_lock);
+
+	return local;
+}
+
+/* called with lock_sock() held */
+static void j1939_sk_unbind(struct j1939_sock *jsk)
+{
+	struct j1939_priv *priv = jsk->priv;
+
+	spin_lock_bh(&priv->j1939_socks_lock);
+	list_del_init(&jsk->list);
+	spin_unlock_bh(&priv->j1939_socks_lock);
+
+	j1939_tp_cancel_sk(priv, &jsk->sk);
+
+	jsk->priv = NULL;
+	jsk->state &= ~(J1939_SOCK_BOUND | J1939_SOCK_CONNECTED);
+
+	j1939_netdev_stop(priv);
+}
+
+static int j1939_sk_init(struct sock *sk)
+{
+	struct j1939_sock *jsk = j1939_sk(sk);
+
+	INIT_LIST_HEAD(&jsk->list);
+
+	jsk->priv = NULL;
+	jsk->ifindex = 0;
+	jsk->state = 0;
+
+	jsk->addr.src_name = J1939_NO_NAME;
+	jsk->addr.dst_name = J1939_NO_NAME;
+	jsk->addr.pgn = J1939_NO_PGN;
+	jsk->addr.sa = J1939_NO_ADDR;
+	jsk->addr.da = J1939_NO_ADDR;
+
+	jsk->filters = NULL;
+	jsk->nfilters = 0;
+
+	/* J1939 default priority of data messages */
+	sk->sk_priority = j1939_to_sk_priority(6);
+
+	return 0;
+}
+
+static int j1939_sk_check_pgn(pgn_t *pgn)
+{
+	if (*pgn == J1939_NO_PGN)
+		return 0;
+
+	if (!j1939_pgn_is_valid(*pgn))
+		return -EINVAL;
+
+	/* the PS field of PDU1 PGNs is the destination address */
+	if (j1939_pgn_is_pdu1(*pgn))
+		*pgn &= J1939_PGN_PDU1_MAX;
+
+	return 0;
+}
+
+static int j1939_sk_bind(struct socket *sock, struct sockaddr *uaddr, int len)
+{
+	struct sockaddr_can *addr = (struct sockaddr_can *)uaddr;
+	struct sock *sk = sock->sk;
+	struct j1939_sock *jsk = j1939_sk(sk);
+	struct j1939_priv *priv;
+	struct net_device *dev;
+	pgn_t pgn;
+	int err = 0;
+	int notify_enetdown = 0;
+
+	if (len < CAN_REQUIRED_SIZE(*addr, can_addr.j1939))
+		return -EINVAL;
+
+	if (addr->can_family != AF_CAN)
+		return -EINVAL;
+
+	if (!addr->can_ifindex)
+		return -ENODEV;
+
+	pgn = addr->can_addr.j1939.pgn;
+	err = j1939_sk_check_pgn(&pgn);
+	if (err)
+		return err;
+
+	lock_sock(sk);
+
+	if (jsk->state & J1939_SOCK_BOUND) {
+		/* rebinding changes the addresses on the same interface */
+		if (jsk->ifindex != addr->can_ifindex) {
+			err = -EINVAL;
+			goto out;
+		}
+
+		priv = jsk->priv;
+		spin_lock_bh(&priv->j1939_socks_lock);
+		jsk->addr.src_name = addr->can_addr.j1939.name;
+		jsk->addr.sa = addr->can_addr.j1939.addr;
+		jsk->addr.pgn = pgn;
+		spin_unlock_bh(&priv->j1939_socks_lock);
+		goto out;
+	}
+
+	dev = dev_get_by_index(&init_net, addr->can_ifindex);
+	if (!dev) {
+		err = -ENODEV;
+		goto out;
+	}
+	if (dev->type != ARPHRD_CAN) {
+		dev_put(dev);
+		err = -ENODEV;
+		goto out;
+	}
+	if (!(dev->flags & IFF_UP))
+		notify_enetdown = 1;
+
+	priv = j1939_netdev_start(dev);
+	dev_put(dev);
+	if (IS_ERR(priv)) {
+		err = PTR_ERR(priv);
+		goto out;
+	}
+
+	jsk->priv = priv;
+	jsk->ifindex = addr->can_ifindex;
+	jsk->addr.src_name = addr->can_addr.j1939.name;
+	jsk->addr.sa = addr->can_addr.j1939.addr;
+	jsk->addr.pgn = pgn;
+	jsk->state |= J1939_SOCK_BOUND;
+
+	spin_lock_bh(&priv->j1939_socks_lock);
+	list_add_tail(&jsk->list, &priv->j1939_socks);
+	spin_unlock_bh(&priv->j1939_socks_lock);
+
+ out:
+	release_sock(sk);
+
+	if (notify_enetdown) {
+		sk->sk_err = ENETDOWN;
+		if (!sock_flag(sk, SOCK_DEAD))
+			sk->sk_error_report(sk);
+	}
+
+	return err;
+}
+
+static int j1939_sk_connect(struct socket *sock, struct sockaddr *uaddr,
+			    int len, int flags)
+{
+	struct sockaddr_can *addr = (struct sockaddr_can *)uaddr;
+	struct sock *sk = sock->sk;
+	struct j1939_sock *jsk = j1939_sk(sk);
+	struct j1939_priv *priv;
+	pgn_t pgn;
+	int err = 0;
+
+	if (len < CAN_REQUIRED_SIZE(*addr, can_addr.j1939))
+		return -EINVAL;
+
+	if (addr->can_family != AF_CAN)
+		return -EINVAL;
+
+	pgn = addr->can_addr.j1939.pgn;
+	err = j1939_sk_check_pgn(&pgn);
+	if (err)
+		return err;
+
+	lock_sock(sk);
+
+	if (!(jsk->state & J1939_SOCK_BOUND)) {
+		err = -EBADFD;
+		goto out;
+	}
+
+	if (addr->can_ifindex && addr->can_ifindex != jsk->ifindex) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	priv = jsk->priv;
+	spin_lock_bh(&priv->j1939_socks_lock);
+	jsk->addr.dst_name = addr->can_addr.j1939.name;
+	jsk->addr.da = addr->can_addr.j1939.addr;
+	if (pgn != J1939_NO_PGN)
+		jsk->addr.pgn = pgn;
+	jsk->state |= J1939_SOCK_CONNECTED;
+	spin_unlock_bh(&priv->j1939_socks_lock);
+
+ out:
+	release_sock(sk);
+
+	return err;
+}
+
+static int j1939_sk_getname(struct socket *sock, struct sockaddr *uaddr,
+			    int *len, int peer)
+{
+	struct sockaddr_can *addr = (struct sockaddr_can *)uaddr;
+	struct sock *sk = sock->sk;
+	struct j1939_sock *jsk = j1939_sk(sk);
+	int err = 0;
+
+	lock_sock(sk);
+
+	if (peer && !(jsk->state & J1939_SOCK_CONNECTED)) {
+		err = -EADDRNOTAVAIL;
+		goto out;
+	}
+
+	memset(addr, 0, sizeof(*addr));
+	addr->can_family = AF_CAN;
+	addr->can_ifindex = jsk->ifindex;
+	addr->can_addr.j1939.pgn = jsk->addr.pgn;
+	if (peer) {
+		addr->can_addr.j1939.name = jsk->addr.dst_name;
+		addr->can_addr.j1939.addr = jsk->addr.da;
+	} else {
+		addr->can_addr.j1939.name = jsk->addr.src_name;
+		addr->can_addr.j1939.addr = jsk->addr.sa;
+	}
+
+	*len = sizeof(*addr);
+
+ out:
+	release_sock(sk);
+
+	return err;
+}
+
+static int j1939_sk_release(struct socket *sock)
+{
+	struct sock *sk = sock->sk;
+	struct j1939_sock *jsk;
+
+	if (!sk)
+		return 0;
+
+	jsk = j1939_sk(sk);
+
+	lock_sock(sk);
+
+	if (jsk->state & J1939_SOCK_BOUND)
+		j1939_sk_unbind(jsk);
+
+	kfree(jsk->filters);
+	jsk->filters = NULL;
+	jsk->nfilters = 0;
+
+	sock_orphan(sk);
+	sock->sk = NULL;
+
+	release_sock(sk);
+	sock_put(sk);
+
+	return 0;
+}
+
+static int j1939_sk_setsockopt_flag(struct j1939_sock *jsk,
+				    char __user *optval, unsigned int optlen,
+				    u32 flag)
+{
+	int tmp;
+
+	if (optlen != sizeof(tmp))
+		return -EINVAL;
+	if (copy_from_user(&tmp, optval, optlen))
+		return -EFAULT;
+
+	lock_sock(&jsk->sk);
+	if (tmp)
+		jsk->state |= flag;
+	else
+		jsk->state &= ~flag;
+	release_sock(&jsk->sk);
+
+	return 0;
+}
+
+static int j1939_sk_setsockopt(struct socket *sock, int level, int optname,
+			       char __user *optval, unsigned int optlen)
+{
+	struct sock *sk = sock->sk;
+	struct j1939_sock *jsk = j1939_sk(sk);
+	struct j1939_filter *filters = NULL, *old;
+	int tmp, count = 0;
+
+	if (level != SOL_CAN_J1939)
+		return -EINVAL;
+
+	switch (optname) {
+
+	case SO_J1939_FILTER:
+		if (optlen % sizeof(*filters))
+			return -EINVAL;
+
+		count = optlen / sizeof(*filters);
+		if (count > J1939_FILTER_MAX)
+			return -EINVAL;
+
+		if (count) {
+			filters = memdup_user(optval, optlen);
+			if (IS_ERR(filters))
+				return PTR_ERR(filters);
+		}
+
+		lock_sock(sk);
+		if (jsk->priv)
+			spin_lock_bh(&jsk->priv->j1939_socks_lock);
+		old = jsk->filters;
+		jsk->filters = filters;
+		jsk->nfilters = count;
+		if (jsk->priv)
+			spin_unlock_bh(&jsk->priv->j1939_socks_lock);
+		release_sock(sk);
+
+		kfree(old);
+		return 0;
+
+	case SO_J1939_PROMISC:
+		return j1939_sk_setsockopt_flag(jsk, optval, optlen,
+						J1939_SOCK_PROMISC);
+
+	case SO_J1939_SEND_PRIO:
+		if (optlen != sizeof(tmp))
+			return -EINVAL;
+		if (copy_from_user(&tmp, optval, optlen))
+			return -EFAULT;
+		if (tmp < 0 || tmp > 7)
+			return -EDOM;
+		/* the highest priorities are reserved for the network */
+		if (tmp < 2 && !capable(CAP_NET_ADMIN))
+			return -EPERM;
+
+		lock_sock(sk);
+		sk->sk_priority = j1939_to_sk_priority(tmp);
+		release_sock(sk);
+		return 0;
+
+	default:
+		return -ENOPROTOOPT;
+	}
+}
+
+static int j1939_sk_getsockopt(struct socket *sock, int level, int optname,
+			       char __user *optval, int __user *optlen)
+{
+	struct sock *sk = sock->sk;
+	struct j1939_sock *jsk = j1939_sk(sk);
+	int len, tmp;
+
+	if (level != SOL_CAN_J1939)
+		return -EINVAL;
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+
+	switch (optname) {
+
+	case SO_J1939_PROMISC:
+		tmp = !!(jsk->state & J1939_SOCK_PROMISC);
+		break;
+
+	case SO_J1939_SEND_PRIO:
+		tmp = j1939_prio(sk->sk_priority);
+		break;
+
+	default:
+		return -ENOPROTOOPT;
+	}
+
+	len = min_t(int, len, sizeof(tmp));
+
+	if (put_user(len, optlen))
+		return -EFAULT;
+	if (copy_to_user(optval, &tmp, len))
+		return -EFAULT;
+	return 0;
+}
+
+static int j1939_sk_recvmsg(struct socket *sock, struct msghdr *msg,
+			    size_t size, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct j1939_sk_buff_cb *skcb;
+	struct sk_buff *skb;
+	int err = 0;
+	int noblock;
+
+	noblock = flags & MSG_DONTWAIT;
+	flags &= ~MSG_DONTWAIT;
+
+	skb = skb_recv_datagram(sk, flags, noblock, &err);
+	if (!skb)
+		return err;
+
+	if (size < skb->len)
+		msg->msg_flags |= MSG_TRUNC;
+	else
+		size = skb->len;
+
+	err = skb_copy_datagram_msg(skb, 0, msg, size);
+	if (err < 0) {
+		skb_free_datagram(sk, skb);
+		return err;
+	}
+
+	skcb = j1939_skb_to_cb(skb);
+
+	if (j1939_address_is_valid(skcb->addr.da))
+		put_cmsg(msg, SOL_CAN_J1939, SCM_J1939_DEST_ADDR,
+			 sizeof(skcb->addr.da), &skcb->addr.da);
+
+	if (skcb->addr.dst_name)
+		put_cmsg(msg, SOL_CAN_J1939, SCM_J1939_DEST_NAME,
+			 sizeof(skcb->addr.dst_name), &skcb->addr.dst_name);
+
+	put_cmsg(msg, SOL_CAN_J1939, SCM_J1939_PRIO,
+		 sizeof(skcb->priority), &skcb->priority);
+
+	sock_recv_timestamp(msg, sk, skb);
+
+	if (msg->msg_name) {
+		struct sockaddr_can *addr = msg->msg_name;
+
+		__sockaddr_check_size(sizeof(struct sockaddr_can));
+		msg->msg_namelen = sizeof(struct sockaddr_can);
+		memset(addr, 0, msg->msg_namelen);
+		addr->can_family = AF_CAN;
+		addr->can_ifindex = skb->dev ? skb->dev->ifindex : 0;
+		addr->can_addr.j1939.name = skcb->addr.src_name;
+		addr->can_addr.j1939.addr = skcb->addr.sa;
+		addr->can_addr.j1939.pgn = skcb->addr.pgn;
+	}
+
+	skb_free_datagram(sk, skb);
+
+	return size;
+}
+
+static struct sk_buff *j1939_sk_alloc_skb(struct sock *sk, struct msghdr *msg,
+					  size_t size, int *err)
+{
+	size_t linear = min_t(size_t, size, J1939_MAX_TP_PACKET_SIZE);
+	struct sk_buff *skb;
+
+	/* ETP messages go into page fragments */
+	skb = sock_alloc_send_pskb(sk, linear, size - linear,
+				   msg->msg_flags & MSG_DONTWAIT, err,
+				   PAGE_ALLOC_COSTLY_ORDER);
+	if (!skb)
+		return NULL;
+
+	skb_put(skb, linear);
+	skb->data_len = size - linear;
+	skb->len = size;
+
+	*err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter, size);
+	if (*err < 0) {
+		kfree_skb(skb);
+		return NULL;
+	}
+
+	return skb;
+}
+
+static int j1939_sk_sendmsg(struct socket *sock, struct msghdr *msg,
+			    size_t size)
+{
+	struct sock *sk = sock->sk;
+	struct j1939_sock *jsk = j1939_sk(sk);
+	struct j1939_sk_buff_cb skcb, *se_skcb;
+	struct j1939_session *session;
+	struct j1939_priv *priv;
+	struct sk_buff *skb;
+	bool wait;
+	u8 data[8];
+	int err;
+
+	if (size > J1939_MAX_ETP_PACKET_SIZE)
+		return -EMSGSIZE;
+
+	memset(&skcb, 0, sizeof(skcb));
+
+	lock_sock(sk);
+
+	if (!(jsk->state & J1939_SOCK_BOUND)) {
+		release_sock(sk);
+		return -EBADFD;
+	}
+
+	priv = jsk->priv;
+	j1939_priv_get(priv);
+
+	skcb.addr = jsk->addr;
+	if (!(jsk->state & J1939_SOCK_CONNECTED)) {
+		skcb.addr.dst_name = J1939_NO_NAME;
+		skcb.addr.da = J1939_NO_ADDR;
+	}
+	skcb.priority = j1939_prio(sk->sk_priority);
+
+	release_sock(sk);
+
+	if (msg->msg_name) {
+		struct sockaddr_can *addr = msg->msg_name;
+		pgn_t pgn;
+
+		if (msg->msg_namelen < CAN_REQUIRED_SIZE(*addr, can_addr.j1939) ||
+		    addr->can_family != AF_CAN) {
+			err = -EINVAL;
+			goto out;
+		}
+
+		if (addr->can_ifindex && addr->can_ifindex != priv->ifindex) {
+			err = -EBADFD;
+			goto out;
+		}
+
+		pgn = addr->can_addr.j1939.pgn;
+		err = j1939_sk_check_pgn(&pgn);
+		if (err)
+			goto out;
+
+		if (pgn != J1939_NO_PGN)
+			skcb.addr.pgn = pgn;
+		skcb.addr.dst_name = addr->can_addr.j1939.name;
+		skcb.addr.da = addr->can_addr.j1939.addr;
+	}
+
+	if (!j1939_pgn_is_valid(skcb.addr.pgn)) {
+		err = -EDESTADDRREQ;
+		goto out;
+	}
+
+	/* resolve the NAMEs, address claims use the address being claimed */
+	if (skcb.addr.src_name &&
+	    skcb.addr.pgn != J1939_PGN_ADDRESS_CLAIMED)
+		skcb.addr.sa = j1939_name_to_addr(priv, skcb.addr.src_name);
+
+	if (!j1939_address_is_unicast(skcb.addr.sa) &&
+	    skcb.addr.pgn != J1939_PGN_ADDRESS_CLAIMED) {
+		err = -EADDRNOTAVAIL;
+		goto out;
+	}
+
+	if (skcb.addr.dst_name) {
+		skcb.addr.da = j1939_name_to_addr(priv, skcb.addr.dst_name);
+		if (!j1939_address_is_unicast(skcb.addr.da)) {
+			err = -EADDRNOTAVAIL;
+			goto out;
+		}
+	}
+
+	/* PDU2 messages are broadcast only */
+	if (!j1939_pgn_is_pdu1(skcb.addr.pgn)) {
+		if (j1939_address_is_unicast(skcb.addr.da)) {
+			err = -EINVAL;
+			goto out;
+		}
+		skcb.addr.da = J1939_NO_ADDR;
+	}
+
+	skcb.flags = J1939_ECU_LOCAL_SRC;
+	skcb.tx_sk = sk;
+
+	if (size <= sizeof(data)) {
+		err = memcpy_from_msg(data, msg, size);
+		if (err < 0)
+			goto out;
+
+		if (skcb.addr.pgn == J1939_PGN_ADDRESS_CLAIMED) {
+			err = j1939_ac_verify_outgoing(priv, &skcb, data, size);
+			if (err < 0)
+				goto out;
+		}
+
+		err = j1939_send_frame(priv, &skcb, data, size);
+		goto out;
+	}
+
+	if (skcb.addr.pgn == J1939_PGN_ADDRESS_CLAIMED) {
+		err = -EPROTO;
+		goto out;
+	}
+
+	skb = j1939_sk_alloc_skb(sk, msg, size, &err);
+	if (!skb)
+		goto out;
+
+	se_skcb = j1939_skb_to_cb(skb);
+	*se_skcb = skcb;
+	skb->dev = priv->ndev;
+	__net_timestamp(skb);
+
+	/* local destination - no need for the transport protocol */
+	if (j1939_address_is_unicast(skcb.addr.da) &&
+	    j1939_sk_addr_is_local(priv, skcb.addr.da)) {
+		j1939_sk_recv(priv, skb);
+		consume_skb(skb);
+		err = 0;
+		goto out;
+	}
+
+	wait = !(msg->msg_flags & MSG_DONTWAIT);
+
+	session = j1939_tp_send(priv, skb, sk, wait);
+	if (IS_ERR(session)) {
+		kfree_skb(skb);
+		err = PTR_ERR(session);
+		goto out;
+	}
+
+	err = wait ? j1939_tp_wait(session, sk) : 0;
+
+ out:
+	j1939_priv_put(priv);
+
+	return err < 0 ? err : size;
+}
+
+static unsigned int j1939_sk_poll(struct file *file, struct socket *sock,
+				  poll_table *wait)
+{
+	return datagram_poll(file, sock, wait);
+}
+
+/* the CAN interface is gone - unbind all sockets */
+void j1939_sk_netdev_event_unregister(struct j1939_priv *priv)
+{
+	struct j1939_sock *jsk;
+	struct sock *sk;
+
+	spin_lock_bh(&priv->j1939_socks_lock);
+	while ((jsk = list_first_entry_or_null(&priv->j1939_socks,
+					       struct j1939_sock, list))) {
+		sk = &jsk->sk;
+		list_del_init(&jsk->list);
+		sock_hold(sk);
+		spin_unlock_bh(&priv->j1939_socks_lock);
+
+		lock_sock(sk);
+		/* j1939_sk_release() may have been faster */
+		if (jsk->priv == priv)
+			j1939_sk_unbind(jsk);
+		release_sock(sk);
+
+		sk->sk_err = ENODEV;
+		if (!sock_flag(sk, SOCK_DEAD))
+			sk->sk_error_report(sk);
+
+		sock_put(sk);
+		spin_lock_bh(&priv->j1939_socks_lock);
+	}
+	spin_unlock_bh(&priv->j1939_socks_lock);
+}
+
+static const struct proto_ops j1939_ops = {
+	.family        = PF_CAN,
+	.release       = j1939_sk_release,
+	.bind          = j1939_sk_bind,
+	.connect       = j1939_sk_connect,
+	.socketpair    = sock_no_socketpair,
+	.accept        = sock_no_accept,
+	.getname       = j1939_sk_getname,
+	.poll          = j1939_sk_poll,
+	.ioctl         = can_ioctl,	/* use can_ioctl() from af_can.c */
+	.listen        = sock_no_listen,
+	.shutdown      = sock_no_shutdown,
+	.setsockopt    = j1939_sk_setsockopt,
+	.getsockopt    = j1939_sk_getsockopt,
+	.sendmsg       = j1939_sk_sendmsg,
+	.recvmsg       = j1939_sk_recvmsg,
+	.mmap          = sock_no_mmap,
+	.sendpage      = sock_no_sendpage,
+};
+
+static struct proto j1939_proto __read_mostly = {
+	.name       = "CAN_J1939",
+	.owner      = THIS_MODULE,
+	.obj_size   = sizeof(struct j1939_sock),
+	.init       = j1939_sk_init,
+};
+
+static const struct can_proto j1939_can_proto = {
+	.type       = SOCK_DGRAM,
+	.protocol   = CAN_J1939,
+	.ops        = &j1939_ops,
+	.prot       = &j1939_proto,
+};
+
+int j1939_sk_module_init(void)
+{
+	int err;
+
+	err = can_proto_register(&j1939_can_proto);
+	if (err < 0)
+		printk(KERN_ERR "can: registration of j1939 protocol failed\n");
+
+	return err;
+}
+
+void j1939_sk_module_exit(void)
+{
+	can_proto_unregister(&j1939_can_proto);
+}
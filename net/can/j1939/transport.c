@@ -0,0 +1,1121 @@
+/*
+ * transport.c - SAE J1939 transport protocol (TP) and extended TP (ETP)
+ *
+ * Messages with more than 8 bytes are split into data transfer (DT) packets
+ * of 7 bytes, framed by connection management (CM) messages:
+ *
+ * - broadcast messages are announced with a BAM and their DT packets follow
+ *   with a fixed gap
+ * - destination specific messages start with an RTS, the receiver paces the
+ *   transfer with CTS messages and confirms it with an EOMA
+ * - messages with more than 1785 bytes use the extended transport protocol,
+ *   which is destination specific only and uses a data packet offset (DPO)
+ *   in front of every block of DT packets
+ *
+ * Every transfer is a session with its own state machine. All timeouts and
+ * all frames sent by a session are handled in its tasklet_hrtimer callback,
+ * the CM and DT frames of the other side are processed in the CAN receive
+ * path. The state of all sessions of a J1939 instance is protected by
+ * priv->active_session_list_lock.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <asm/unaligned.h>
+
+#include "j1939-priv.h"
+
+#define J1939_TP_PGN_DAT 0x0eb00
+#define J1939_TP_PGN_CTL 0x0ec00
+#define J1939_ETP_PGN_DAT 0x0c700
+#define J1939_ETP_PGN_CTL 0x0c800
+
+#define J1939_TP_CMD_RTS 0x10
+#define J1939_TP_CMD_CTS 0x11
+#define J1939_TP_CMD_EOMA 0x13
+#define J1939_TP_CMD_BAM 0x20
+#define J1939_TP_CMD_ABORT 0xff
+
+#define J1939_ETP_CMD_RTS 0x14
+#define J1939_ETP_CMD_CTS 0x15
+#define J1939_ETP_CMD_DPO 0x16
+#define J1939_ETP_CMD_EOMA 0x17
+#define J1939_ETP_CMD_ABORT 0xff
+
+/* default priority of CM and DT messages */
+#define J1939_TP_PRIO 7
+
+/* largest number of DT packets per CTS (and per DPO) */
+#define J1939_TP_MAX_BLOCK 0xff
+
+/* timeouts in ms as specified in J1939-21 */
+#define J1939_TP_T1 750		/* rx: between two DT packets */
+#define J1939_TP_T2 1250	/* rx: from CTS to the first DT packet */
+#define J1939_TP_T3 1250	/* tx: from the last DT packet to CTS/EOMA */
+#define J1939_TP_T4 1050	/* tx: hold (CTS for 0 packets) to next CTS */
+#define J1939_TP_BAM_GAP 50	/* tx: between two DT packets of a BAM */
+
+/* tx: poll interval while the CAN interface queue is full */
+#define J1939_TP_RETRY 1
+
+enum j1939_xtp_abort {
+	J1939_XTP_NO_ABORT = 0,
+	J1939_XTP_ABORT_BUSY = 1,	/* already in one or more sessions */
+	J1939_XTP_ABORT_RESOURCE = 2,	/* resources needed elsewhere */
+	J1939_XTP_ABORT_TIMEOUT = 3,	/* a timeout occurred */
+	J1939_XTP_ABORT_GENERIC = 4,	/* CTS received while transferring */
+	J1939_XTP_ABORT_UNEXPECTED_DATA = 6,
+	J1939_XTP_ABORT_BAD_SEQ = 7,	/* bad sequence number */
+	J1939_XTP_ABORT_DUP_SEQ = 8,	/* duplicate sequence number */
+	J1939_XTP_ABORT_EDPO_UNEXPECTED = 10,
+	J1939_XTP_ABORT_BAD_EDPO_OFFSET = 11,
+	J1939_XTP_ABORT_OTHER = 250,
+};
+
+enum j1939_session_state {
+	J1939_SESSION_NEW,		/* tx: RTS or BAM pending */
+	J1939_SESSION_WAIT_CTS,		/* tx: waiting for CTS or EOMA */
+	J1939_SESSION_SENDING,		/* tx: DT packets pending */
+	J1939_SESSION_SEND_CTS,		/* rx: CTS pending */
+	J1939_SESSION_RECEIVING,	/* rx: waiting for DT packets */
+	J1939_SESSION_SEND_EOMA,	/* rx: EOMA pending */
+	J1939_SESSION_DONE,
+};
+
+struct j1939_session {
+	struct j1939_priv *priv;
+	struct list_head list;		/* on priv->active_session_list */
+	struct kref kref;
+	struct work_struct free_work;
+	struct tasklet_hrtimer timer;
+
+	/* message data, its addressing is in the skb control buffer */
+	struct sk_buff *skb;
+	unsigned int size;
+
+	/* sending socket, NULL for receive sessions */
+	struct sock *sk;
+
+	enum j1939_session_state state;
+	int err;
+
+	bool transmission;
+	bool extd;		/* extended transport protocol */
+	bool bam;		/* broadcast */
+	bool passive;		/* rx of a transfer between other ECUs */
+	bool waiting;		/* the sender sleeps in j1939_tp_wait() */
+	bool dpo_pending;	/* tx: DPO of the current block not sent */
+
+	struct {
+		unsigned int total;	/* packets of the message */
+		unsigned int done;	/* packets sent or received */
+		unsigned int block_end;	/* end of the current CTS block */
+		unsigned int block;	/* rx: packets per CTS */
+		unsigned int dpo;	/* ETP data packet offset */
+	} pkt;
+};
+
+/* frees the sessions from process context, see j1939_session_free_work() */
+static struct workqueue_struct *j1939_tp_wq;
+
+static inline pgn_t j1939_xtp_ctl_to_pgn(const u8 *dat)
+{
+	return (dat[7] << 16) | (dat[6] << 8) | dat[5];
+}
+
+static inline unsigned int j1939_etp_get_le24(const u8 *dat)
+{
+	return (dat[2] << 16) | (dat[1] << 8) | dat[0];
+}
+
+static inline void j1939_etp_put_le24(u8 *dat, unsigned int val)
+{
+	dat[0] = val;
+	dat[1] = val >> 8;
+	dat[2] = val >> 16;
+}
+
+static int j1939_xtp_abort_to_errno(enum j1939_xtp_abort abort)
+{
+	switch (abort) {
+	case J1939_XTP_ABORT_BUSY:
+		return EALREADY;
+	case J1939_XTP_ABORT_RESOURCE:
+		return EMSGSIZE;
+	case J1939_XTP_ABORT_TIMEOUT:
+		return EHOSTUNREACH;
+	case J1939_XTP_ABORT_GENERIC:
+		return EBADMSG;
+	default:
+		return EPROTO;
+	}
+}
+
+static inline struct j1939_sk_buff_cb *j1939_session_cb(struct j1939_session *session)
+{
+	return j1939_skb_to_cb(session->skb);
+}
+
+static void j1939_session_free_work(struct work_struct *work)
+{
+	struct j1939_session *session = container_of(work, struct j1939_session,
+						     free_work);
+
+	/* the timer callback may have dropped the last reference itself */
+	tasklet_hrtimer_cancel(&session->timer);
+
+	kfree_skb(session->skb);
+	if (session->sk)
+		sock_put(session->sk);
+	j1939_priv_put(session->priv);
+	kfree(session);
+}
+
+static void __j1939_session_release(struct kref *kref)
+{
+	struct j1939_session *session = container_of(kref, struct j1939_session,
+						     kref);
+
+	queue_work(j1939_tp_wq, &session->free_work);
+}
+
+static void j1939_session_get(struct j1939_session *session)
+{
+	kref_get(&session->kref);
+}
+
+static void j1939_session_put(struct j1939_session *session)
+{
+	kref_put(&session->kref, __j1939_session_release);
+}
+
+static enum hrtimer_restart j1939_session_timer(struct hrtimer *hrtimer);
+
+/* the initial reference belongs to priv->active_session_list */
+static struct j1939_session *j1939_session_new(struct j1939_priv *priv,
+					       struct sk_buff *skb,
+					       unsigned int size, gfp_t gfp)
+{
+	struct j1939_session *session;
+
+	session = kzalloc(sizeof(*session), gfp);
+	if (!session)
+		return NULL;
+
+	j1939_priv_get(priv);
+	session->priv = priv;
+	INIT_LIST_HEAD(&session->list);
+	kref_init(&session->kref);
+	INIT_WORK(&session->free_work, j1939_session_free_work);
+	tasklet_hrtimer_init(&session->timer, j1939_session_timer,
+			     CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+
+	session->skb = skb;
+	session->size = size;
+	session->state = J1939_SESSION_NEW;
+	session->pkt.total = DIV_ROUND_UP(size, 7);
+	session->pkt.block = J1939_TP_MAX_BLOCK;
+
+	return session;
+}
+
+/* called with active_session_list_lock held */
+static struct j1939_session *j1939_session_find_locked(struct j1939_priv *priv,
+						       u8 sa, u8 da, bool extd,
+						       bool transmission)
+{
+	struct j1939_session *session;
+	struct j1939_sk_buff_cb *skcb;
+
+	list_for_each_entry(session, &priv->active_session_list, list) {
+		skcb = j1939_session_cb(session);
+
+		if (session->transmission == transmission &&
+		    session->extd == extd &&
+		    skcb->addr.sa == sa && skcb->addr.da == da)
+			return session;
+	}
+
+	return NULL;
+}
+
+static void j1939_session_timer_start(struct j1939_session *session,
+				      unsigned int msec)
+{
+	tasklet_hrtimer_start(&session->timer, ms_to_ktime(msec),
+			      HRTIMER_MODE_REL);
+}
+
+/*
+ * Finish a session: take it off the list, wake up the sender and drop the
+ * list reference. Callers that still need the session have to hold their
+ * own reference. Called with active_session_list_lock held.
+ */
+static void j1939_session_complete_locked(struct j1939_session *session,
+					  int err)
+{
+	struct sock *sk = session->sk;
+
+	if (session->state == J1939_SESSION_DONE)
+		return;
+
+	session->err = err;
+	session->state = J1939_SESSION_DONE;
+	list_del_init(&session->list);
+	hrtimer_try_to_cancel(&session->timer.timer);
+
+	if (sk) {
+		/* nobody collects the result - report errors on the socket */
+		if (err && !session->waiting) {
+			sk->sk_err = -err;
+			if (!sock_flag(sk, SOCK_DEAD))
+				sk->sk_error_report(sk);
+		}
+		wake_up_interruptible(sk_sleep(sk));
+	}
+
+	j1939_session_put(session);
+}
+
+/*
+ * Send a CM message. @re is the addressing of the session's message, swap
+ * the addresses for the flow control of receive sessions.
+ */
+static int j1939_xtp_do_tx_ctl(struct j1939_priv *priv,
+			       const struct j1939_sk_buff_cb *re, bool swap,
+			       bool extd, pgn_t pgn, const u8 *dat)
+{
+	struct j1939_sk_buff_cb skcb;
+	u8 buf[8];
+
+	memset(&skcb, 0, sizeof(skcb));
+	skcb.priority = J1939_TP_PRIO;
+	skcb.addr.pgn = extd ? J1939_ETP_PGN_CTL : J1939_TP_PGN_CTL;
+
+	if (swap) {
+		skcb.addr.sa = re->addr.da;
+		skcb.addr.da = re->addr.sa;
+	} else {
+		skcb.addr.sa = re->addr.sa;
+		skcb.addr.da = re->addr.da;
+		skcb.tx_sk = re->tx_sk;
+	}
+
+	memcpy(buf, dat, 5);
+	buf[5] = pgn;
+	buf[6] = pgn >> 8;
+	buf[7] = pgn >> 16;
+
+	return j1939_send_frame(priv, &skcb, buf, sizeof(buf));
+}
+
+static int j1939_session_tx_ctl(struct j1939_session *session, const u8 *dat)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_session_cb(session);
+
+	return j1939_xtp_do_tx_ctl(session->priv, skcb, !session->transmission,
+				   session->extd, skcb->addr.pgn, dat);
+}
+
+static void j1939_xtp_tx_abort(struct j1939_priv *priv,
+			       const struct j1939_sk_buff_cb *re, bool swap,
+			       bool extd, pgn_t pgn,
+			       enum j1939_xtp_abort abort)
+{
+	u8 dat[5] = { J1939_TP_CMD_ABORT, abort, 0xff, 0xff, 0xff };
+
+	/* broadcast transfers cannot be aborted */
+	if (!j1939_address_is_unicast(re->addr.da))
+		return;
+
+	j1939_xtp_do_tx_ctl(priv, re, swap, extd, pgn, dat);
+}
+
+/* abort a session towards the other ECU, if it has one to talk to */
+static void j1939_session_abort_locked(struct j1939_session *session,
+				       enum j1939_xtp_abort abort, int err)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_session_cb(session);
+
+	if (!session->bam && !session->passive &&
+	    session->state != J1939_SESSION_NEW)
+		j1939_xtp_tx_abort(session->priv, skcb, !session->transmission,
+				   session->extd, skcb->addr.pgn, abort);
+
+	j1939_session_complete_locked(session, err);
+}
+
+/* TX */
+
+static int j1939_session_tx_rts(struct j1939_session *session)
+{
+	u8 dat[5];
+
+	if (session->extd) {
+		dat[0] = J1939_ETP_CMD_RTS;
+		put_unaligned_le32(session->size, &dat[1]);
+	} else {
+		dat[0] = session->bam ? J1939_TP_CMD_BAM : J1939_TP_CMD_RTS;
+		put_unaligned_le16(session->size, &dat[1]);
+		dat[3] = session->pkt.total;
+		dat[4] = session->bam ? 0xff : J1939_TP_MAX_BLOCK;
+	}
+
+	return j1939_session_tx_ctl(session, dat);
+}
+
+static int j1939_session_tx_dpo(struct j1939_session *session)
+{
+	u8 dat[5];
+
+	dat[0] = J1939_ETP_CMD_DPO;
+	dat[1] = session->pkt.block_end - session->pkt.dpo;
+	j1939_etp_put_le24(&dat[2], session->pkt.dpo);
+
+	return j1939_session_tx_ctl(session, dat);
+}
+
+static int j1939_session_tx_dat(struct j1939_session *session)
+{
+	struct j1939_sk_buff_cb skcb = *j1939_session_cb(session);
+	unsigned int offset = session->pkt.done * 7;
+	unsigned int len = min_t(unsigned int, 7, session->size - offset);
+	u8 dat[8];
+	int ret;
+
+	memset(dat, 0xff, sizeof(dat));
+	dat[0] = session->pkt.done - session->pkt.dpo + 1;
+
+	ret = skb_copy_bits(session->skb, offset, &dat[1], len);
+	if (ret < 0)
+		return ret;
+
+	skcb.priority = J1939_TP_PRIO;
+	skcb.addr.pgn = session->extd ? J1939_ETP_PGN_DAT : J1939_TP_PGN_DAT;
+
+	return j1939_send_frame(session->priv, &skcb, dat, sizeof(dat));
+}
+
+/*
+ * Send the pending frames of a transmit session. Returns true when a
+ * completed broadcast has to be delivered to the local sockets.
+ */
+static bool j1939_session_tx_locked(struct j1939_session *session)
+{
+	int ret;
+
+	if (session->state == J1939_SESSION_NEW) {
+		ret = j1939_session_tx_rts(session);
+		if (ret < 0)
+			goto tx_error;
+
+		if (session->bam) {
+			session->pkt.block_end = session->pkt.total;
+			session->state = J1939_SESSION_SENDING;
+			j1939_session_timer_start(session, J1939_TP_BAM_GAP);
+		} else {
+			session->state = J1939_SESSION_WAIT_CTS;
+			j1939_session_timer_start(session, J1939_TP_T3);
+		}
+		return false;
+	}
+
+	if (session->dpo_pending) {
+		ret = j1939_session_tx_dpo(session);
+		if (ret < 0)
+			goto tx_error;
+		session->dpo_pending = false;
+	}
+
+	while (session->pkt.done < session->pkt.block_end) {
+		ret = j1939_session_tx_dat(session);
+		if (ret < 0)
+			goto tx_error;
+
+		session->pkt.done++;
+
+		/* broadcasts are sent one packet per gap */
+		if (session->bam)
+			break;
+	}
+
+	if (session->bam) {
+		if (session->pkt.done < session->pkt.total) {
+			j1939_session_timer_start(session, J1939_TP_BAM_GAP);
+			return false;
+		}
+
+		j1939_session_complete_locked(session, 0);
+		return true;
+	}
+
+	/* wait for the next CTS or for the EOMA */
+	session->state = J1939_SESSION_WAIT_CTS;
+	j1939_session_timer_start(session, J1939_TP_T3);
+	return false;
+
+ tx_error:
+	if (ret == -ENOBUFS) {
+		/* interface queue is full, try again shortly */
+		j1939_session_timer_start(session, J1939_TP_RETRY);
+		return false;
+	}
+
+	j1939_session_complete_locked(session, ret);
+	return false;
+}
+
+/* RX flow control */
+
+static int j1939_session_tx_cts(struct j1939_session *session)
+{
+	unsigned int num;
+	u8 dat[5];
+
+	num = min(session->pkt.total - session->pkt.done, session->pkt.block);
+
+	if (session->extd) {
+		dat[0] = J1939_ETP_CMD_CTS;
+		dat[1] = num;
+		j1939_etp_put_le24(&dat[2], session->pkt.done + 1);
+	} else {
+		dat[0] = J1939_TP_CMD_CTS;
+		dat[1] = num;
+		dat[2] = session->pkt.done + 1;
+		dat[3] = 0xff;
+		dat[4] = 0xff;
+	}
+
+	session->pkt.block_end = session->pkt.done + num;
+
+	return j1939_session_tx_ctl(session, dat);
+}
+
+static int j1939_session_tx_eoma(struct j1939_session *session)
+{
+	u8 dat[5];
+
+	memset(dat, 0xff, sizeof(dat));
+
+	if (session->extd) {
+		dat[0] = J1939_ETP_CMD_EOMA;
+		put_unaligned_le32(session->size, &dat[1]);
+	} else {
+		dat[0] = J1939_TP_CMD_EOMA;
+		put_unaligned_le16(session->size, &dat[1]);
+		dat[3] = session->pkt.total;
+	}
+
+	return j1939_session_tx_ctl(session, dat);
+}
+
+static enum hrtimer_restart j1939_session_timer(struct hrtimer *hrtimer)
+{
+	struct j1939_session *session = container_of(hrtimer,
+						     struct j1939_session,
+						     timer.timer);
+	struct j1939_priv *priv = session->priv;
+	bool deliver = false;
+	int ret;
+
+	spin_lock(&priv->active_session_list_lock);
+
+	switch (session->state) {
+	case J1939_SESSION_NEW:
+	case J1939_SESSION_SENDING:
+		j1939_session_get(session);
+		deliver = j1939_session_tx_locked(session);
+		if (!deliver)
+			j1939_session_put(session);
+		break;
+
+	case J1939_SESSION_SEND_CTS:
+		ret = j1939_session_tx_cts(session);
+		if (ret == -ENOBUFS) {
+			j1939_session_timer_start(session, J1939_TP_RETRY);
+		} else if (ret < 0) {
+			j1939_session_complete_locked(session, ret);
+		} else {
+			session->state = J1939_SESSION_RECEIVING;
+			j1939_session_timer_start(session, J1939_TP_T2);
+		}
+		break;
+
+	case J1939_SESSION_SEND_EOMA:
+		ret = j1939_session_tx_eoma(session);
+		if (ret == -ENOBUFS)
+			j1939_session_timer_start(session, J1939_TP_RETRY);
+		else
+			j1939_session_complete_locked(session, ret);
+		break;
+
+	case J1939_SESSION_WAIT_CTS:
+	case J1939_SESSION_RECEIVING:
+		j1939_session_abort_locked(session, J1939_XTP_ABORT_TIMEOUT,
+					   -ETIMEDOUT);
+		break;
+
+	case J1939_SESSION_DONE:
+		break;
+	}
+
+	spin_unlock(&priv->active_session_list_lock);
+
+	if (deliver) {
+		/* local sockets see the broadcast like the other ECUs */
+		j1939_sk_recv(priv, session->skb);
+		j1939_session_put(session);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/* CM and DT reception */
+
+static struct sk_buff *j1939_xtp_alloc_skb(unsigned int size)
+{
+	struct sk_buff *skb;
+	int err;
+
+	if (size <= J1939_MAX_TP_PACKET_SIZE) {
+		skb = alloc_skb(size, GFP_ATOMIC);
+		if (skb)
+			skb_put(skb, size);
+		return skb;
+	}
+
+	/* ETP messages go into page fragments */
+	skb = alloc_skb_with_frags(0, size, PAGE_ALLOC_COSTLY_ORDER, &err,
+				   GFP_ATOMIC);
+	if (!skb)
+		return NULL;
+
+	skb->data_len = size;
+	skb->len = size;
+
+	return skb;
+}
+
+static void j1939_xtp_rx_rts(struct j1939_priv *priv, struct sk_buff *skb,
+			     bool extd)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	enum j1939_xtp_abort abort = J1939_XTP_NO_ABORT;
+	struct j1939_session *session;
+	const u8 *dat = skb->data;
+	bool bam = dat[0] == J1939_TP_CMD_BAM;
+	pgn_t pgn = j1939_xtp_ctl_to_pgn(dat);
+	unsigned int size, block;
+	struct sk_buff *se_skb;
+	bool passive;
+
+	if (!j1939_address_is_unicast(skcb->addr.sa) ||
+	    bam == j1939_address_is_unicast(skcb->addr.da))
+		return;
+
+	if (extd) {
+		size = get_unaligned_le32(&dat[1]);
+		block = J1939_TP_MAX_BLOCK;
+		if (size <= J1939_MAX_TP_PACKET_SIZE)
+			abort = J1939_XTP_ABORT_OTHER;
+		else if (size > J1939_MAX_ETP_PACKET_SIZE)
+			abort = J1939_XTP_ABORT_RESOURCE;
+	} else {
+		size = get_unaligned_le16(&dat[1]);
+		block = dat[4] ? dat[4] : J1939_TP_MAX_BLOCK;
+		if (size <= 8 || size > J1939_MAX_TP_PACKET_SIZE ||
+		    dat[3] != DIV_ROUND_UP(size, 7))
+			abort = J1939_XTP_ABORT_OTHER;
+	}
+
+	if (!j1939_pgn_is_valid(pgn))
+		abort = J1939_XTP_ABORT_OTHER;
+	else if (j1939_pgn_is_pdu1(pgn))
+		pgn &= J1939_PGN_PDU1_MAX;
+
+	passive = !bam && !j1939_sk_addr_is_local(priv, skcb->addr.da);
+
+	spin_lock(&priv->active_session_list_lock);
+
+	/* a new RTS or BAM replaces a running transfer */
+	session = j1939_session_find_locked(priv, skcb->addr.sa,
+					    skcb->addr.da, extd, false);
+	if (session)
+		j1939_session_complete_locked(session, -EBADMSG);
+
+	if (abort)
+		goto abort;
+
+	se_skb = j1939_xtp_alloc_skb(size);
+	if (!se_skb) {
+		abort = J1939_XTP_ABORT_RESOURCE;
+		goto abort;
+	}
+
+	session = j1939_session_new(priv, se_skb, size, GFP_ATOMIC);
+	if (!session) {
+		kfree_skb(se_skb);
+		abort = J1939_XTP_ABORT_RESOURCE;
+		goto abort;
+	}
+
+	se_skb->tstamp = skb->tstamp;
+	se_skb->dev = skb->dev;
+	*j1939_skb_to_cb(se_skb) = *skcb;
+	j1939_skb_to_cb(se_skb)->addr.pgn = pgn;
+
+	session->extd = extd;
+	session->bam = bam;
+	session->passive = passive;
+	session->pkt.block = block;
+	list_add_tail(&session->list, &priv->active_session_list);
+
+	if (bam || passive) {
+		session->pkt.block_end = session->pkt.total;
+		session->state = J1939_SESSION_RECEIVING;
+		j1939_session_timer_start(session, bam ? J1939_TP_T1 :
+					  J1939_TP_T2);
+	} else {
+		session->state = J1939_SESSION_SEND_CTS;
+		j1939_session_timer_start(session, 0);
+	}
+
+	spin_unlock(&priv->active_session_list_lock);
+	return;
+
+ abort:
+	spin_unlock(&priv->active_session_list_lock);
+
+	if (!passive)
+		j1939_xtp_tx_abort(priv, skcb, true, extd, pgn, abort);
+}
+
+static void j1939_xtp_rx_cts(struct j1939_priv *priv, struct sk_buff *skb,
+			     bool extd)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	struct j1939_session *session;
+	const u8 *dat = skb->data;
+	unsigned int num, next;
+
+	spin_lock(&priv->active_session_list_lock);
+
+	session = j1939_session_find_locked(priv, skcb->addr.da, skcb->addr.sa,
+					    extd, true);
+	if (!session || session->bam)
+		goto out;
+
+	if (session->state != J1939_SESSION_WAIT_CTS) {
+		j1939_session_abort_locked(session, J1939_XTP_ABORT_GENERIC,
+					   -EBADMSG);
+		goto out;
+	}
+
+	num = dat[1];
+	next = extd ? j1939_etp_get_le24(&dat[2]) : dat[2];
+
+	if (!num) {
+		/* the receiver holds the connection open */
+		j1939_session_timer_start(session, J1939_TP_T4);
+		goto out;
+	}
+
+	/* retransmissions are fine, skipping packets is not */
+	if (!next || next > session->pkt.done + 1 ||
+	    next > session->pkt.total) {
+		j1939_session_abort_locked(session, J1939_XTP_ABORT_BAD_SEQ,
+					   -EBADMSG);
+		goto out;
+	}
+
+	session->pkt.done = next - 1;
+	session->pkt.block_end = min(session->pkt.total,
+				     session->pkt.done + num);
+	if (extd) {
+		session->pkt.dpo = session->pkt.done;
+		session->dpo_pending = true;
+	}
+
+	session->state = J1939_SESSION_SENDING;
+	j1939_session_timer_start(session, 0);
+
+ out:
+	spin_unlock(&priv->active_session_list_lock);
+}
+
+static void j1939_xtp_rx_eoma(struct j1939_priv *priv, struct sk_buff *skb,
+			      bool extd)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	struct j1939_session *session;
+
+	spin_lock(&priv->active_session_list_lock);
+
+	session = j1939_session_find_locked(priv, skcb->addr.da, skcb->addr.sa,
+					    extd, true);
+	if (!session || session->state != J1939_SESSION_WAIT_CTS ||
+	    session->pkt.done != session->pkt.total) {
+		spin_unlock(&priv->active_session_list_lock);
+		return;
+	}
+
+	j1939_session_get(session);
+	j1939_session_complete_locked(session, 0);
+
+	spin_unlock(&priv->active_session_list_lock);
+
+	/* local sockets may listen to the message as well */
+	j1939_sk_recv(priv, session->skb);
+	j1939_session_put(session);
+}
+
+static void j1939_etp_rx_dpo(struct j1939_priv *priv, struct sk_buff *skb)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	struct j1939_session *session;
+	const u8 *dat = skb->data;
+	unsigned int offset;
+
+	spin_lock(&priv->active_session_list_lock);
+
+	session = j1939_session_find_locked(priv, skcb->addr.sa, skcb->addr.da,
+					    true, false);
+	if (!session || session->state != J1939_SESSION_RECEIVING)
+		goto out;
+
+	offset = j1939_etp_get_le24(&dat[2]);
+	if (offset > session->pkt.done || offset >= session->pkt.total) {
+		j1939_session_abort_locked(session,
+					   J1939_XTP_ABORT_BAD_EDPO_OFFSET,
+					   -EBADMSG);
+		goto out;
+	}
+
+	session->pkt.dpo = offset;
+	session->pkt.done = offset;
+
+ out:
+	spin_unlock(&priv->active_session_list_lock);
+}
+
+static void j1939_xtp_rx_abort(struct j1939_priv *priv, struct sk_buff *skb,
+			       bool extd)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	struct j1939_session *session;
+	int err = -j1939_xtp_abort_to_errno(skb->data[1]);
+
+	spin_lock(&priv->active_session_list_lock);
+
+	/* aborted by the receiver of our transfer */
+	session = j1939_session_find_locked(priv, skcb->addr.da, skcb->addr.sa,
+					    extd, true);
+	if (session)
+		j1939_session_complete_locked(session, err);
+
+	/* aborted by the sender */
+	session = j1939_session_find_locked(priv, skcb->addr.sa, skcb->addr.da,
+					    extd, false);
+	if (session)
+		j1939_session_complete_locked(session, err);
+
+	spin_unlock(&priv->active_session_list_lock);
+}
+
+static void j1939_xtp_rx_ctl(struct j1939_priv *priv, struct sk_buff *skb,
+			     bool extd)
+{
+	if (skb->len != 8)
+		return;
+
+	switch (skb->data[0]) {
+	case J1939_TP_CMD_BAM:
+	case J1939_TP_CMD_RTS:
+		if (!extd)
+			j1939_xtp_rx_rts(priv, skb, false);
+		break;
+	case J1939_ETP_CMD_RTS:
+		if (extd)
+			j1939_xtp_rx_rts(priv, skb, true);
+		break;
+	case J1939_TP_CMD_CTS:
+		if (!extd)
+			j1939_xtp_rx_cts(priv, skb, false);
+		break;
+	case J1939_ETP_CMD_CTS:
+		if (extd)
+			j1939_xtp_rx_cts(priv, skb, true);
+		break;
+	case J1939_ETP_CMD_DPO:
+		if (extd)
+			j1939_etp_rx_dpo(priv, skb);
+		break;
+	case J1939_TP_CMD_EOMA:
+		if (!extd)
+			j1939_xtp_rx_eoma(priv, skb, false);
+		break;
+	case J1939_ETP_CMD_EOMA:
+		if (extd)
+			j1939_xtp_rx_eoma(priv, skb, true);
+		break;
+	case J1939_TP_CMD_ABORT:
+		j1939_xtp_rx_abort(priv, skb, extd);
+		break;
+	}
+}
+
+static void j1939_xtp_rx_dat(struct j1939_priv *priv, struct sk_buff *skb,
+			     bool extd)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	struct j1939_session *session;
+	const u8 *dat = skb->data;
+	unsigned int idx, offset, len;
+	bool active;
+
+	if (skb->len < 2)
+		return;
+
+	spin_lock(&priv->active_session_list_lock);
+
+	session = j1939_session_find_locked(priv, skcb->addr.sa, skcb->addr.da,
+					    extd, false);
+	if (!session || session->state != J1939_SESSION_RECEIVING)
+		goto out;
+
+	active = !session->bam && !session->passive;
+
+	if (!dat[0]) {
+		j1939_session_abort_locked(session, J1939_XTP_ABORT_BAD_SEQ,
+					   -EBADMSG);
+		goto out;
+	}
+
+	idx = session->pkt.dpo + dat[0] - 1;
+
+	/* repeated packet, e.g. after a retransmission request */
+	if (idx < session->pkt.done)
+		goto out;
+
+	if (idx > session->pkt.done) {
+		j1939_session_abort_locked(session, J1939_XTP_ABORT_BAD_SEQ,
+					   -EBADMSG);
+		goto out;
+	}
+
+	if (idx >= session->pkt.block_end) {
+		j1939_session_abort_locked(session,
+					   J1939_XTP_ABORT_UNEXPECTED_DATA,
+					   -EBADMSG);
+		goto out;
+	}
+
+	offset = idx * 7;
+	len = min_t(unsigned int, 7, session->size - offset);
+	if (skb->len - 1 < len) {
+		j1939_session_abort_locked(session, J1939_XTP_ABORT_OTHER,
+					   -EBADMSG);
+		goto out;
+	}
+
+	skb_store_bits(session->skb, offset, &dat[1], len);
+	session->pkt.done++;
+
+	if (session->pkt.done == session->pkt.total) {
+		j1939_session_get(session);
+		j1939_skb_to_cb(session->skb)->priority = skcb->priority;
+		session->skb->tstamp = skb->tstamp;
+
+		if (active) {
+			session->state = J1939_SESSION_SEND_EOMA;
+			j1939_session_timer_start(session, 0);
+		} else {
+			j1939_session_complete_locked(session, 0);
+		}
+
+		spin_unlock(&priv->active_session_list_lock);
+
+		j1939_sk_recv(priv, session->skb);
+		j1939_session_put(session);
+		return;
+	}
+
+	if (active && session->pkt.done == session->pkt.block_end) {
+		session->state = J1939_SESSION_SEND_CTS;
+		j1939_session_timer_start(session, 0);
+	} else {
+		j1939_session_timer_start(session, session->passive ?
+					  J1939_TP_T2 : J1939_TP_T1);
+	}
+
+ out:
+	spin_unlock(&priv->active_session_list_lock);
+}
+
+/*
+ * Process a received frame. Returns true when it belongs to the transport
+ * protocol and must not be passed to the sockets as a single message.
+ */
+bool j1939_tp_recv(struct j1939_priv *priv, struct sk_buff *skb)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	bool extd;
+
+	switch (skcb->addr.pgn) {
+	case J1939_TP_PGN_CTL:
+	case J1939_TP_PGN_DAT:
+		extd = false;
+		break;
+	case J1939_ETP_PGN_CTL:
+	case J1939_ETP_PGN_DAT:
+		extd = true;
+		break;
+	default:
+		return false;
+	}
+
+	/* echo of our own frames, the sessions know about them */
+	if (skcb->flags & J1939_ECU_LOCAL_SRC)
+		return true;
+
+	/* ETP is destination specific only */
+	if (extd && !j1939_address_is_unicast(skcb->addr.da))
+		return true;
+
+	if (skcb->addr.pgn == J1939_TP_PGN_CTL ||
+	    skcb->addr.pgn == J1939_ETP_PGN_CTL)
+		j1939_xtp_rx_ctl(priv, skb, extd);
+	else
+		j1939_xtp_rx_dat(priv, skb, extd);
+
+	return true;
+}
+
+/*
+ * Start the transfer of a message (skb->len > 8) with the addressing in the
+ * skb control buffer. On success the session owns the skb. With @wait the
+ * caller gets a session reference for j1939_tp_wait().
+ */
+struct j1939_session *j1939_tp_send(struct j1939_priv *priv,
+				    struct sk_buff *skb, struct sock *sk,
+				    bool wait)
+{
+	struct j1939_sk_buff_cb *skcb = j1939_skb_to_cb(skb);
+	struct j1939_session *session;
+	unsigned int size = skb->len;
+	bool extd = size > J1939_MAX_TP_PACKET_SIZE;
+	bool bam = !j1939_address_is_unicast(skcb->addr.da);
+
+	if (size > J1939_MAX_ETP_PACKET_SIZE || (extd && bam))
+		return ERR_PTR(-EMSGSIZE);
+
+	if (!j1939_address_is_unicast(skcb->addr.sa))
+		return ERR_PTR(-EADDRNOTAVAIL);
+
+	session = j1939_session_new(priv, skb, size, GFP_KERNEL);
+	if (!session)
+		return ERR_PTR(-ENOMEM);
+
+	sock_hold(sk);
+	session->sk = sk;
+	session->transmission = true;
+	session->extd = extd;
+	session->bam = bam;
+	session->waiting = wait;
+
+	spin_lock_bh(&priv->active_session_list_lock);
+
+	if (j1939_session_find_locked(priv, skcb->addr.sa, skcb->addr.da,
+				      extd, true)) {
+		spin_unlock_bh(&priv->active_session_list_lock);
+
+		/* the skb stays with the caller */
+		session->skb = NULL;
+		j1939_session_put(session);
+		return ERR_PTR(-EBUSY);
+	}
+
+	list_add_tail(&session->list, &priv->active_session_list);
+	if (wait)
+		j1939_session_get(session);
+	j1939_session_timer_start(session, 0);
+
+	spin_unlock_bh(&priv->active_session_list_lock);
+
+	return session;
+}
+
+/* wait for the end of a transfer started by j1939_tp_send() */
+int j1939_tp_wait(struct j1939_session *session, struct sock *sk)
+{
+	spinlock_t *lock = &session->priv->active_session_list_lock;
+	int ret;
+
+	ret = wait_event_interruptible(*sk_sleep(sk),
+				       READ_ONCE(session->state) ==
+				       J1939_SESSION_DONE);
+
+	spin_lock_bh(lock);
+	if (session->state == J1939_SESSION_DONE)
+		ret = session->err;
+	else
+		/* the transfer goes on, errors are reported on the socket */
+		session->waiting = false;
+	spin_unlock_bh(lock);
+
+	j1939_session_put(session);
+
+	return ret;
+}
+
+/* abort the transfers of a socket that is closed */
+void j1939_tp_cancel_sk(struct j1939_priv *priv, struct sock *sk)
+{
+	struct j1939_session *session, *tmp;
+
+	spin_lock_bh(&priv->active_session_list_lock);
+	list_for_each_entry_safe(session, tmp, &priv->active_session_list,
+				 list) {
+		if (session->sk == sk)
+			j1939_session_abort_locked(session,
+						   J1939_XTP_ABORT_OTHER,
+						   -ESHUTDOWN);
+	}
+	spin_unlock_bh(&priv->active_session_list_lock);
+}
+
+/* abort all transfers, e.g. when the interface goes down */
+void j1939_tp_cancel_all(struct j1939_priv *priv)
+{
+	struct j1939_session *session, *tmp;
+
+	spin_lock_bh(&priv->active_session_list_lock);
+	list_for_each_entry_safe(session, tmp, &priv->active_session_list,
+				 list)
+		j1939_session_abort_locked(session, J1939_XTP_ABORT_OTHER,
+					   -ENETDOWN);
+	spin_unlock_bh(&priv->active_session_list_lock);
+}
+
+int j1939_tp_init(void)
+{
+	j1939_tp_wq = alloc_workqueue("j1939_tp", 0, 0);
+	if (!j1939_tp_wq)
+		return -ENOMEM;
+
+	return 0;
+}
+
+void j1939_tp_exit(void)
+{
+	destroy_workqueue(j1939_tp_wq);
+}
@@ -44,6 +44,10 @@
 #include <linux/uio.h>
 #include <linux/net.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/log2.h>
 #include <linux/netdevice.h>
 #include <linux/socket.h>
 #include <linux/if_arp.h>
@@ -94,6 +98,10 @@ struct raw_sock {
 	struct can_filter *filter; /* pointer to filter(s) */
 	can_err_mask_t err_mask;
 	struct uniqframe __percpu *uniq;
+	struct can_raw_ring_slot *ring;	/* mmap'able receive ring */
+	unsigned int ring_nr;		/* number of slots (power of two) */
+	unsigned int ring_head;		/* next slot to be filled */
+	spinlock_t ring_lock;		/* serializes raw_rcv() ring access */
 };
 
 /*
@@ -115,11 +123,74 @@ static inline struct raw_sock *raw_sk(const struct sock *sk)
 	return (struct raw_sock *)sk;
 }
 
+static inline unsigned int raw_ring_size(unsigned int nr)
+{
+	return PAGE_ALIGN(nr * sizeof(struct can_raw_ring_slot));
+}
+
+/*
+ * Copy the received CAN frame into the next slot of the mmap'ed receive
+ * ring. This replaces skb_clone() and the socket receive queue for sockets
+ * that have set up a CAN_RAW_RX_RING.
+ */
+static void raw_ring_rcv(struct sock *sk, struct sk_buff *oskb,
+			 struct can_raw_ring_slot *ring)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct skb_shared_hwtstamps *hwts = skb_hwtstamps(oskb);
+	struct can_raw_ring_slot *slot;
+	ktime_t tstamp;
+	u32 flags = 0;
+
+	if (hwts->hwtstamp.tv64) {
+		tstamp = hwts->hwtstamp;
+		flags |= CAN_RAW_RING_F_HWTSTAMP;
+	} else if (oskb->tstamp.tv64) {
+		tstamp = oskb->tstamp;
+	} else {
+		tstamp = ktime_get_real();
+	}
+
+	if (oskb->sk)
+		flags |= CAN_RAW_RING_F_LOCAL;
+	if (oskb->sk == sk)
+		flags |= CAN_RAW_RING_F_OWN;
+
+	spin_lock(&ro->ring_lock);
+
+	slot = &ring[ro->ring_head];
+	if (ACCESS_ONCE(slot->status) != CAN_RAW_RING_KERNEL) {
+		spin_unlock(&ro->ring_lock);
+		atomic_inc(&sk->sk_drops);
+		return;
+	}
+
+	/* read the slot content only after checking the ownership */
+	smp_rmb();
+
+	slot->mtu = oskb->len;
+	slot->ifindex = oskb->dev->ifindex;
+	slot->flags = flags;
+	slot->tstamp = ktime_to_ns(tstamp);
+	memcpy(&slot->frame, oskb->data, oskb->len);
+
+	/* make the slot content visible before handing it to userspace */
+	smp_wmb();
+	slot->status = CAN_RAW_RING_USER;
+
+	ro->ring_head = (ro->ring_head + 1) & (ro->ring_nr - 1);
+
+	spin_unlock(&ro->ring_lock);
+
+	sk->sk_data_ready(sk);
+}
+
 static void raw_rcv(struct sk_buff *oskb, void *data)
 {
 	struct sock *sk = (struct sock *)data;
 	struct raw_sock *ro = raw_sk(sk);
 	struct sockaddr_can *addr;
+	struct can_raw_ring_slot *ring;
 	struct sk_buff *skb;
 	unsigned int *pflags;
 
@@ -151,6 +222,13 @@ static void raw_rcv(struct sk_buff *oskb, void *data)
 			return;
 	}
 
+	/* the mmap'ed receive ring bypasses the socket receive queue */
+	ring = ACCESS_ONCE(ro->ring);
+	if (ring) {
+		raw_ring_rcv(sk, oskb, ring);
+		return;
+	}
+
 	/* clone the given skb to be able to enqueue it into the rcv queue */
 	skb = skb_clone(oskb, GFP_ATOMIC);
 	if (!skb)
@@ -326,6 +404,12 @@ static int raw_init(struct sock *sk)
 	ro->fd_frames        = 0;
 	ro->join_filters     = 0;
 
+	/* no receive ring by default */
+	ro->ring             = NULL;
+	ro->ring_nr          = 0;
+	ro->ring_head        = 0;
+	spin_lock_init(&ro->ring_lock);
+
 	/* alloc_percpu provides zero'ed memory */
 	ro->uniq = alloc_percpu(struct uniqframe);
 	if (unlikely(!ro->uniq))
@@ -375,6 +459,13 @@ static int raw_release(struct socket *sock)
 	ro->count   = 0;
 	free_percpu(ro->uniq);
 
+	if (ro->ring) {
+		/* wait for raw_rcv() instances still filling the ring */
+		synchronize_rcu();
+		vfree(ro->ring);
+		ro->ring = NULL;
+	}
+
 	sock_orphan(sk);
 	sock->sk = NULL;
 
@@ -393,7 +484,7 @@ static int raw_bind(struct socket *sock, struct sockaddr *uaddr, int len)
 	int err = 0;
 	int notify_enetdown = 0;
 
-	if (len < sizeof(*addr))
+	if (len < CAN_REQUIRED_SIZE(*addr, can_ifindex))
 		return -EINVAL;
 
 	lock_sock(sk);
@@ -478,6 +569,55 @@ static int raw_getname(struct socket *sock, struct sockaddr *uaddr,
 	return 0;
 }
 
+static int raw_setup_ring(struct sock *sk, char __user *optval,
+			  unsigned int optlen)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct can_raw_ring_req req;
+	struct can_raw_ring_slot *ring;
+	int err = 0;
+
+	if (optlen < sizeof(req.frame_nr))
+		return -EINVAL;
+
+	if (copy_from_user(&req.frame_nr, optval, sizeof(req.frame_nr)))
+		return -EFAULT;
+
+	if (!req.frame_nr || req.frame_nr > CAN_RAW_RX_RING_MAX_FRAMES ||
+	    !is_power_of_2(req.frame_nr))
+		return -EINVAL;
+
+	/* vmalloc_user() provides zero'ed slots owned by the kernel */
+	ring = vmalloc_user(raw_ring_size(req.frame_nr));
+	if (!ring)
+		return -ENOMEM;
+
+	lock_sock(sk);
+
+	if (ro->ring) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	/* raw_rcv() reads ring_nr and ring_head under the ring lock */
+	spin_lock_bh(&ro->ring_lock);
+	ro->ring_nr = req.frame_nr;
+	ro->ring_head = 0;
+	ro->ring = ring;
+	spin_unlock_bh(&ro->ring_lock);
+	ring = NULL;
+
+	/* get skb->tstamp set in netif_rx() for the ring slots */
+	sock_enable_timestamp(sk, SOCK_TIMESTAMP);
+
+ out:
+	release_sock(sk);
+
+	vfree(ring);
+
+	return err;
+}
+
 static int raw_setsockopt(struct socket *sock, int level, int optname,
 			  char __user *optval, unsigned int optlen)
 {
@@ -627,6 +767,9 @@ static int raw_setsockopt(struct socket *sock, int level, int optname,
 
 		break;
 
+	case CAN_RAW_RX_RING:
+		return raw_setup_ring(sk, optval, optlen);
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -697,6 +840,21 @@ static int raw_getsockopt(struct socket *sock, int level, int optname,
 		val = &ro->join_filters;
 		break;
 
+	case CAN_RAW_RX_RING: {
+		struct can_raw_ring_req req;
+
+		req.frame_nr = ro->ring_nr;
+		req.frame_size = sizeof(struct can_raw_ring_slot);
+
+		if (len > sizeof(req))
+			len = sizeof(req);
+		if (put_user(len, optlen))
+			return -EFAULT;
+		if (copy_to_user(optval, &req, len))
+			return -EFAULT;
+		return 0;
+	}
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -720,7 +878,7 @@ static int raw_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
 	if (msg->msg_name) {
 		DECLARE_SOCKADDR(struct sockaddr_can *, addr, msg->msg_name);
 
-		if (msg->msg_namelen < sizeof(*addr))
+		if (msg->msg_namelen < CAN_REQUIRED_SIZE(*addr, can_ifindex))
 			return -EINVAL;
 
 		if (addr->can_family != AF_CAN)
@@ -820,6 +978,52 @@ static int raw_recvmsg(struct socket *sock, struct msghdr *msg, size_t size,
 	return size;
 }
 
+static unsigned int raw_poll(struct file *file, struct socket *sock,
+			     poll_table *wait)
+{
+	struct sock *sk = sock->sk;
+	struct raw_sock *ro = raw_sk(sk);
+	unsigned int mask = datagram_poll(file, sock, wait);
+	struct can_raw_ring_slot *ring = ACCESS_ONCE(ro->ring);
+
+	if (ring) {
+		unsigned int prev;
+
+		/* data is available when the last filled slot is not read */
+		spin_lock_bh(&ro->ring_lock);
+		prev = (ro->ring_head - 1) & (ro->ring_nr - 1);
+		if (ring[prev].status != CAN_RAW_RING_KERNEL)
+			mask |= POLLIN | POLLRDNORM;
+		spin_unlock_bh(&ro->ring_lock);
+	}
+
+	return mask;
+}
+
+static int raw_mmap(struct file *file, struct socket *sock,
+		    struct vm_area_struct *vma)
+{
+	struct sock *sk = sock->sk;
+	struct raw_sock *ro = raw_sk(sk);
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int err = -EINVAL;
+
+	lock_sock(sk);
+
+	if (!ro->ring)
+		goto out;
+
+	if (vma->vm_pgoff || size != raw_ring_size(ro->ring_nr))
+		goto out;
+
+	err = remap_vmalloc_range(vma, ro->ring, 0);
+
+ out:
+	release_sock(sk);
+
+	return err;
+}
+
 static const struct proto_ops raw_ops = {
 	.family        = PF_CAN,
 	.release       = raw_release,
@@ -828,7 +1032,7 @@ static const struct proto_ops raw_ops = {
 	.socketpair    = sock_no_socketpair,
 	.accept        = sock_no_accept,
 	.getname       = raw_getname,
-	.poll          = datagram_poll,
+	.poll          = raw_poll,
 	.ioctl         = can_ioctl,	/* use can_ioctl() from af_can.c */
 	.listen        = sock_no_listen,
 	.shutdown      = sock_no_shutdown,
@@ -836,7 +1040,7 @@ static const struct proto_ops raw_ops = {
 	.getsockopt    = raw_getsockopt,
 	.sendmsg       = raw_sendmsg,
 	.recvmsg       = raw_recvmsg,
-	.mmap          = sock_no_mmap,
+	.mmap          = raw_mmap,
 	.sendpage      = sock_no_sendpage,
 };
 
@@ -141,6 +141,54 @@ static void esp_output_done(struct crypto_async_request *base, int err)
 	xfrm_output_resume(skb, err);
 }
 
+static void esp_output_offload_done(struct sk_buff *skb, int err)
+{
+	xfrm_output_resume(skb, err);
+}
+
+/*
+ * The offload engine owns the sequence number of the SA, so once an SA is
+ * offloaded all of its packets go to the engine. It works on one
+ * contiguous buffer and does the padding itself, only the room for it is
+ * made here.
+ */
+static int esp6_output_offload(struct xfrm_state *x, struct sk_buff *skb)
+{
+	struct esp_offload *xo = x->esp_offload;
+	struct crypto_aead *aead = x->data;
+	struct ip_esp_hdr *esph;
+	struct sk_buff *trailer;
+	int blksize;
+	int clen;
+	int alen;
+	int len;
+	int err;
+
+	alen = crypto_aead_authsize(aead);
+	blksize = ALIGN(crypto_aead_blocksize(aead), 4);
+	len = skb->len;
+	clen = ALIGN(len + 2, blksize);
+
+	if (skb_linearize(skb))
+		return -ENOMEM;
+
+	err = skb_cow_data(skb, clen - len + alen, &trailer);
+	if (err < 0)
+		return err;
+
+	pskb_put(skb, trailer, clen - len + alen);
+
+	skb_push(skb, -skb_network_offset(skb));
+	esph = ip_esp_hdr(skb);
+	*skb_mac_header(skb) = IPPROTO_ESP;
+
+	err = xo->ops->encap(xo->ctx, skb, esph, len, esp_output_offload_done);
+	if (err == -EBUSY)
+		err = NET_XMIT_DROP;
+
+	return err;
+}
+
 static int esp6_output(struct xfrm_state *x, struct sk_buff *skb)
 {
 	int err;
@@ -165,6 +213,9 @@ static int esp6_output(struct xfrm_state *x, struct sk_buff *skb)
 	__be32 *seqhi;
 
 	/* skb is pure payload to encrypt */
+	if (x->esp_offload)
+		return esp6_output_offload(x, skb);
+
 	aead = x->data;
 	alen = crypto_aead_authsize(aead);
 
@@ -318,6 +369,40 @@ static void esp_input_done(struct crypto_async_request *base, int err)
 	xfrm_input_resume(skb, esp_input_done2(skb, err));
 }
 
+static void esp_input_offload_done(struct sk_buff *skb, int err)
+{
+	xfrm_input_resume(skb, esp_input_done2(skb, err));
+}
+
+/*
+ * The engine checks the ICV and its own anti-replay window and leaves the
+ * plaintext with the ESP trailer after the IV, so esp_input_done2() can
+ * strip it like after a software decrypt.
+ */
+static int esp6_input_offload(struct xfrm_state *x, struct sk_buff *skb)
+{
+	struct esp_offload *xo = x->esp_offload;
+	struct sk_buff *trailer;
+	int err;
+
+	if (skb_linearize(skb))
+		return -ENOMEM;
+
+	err = skb_cow_data(skb, 0, &trailer);
+	if (err < 0)
+		return err;
+
+	ESP_SKB_CB(skb)->tmp = NULL;
+	skb->ip_summed = CHECKSUM_NONE;
+
+	err = xo->ops->decap(xo->ctx, skb, (struct ip_esp_hdr *)skb->data,
+			     skb->len, esp_input_offload_done);
+	if (err == -EINPROGRESS)
+		return err;
+
+	return esp_input_done2(skb, err);
+}
+
 static int esp6_input(struct xfrm_state *x, struct sk_buff *skb)
 {
 	struct ip_esp_hdr *esph;
@@ -346,6 +431,9 @@ static int esp6_input(struct xfrm_state *x, struct sk_buff *skb)
 		goto out;
 	}
 
+	if (x->esp_offload)
+		return esp6_input_offload(x, skb);
+
 	nfrags = skb_cow_data(skb, 0, &trailer);
 	if (nfrags < 0) {
 		ret = -EINVAL;
@@ -456,6 +544,7 @@ static void esp6_destroy(struct xfrm_state *x)
 	if (!aead)
 		return;
 
+	esp_offload_del_state(x);
 	crypto_free_aead(aead);
 }
 
@@ -614,6 +703,16 @@ static int esp6_init_state(struct xfrm_state *x)
 	align = ALIGN(crypto_aead_blocksize(aead), 4);
 	x->props.trailer_len = align + 1 + crypto_aead_authsize(aead);
 
+	/*
+	 * Protocol offload engines take one next header per SA, which only
+	 * tunnel mode SAs for a single inner family have. TFC padding stays
+	 * in software. The AEAD is kept for the MTU and padding calculations.
+	 */
+	if (x->props.mode == XFRM_MODE_TUNNEL && !x->tfcpad &&
+	    x->sel.family != AF_UNSPEC)
+		esp_offload_add_state(x, x->sel.family == AF_INET ?
+					 IPPROTO_IPIP : IPPROTO_IPV6);
+
 error:
 	return err;
 }
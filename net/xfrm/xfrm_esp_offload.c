@@ -0,0 +1,162 @@
+/*
+ * xfrm_esp_offload.c - ESP protocol offload engine registration.
+ *
+ * A crypto engine that implements the ESP protocol itself registers its
+ * esp_offload_ops here. esp4/esp6 offer every SA they set up to it and
+ * keep the engine's per-SA context in x->esp_offload.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <linux/err.h>
+#include <linux/export.h>
+#include <linux/interrupt.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <net/esp.h>
+#include <net/xfrm.h>
+
+static const struct esp_offload_ops *esp_offload_engine;
+static DEFINE_MUTEX(esp_offload_mutex);
+
+/*
+ * Engine flush pending on this CPU. The tasklet runs once the softirq that
+ * scheduled it is done, so a NAPI poll hands all of its packets to the
+ * engine before they are submitted.
+ */
+struct esp_offload_flush {
+	struct tasklet_struct		tasklet;
+	const struct esp_offload_ops	*ops;
+};
+
+static DEFINE_PER_CPU(struct esp_offload_flush, esp_offload_flush);
+
+int esp_offload_register(const struct esp_offload_ops *ops)
+{
+	int err = 0;
+
+	mutex_lock(&esp_offload_mutex);
+	if (esp_offload_engine)
+		err = -EBUSY;
+	else
+		esp_offload_engine = ops;
+	mutex_unlock(&esp_offload_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(esp_offload_register);
+
+/*
+ * SAs already offloaded keep a module reference on the engine, a flush
+ * may however still be pending after the last of them went away.
+ */
+void esp_offload_unregister(const struct esp_offload_ops *ops)
+{
+	int cpu;
+
+	mutex_lock(&esp_offload_mutex);
+	if (esp_offload_engine == ops)
+		esp_offload_engine = NULL;
+	mutex_unlock(&esp_offload_mutex);
+
+	for_each_possible_cpu(cpu)
+		tasklet_kill(&per_cpu(esp_offload_flush, cpu).tasklet);
+}
+EXPORT_SYMBOL_GPL(esp_offload_unregister);
+
+/*
+ * Offer a fully initialised SA to the engine. Failing to offload is not an
+ * error, the SA is then handled by the software ESP path.
+ */
+void esp_offload_add_state(struct xfrm_state *x, u8 nexthdr)
+{
+	const struct esp_offload_ops *ops;
+	struct esp_offload *xo;
+	void *ctx;
+
+	x->esp_offload = NULL;
+
+	xo = kmalloc(sizeof(*xo), GFP_KERNEL);
+	if (!xo)
+		return;
+
+	mutex_lock(&esp_offload_mutex);
+	ops = esp_offload_engine;
+	if (!ops || !try_module_get(ops->owner))
+		goto out_free;
+
+	ctx = ops->add_state(x, nexthdr);
+	if (IS_ERR_OR_NULL(ctx)) {
+		module_put(ops->owner);
+		goto out_free;
+	}
+	mutex_unlock(&esp_offload_mutex);
+
+	xo->ops = ops;
+	xo->ctx = ctx;
+	x->esp_offload = xo;
+	return;
+
+out_free:
+	mutex_unlock(&esp_offload_mutex);
+	kfree(xo);
+}
+EXPORT_SYMBOL_GPL(esp_offload_add_state);
+
+void esp_offload_del_state(struct xfrm_state *x)
+{
+	struct esp_offload *xo = x->esp_offload;
+
+	if (!xo)
+		return;
+
+	x->esp_offload = NULL;
+	xo->ops->del_state(xo->ctx);
+	module_put(xo->ops->owner);
+	kfree(xo);
+}
+EXPORT_SYMBOL_GPL(esp_offload_del_state);
+
+static void esp_offload_flush_run(unsigned long data)
+{
+	struct esp_offload_flush *flush = (struct esp_offload_flush *)data;
+	const struct esp_offload_ops *ops = flush->ops;
+
+	flush->ops = NULL;
+	if (ops)
+		ops->flush();
+}
+
+/*
+ * Called by the engine after holding a job back, in the section that held
+ * it back so that the flush is scheduled on the CPU holding the job. From
+ * process context the flush runs right away on local_bh_enable(), only
+ * packets handed over in softirq context are batched.
+ */
+void esp_offload_kick(const struct esp_offload_ops *ops)
+{
+	struct esp_offload_flush *flush;
+
+	local_bh_disable();
+	flush = this_cpu_ptr(&esp_offload_flush);
+	flush->ops = ops;
+	tasklet_schedule(&flush->tasklet);
+	local_bh_enable();
+}
+EXPORT_SYMBOL_GPL(esp_offload_kick);
+
+void __init xfrm_esp_offload_init(void)
+{
+	struct esp_offload_flush *flush;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		flush = &per_cpu(esp_offload_flush, cpu);
+		tasklet_init(&flush->tasklet, esp_offload_flush_run,
+			     (unsigned long)flush);
+	}
+}